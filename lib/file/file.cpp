@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 namespace openset
@@ -130,5 +131,95 @@ namespace openset
 
 			return content;
 		}
+
+		MappedFile::~MappedFile()
+		{
+			unmap();
+		}
+
+		bool MappedFile::map(const std::string& filename)
+		{
+			unmap();
+
+#ifdef _MSC_VER
+
+			const auto fileHandle = CreateFile(
+				filename.c_str(),
+				GENERIC_READ,
+				FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+				NULL,
+				OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL,
+				NULL);
+
+			if (fileHandle == INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER size;
+			GetFileSizeEx(fileHandle, &size);
+
+			const auto mapHandle = size.QuadPart ?
+				CreateFileMapping(fileHandle, NULL, PAGE_WRITECOPY, 0, 0, NULL) :
+				NULL;
+
+			// the view holds its own reference to the file
+			CloseHandle(fileHandle);
+
+			if (!mapHandle)
+				return false;
+
+			const auto view = MapViewOfFile(mapHandle, FILE_MAP_COPY, 0, 0, 0);
+			CloseHandle(mapHandle);
+
+			if (!view)
+				return false;
+
+			data = static_cast<char*>(view);
+			length = size.QuadPart;
+
+#else
+
+			const auto handle = open(filename.c_str(), O_RDONLY);
+
+			if (handle == -1)
+				return false;
+
+			struct stat info;
+
+			if (fstat(handle, &info) == -1 || info.st_size == 0)
+			{
+				close(handle);
+				return false;
+			}
+
+			// the mapping holds its own reference to the file
+			const auto view = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, handle, 0);
+			close(handle);
+
+			if (view == MAP_FAILED)
+				return false;
+
+			data = static_cast<char*>(view);
+			length = info.st_size;
+
+#endif
+
+			return true;
+		}
+
+		void MappedFile::unmap()
+		{
+			if (!data)
+				return;
+
+#ifdef _MSC_VER
+			UnmapViewOfFile(data);
+#else
+			munmap(data, length);
+#endif
+
+			data = nullptr;
+			length = 0;
+		}
 	}; // IO
 }; // OpenSet
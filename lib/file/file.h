@@ -46,5 +46,43 @@ namespace openset
 			File& operator=(const File& file);
 		};
 
+		// MappedFile - maps an entire file into memory
+		//
+		// the mapping is private (copy-on-write), pages can be written to
+		// but changes are never written back to the file. The file may be
+		// deleted or replaced while mapped, the mapping remains valid until
+		// `unmap` or destruction.
+		class MappedFile
+		{
+			char* data{ nullptr };
+			int64_t length{ 0 };
+
+		public:
+			MappedFile() = default;
+			~MappedFile();
+
+			bool map(const std::string& filename);
+			void unmap();
+
+			char* getData() const
+			{
+				return data;
+			}
+
+			int64_t getLength() const
+			{
+				return length;
+			}
+
+			bool isMapped() const
+			{
+				return data != nullptr;
+			}
+
+		private:
+			MappedFile(const MappedFile& file);
+			MappedFile& operator=(const MappedFile& file);
+		};
+
 	}; // IO
 }; // OpenSet
@@ -78,6 +78,10 @@ void PoolMem::freePtr(void* ptr)
     if (alloc->poolIndex == -2) // already freed 
         return; // nice place for a breakpoint in debug
 
+    // memory belongs to someone else (a mapped file), it is released with its owner
+    if (alloc->poolIndex == MemConstants::PoolMemExternal)
+        return;
+
     // -1 means this was non-pooled so just delete it
 	if (alloc->poolIndex == -1)
 	{
@@ -10,6 +10,9 @@ namespace MemConstants
 	const int PoolBucketOffset = 4;
 	const int PoolBucketAlign = 8;
     const int CullSize = 10;
+    // poolIndex for blocks PoolMem does not own (i.e. records in a mapped
+    // checkpoint file), freePtr ignores them
+    const int32_t PoolMemExternal = -3;
 }
 
 class PoolMem
@@ -104,6 +107,13 @@ public:
 
 	void* getPtr(int64_t size);
 	void freePtr(void* ptr);
+
+	// true if the block is marked MemConstants::PoolMemExternal
+	static bool isExternal(const void* ptr)
+	{
+		return reinterpret_cast<const alloc_s*>(
+			static_cast<const char*>(ptr) - MemConstants::PoolMemHeaderSize)->poolIndex == MemConstants::PoolMemExternal;
+	}
 };
 
 //extern PoolMem* POOL;
@@ -2,6 +2,7 @@
 #include "asyncpool.h"
 #include "config.h"
 #include "internoderouter.h"
+#include "sidelog.h"
 #include <cassert>
 
 using namespace openset::async;
@@ -396,10 +397,18 @@ void AsyncPool::runner(int32_t workerId) noexcept
 
 void openset::async::AsyncPool::maint() noexcept
 {
+    // the write ahead log is synced from here, so wake at least once per sync interval
+    const auto syncInterval = globals::running->walSyncInterval;
+    const auto tick = syncInterval > 0 ? std::min<int64_t>(syncInterval, 5000) : 5000;
+
+    int64_t lastZombieCheck = 0;
+
     while (true)
     {
-        if (lastZombieStamp + 15'000 < Now())
+        if (lastZombieCheck + 5000 <= Now() && lastZombieStamp + 15'000 < Now())
         {
+            lastZombieCheck = Now();
+
             csLock lock(poolLock);
 
             if (zombiePartitions.size())
@@ -416,7 +425,9 @@ void openset::async::AsyncPool::maint() noexcept
             }
         }
 
-        ThreadSleep(5000);
+        db::SideLog::getSideLog().syncWriteAheadLog();
+
+        ThreadSleep(tick);
     }
 }
 
@@ -4,13 +4,15 @@
 #include "properties.h"
 #include "attributeblob.h"
 
+#include <algorithm>
+
 using namespace openset::db;
 
 IndexBits* Attr_s::getBits()
 {
     auto bits = new IndexBits();
 
-    bits->mount(index, ints, ofs, len, linId);
+    bits->mount(index, ints, ofs, len, comp, linId);
 
     return bits;
 }
@@ -35,6 +37,17 @@ void Attributes::addChange(const int32_t propIndex, const int64_t value, const i
 {
     const auto key = attr_key_s{ propIndex, value };
 
+    if (!slicedIndexes.empty() && value != NONE)
+    {
+        if (const auto sliced = slicedIndexes.find(propIndex); sliced != slicedIndexes.end())
+        {
+            if (state)
+                sliced->second->set(linearId, value);
+            else
+                sliced->second->clear(linearId, value);
+        }
+    }
+
     if (auto changeRecord = changeIndex.find(key); changeRecord != changeIndex.end())
     {
         changeRecord->second.emplace_back(Attr_changes_s{linearId, state});
@@ -51,6 +64,8 @@ Attr_s* Attributes::getMake(const int32_t propIndex, const int64_t value)
     {
         const auto attr = new(PoolMem::getPool().getPtr(sizeof(Attr_s)))Attr_s();
         propertyIndex.emplace(attr_key_s{ propIndex, value }, attr);
+        indexValue(propIndex, value);
+        markChanged(propIndex, value);
         return attr;
     }
     else
@@ -68,6 +83,8 @@ Attr_s* Attributes::getMake(const int32_t propIndex, const string& value)
         const auto attr = new(PoolMem::getPool().getPtr(sizeof(Attr_s)))Attr_s();
         attr->text = blob->storeValue(propIndex, value);
         propertyIndex.insert({attr_key_s{ propIndex, valueHash }, attr});
+        indexValue(propIndex, valueHash);
+        markChanged(propIndex, valueHash);
         return attr;
     }
     else
@@ -94,7 +111,56 @@ Attr_s* Attributes::get(const int32_t propIndex, const string& value) const
 
 void Attributes::drop(const int32_t propIndex, const int64_t value)
 {
-    propertyIndex.erase({ propIndex, value });
+    if (const auto attrPair = propertyIndex.find({ propIndex, value }); attrPair != propertyIndex.end())
+    {
+        deltas.erase(attrPair->second);
+        cache.erase(attrPair->second);
+        propertyIndex.erase(attrPair);
+    }
+
+    unindexValue(propIndex);
+    markChanged(propIndex, value);
+}
+
+void Attributes::indexValue(const int32_t propIndex, const int64_t value)
+{
+    auto& list = valueIndex[propIndex];
+
+    if (!list.values.empty() && value <= list.values.back())
+        list.sorted = false;
+
+    list.values.push_back(value);
+}
+
+void Attributes::unindexValue(const int32_t propIndex)
+{
+    // the value is removed when the list is next sorted
+    if (const auto iter = valueIndex.find(propIndex); iter != valueIndex.end())
+        iter->second.sorted = false;
+}
+
+const std::vector<int64_t>& Attributes::getSortedValues(const int32_t propIndex)
+{
+    auto& list = valueIndex[propIndex];
+
+    if (!list.sorted)
+    {
+        auto& values = list.values;
+
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+
+        values.erase(
+            std::remove_if(
+                values.begin(),
+                values.end(),
+                [&](const int64_t value) { return !propertyIndex.count(attr_key_s{ propIndex, value }); }),
+            values.end());
+
+        list.sorted = true;
+    }
+
+    return list.values;
 }
 
 void Attributes::setDirty(const int32_t linId, const int32_t propIndex, const int64_t value, const bool on)
@@ -102,10 +168,20 @@ void Attributes::setDirty(const int32_t linId, const int32_t propIndex, const in
     addChange(propIndex, value, linId, on);
 }
 
-void Attributes::clearDirty()
+void Attributes::AttrDelta_s::change(const int32_t linId, const bool state)
 {
-    IndexBits bits;
+    auto& add = state ? set : cleared;
+    auto& remove = state ? cleared : set;
+
+    if (const auto iter = std::lower_bound(remove.begin(), remove.end(), linId); iter != remove.end() && *iter == linId)
+        remove.erase(iter);
 
+    if (const auto iter = std::lower_bound(add.begin(), add.end(), linId); iter == add.end() || *iter != linId)
+        add.insert(iter, linId);
+}
+
+void Attributes::clearDirty()
+{
     for (auto& change : changeIndex)
     {
         const auto attrPair = propertyIndex.find({ change.first.index, change.first.value });
@@ -113,58 +189,150 @@ void Attributes::clearDirty()
         if (attrPair == propertyIndex.end() || !attrPair->second)
             continue;
 
-        const auto attr = attrPair->second;
+        auto& delta = deltas[attrPair->second];
+        delta.key = change.first;
 
-        bits.mount(attr->index, attr->ints, attr->ofs, attr->len, attr->linId);
+        cache.erase(attrPair->second);
 
         for (const auto& t : change.second)
-        {
-            if (t.state)
-                bits.bitSet(t.linId);
-            else
-                bits.bitClear(t.linId);
-        }
+            delta.change(t.linId, t.state);
 
-        if (!bits.population(bits.ints * 64)) //pop count zero? remove this
-        {
-            drop(change.first.index, change.first.value );
-            PoolMem::getPool().freePtr(attr);
-        }
-        else
-        {
-            int64_t compBytes = 0; // OUT value via reference
-            int64_t linId;
-            int32_t ofs, len;
-
-            // compress the data, get it back in a pool ptr
-            const auto compData = bits.store(compBytes, linId, ofs, len, table->indexCompression);
-            const auto destAttr = recast<Attr_s*>(PoolMem::getPool().getPtr(sizeof(Attr_s) + compBytes));
-
-            // copy header
-            memcpy(destAttr, attr, sizeof(Attr_s));
-            if (compData)
-            {
-                memcpy(destAttr->index, compData, compBytes);
-                // return work buffer from bits.store to the pool
-                PoolMem::getPool().freePtr(compData);
-            }
-
-            destAttr->ints = bits.ints;//(isList) ? 0 : bits.ints;
-            destAttr->comp = static_cast<int>(compBytes);
-            destAttr->linId = linId;
-            destAttr->ofs = ofs;
-            destAttr->len = len;
-
-            // if we made a new destination, we have to update the
-            // index to point to it, and free the old one up.
-            // update the Attr pointer directly in the index
-            attrPair->second = destAttr;
-            PoolMem::getPool().freePtr(attr);
-        }
+        // rewrite a long delta, or one that may have emptied the index (so
+        // empty indexes are still dropped here)
+        const auto attr = attrPair->second;
+
+        if (delta.size() > DELTA_LIMIT ||
+            (delta.set.empty() &&
+             static_cast<int64_t>(delta.cleared.size()) >=
+                 IndexBits::storedPopulation(attr->index, attr->ints, attr->ofs, attr->len, attr->linId)))
+            flush(change.first);
     }
     changeIndex.clear();
 }
 
+void Attributes::compact()
+{
+    clearDirty();
+
+    std::vector<attr_key_s> keys;
+    keys.reserve(deltas.size());
+
+    for (const auto& delta : deltas)
+        keys.push_back(delta.second.key);
+
+    for (const auto& key : keys)
+        flush(key);
+}
+
+int64_t Attributes::getPopulation(Attr_s* attr) const
+{
+    auto population = IndexBits::storedPopulation(attr->index, attr->ints, attr->ofs, attr->len, attr->linId);
+
+    // bits stored before containers don't record a population, guess half
+    if (population < 0)
+        population = attr->ints * 32LL;
+
+    if (const auto delta = deltas.find(attr); delta != deltas.end())
+        population += static_cast<int64_t>(delta->second.set.size()) - static_cast<int64_t>(delta->second.cleared.size());
+
+    return std::max<int64_t>(population, 0);
+}
+
+IndexBits* Attributes::getBits(Attr_s* attr)
+{
+    const auto bits = new IndexBits();
+
+    if (cache.restore(attr, *bits))
+        return bits;
+
+    bits->mount(attr->index, attr->ints, attr->ofs, attr->len, attr->comp, attr->linId);
+
+    if (const auto delta = deltas.find(attr); delta != deltas.end())
+    {
+        for (const auto linId : delta->second.set)
+            bits->bitSet(linId);
+        for (const auto linId : delta->second.cleared)
+            bits->bitClear(linId);
+    }
+
+    cache.store(attr, *bits);
+
+    return bits;
+}
+
+void Attributes::orBits(Attr_s* attr, IndexBits& bits)
+{
+    if (deltas.count(attr))
+    {
+        const auto merged = getBits(attr);
+        bits.opOr(*merged);
+        delete merged;
+        return;
+    }
+
+    bits.opOrStored(attr->index, attr->ints, attr->ofs, attr->len, attr->comp, attr->linId);
+}
+
+void Attributes::flush(const attr_key_s key)
+{
+    const auto attrPair = propertyIndex.find(key);
+
+    if (attrPair == propertyIndex.end())
+        return;
+
+    const auto attr = attrPair->second;
+    const auto delta = deltas.find(attr);
+
+    if (delta == deltas.end())
+        return;
+
+    IndexBits bits;
+    bits.mount(attr->index, attr->ints, attr->ofs, attr->len, attr->comp, attr->linId);
+
+    for (const auto linId : delta->second.set)
+        bits.bitSet(linId);
+    for (const auto linId : delta->second.cleared)
+        bits.bitClear(linId);
+
+    deltas.erase(delta);
+    cache.erase(attr);
+
+    if (!bits.population(bits.ints * 64)) //pop count zero? remove this
+    {
+        drop(key.index, key.value);
+        PoolMem::getPool().freePtr(attr);
+        return;
+    }
+
+    int64_t compBytes = 0; // OUT value via reference
+    int64_t linId;
+    int32_t ofs, len;
+
+    // compress the data, get it back in a pool ptr
+    const auto compData = bits.store(compBytes, linId, ofs, len);
+    const auto destAttr = recast<Attr_s*>(PoolMem::getPool().getPtr(sizeof(Attr_s) + compBytes));
+
+    // copy header
+    memcpy(destAttr, attr, sizeof(Attr_s));
+    if (compData)
+    {
+        memcpy(destAttr->index, compData, compBytes);
+        // return work buffer from bits.store to the pool
+        PoolMem::getPool().freePtr(compData);
+    }
+
+    destAttr->ints = bits.ints;//(isList) ? 0 : bits.ints;
+    destAttr->comp = static_cast<int>(compBytes);
+    destAttr->linId = linId;
+    destAttr->ofs = ofs;
+    destAttr->len = len;
+
+    // update the Attr pointer directly in the index, and free the old one
+    attrPair->second = destAttr;
+    PoolMem::getPool().freePtr(attr);
+    markChanged(key.index, key.value);
+}
+
 void Attributes::swap(const int32_t propIndex, const int64_t value, IndexBits* newBits)
 {
     auto attrPair = propertyIndex.find(attr_key_s{ propIndex, value });
@@ -174,6 +342,10 @@ void Attributes::swap(const int32_t propIndex, const int64_t value, IndexBits* n
 
     const auto attr = attrPair->second;
 
+    // the new bits replace any pending delta
+    deltas.erase(attr);
+    cache.erase(attr);
+
     int64_t compBytes = 0; // OUT value
     int64_t linId = -1;
     int32_t len, ofs;
@@ -200,10 +372,9 @@ void Attributes::swap(const int32_t propIndex, const int64_t value, IndexBits* n
 
     // if we made a new destination, we have to update the
     // index to point to it, and free the old one up.
-    propertyIndex.insert({attr_key_s{ propIndex, value }, destAttr});
-
-    // FIX - memory leak
+    attrPair->second = destAttr;
     PoolMem::getPool().freePtr(attr);
+    markChanged(propIndex, value);
 }
 
 AttributeBlob* Attributes::getBlob() const
@@ -211,13 +382,54 @@ AttributeBlob* Attributes::getBlob() const
     return blob;
 }
 
+SlicedIndex* Attributes::getSliced(const int32_t propIndex)
+{
+    if (const auto iter = slicedIndexes.find(propIndex); iter != slicedIndexes.end())
+        return iter->second.get();
+
+    const auto propInfo = properties->getProperty(propIndex);
+
+    if (!propInfo || !propInfo->isSliced)
+        return nullptr;
+
+    // fold pending changes into the value indexes the slices are built from
+    if (!changeIndex.empty())
+        clearDirty();
+
+    auto sliced = std::make_unique<SlicedIndex>();
+
+    for (const auto& item : getPropertyValues(propIndex))
+    {
+        const auto bits = getBits(item.second);
+
+        LinearBatch batch;
+        int64_t linId;
+
+        while (batch.next(bits, bits->ints * 64, linId))
+            sliced->set(linId, item.first);
+
+        delete bits;
+    }
+
+    const auto result = sliced.get();
+    slicedIndexes.emplace(propIndex, std::move(sliced));
+
+    return result;
+}
+
+void Attributes::invalidateSliced()
+{
+    slicedIndexes.clear();
+}
+
 Attributes::AttrListExpanded Attributes::getPropertyValues(const int32_t propIndex)
 {
     Attributes::AttrListExpanded result;
 
-    for (auto &kv : propertyIndex)
-        if (kv.first.index == propIndex && kv.first.value != NONE)
-            result.push_back({ kv.first.value, kv.second });
+    for (const auto value : getSortedValues(propIndex))
+        if (value != NONE)
+            if (const auto attr = get(propIndex, value); attr)
+                result.push_back({ value, attr });
 
     return result;
 }
@@ -242,36 +454,76 @@ Attributes::AttrList Attributes::getPropertyValues(const int32_t propIndex, cons
         default: ;
     }
 
-    for (auto &kv : propertyIndex)
+    // the values are sorted, so a range is a binary search and a walk
+    const auto& values = getSortedValues(propIndex);
+
+    auto first = values.begin();
+    auto last = values.end();
+
+    switch (mode)
     {
-        if (kv.first.index != propIndex)
+    case listMode_e::PRESENT: // sum of all indexes - slow but accurate for `== nil` test
+        break;
+    case listMode_e::GT:
+        first = std::upper_bound(values.begin(), values.end(), value);
+        break;
+    case listMode_e::GTE:
+        first = std::lower_bound(values.begin(), values.end(), value);
+        break;
+    case listMode_e::LT:
+        last = std::lower_bound(values.begin(), values.end(), value);
+        break;
+    case listMode_e::LTE:
+        last = std::upper_bound(values.begin(), values.end(), value);
+        break;
+    default:
+        // never happens
+        return result;
+    }
+
+    for (auto iter = first; iter < last; ++iter)
+        if (const auto attr = get(propIndex, *iter); attr)
+            result.push_back(attr);
+
+    return result;
+}
+
+Attributes::AttrList Attributes::getTimeBuckets(const int64_t startStamp, const int64_t endStamp)
+{
+    AttrList result;
+
+    if (endStamp < startStamp)
+        return result;
+
+    const auto firstDay = stampToDay(startStamp);
+    const auto lastDay = stampToDay(endStamp);
+
+    // weeks entirely inside the range
+    const auto firstWeek = dayToWeek(firstDay + 6);
+    const auto lastWeek = dayToWeek(lastDay + 1) - 1;
+
+    if (firstWeek <= lastWeek)
+    {
+        const auto& weeks = getSortedValues(PROP_WEEK);
+
+        for (auto iter = std::lower_bound(weeks.begin(), weeks.end(), firstWeek); iter != weeks.end() && *iter <= lastWeek; ++iter)
+            if (const auto attr = get(PROP_WEEK, *iter); attr)
+                result.push_back(attr);
+    }
+
+    // and the days at either end
+    const auto weekStartDay = firstWeek * 7;
+    const auto weekEndDay = (lastWeek + 1) * 7;
+
+    const auto& days = getSortedValues(PROP_DAY);
+
+    for (auto iter = std::lower_bound(days.begin(), days.end(), firstDay); iter != days.end() && *iter <= lastDay; ++iter)
+    {
+        if (firstWeek <= lastWeek && *iter >= weekStartDay && *iter < weekEndDay)
             continue;
 
-        switch (mode)
-        {
-        case listMode_e::PRESENT: // sum of all indexes - slow but accurate for `== nil` test
-            result.push_back(kv.second);
-        break;
-        case listMode_e::GT:
-            if (kv.first.value > value)
-                result.push_back(kv.second);
-            break;
-        case listMode_e::GTE:
-            if (kv.first.value >= value)
-                result.push_back(kv.second);
-            break;
-        case listMode_e::LT:
-            if (kv.first.value < value)
-                result.push_back(kv.second);
-            break;
-        case listMode_e::LTE:
-            if (kv.first.value <= value)
-                result.push_back(kv.second);
-            break;
-        default:
-            // never happens
-            break;
-        }
+        if (const auto attr = get(PROP_DAY, *iter); attr)
+            result.push_back(attr);
     }
 
     return result;
@@ -279,6 +531,9 @@ Attributes::AttrList Attributes::getPropertyValues(const int32_t propIndex, cons
 
 void Attributes::serialize(HeapStack* mem)
 {
+    // the serialized indexes are the compressed bits, so merge any deltas first
+    compact();
+
     // grab 8 bytes, and set the block type at that address
     *recast<serializedBlockType_e*>(mem->newPtr(sizeof(int64_t))) = serializedBlockType_e::attributes;
 
@@ -388,10 +643,13 @@ int64_t Attributes::deserialize(char* mem)
 
         // add it to the index
         propertyIndex.emplace(attr_key_s{ blockHeader->column, blockHeader->hashValue }, attr);
+        indexValue(blockHeader->column, blockHeader->hashValue);
 
         // next block please
         read += blockLength;
     }
 
+    invalidateSliced();
+
     return blockSize + 16;
 }
\ No newline at end of file
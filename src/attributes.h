@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vector>
+#include <unordered_set>
+#include <memory>
 //#include "mem/bigring.h"
 #include "mem/blhash.h"
 #include "heapstack/heapstack.h"
@@ -8,6 +10,8 @@
 #include "robin_hood.h"
 #include "dbtypes.h"
 #include "indexbits.h"
+#include "slicedindex.h"
+#include "indexcache.h"
 
 using namespace std;
 
@@ -18,6 +22,8 @@ namespace openset::db
     const int32_t PROP_EVENT = 1;
     const int32_t PROP_UUID = 2;
     // below are fake properties used for indexing
+    const int32_t PROP_DAY = 3;  // customers with an event on a day (days since the epoch)
+    const int32_t PROP_WEEK = 4; // customers with an event in a week (day / 7)
     const int32_t PROP_SEGMENT = 5;
     const int32_t PROP_SESSION = 6;
 
@@ -28,6 +34,25 @@ namespace openset::db
     const int32_t PROP_INDEX_OMIT_FIRST = PROP_UUID; // omit >=
     const int32_t PROP_INDEX_OMIT_LAST = PROP_SESSION; // omit <=
 
+    const int64_t DAY_MS = 86'400'000LL;
+
+    // rounds toward negative infinity, so stamps before 1970 land in their own day and week
+    inline int64_t floorDiv(const int64_t value, const int64_t divisor)
+    {
+        const auto quotient = value / divisor;
+        return (value % divisor != 0 && (value < 0) != (divisor < 0)) ? quotient - 1 : quotient;
+    }
+
+    inline int64_t stampToDay(const int64_t stamp)
+    {
+        return floorDiv(stamp, DAY_MS);
+    }
+
+    inline int64_t dayToWeek(const int64_t day)
+    {
+        return floorDiv(day, 7);
+    }
+
     struct BitData_s;
     class Properties;
     class Table;
@@ -67,7 +92,9 @@ namespace openset::db
          *
          * Standard layout:
          *   ints - the number of uint64_t in the bit index array decompressed
-         *   comp - how much space they take compressed (in bytes)
+         *   comp - how much space they take stored (in bytes)
+         *   ofs  - -1, the index holds containers (array, bitmap or run)
+         *   len  - the number of containers (see IndexBits::store)
          *
          * Sparse Layout:
          *   ints - negative number, abs value is number of int32_ts in list
@@ -135,6 +162,57 @@ namespace openset::db
         ColumnIndex propertyIndex;//{ ringHint_e::lt_5_million };
         ChangeIndex changeIndex;//{ ringHint_e::lt_5_million };
 
+        // linIds set and cleared in an index since its compressed bits were
+        // last written, each list sorted. clearDirty folds changes in here
+        // rather than rewriting the index, getBits merges them on the way out,
+        // and the index is rewritten once its delta passes DELTA_LIMIT or when
+        // compact is called (checkpoints, the cleaner and serialize).
+        struct AttrDelta_s
+        {
+            attr_key_s key;
+            std::vector<int32_t> set;
+            std::vector<int32_t> cleared;
+
+            void change(const int32_t linId, const bool state);
+
+            size_t size() const
+            {
+                return set.size() + cleared.size();
+            }
+        };
+
+        using DeltaIndex = robin_hood::unordered_map<Attr_s*, AttrDelta_s, robin_hood::hash<Attr_s*>>;
+        DeltaIndex deltas;
+
+        static const size_t DELTA_LIMIT = 4096;
+
+        // decoded bits handed out by getBits, see IndexCache
+        IndexCache cache;
+
+        // the values in propertyIndex for each property, so ranges and listing
+        // a property don't scan every index in the partition. Values are
+        // appended as indexes are made, and sorted (dropping values no longer
+        // in propertyIndex) the first time they are read after a change.
+        struct PropertyValues_s
+        {
+            std::vector<int64_t> values;
+            bool sorted { true };
+        };
+
+        using ValueIndex = robin_hood::unordered_map<int32_t, PropertyValues_s, robin_hood::hash<int32_t>>;
+        ValueIndex valueIndex;
+
+        // bit-sliced indexes of properties marked isSliced, built from the
+        // value indexes on first use and then kept current by addChange
+        using SlicedIndexes = robin_hood::unordered_map<int32_t, std::unique_ptr<SlicedIndex>, robin_hood::hash<int32_t>>;
+        SlicedIndexes slicedIndexes;
+
+        // indexes created, rewritten or dropped since the last checkpoint,
+        // only tracked when `trackChanges` is set
+        using ChangedSet = std::unordered_set<attr_key_s>;
+        ChangedSet changed;
+        bool trackChanges { false };
+
         Table* table;
         AttributeBlob* blob;
         Properties* properties;
@@ -153,9 +231,45 @@ namespace openset::db
 
         void drop(const int32_t propIndex, const int64_t value);
 
+        // keep valueIndex in step with propertyIndex, for code that adds or
+        // erases propertyIndex entries directly (i.e. mapping a checkpoint)
+        void indexValue(const int32_t propIndex, const int64_t value);
+        void unindexValue(const int32_t propIndex);
+
+        // the values indexed for a property in ascending order
+        const std::vector<int64_t>& getSortedValues(const int32_t propIndex);
+
+        // the sliced index for a property, nullptr if it isn't sliced
+        SlicedIndex* getSliced(const int32_t propIndex);
+
+        // discard the sliced indexes (they are rebuilt when next used), for
+        // when indexes are replaced wholesale (i.e. mapping a checkpoint)
+        void invalidateSliced();
+
+        void markChanged(const int32_t propIndex, const int64_t value)
+        {
+            if (trackChanges)
+                changed.insert(attr_key_s{ propIndex, value });
+        }
+
         void setDirty(const int32_t linId, const int32_t propIndex, const int64_t value, const bool on = true);
         void clearDirty();
 
+        // write pending deltas into their indexes, dropping indexes left empty
+        void compact();
+
+        // estimated population of an index, from its container headers and
+        // pending delta, without decoding it
+        int64_t getPopulation(Attr_s* attr) const;
+
+        // the bits of an index with its pending delta merged (caller deletes),
+        // from the index cache when they were decoded recently
+        IndexBits* getBits(Attr_s* attr);
+
+        // OR the bits of an index into `bits`, straight from its containers unless
+        // it has a pending delta
+        void orBits(Attr_s* attr, IndexBits& bits);
+
         // replace an indexes bits with new ones, used when generating segments
         void swap(const int32_t propIndex, const int64_t value, IndexBits* newBits);
 
@@ -164,6 +278,10 @@ namespace openset::db
         AttrListExpanded getPropertyValues(const int32_t propIndex);
         AttrList getPropertyValues(const int32_t propIndex, const listMode_e mode, const int64_t value);
 
+        // the PROP_WEEK and PROP_DAY indexes that together hold every customer with
+        // an event between two stamps (inclusive), whole weeks are used where they fit
+        AttrList getTimeBuckets(const int64_t startStamp, const int64_t endStamp);
+
         bool operator==(const Attributes& other) const
         {
             return (partition == other.partition);
@@ -171,6 +289,10 @@ namespace openset::db
 
         void serialize(HeapStack* mem);
         int64_t deserialize(char* mem);
+
+    private:
+        // rewrite an index with its delta merged in
+        void flush(const attr_key_s key);
     };
 };
 
@@ -0,0 +1,794 @@
+#include "bitkernels.h"
+#include "common.h"
+
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BITKERNELS_X86
+#define TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#define TARGET_AVX512 __attribute__((target("avx512f,popcnt")))
+#define TARGET_AVX512_POPCNT __attribute__((target("avx512f,avx512vpopcntdq,popcnt")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define BITKERNELS_X86
+#define TARGET_AVX2
+#define TARGET_AVX512
+#define TARGET_AVX512_POPCNT
+#endif
+
+#ifdef BITKERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+using namespace openset::db;
+
+namespace
+{
+    struct Kernels_s
+    {
+        BitKernels::Level_e level;
+        const char* name;
+        void (*opAnd)(uint64_t*, const uint64_t*, const uint64_t*, int64_t);
+        void (*opOr)(uint64_t*, const uint64_t*, const uint64_t*, int64_t);
+        void (*opAndNot)(uint64_t*, const uint64_t*, const uint64_t*, int64_t);
+        void (*opNot)(uint64_t*, int64_t);
+        int64_t (*population)(const uint64_t*, int64_t);
+        int64_t (*andPopulation)(const uint64_t*, const uint64_t*, int64_t);
+        void (*compare)(uint64_t*, const int64_t*, int64_t, BitKernels::Compare_e, int64_t);
+        void (*compareScaled)(uint64_t*, const int64_t*, double, double, BitKernels::Compare_e, int64_t);
+    };
+
+    // the word operations, each kernel level instantiates its loops with these
+    struct And_s
+    {
+        static uint64_t word(const uint64_t left, const uint64_t right) { return left & right; }
+#ifdef BITKERNELS_X86
+        TARGET_AVX2 static __m256i avx2(const __m256i left, const __m256i right) { return _mm256_and_si256(left, right); }
+        TARGET_AVX512 static __m512i avx512(const __m512i left, const __m512i right) { return _mm512_and_si512(left, right); }
+#endif
+    };
+
+    struct Or_s
+    {
+        static uint64_t word(const uint64_t left, const uint64_t right) { return left | right; }
+#ifdef BITKERNELS_X86
+        TARGET_AVX2 static __m256i avx2(const __m256i left, const __m256i right) { return _mm256_or_si256(left, right); }
+        TARGET_AVX512 static __m512i avx512(const __m512i left, const __m512i right) { return _mm512_or_si512(left, right); }
+#endif
+    };
+
+    struct AndNot_s
+    {
+        static uint64_t word(const uint64_t left, const uint64_t right) { return left & ~right; }
+#ifdef BITKERNELS_X86
+        // the intrinsics negate their first argument
+        TARGET_AVX2 static __m256i avx2(const __m256i left, const __m256i right) { return _mm256_andnot_si256(right, left); }
+        TARGET_AVX512 static __m512i avx512(const __m512i left, const __m512i right) { return _mm512_andnot_si512(right, left); }
+#endif
+    };
+
+    int64_t countBits(const uint64_t word)
+    {
+#ifdef _MSC_VER
+        return __popcnt64(word);
+#else
+        return __builtin_popcountll(word);
+#endif
+    }
+
+    int64_t trailingZeros(const uint64_t word)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, word);
+        return index;
+#else
+        return __builtin_ctzll(word);
+#endif
+    }
+
+    // compare kernels are instantiated per Compare_e, so the lane loops don't branch on it
+
+    using Compare_e = BitKernels::Compare_e;
+
+    template<Compare_e Op, typename T>
+    bool test(const T left, const T right)
+    {
+        if constexpr (Op == Compare_e::eq)
+            return left == right;
+        else if constexpr (Op == Compare_e::neq)
+            return left != right;
+        else if constexpr (Op == Compare_e::lt)
+            return left < right;
+        else if constexpr (Op == Compare_e::lte)
+            return left <= right;
+        else if constexpr (Op == Compare_e::gt)
+            return left > right;
+        else
+            return left >= right;
+    }
+
+    // a missing value compares as a double NONE, as TypedOp_e::COLDBL does
+    double scale(const int64_t value, const double divisor)
+    {
+        return value == NONE ? static_cast<double>(NONE) : static_cast<double>(value) / divisor;
+    }
+
+    template<template<Compare_e> class Kernel, typename... Args>
+    void dispatch(const Compare_e op, Args... args)
+    {
+        switch (op)
+        {
+        case Compare_e::eq:
+            Kernel<Compare_e::eq>::run(args...);
+            break;
+        case Compare_e::neq:
+            Kernel<Compare_e::neq>::run(args...);
+            break;
+        case Compare_e::lt:
+            Kernel<Compare_e::lt>::run(args...);
+            break;
+        case Compare_e::lte:
+            Kernel<Compare_e::lte>::run(args...);
+            break;
+        case Compare_e::gt:
+            Kernel<Compare_e::gt>::run(args...);
+            break;
+        case Compare_e::gte:
+            Kernel<Compare_e::gte>::run(args...);
+            break;
+        }
+    }
+
+    // scalar
+
+    template<Compare_e Op>
+    struct CompareScalar_s
+    {
+        static void run(uint64_t* bits, const int64_t* values, const int64_t literal, const int64_t count)
+        {
+            for (int64_t i = 0; i < count; i += 64)
+            {
+                const auto end = count - i < 64 ? count - i : 64;
+                uint64_t word = 0;
+                for (int64_t bit = 0; bit < end; ++bit)
+                    word |= static_cast<uint64_t>(test<Op>(values[i + bit], literal)) << bit;
+                bits[i / 64] = word;
+            }
+        }
+    };
+
+    template<Compare_e Op>
+    struct CompareScaledScalar_s
+    {
+        static void run(uint64_t* bits, const int64_t* values, const double divisor, const double literal, const int64_t count)
+        {
+            for (int64_t i = 0; i < count; i += 64)
+            {
+                const auto end = count - i < 64 ? count - i : 64;
+                uint64_t word = 0;
+                for (int64_t bit = 0; bit < end; ++bit)
+                    word |= static_cast<uint64_t>(test<Op>(scale(values[i + bit], divisor), literal)) << bit;
+                bits[i / 64] = word;
+            }
+        }
+    };
+
+    void compareScalar(uint64_t* bits, const int64_t* values, const int64_t literal, const Compare_e op, const int64_t count)
+    {
+        dispatch<CompareScalar_s>(op, bits, values, literal, count);
+    }
+
+    void compareScaledScalar(
+        uint64_t* bits, const int64_t* values, const double divisor, const double literal, const Compare_e op, const int64_t count)
+    {
+        dispatch<CompareScaledScalar_s>(op, bits, values, divisor, literal, count);
+    }
+
+    template<typename Op>
+    void combineScalar(uint64_t* dest, const uint64_t* left, const uint64_t* right, const int64_t count)
+    {
+        for (auto i = 0; i < count; ++i)
+            dest[i] = Op::word(left[i], right[i]);
+    }
+
+    void notScalar(uint64_t* dest, const int64_t count)
+    {
+        for (auto i = 0; i < count; ++i)
+            dest[i] = ~dest[i];
+    }
+
+    int64_t populationScalar(const uint64_t* words, const int64_t count)
+    {
+        int64_t total = 0;
+        for (auto i = 0; i < count; ++i)
+            total += countBits(words[i]);
+        return total;
+    }
+
+    int64_t andPopulationScalar(const uint64_t* left, const uint64_t* right, const int64_t count)
+    {
+        int64_t total = 0;
+        for (auto i = 0; i < count; ++i)
+            total += countBits(left[i] & right[i]);
+        return total;
+    }
+
+    const Kernels_s scalarKernels {
+        BitKernels::Level_e::scalar,
+        "scalar",
+        combineScalar<And_s>,
+        combineScalar<Or_s>,
+        combineScalar<AndNot_s>,
+        notScalar,
+        populationScalar,
+        andPopulationScalar,
+        compareScalar,
+        compareScaledScalar
+    };
+
+#ifdef BITKERNELS_X86
+
+    // AVX2, four words at a time
+
+    template<typename Op>
+    TARGET_AVX2 void combineAvx2(uint64_t* dest, const uint64_t* left, const uint64_t* right, const int64_t count)
+    {
+        int64_t i = 0;
+
+        for (; i + 4 <= count; i += 4)
+        {
+            const auto result = Op::avx2(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), result);
+        }
+
+        for (; i < count; ++i)
+            dest[i] = Op::word(left[i], right[i]);
+    }
+
+    TARGET_AVX2 void notAvx2(uint64_t* dest, const int64_t count)
+    {
+        const auto ones = _mm256_set1_epi64x(-1);
+        int64_t i = 0;
+
+        for (; i + 4 <= count; i += 4)
+        {
+            const auto words = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dest + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), _mm256_xor_si256(words, ones));
+        }
+
+        for (; i < count; ++i)
+            dest[i] = ~dest[i];
+    }
+
+    // per 64 bit lane popcount, nibble lookup with a shuffle (there is no AVX2 popcount)
+    TARGET_AVX2 __m256i countAvx2(const __m256i words)
+    {
+        const auto lookup = _mm256_setr_epi8(
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const auto nibble = _mm256_set1_epi8(0x0f);
+
+        const auto low = _mm256_and_si256(words, nibble);
+        const auto high = _mm256_and_si256(_mm256_srli_epi16(words, 4), nibble);
+
+        const auto bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low), _mm256_shuffle_epi8(lookup, high));
+
+        return _mm256_sad_epu8(bytes, _mm256_setzero_si256());
+    }
+
+    TARGET_AVX2 int64_t sumAvx2(const __m256i lanes)
+    {
+        return _mm256_extract_epi64(lanes, 0) + _mm256_extract_epi64(lanes, 1) +
+            _mm256_extract_epi64(lanes, 2) + _mm256_extract_epi64(lanes, 3);
+    }
+
+    TARGET_AVX2 int64_t populationAvx2(const uint64_t* words, const int64_t count)
+    {
+        auto lanes = _mm256_setzero_si256();
+        int64_t i = 0;
+
+        for (; i + 4 <= count; i += 4)
+            lanes = _mm256_add_epi64(lanes, countAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i))));
+
+        auto total = sumAvx2(lanes);
+
+        for (; i < count; ++i)
+            total += _mm_popcnt_u64(words[i]);
+
+        return total;
+    }
+
+    TARGET_AVX2 int64_t andPopulationAvx2(const uint64_t* left, const uint64_t* right, const int64_t count)
+    {
+        auto lanes = _mm256_setzero_si256();
+        int64_t i = 0;
+
+        for (; i + 4 <= count; i += 4)
+        {
+            const auto words = _mm256_and_si256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i)));
+            lanes = _mm256_add_epi64(lanes, countAvx2(words));
+        }
+
+        auto total = sumAvx2(lanes);
+
+        for (; i < count; ++i)
+            total += _mm_popcnt_u64(left[i] & right[i]);
+
+        return total;
+    }
+
+    template<Compare_e Op>
+    constexpr int doublePredicate()
+    {
+        if constexpr (Op == Compare_e::eq)
+            return _CMP_EQ_OQ;
+        else if constexpr (Op == Compare_e::neq)
+            return _CMP_NEQ_UQ;
+        else if constexpr (Op == Compare_e::lt)
+            return _CMP_LT_OQ;
+        else if constexpr (Op == Compare_e::lte)
+            return _CMP_LE_OQ;
+        else if constexpr (Op == Compare_e::gt)
+            return _CMP_GT_OQ;
+        else
+            return _CMP_GE_OQ;
+    }
+
+    // four bits, one per lane (there are only == and signed > compares in AVX2)
+    template<Compare_e Op>
+    TARGET_AVX2 uint64_t lanesAvx2(const __m256i values, const __m256i literal)
+    {
+        __m256i result;
+
+        if constexpr (Op == Compare_e::eq || Op == Compare_e::neq)
+            result = _mm256_cmpeq_epi64(values, literal);
+        else if constexpr (Op == Compare_e::gt || Op == Compare_e::lte)
+            result = _mm256_cmpgt_epi64(values, literal);
+        else
+            result = _mm256_cmpgt_epi64(literal, values);
+
+        const auto lanes = static_cast<uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(result)));
+
+        // !=, <= and >= are the complements
+        if constexpr (Op == Compare_e::neq || Op == Compare_e::lte || Op == Compare_e::gte)
+            return lanes ^ 0xf;
+        else
+            return lanes;
+    }
+
+    template<Compare_e Op>
+    struct CompareAvx2_s
+    {
+        TARGET_AVX2 static void run(uint64_t* bits, const int64_t* values, const int64_t literal, const int64_t count)
+        {
+            const auto right = _mm256_set1_epi64x(literal);
+            int64_t i = 0;
+
+            for (; i + 64 <= count; i += 64)
+            {
+                uint64_t word = 0;
+                for (auto lane = 0; lane < 64; lane += 4)
+                    word |= lanesAvx2<Op>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i + lane)), right) << lane;
+                bits[i / 64] = word;
+            }
+
+            if (i < count)
+                CompareScalar_s<Op>::run(bits + i / 64, values + i, literal, count - i);
+        }
+    };
+
+    template<Compare_e Op>
+    struct CompareScaledAvx2_s
+    {
+        TARGET_AVX2 static void run(uint64_t* bits, const int64_t* values, const double divisor, const double literal, const int64_t count)
+        {
+            const auto right = _mm256_set1_pd(literal);
+            int64_t i = 0;
+
+            for (; i + 64 <= count; i += 64)
+            {
+                uint64_t word = 0;
+                for (auto lane = 0; lane < 64; lane += 4)
+                {
+                    const auto value = values + i + lane;
+                    const auto left = _mm256_setr_pd(
+                        scale(value[0], divisor), scale(value[1], divisor), scale(value[2], divisor), scale(value[3], divisor));
+                    word |= static_cast<uint64_t>(_mm256_movemask_pd(_mm256_cmp_pd(left, right, doublePredicate<Op>()))) << lane;
+                }
+                bits[i / 64] = word;
+            }
+
+            if (i < count)
+                CompareScaledScalar_s<Op>::run(bits + i / 64, values + i, divisor, literal, count - i);
+        }
+    };
+
+    void compareAvx2(uint64_t* bits, const int64_t* values, const int64_t literal, const Compare_e op, const int64_t count)
+    {
+        dispatch<CompareAvx2_s>(op, bits, values, literal, count);
+    }
+
+    void compareScaledAvx2(
+        uint64_t* bits, const int64_t* values, const double divisor, const double literal, const Compare_e op, const int64_t count)
+    {
+        dispatch<CompareScaledAvx2_s>(op, bits, values, divisor, literal, count);
+    }
+
+    const Kernels_s avx2Kernels {
+        BitKernels::Level_e::avx2,
+        "avx2",
+        combineAvx2<And_s>,
+        combineAvx2<Or_s>,
+        combineAvx2<AndNot_s>,
+        notAvx2,
+        populationAvx2,
+        andPopulationAvx2,
+        compareAvx2,
+        compareScaledAvx2
+    };
+
+    // AVX-512, eight words at a time
+
+    template<typename Op>
+    TARGET_AVX512 void combineAvx512(uint64_t* dest, const uint64_t* left, const uint64_t* right, const int64_t count)
+    {
+        int64_t i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            const auto result = Op::avx512(_mm512_loadu_si512(left + i), _mm512_loadu_si512(right + i));
+            _mm512_storeu_si512(dest + i, result);
+        }
+
+        for (; i < count; ++i)
+            dest[i] = Op::word(left[i], right[i]);
+    }
+
+    TARGET_AVX512 void notAvx512(uint64_t* dest, const int64_t count)
+    {
+        const auto ones = _mm512_set1_epi64(-1);
+        int64_t i = 0;
+
+        for (; i + 8 <= count; i += 8)
+            _mm512_storeu_si512(dest + i, _mm512_xor_si512(_mm512_loadu_si512(dest + i), ones));
+
+        for (; i < count; ++i)
+            dest[i] = ~dest[i];
+    }
+
+    TARGET_AVX512 int64_t sumAvx512(const __m512i lanes)
+    {
+        uint64_t counts[8];
+        _mm512_storeu_si512(counts, lanes);
+
+        int64_t total = 0;
+        for (const auto count : counts)
+            total += count;
+        return total;
+    }
+
+    TARGET_AVX512_POPCNT int64_t populationAvx512(const uint64_t* words, const int64_t count)
+    {
+        auto lanes = _mm512_setzero_si512();
+        int64_t i = 0;
+
+        for (; i + 8 <= count; i += 8)
+            lanes = _mm512_add_epi64(lanes, _mm512_popcnt_epi64(_mm512_loadu_si512(words + i)));
+
+        auto total = sumAvx512(lanes);
+
+        for (; i < count; ++i)
+            total += _mm_popcnt_u64(words[i]);
+
+        return total;
+    }
+
+    TARGET_AVX512_POPCNT int64_t andPopulationAvx512(const uint64_t* left, const uint64_t* right, const int64_t count)
+    {
+        auto lanes = _mm512_setzero_si512();
+        int64_t i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            const auto words = _mm512_and_si512(_mm512_loadu_si512(left + i), _mm512_loadu_si512(right + i));
+            lanes = _mm512_add_epi64(lanes, _mm512_popcnt_epi64(words));
+        }
+
+        auto total = sumAvx512(lanes);
+
+        for (; i < count; ++i)
+            total += _mm_popcnt_u64(left[i] & right[i]);
+
+        return total;
+    }
+
+    template<Compare_e Op>
+    constexpr int intPredicate()
+    {
+        if constexpr (Op == Compare_e::eq)
+            return _MM_CMPINT_EQ;
+        else if constexpr (Op == Compare_e::neq)
+            return _MM_CMPINT_NE;
+        else if constexpr (Op == Compare_e::lt)
+            return _MM_CMPINT_LT;
+        else if constexpr (Op == Compare_e::lte)
+            return _MM_CMPINT_LE;
+        else if constexpr (Op == Compare_e::gt)
+            return _MM_CMPINT_NLE;
+        else
+            return _MM_CMPINT_NLT;
+    }
+
+    template<Compare_e Op>
+    struct CompareAvx512_s
+    {
+        TARGET_AVX512 static void run(uint64_t* bits, const int64_t* values, const int64_t literal, const int64_t count)
+        {
+            const auto right = _mm512_set1_epi64(literal);
+            int64_t i = 0;
+
+            for (; i + 64 <= count; i += 64)
+            {
+                uint64_t word = 0;
+                for (auto lane = 0; lane < 64; lane += 8)
+                {
+                    const auto lanes = _mm512_cmp_epi64_mask(_mm512_loadu_si512(values + i + lane), right, intPredicate<Op>());
+                    word |= static_cast<uint64_t>(lanes) << lane;
+                }
+                bits[i / 64] = word;
+            }
+
+            if (i < count)
+                CompareScalar_s<Op>::run(bits + i / 64, values + i, literal, count - i);
+        }
+    };
+
+    template<Compare_e Op>
+    struct CompareScaledAvx512_s
+    {
+        TARGET_AVX512 static void run(uint64_t* bits, const int64_t* values, const double divisor, const double literal, const int64_t count)
+        {
+            const auto right = _mm512_set1_pd(literal);
+            int64_t i = 0;
+
+            for (; i + 64 <= count; i += 64)
+            {
+                uint64_t word = 0;
+                for (auto lane = 0; lane < 64; lane += 8)
+                {
+                    const auto value = values + i + lane;
+                    const auto left = _mm512_setr_pd(
+                        scale(value[0], divisor), scale(value[1], divisor), scale(value[2], divisor), scale(value[3], divisor),
+                        scale(value[4], divisor), scale(value[5], divisor), scale(value[6], divisor), scale(value[7], divisor));
+                    word |= static_cast<uint64_t>(_mm512_cmp_pd_mask(left, right, doublePredicate<Op>())) << lane;
+                }
+                bits[i / 64] = word;
+            }
+
+            if (i < count)
+                CompareScaledScalar_s<Op>::run(bits + i / 64, values + i, divisor, literal, count - i);
+        }
+    };
+
+    void compareAvx512(uint64_t* bits, const int64_t* values, const int64_t literal, const Compare_e op, const int64_t count)
+    {
+        dispatch<CompareAvx512_s>(op, bits, values, literal, count);
+    }
+
+    void compareScaledAvx512(
+        uint64_t* bits, const int64_t* values, const double divisor, const double literal, const Compare_e op, const int64_t count)
+    {
+        dispatch<CompareScaledAvx512_s>(op, bits, values, divisor, literal, count);
+    }
+
+    // without VPOPCNTDQ the AVX2 counts are used
+    const Kernels_s avx512Kernels {
+        BitKernels::Level_e::avx512,
+        "avx512",
+        combineAvx512<And_s>,
+        combineAvx512<Or_s>,
+        combineAvx512<AndNot_s>,
+        notAvx512,
+        populationAvx2,
+        andPopulationAvx2,
+        compareAvx512,
+        compareScaledAvx512
+    };
+
+    const Kernels_s avx512PopcntKernels {
+        BitKernels::Level_e::avx512,
+        "avx512",
+        combineAvx512<And_s>,
+        combineAvx512<Or_s>,
+        combineAvx512<AndNot_s>,
+        notAvx512,
+        populationAvx512,
+        andPopulationAvx512,
+        compareAvx512,
+        compareScaledAvx512
+    };
+
+    struct Features_s
+    {
+        bool avx2 { false };
+        bool avx512 { false };
+        bool avx512Popcnt { false };
+    };
+
+    Features_s detect()
+    {
+        Features_s features;
+
+#ifdef _MSC_VER
+        int info[4];
+
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return features;
+
+        // the OS must save the AVX (and AVX-512) registers
+        __cpuid(info, 1);
+        const auto osxsave = (info[2] & (1 << 27)) != 0;
+        if (!osxsave)
+            return features;
+
+        const auto xcr0 = _xgetbv(0);
+        const auto avxState = (xcr0 & 0x06) == 0x06;
+        const auto avx512State = (xcr0 & 0xe6) == 0xe6;
+
+        __cpuidex(info, 7, 0);
+        features.avx2 = avxState && (info[1] & (1 << 5));
+        features.avx512 = avx512State && (info[1] & (1 << 16));
+        features.avx512Popcnt = features.avx512 && (info[2] & (1 << 14));
+#else
+        __builtin_cpu_init();
+        features.avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+        features.avx512 = features.avx2 && __builtin_cpu_supports("avx512f");
+        features.avx512Popcnt = features.avx512 && __builtin_cpu_supports("avx512vpopcntdq");
+#endif
+
+        return features;
+    }
+
+    const Features_s& getFeatures()
+    {
+        static const auto features = detect();
+        return features;
+    }
+
+#endif
+
+    const Kernels_s* kernelsFor(const BitKernels::Level_e level)
+    {
+#ifdef BITKERNELS_X86
+        const auto& features = getFeatures();
+
+        if (level >= BitKernels::Level_e::avx512 && features.avx512)
+            return features.avx512Popcnt ? &avx512PopcntKernels : &avx512Kernels;
+
+        if (level >= BitKernels::Level_e::avx2 && features.avx2)
+            return &avx2Kernels;
+#endif
+
+        return &scalarKernels;
+    }
+
+    std::atomic<const Kernels_s*> active { nullptr };
+
+    const Kernels_s* getKernels()
+    {
+        auto kernels = active.load(std::memory_order_relaxed);
+
+        if (!kernels)
+        {
+            kernels = kernelsFor(BitKernels::Level_e::avx512);
+            active = kernels;
+        }
+
+        return kernels;
+    }
+}
+
+void BitKernels::opAnd(uint64_t* dest, const uint64_t* source, const int64_t count)
+{
+    getKernels()->opAnd(dest, dest, source, count);
+}
+
+void BitKernels::opOr(uint64_t* dest, const uint64_t* source, const int64_t count)
+{
+    getKernels()->opOr(dest, dest, source, count);
+}
+
+void BitKernels::opAndNot(uint64_t* dest, const uint64_t* source, const int64_t count)
+{
+    getKernels()->opAndNot(dest, dest, source, count);
+}
+
+void BitKernels::opNot(uint64_t* dest, const int64_t count)
+{
+    getKernels()->opNot(dest, count);
+}
+
+void BitKernels::opCopyAnd(uint64_t* dest, const uint64_t* left, const uint64_t* right, const int64_t count)
+{
+    getKernels()->opAnd(dest, left, right, count);
+}
+
+void BitKernels::opCopyAndNot(uint64_t* dest, const uint64_t* left, const uint64_t* right, const int64_t count)
+{
+    getKernels()->opAndNot(dest, left, right, count);
+}
+
+int64_t BitKernels::population(const uint64_t* words, const int64_t count)
+{
+    return getKernels()->population(words, count);
+}
+
+int64_t BitKernels::andPopulation(const uint64_t* left, const uint64_t* right, const int64_t count)
+{
+    return getKernels()->andPopulation(left, right, count);
+}
+
+void BitKernels::compare(uint64_t* bits, const int64_t* values, const int64_t literal, const Compare_e op, const int64_t count)
+{
+    getKernels()->compare(bits, values, literal, op, count);
+}
+
+void BitKernels::compareScaled(
+    uint64_t* bits,
+    const int64_t* values,
+    const double divisor,
+    const double literal,
+    const Compare_e op,
+    const int64_t count)
+{
+    getKernels()->compareScaled(bits, values, divisor, literal, op, count);
+}
+
+int32_t BitKernels::select(const uint64_t* bits, const int64_t count, const int32_t offset, int32_t* selected)
+{
+    int32_t found = 0;
+
+    for (int64_t i = 0; i < count; i += 64)
+    {
+        auto word = bits[i / 64];
+
+        if (count - i < 64)
+            word &= (1ULL << (count - i)) - 1;
+
+        while (word)
+        {
+            selected[found++] = offset + static_cast<int32_t>(i + trailingZeros(word));
+            word &= word - 1;
+        }
+    }
+
+    return found;
+}
+
+BitKernels::Level_e BitKernels::getSupported()
+{
+    return kernelsFor(Level_e::avx512)->level;
+}
+
+BitKernels::Level_e BitKernels::getLevel()
+{
+    return getKernels()->level;
+}
+
+void BitKernels::setLevel(const Level_e level)
+{
+    active = kernelsFor(level);
+}
+
+const char* BitKernels::getLevelName()
+{
+    return getKernels()->name;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+namespace openset::db
+{
+    /*
+     * BitKernels - the word loops under IndexBits
+     *
+     * Each kernel is built three times, scalar, AVX2 and AVX-512, and the
+     * widest one the CPU supports is picked the first time a kernel is used.
+     * Compilers without x86 target attributes get the scalar kernels only.
+     *
+     * Counts are in uint64_t words, `dest` may be the same buffer as `left`.
+     *
+     * The compare kernels go the other way, they test a column of values
+     * against a literal and write one bit per value (used to select the
+     * rows of `each_row` filters, see Interpreter::selectRows).
+     */
+    class BitKernels
+    {
+    public:
+        enum class Level_e : int
+        {
+            scalar = 0,
+            avx2 = 1,
+            avx512 = 2
+        };
+
+        enum class Compare_e : int
+        {
+            eq,
+            neq,
+            lt,
+            lte,
+            gt,
+            gte
+        };
+
+        static void opAnd(uint64_t* dest, const uint64_t* source, const int64_t count);
+        static void opOr(uint64_t* dest, const uint64_t* source, const int64_t count);
+        static void opAndNot(uint64_t* dest, const uint64_t* source, const int64_t count);
+        static void opNot(uint64_t* dest, const int64_t count);
+
+        // dest = left & right, and dest = left & ~right
+        static void opCopyAnd(uint64_t* dest, const uint64_t* left, const uint64_t* right, const int64_t count);
+        static void opCopyAndNot(uint64_t* dest, const uint64_t* left, const uint64_t* right, const int64_t count);
+
+        static int64_t population(const uint64_t* words, const int64_t count);
+
+        // population of left & right without writing it anywhere
+        static int64_t andPopulation(const uint64_t* left, const uint64_t* right, const int64_t count);
+
+        // bit `i` of `bits` is set when `values[i] op literal`, `count` is in values,
+        // the unused bits of the last word are cleared
+        static void compare(uint64_t* bits, const int64_t* values, const int64_t literal, const Compare_e op, const int64_t count);
+
+        // as compare, with values scaled to `value / divisor` (NONE stays NONE, as a double)
+        static void compareScaled(
+            uint64_t* bits,
+            const int64_t* values,
+            const double divisor,
+            const double literal,
+            const Compare_e op,
+            const int64_t count);
+
+        // writes `offset + i` for each set bit `i` in the first `count` bits, returns how many
+        static int32_t select(const uint64_t* bits, const int64_t count, const int32_t offset, int32_t* selected);
+
+        // the widest level this CPU supports
+        static Level_e getSupported();
+
+        // the level in use, setLevel is clamped to what is supported (for testing)
+        static Level_e getLevel();
+        static void setLevel(const Level_e level);
+
+        static const char* getLevelName();
+    };
+}
@@ -0,0 +1,1333 @@
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <unordered_map>
+
+#include "config.h"
+#include "database.h"
+#include "table.h"
+#include "tablepartitioned.h"
+#include "asyncpool.h"
+#include "attributeblob.h"
+#include "file/file.h"
+#include "file/directory.h"
+#include "var/varblob.h"
+#include "sba/sba.h"
+#include "threads/locks.h"
+
+#ifdef _MSC_VER
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace openset::db;
+
+namespace
+{
+    const int64_t CHECKPOINT_MAGIC = 0x54504b4843534f; // "OSCHKPT"
+    const int32_t CHECKPOINT_VERSION = 3;
+
+    // deltas are merged into the base once they reach half its size (and at least 1MB)
+    const int64_t COMPACT_DIVISOR = 2;
+    const int64_t COMPACT_MIN_BYTES = 1024LL * 1024LL;
+
+#pragma pack(push,1)
+    // starts a base file and each delta batch
+    struct Header_s
+    {
+        int64_t magic;
+        int32_t version;
+        int32_t partition;
+        int64_t segment;       // oldest write ahead log segment not in this snapshot
+        int64_t walOffset;     // offset in `segment` of the last event in this snapshot, -1 for none
+        int64_t generation;    // base: newest delta generation merged in, batch: its delta generation
+        int64_t customerSlots; // size of customerLinear
+        int64_t customerCount;
+        int64_t customerBytes;
+        int64_t attrCount;
+        int64_t attrBytes;
+        int32_t customerDrops; // batch only, linIds (int32_t) following the index records
+        int32_t attrDrops;     // batch only, AttrDrop_s following the customer drops
+    };
+
+    // followed by PersonData_s, then (if propsBytes) a PoolMem header and the props blob
+    struct CustomerRecord_s
+    {
+        int32_t propsBytes;
+        int32_t poolIndex; // PoolMem header for the PersonData_s that follows
+    };
+
+    // followed by text, then a PoolMem header and the Attr_s
+    struct AttrRecord_s
+    {
+        int32_t column;
+        int32_t textSize;
+        int64_t hashValue;
+    };
+
+    struct AttrDrop_s
+    {
+        int32_t column;
+        int32_t unused;
+        int64_t hashValue;
+    };
+
+    // ends each delta batch
+    struct Trailer_s
+    {
+        int64_t length; // bytes in the batch before the trailer
+        int64_t check;  // hash of those bytes
+    };
+#pragma pack(pop)
+
+    // bytes needed to move `offset` to the next position where offset % 8 == remainder
+    int64_t padding(const int64_t offset, const int64_t remainder)
+    {
+        return (8 + remainder - (offset % 8)) % 8;
+    }
+
+    // writes to a file, or (for delta batches) to a memory buffer
+    class SnapshotWriter
+    {
+        FILE* file { nullptr };
+        std::vector<char>* buffer { nullptr };
+        int64_t offset { 0 };
+        bool failed { false };
+
+    public:
+        explicit SnapshotWriter(FILE* file) :
+            file(file)
+        {}
+
+        explicit SnapshotWriter(std::vector<char>* buffer) :
+            buffer(buffer)
+        {}
+
+        void write(const void* data, const int64_t length)
+        {
+            if (!length)
+                return;
+
+            if (buffer)
+                buffer->insert(buffer->end(), static_cast<const char*>(data), static_cast<const char*>(data) + length);
+            else if (fwrite(data, 1, length, file) != static_cast<size_t>(length))
+                failed = true;
+
+            offset += length;
+        }
+
+        // write zeros until offset % 8 == remainder
+        void align(const int64_t remainder)
+        {
+            const char zeros[8] = {};
+            write(zeros, padding(offset, remainder));
+        }
+
+        void poolHeader()
+        {
+            const auto poolIndex = MemConstants::PoolMemExternal;
+            write(&poolIndex, sizeof(int32_t));
+        }
+
+        int64_t getOffset() const
+        {
+            return offset;
+        }
+
+        bool isFailed() const
+        {
+            return failed;
+        }
+    };
+
+    void syncFile(FILE* file)
+    {
+        fflush(file);
+#ifdef _MSC_VER
+        _commit(_fileno(file));
+#else
+        fsync(fileno(file));
+#endif
+    }
+
+    void writeCustomer(SnapshotWriter& writer, PersonData_s* person, HeapStack& propMem)
+    {
+        char* props = nullptr;
+        int64_t propsBytes = 0;
+
+        // props are a varBlob, it doesn't know its own length, so repack it
+        if (person->props)
+        {
+            cvar var;
+            varBlob::deserialize(var, person->props);
+            varBlob::serialize(propMem, var);
+            props = propMem.flatten(propsBytes);
+            propMem.reset();
+        }
+
+        CustomerRecord_s record { static_cast<int32_t>(propsBytes), MemConstants::PoolMemExternal };
+        writer.write(&record, sizeof(CustomerRecord_s));
+
+        // props pointers are meaningless on disk
+        auto personHeader = *person;
+        personHeader.props = nullptr;
+
+        writer.write(&personHeader, PERSON_DATA_SIZE);
+        writer.write(person->events, person->size() - PERSON_DATA_SIZE);
+
+        if (props)
+        {
+            writer.align(4);
+            writer.poolHeader();
+            writer.write(props, propsBytes);
+            PoolMem::getPool().freePtr(props);
+        }
+
+        writer.align(0);
+    }
+
+    void writeAttr(SnapshotWriter& writer, const attr_key_s& key, Attr_s* attr, AttributeBlob* blob)
+    {
+        const auto text = blob->getValue(key.index, key.value);
+
+        AttrRecord_s record {
+            key.index,
+            text ? static_cast<int32_t>(strlen(text)) : 0,
+            key.value
+        };
+
+        writer.write(&record, sizeof(AttrRecord_s));
+        writer.write(text, record.textSize);
+
+        writer.align(4);
+        writer.poolHeader();
+
+        // text pointers are meaningless on disk
+        auto attrHeader = *attr;
+        attrHeader.text = nullptr;
+
+        writer.write(&attrHeader, sizeof(Attr_s) - 1);
+        writer.write(attr->index, attr->comp + 1LL);
+
+        writer.align(0);
+    }
+
+    // offset of the record following the customer record at `offset`
+    int64_t customerRecordEnd(const char* data, int64_t offset)
+    {
+        const auto record = recast<const CustomerRecord_s*>(data + offset);
+        const auto person = recast<const PersonData_s*>(data + offset + sizeof(CustomerRecord_s));
+
+        offset += static_cast<int64_t>(sizeof(CustomerRecord_s)) + person->size();
+
+        if (record->propsBytes)
+            offset += padding(offset, 4) + sizeof(int32_t) + record->propsBytes;
+
+        return offset + padding(offset, 0);
+    }
+
+    // offset of the Attr_s in the index record at `offset`
+    int64_t attrRecordAttr(const char* data, int64_t offset)
+    {
+        const auto record = recast<const AttrRecord_s*>(data + offset);
+
+        offset += static_cast<int64_t>(sizeof(AttrRecord_s)) + record->textSize;
+        return offset + padding(offset, 4) + sizeof(int32_t);
+    }
+
+    // offset of the record following the index record at `offset`
+    int64_t attrRecordEnd(const char* data, int64_t offset)
+    {
+        offset = attrRecordAttr(data, offset);
+        offset += sizeof(Attr_s) + recast<const Attr_s*>(data + offset)->comp;
+
+        return offset + padding(offset, 0);
+    }
+
+    int64_t batchLength(const Header_s* header)
+    {
+        const auto dropBytes = header->customerDrops * static_cast<int64_t>(sizeof(int32_t));
+
+        return static_cast<int64_t>(sizeof(Header_s)) +
+            header->customerBytes +
+            header->attrBytes +
+            dropBytes + padding(dropBytes, 0) +
+            header->attrDrops * static_cast<int64_t>(sizeof(AttrDrop_s));
+    }
+
+    bool checkBase(const char* data, const int64_t length, const int32_t partition)
+    {
+        const auto header = recast<const Header_s*>(data);
+
+        return length >= static_cast<int64_t>(sizeof(Header_s)) &&
+            header->magic == CHECKPOINT_MAGIC &&
+            header->version == CHECKPOINT_VERSION &&
+            header->partition == partition &&
+            static_cast<int64_t>(sizeof(Header_s)) + header->customerBytes + header->attrBytes <= length;
+    }
+
+    // length of the batch (with its trailer) at `offset`, or -1 if it is torn or damaged
+    int64_t checkBatch(const char* data, const int64_t length, const int64_t offset, const int32_t partition)
+    {
+        if (offset + static_cast<int64_t>(sizeof(Header_s) + sizeof(Trailer_s)) > length)
+            return -1;
+
+        const auto header = recast<const Header_s*>(data + offset);
+
+        if (header->magic != CHECKPOINT_MAGIC ||
+            header->version != CHECKPOINT_VERSION ||
+            header->partition != partition ||
+            header->customerBytes < 0 ||
+            header->attrBytes < 0 ||
+            header->customerDrops < 0 ||
+            header->attrDrops < 0)
+            return -1;
+
+        const auto bytes = batchLength(header);
+
+        if (offset + bytes + static_cast<int64_t>(sizeof(Trailer_s)) > length)
+            return -1;
+
+        const auto trailer = recast<const Trailer_s*>(data + offset + bytes);
+
+        if (trailer->length != bytes || trailer->check != MakeHash(data + offset, bytes))
+            return -1;
+
+        return bytes + static_cast<int64_t>(sizeof(Trailer_s));
+    }
+
+    // point customerLinear and customerMap at the mapped customer records in [offset, end)
+    bool mapCustomers(Customers& people, char* data, int64_t offset, const int64_t end, const int64_t slots)
+    {
+        if (slots > static_cast<int64_t>(people.customerLinear.size()))
+            people.customerLinear.resize(slots, nullptr);
+
+        while (offset < end)
+        {
+            const auto record = recast<CustomerRecord_s*>(data + offset);
+            const auto person = recast<PersonData_s*>(data + offset + sizeof(CustomerRecord_s));
+            const auto next = customerRecordEnd(data, offset);
+
+            if (person->linId < 0 || person->linId >= static_cast<int64_t>(people.customerLinear.size()) || next > end)
+                return false;
+
+            if (record->propsBytes)
+            {
+                const auto propsOffset = offset + static_cast<int64_t>(sizeof(CustomerRecord_s)) + person->size();
+                // this is the only write to the mapped record, it lands in a private copy of the page
+                person->props = data + propsOffset + padding(propsOffset, 4) + sizeof(int32_t);
+            }
+
+            // a newer record may reuse the linId of a dropped customer
+            if (const auto existing = people.customerLinear[person->linId]; existing)
+            {
+                if (existing->id != person->id)
+                    people.customerMap.erase(existing->id);
+                Dictionaries::release(existing->getDictionaryId());
+            }
+
+            Dictionaries::retain(person->getDictionaryId());
+            people.customerLinear[person->linId] = person;
+            people.customerMap[person->id] = person->linId;
+
+            offset = next;
+        }
+
+        return true;
+    }
+
+    // point propertyIndex at the mapped index records in [offset, end)
+    void mapAttrs(Attributes& attributes, char* data, int64_t offset, const int64_t end)
+    {
+        attributes.invalidateSliced();
+        attributes.cache.clear();
+
+        while (offset < end)
+        {
+            const auto record = recast<AttrRecord_s*>(data + offset);
+            const auto text = data + offset + sizeof(AttrRecord_s);
+            const auto attr = recast<Attr_s*>(data + attrRecordAttr(data, offset));
+
+            if (record->textSize)
+                attr->text = attributes.blob->storeValue(record->column, std::string{ text, static_cast<size_t>(record->textSize) });
+
+            attributes.propertyIndex[attr_key_s{ record->column, record->hashValue }] = attr;
+            attributes.indexValue(record->column, record->hashValue);
+
+            offset = attrRecordEnd(data, offset);
+        }
+    }
+
+    // apply the delta batch at `offset` (already checked) to the partition
+    bool mapBatch(TablePartitioned* parts, char* data, int64_t offset)
+    {
+        const auto header = recast<Header_s*>(data + offset);
+
+        offset += sizeof(Header_s);
+
+        if (!mapCustomers(parts->people, data, offset, offset + header->customerBytes, header->customerSlots))
+            return false;
+
+        offset += header->customerBytes;
+
+        mapAttrs(parts->attributes, data, offset, offset + header->attrBytes);
+
+        offset += header->attrBytes;
+
+        auto& people = parts->people;
+        const auto linIds = recast<int32_t*>(data + offset);
+
+        for (auto i = 0; i < header->customerDrops; ++i)
+        {
+            const auto linId = linIds[i];
+
+            if (linId < 0 || linId >= static_cast<int32_t>(people.customerLinear.size()) || !people.customerLinear[linId])
+                continue;
+
+            people.customerMap.erase(people.customerLinear[linId]->id);
+            Dictionaries::release(people.customerLinear[linId]->getDictionaryId());
+            people.customerLinear[linId] = nullptr;
+        }
+
+        const auto dropBytes = header->customerDrops * static_cast<int64_t>(sizeof(int32_t));
+        offset += dropBytes + padding(dropBytes, 0);
+
+        const auto attrDrops = recast<AttrDrop_s*>(data + offset);
+
+        for (auto i = 0; i < header->attrDrops; ++i)
+        {
+            parts->attributes.propertyIndex.erase(attr_key_s{ attrDrops[i].column, attrDrops[i].hashValue });
+            parts->attributes.unindexValue(attrDrops[i].column);
+        }
+
+        return true;
+    }
+
+    // delta generations on disk for a partition, oldest first
+    std::vector<int64_t> listDeltas(const std::string& tableName, const int32_t partition)
+    {
+        std::vector<int64_t> generations;
+
+        openset::IO::Directory dir;
+        auto mask = Checkpoint::getTablePath(tableName) + "*";
+
+        if (!dir.Open(mask))
+            return generations;
+
+        const auto prefix = to_string(partition) + ".";
+
+        std::string fileName;
+        auto more = dir.FirstFile(fileName);
+
+        while (more)
+        {
+            long long generation;
+
+            if (fileName.compare(0, prefix.length(), prefix) == 0 &&
+                sscanf(fileName.c_str() + prefix.length(), "%lld.delta", &generation) == 1 &&
+                fileName == prefix + to_string(generation) + ".delta")
+                generations.push_back(generation);
+
+            more = dir.NextFile(fileName);
+        }
+
+        std::sort(generations.begin(), generations.end());
+
+        return generations;
+    }
+
+    std::string getDictionaryFile(const std::string& tableName, const int32_t id)
+    {
+        return Checkpoint::getTablePath(tableName) + "dictionary." + to_string(id);
+    }
+
+    // write the dictionaries a trainer knows about that are not on disk yet,
+    // records in the partition files may have been compressed with any of them
+    void saveDictionaries(const std::string& tableName, DictionaryTrainer& trainer)
+    {
+        for (const auto id : trainer.getHistory())
+        {
+            const auto fileName = getDictionaryFile(tableName, id);
+            const auto dictionary = Dictionaries::get(id);
+
+            if (!dictionary || openset::IO::File::FileExists(fileName))
+                continue;
+
+            const auto tempName = fileName + ".tmp";
+            const auto file = fopen(tempName.c_str(), "wb");
+
+            if (!file)
+            {
+                Logger::get().error("could not create dictionary " + tempName);
+                continue;
+            }
+
+            const auto written = fwrite(dictionary->data.data(), 1, dictionary->data.size(), file);
+            fclose(file);
+
+            if (written != dictionary->data.size())
+            {
+                Logger::get().error("could not write dictionary " + tempName);
+                openset::IO::File::FileDelete(tempName);
+                continue;
+            }
+
+            rename(tempName.c_str(), fileName.c_str());
+        }
+    }
+
+    // register the dictionaries in `ids` (a json array) with a trainer, and make `active` active
+    void loadDictionaries(const std::string& tableName, const cjson* node, DictionaryTrainer& trainer)
+    {
+        if (!node)
+            return;
+
+        if (const auto ids = node->find("ids"); ids)
+        {
+            for (auto id : ids->getNodes())
+            {
+                const auto fileName = getDictionaryFile(tableName, static_cast<int32_t>(id->getInt()));
+
+                openset::IO::MappedFile mapping;
+
+                if (!mapping.map(fileName))
+                {
+                    Logger::get().error("dictionary " + fileName + " is missing.");
+                    continue;
+                }
+
+                if (const auto dictionary = Dictionaries::add(mapping.getData(), static_cast<int32_t>(mapping.getLength()));
+                    dictionary)
+                    trainer.addHistory(dictionary->id);
+            }
+        }
+
+        if (const auto active = node->find("active"); active && active->getInt())
+            trainer.setActive(static_cast<int32_t>(active->getInt()));
+    }
+
+    void serializeDictionaries(cjson* node, DictionaryTrainer& trainer)
+    {
+        node->set("active", static_cast<int64_t>(trainer.getActiveId()));
+
+        const auto ids = node->setArray("ids");
+        for (const auto id : trainer.getHistory())
+            ids->push(static_cast<int64_t>(id));
+    }
+
+    void removeDeltas(const std::string& tableName, const int32_t partition, const int64_t upToGeneration)
+    {
+        for (const auto generation : listDeltas(tableName, partition))
+        {
+            if (generation <= upToGeneration)
+                openset::IO::File::FileDelete(Checkpoint::getDeltaFile(tableName, partition, generation));
+        }
+    }
+
+    /*
+     * Compactor - one background thread shared by all partitions.
+     *
+     * Merging works on the files only, the partition keeps its mappings and
+     * keeps appending to a newer delta file while the merge runs. The merged
+     * base is renamed into place (and the merged deltas removed) under
+     * `compactCS`, which dropPartition and dropTable also take, so a merge
+     * never resurrects the files of a partition or table that has gone.
+     */
+    struct CompactJob_s
+    {
+        Database::TablePtr table;
+        std::shared_ptr<CheckpointState_s> state;
+        int32_t partition;
+        int64_t generation; // merge deltas up to and including this generation
+    };
+
+    CriticalSection compactCS;
+    CriticalSection compactQueueCS;
+    std::vector<CompactJob_s> compactQueue;
+    bool compactorRunning = false;
+
+    bool compactPartition(const CompactJob_s& job)
+    {
+        struct Source_s
+        {
+            const char* data;
+            int64_t length;
+        };
+
+        const auto tableName = job.table->getName();
+        const auto fileName = Checkpoint::getPartitionFile(tableName, job.partition);
+        const auto tempName = fileName + ".compact";
+
+        openset::IO::MappedFile base;
+
+        if (!base.map(fileName) || !checkBase(base.getData(), base.getLength(), job.partition))
+        {
+            Logger::get().error("could not compact checkpoint " + fileName + ", base is missing or damaged.");
+            return false;
+        }
+
+        const auto baseHeader = recast<Header_s*>(base.getData());
+
+        // newest copy of each record
+        std::unordered_map<int32_t, Source_s> customers;
+        std::unordered_map<attr_key_s, Source_s> attrs;
+
+        auto customerSlots = baseHeader->customerSlots;
+        auto segment = baseHeader->segment;
+        auto walOffset = baseHeader->walOffset;
+
+        const auto collect = [&](const char* data, int64_t offset, const Header_s* header)
+        {
+            auto end = offset + header->customerBytes;
+
+            while (offset < end)
+            {
+                const auto next = customerRecordEnd(data, offset);
+                const auto person = recast<const PersonData_s*>(data + offset + sizeof(CustomerRecord_s));
+                customers[person->linId] = Source_s{ data + offset, next - offset };
+                offset = next;
+            }
+
+            end = offset + header->attrBytes;
+
+            while (offset < end)
+            {
+                const auto next = attrRecordEnd(data, offset);
+                const auto record = recast<const AttrRecord_s*>(data + offset);
+                attrs[attr_key_s{ record->column, record->hashValue }] = Source_s{ data + offset, next - offset };
+                offset = next;
+            }
+
+            return offset;
+        };
+
+        collect(base.getData(), sizeof(Header_s), baseHeader);
+
+        std::vector<std::unique_ptr<openset::IO::MappedFile>> deltas;
+
+        for (const auto generation : listDeltas(tableName, job.partition))
+        {
+            if (generation <= baseHeader->generation || generation > job.generation)
+                continue;
+
+            deltas.emplace_back(new openset::IO::MappedFile());
+            auto& delta = *deltas.back();
+
+            const auto deltaName = Checkpoint::getDeltaFile(tableName, job.partition, generation);
+
+            if (!delta.map(deltaName))
+            {
+                Logger::get().error("could not compact checkpoint " + fileName + ", could not map " + deltaName);
+                return false;
+            }
+
+            const auto data = delta.getData();
+            int64_t offset = 0;
+
+            while (offset < delta.getLength())
+            {
+                const auto batchBytes = checkBatch(data, delta.getLength(), offset, job.partition);
+
+                if (batchBytes == -1)
+                {
+                    Logger::get().error("could not compact checkpoint " + fileName + ", " + deltaName + " has a torn batch.");
+                    return false;
+                }
+
+                const auto header = recast<const Header_s*>(data + offset);
+                auto read = collect(data, offset + sizeof(Header_s), header);
+
+                const auto linIds = recast<const int32_t*>(data + read);
+
+                for (auto i = 0; i < header->customerDrops; ++i)
+                    customers.erase(linIds[i]);
+
+                const auto dropBytes = header->customerDrops * static_cast<int64_t>(sizeof(int32_t));
+                read += dropBytes + padding(dropBytes, 0);
+
+                const auto attrDrops = recast<const AttrDrop_s*>(data + read);
+
+                for (auto i = 0; i < header->attrDrops; ++i)
+                    attrs.erase(attr_key_s{ attrDrops[i].column, attrDrops[i].hashValue });
+
+                customerSlots = std::max(customerSlots, header->customerSlots);
+                segment = header->segment;
+                walOffset = header->walOffset;
+
+                offset += batchBytes;
+            }
+        }
+
+        const auto file = fopen(tempName.c_str(), "wb");
+
+        if (!file)
+        {
+            Logger::get().error("could not create checkpoint " + tempName);
+            return false;
+        }
+
+        setvbuf(file, nullptr, _IOFBF, 1024 * 1024);
+
+        SnapshotWriter writer(file);
+
+        Header_s header {};
+        header.magic = CHECKPOINT_MAGIC;
+        header.version = CHECKPOINT_VERSION;
+        header.partition = job.partition;
+        header.segment = segment;
+        header.walOffset = walOffset;
+        header.generation = job.generation;
+        header.customerSlots = customerSlots;
+
+        writer.write(&header, sizeof(Header_s));
+
+        // records start and end 8 byte aligned in every file, so they copy as they are
+        std::vector<int32_t> linIds;
+        linIds.reserve(customers.size());
+
+        for (const auto& kv : customers)
+            linIds.push_back(kv.first);
+
+        std::sort(linIds.begin(), linIds.end());
+
+        for (const auto linId : linIds)
+        {
+            const auto& source = customers[linId];
+            writer.write(source.data, source.length);
+            header.customerBytes += source.length;
+            ++header.customerCount;
+        }
+
+        for (const auto& kv : attrs)
+        {
+            writer.write(kv.second.data, kv.second.length);
+            header.attrBytes += kv.second.length;
+            ++header.attrCount;
+        }
+
+        const auto baseBytes = writer.getOffset();
+
+        fseek(file, 0, SEEK_SET);
+        writer.write(&header, sizeof(Header_s));
+
+        syncFile(file);
+        fclose(file);
+
+        if (writer.isFailed())
+        {
+            Logger::get().error("could not write checkpoint " + tempName);
+            openset::IO::File::FileDelete(tempName);
+            return false;
+        }
+
+        {
+            csLock lock(compactCS);
+
+            if (job.state->dropped || job.table->deleted)
+            {
+                openset::IO::File::FileDelete(tempName);
+                return false;
+            }
+
+#ifdef _MSC_VER
+            remove(fileName.c_str());
+#endif
+            rename(tempName.c_str(), fileName.c_str());
+
+            removeDeltas(tableName, job.partition, job.generation);
+        }
+
+        job.state->baseBytes = baseBytes;
+
+        Logger::get().debug(
+            "compacted checkpoint " + tableName + " partition " + to_string(job.partition) +
+            " (" + to_string(header.customerCount) + " customers, " + to_string(header.attrCount) + " indexes).");
+
+        return true;
+    }
+
+    void queueCompaction(CompactJob_s&& job)
+    {
+        csLock lock(compactQueueCS);
+
+        compactQueue.emplace_back(std::move(job));
+
+        if (compactorRunning)
+            return;
+
+        compactorRunning = true;
+
+        std::thread compactor([]()
+        {
+            while (true)
+            {
+                CompactJob_s job;
+
+                {
+                    csLock lock(compactQueueCS);
+
+                    if (!compactQueue.empty())
+                    {
+                        job = std::move(compactQueue.front());
+                        compactQueue.erase(compactQueue.begin());
+                    }
+                }
+
+                if (!job.state)
+                {
+                    ThreadSleep(250);
+                    continue;
+                }
+
+                compactPartition(job);
+                job.state->compacting = false;
+            }
+        });
+
+        compactor.detach();
+    }
+}
+
+bool Checkpoint::isEnabled()
+{
+    return (!globals::running->testMode || globals::running->testCheckpoints) &&
+        globals::running->checkpointInterval > 0;
+}
+
+std::string Checkpoint::getTablePath(const std::string& tableName)
+{
+    return globals::running->path + "checkpoint/" + tableName + "/";
+}
+
+std::string Checkpoint::getPartitionFile(const std::string& tableName, const int32_t partition)
+{
+    return getTablePath(tableName) + to_string(partition) + ".chk";
+}
+
+std::string Checkpoint::getDeltaFile(const std::string& tableName, const int32_t partition, const int64_t generation)
+{
+    return getTablePath(tableName) + to_string(partition) + "." + to_string(generation) + ".delta";
+}
+
+void Checkpoint::saveTable(Table* table)
+{
+    // partitions checkpoint on their own threads, they all share one table.json
+    static CriticalSection saveCS;
+    csLock saveLock(saveCS);
+
+    cjson doc;
+
+    {
+        csLock lock(*table->getLock());
+
+        doc.set("name", table->getName());
+        doc.set("numeric_ids", table->numericCustomerIds);
+        table->serializeTable(doc.setObject("table"));
+        table->serializeSettings(doc.setObject("settings"));
+        table->serializeTriggers(doc.setObject("triggers"));
+    }
+
+    const auto dictionaries = doc.setObject("dictionaries");
+    serializeDictionaries(dictionaries->setObject("customer"), table->customerDictionary);
+
+    // every partition checkpoints the table, it is only written when it changed
+    const auto docHash = MakeHash(cjson::stringify(&doc));
+
+    if (docHash == table->checkpointHash)
+        return;
+
+    openset::IO::Directory::mkdir(globals::running->path + "checkpoint/");
+    openset::IO::Directory::mkdir(getTablePath(table->getName()));
+
+    // dictionaries go first, table.json and the partitions refer to them
+    saveDictionaries(table->getName(), table->customerDictionary);
+
+    const auto fileName = getTablePath(table->getName()) + "table.json";
+    const auto tempName = fileName + ".tmp";
+
+    cjson::toFile(tempName, &doc);
+
+#ifdef _MSC_VER
+    remove(fileName.c_str());
+#endif
+    rename(tempName.c_str(), fileName.c_str());
+
+    table->checkpointHash = docHash;
+}
+
+int64_t Checkpoint::loadTables(Database* database)
+{
+    if (!isEnabled())
+        return 0;
+
+    openset::IO::Directory dir;
+    auto mask = globals::running->path + "checkpoint/*";
+
+    if (!dir.Open(mask))
+        return 0;
+
+    std::vector<std::string> tableNames;
+    std::string fileName;
+
+    auto more = dir.FirstFile(fileName);
+
+    while (more)
+    {
+        if (openset::IO::File::FileExists(getTablePath(fileName) + "table.json"))
+            tableNames.push_back(fileName);
+        more = dir.NextFile(fileName);
+    }
+
+    globals::async->suspendAsync();
+
+    for (const auto& name : tableNames)
+    {
+        cjson doc(getTablePath(name) + "table.json", cjson::Mode_e::file);
+
+        const auto tableName = doc.xPathString("/name", "");
+
+        if (tableName != name)
+        {
+            Logger::get().error("checkpoint for table '" + name + "' is damaged, skipping.");
+            continue;
+        }
+
+        // creating the table creates our partitions, they will find their snapshots
+        const auto table = database->newTable(tableName, doc.xPathBool("/numeric_ids", false));
+
+        // records are decompressed on use, after async resumes
+        loadDictionaries(tableName, doc.xPath("/dictionaries/customer"), table->customerDictionary);
+
+        table->deserializeTable(doc.xPath("/table"));
+        table->deserializeTriggers(doc.xPath("/triggers"));
+
+        if (const auto settings = doc.xPath("/settings"); settings)
+            table->deserializeSettings(settings);
+
+        Logger::get().info("table '" + tableName + "' loaded from checkpoint.");
+    }
+
+    globals::async->resumeAsync();
+
+    return static_cast<int64_t>(tableNames.size());
+}
+
+bool Checkpoint::save(TablePartitioned* parts, const int64_t segment, const int64_t walOffset)
+{
+    auto& state = *parts->checkpoint;
+
+    // the partition may refer to dictionaries (or properties) that are new
+    saveTable(parts->table);
+
+    if (!state.hasBase || state.forceFull)
+    {
+        // a new base replaces every delta, wait for a running merge of them to finish
+        if (state.compacting)
+            return false;
+
+        return savePartition(parts, segment, walOffset);
+    }
+
+    if (!saveDelta(parts, segment, walOffset))
+        return false;
+
+    if (!state.compacting &&
+        state.deltaBytes >= std::max(state.baseBytes / COMPACT_DIVISOR, COMPACT_MIN_BYTES))
+    {
+        // move on to a new delta file, the compactor merges the ones before it
+        state.compacting = true;
+        queueCompaction(CompactJob_s{ parts->table->getSharedPtr(), parts->checkpoint, parts->partition, state.generation });
+
+        ++state.generation;
+        state.deltaBytes = 0;
+    }
+
+    return true;
+}
+
+bool Checkpoint::savePartition(TablePartitioned* parts, const int64_t segment, const int64_t walOffset)
+{
+    const auto table = parts->table;
+    const auto fileName = getPartitionFile(table->getName(), parts->partition);
+    const auto tempName = fileName + ".tmp";
+
+    auto& state = *parts->checkpoint;
+
+    openset::IO::Directory::mkdir(globals::running->path + "checkpoint/");
+    openset::IO::Directory::mkdir(getTablePath(table->getName()));
+
+    const auto file = fopen(tempName.c_str(), "wb");
+
+    if (!file)
+    {
+        Logger::get().error("could not create checkpoint " + tempName);
+        return false;
+    }
+
+    setvbuf(file, nullptr, _IOFBF, 1024 * 1024);
+
+    SnapshotWriter writer(file);
+
+    Header_s header {};
+    header.magic = CHECKPOINT_MAGIC;
+    header.version = CHECKPOINT_VERSION;
+    header.partition = parts->partition;
+    header.segment = segment;
+    header.walOffset = walOffset;
+    header.generation = state.generation; // every delta up to the current one is in this base
+    header.customerSlots = static_cast<int64_t>(parts->people.customerLinear.size());
+
+    // placeholder, the lengths are filled in when we are done
+    writer.write(&header, sizeof(Header_s));
+
+    // customers
+    const auto customerStart = writer.getOffset();
+
+    HeapStack propMem;
+
+    for (const auto person : parts->people.customerLinear)
+    {
+        if (!person)
+            continue;
+
+        writeCustomer(writer, person, propMem);
+        ++header.customerCount;
+    }
+
+    header.customerBytes = writer.getOffset() - customerStart;
+
+    // indexes
+    const auto attrStart = writer.getOffset();
+
+    for (const auto& kv : parts->attributes.propertyIndex)
+    {
+        writeAttr(writer, kv.first, kv.second, parts->attributes.blob);
+        ++header.attrCount;
+    }
+
+    header.attrBytes = writer.getOffset() - attrStart;
+
+    const auto baseBytes = writer.getOffset();
+
+    fseek(file, 0, SEEK_SET);
+    writer.write(&header, sizeof(Header_s));
+
+    syncFile(file);
+    fclose(file);
+
+    if (writer.isFailed())
+    {
+        Logger::get().error("could not write checkpoint " + tempName);
+        openset::IO::File::FileDelete(tempName);
+        return false;
+    }
+
+#ifdef _MSC_VER
+    remove(fileName.c_str());
+#endif
+    rename(tempName.c_str(), fileName.c_str());
+
+    removeDeltas(table->getName(), parts->partition, state.generation);
+
+    state.hasBase = true;
+    state.forceFull = false;
+    state.baseBytes = baseBytes;
+    state.deltaBytes = 0;
+    state.segment = segment;
+    state.walOffset = walOffset;
+    ++state.generation;
+
+    parts->people.changed.clear();
+    parts->attributes.changed.clear();
+
+    return true;
+}
+
+bool Checkpoint::saveDelta(TablePartitioned* parts, const int64_t segment, const int64_t walOffset)
+{
+    auto& state = *parts->checkpoint;
+    auto& people = parts->people;
+    auto& attributes = parts->attributes;
+
+    if (people.changed.empty() && attributes.changed.empty() && segment == state.segment && walOffset == state.walOffset)
+        return true;
+
+    std::vector<char> batch;
+    SnapshotWriter writer(&batch);
+
+    Header_s header {};
+    header.magic = CHECKPOINT_MAGIC;
+    header.version = CHECKPOINT_VERSION;
+    header.partition = parts->partition;
+    header.segment = segment;
+    header.walOffset = walOffset;
+    header.generation = state.generation;
+    header.customerSlots = static_cast<int64_t>(people.customerLinear.size());
+
+    // placeholder, the lengths are filled in when we are done
+    writer.write(&header, sizeof(Header_s));
+
+    std::vector<int32_t> customerDrops;
+    std::vector<AttrDrop_s> attrDrops;
+
+    // customers, changed ones that are gone become tombstones
+    const auto customerStart = writer.getOffset();
+
+    HeapStack propMem;
+
+    for (const auto linId : people.changed)
+    {
+        const auto person = linId < static_cast<int32_t>(people.customerLinear.size()) ?
+            people.customerLinear[linId] :
+            nullptr;
+
+        if (!person)
+        {
+            customerDrops.push_back(linId);
+            continue;
+        }
+
+        writeCustomer(writer, person, propMem);
+        ++header.customerCount;
+    }
+
+    header.customerBytes = writer.getOffset() - customerStart;
+
+    // indexes
+    const auto attrStart = writer.getOffset();
+
+    for (const auto& key : attributes.changed)
+    {
+        const auto attrPair = attributes.propertyIndex.find(key);
+
+        if (attrPair == attributes.propertyIndex.end())
+        {
+            attrDrops.push_back(AttrDrop_s{ key.index, 0, key.value });
+            continue;
+        }
+
+        writeAttr(writer, key, attrPair->second, attributes.blob);
+        ++header.attrCount;
+    }
+
+    header.attrBytes = writer.getOffset() - attrStart;
+
+    // tombstones
+    header.customerDrops = static_cast<int32_t>(customerDrops.size());
+    header.attrDrops = static_cast<int32_t>(attrDrops.size());
+
+    writer.write(customerDrops.data(), customerDrops.size() * sizeof(int32_t));
+    writer.align(0);
+    writer.write(attrDrops.data(), attrDrops.size() * sizeof(AttrDrop_s));
+
+    std::memcpy(batch.data(), &header, sizeof(Header_s));
+
+    Trailer_s trailer { static_cast<int64_t>(batch.size()), MakeHash(batch.data(), batch.size()) };
+    writer.write(&trailer, sizeof(Trailer_s));
+
+    openset::IO::Directory::mkdir(globals::running->path + "checkpoint/");
+    openset::IO::Directory::mkdir(getTablePath(parts->table->getName()));
+
+    const auto fileName = getDeltaFile(parts->table->getName(), parts->partition, state.generation);
+    const auto file = fopen(fileName.c_str(), "ab");
+
+    if (!file)
+    {
+        Logger::get().error("could not open checkpoint " + fileName);
+        return false;
+    }
+
+    const auto written = fwrite(batch.data(), 1, batch.size(), file) == batch.size();
+
+    syncFile(file);
+    fclose(file);
+
+    if (!written)
+    {
+        // anything appended after a torn batch would be unreachable, start over with a full base
+        Logger::get().error("could not write checkpoint " + fileName);
+        state.forceFull = true;
+        return false;
+    }
+
+    state.deltaBytes += static_cast<int64_t>(batch.size());
+    state.segment = segment;
+    state.walOffset = walOffset;
+
+    people.changed.clear();
+    attributes.changed.clear();
+
+    return true;
+}
+
+int64_t Checkpoint::loadPartition(TablePartitioned* parts, int64_t& walOffset)
+{
+    walOffset = -1;
+
+    if (!isEnabled())
+        return -1;
+
+    auto& state = *parts->checkpoint;
+
+    const auto tableName = parts->table->getName();
+    const auto fileName = getPartitionFile(tableName, parts->partition);
+    const auto deltas = listDeltas(tableName, parts->partition);
+
+    // never append to a delta from a previous run, its tail may be torn
+    state.generation = (deltas.empty() ? 0 : deltas.back()) + 1;
+
+    if (!openset::IO::File::FileExists(fileName))
+    {
+        state.forceFull = !deltas.empty();
+        return -1;
+    }
+
+    state.mappings.emplace_back(new openset::IO::MappedFile());
+    auto& mapping = *state.mappings.back();
+
+    if (!mapping.map(fileName) || !checkBase(mapping.getData(), mapping.getLength(), parts->partition))
+    {
+        Logger::get().error("checkpoint " + fileName + " is missing or damaged, skipping.");
+        state.mappings.clear();
+        state.forceFull = true;
+        return -1;
+    }
+
+    const auto data = mapping.getData();
+    const auto header = recast<Header_s*>(data);
+
+    state.generation = std::max(state.generation, header->generation + 1);
+    state.hasBase = true;
+    state.baseBytes = mapping.getLength();
+
+    auto segment = header->segment;
+    walOffset = header->walOffset;
+
+    // base
+    auto& people = parts->people;
+
+    people.customerMap.clear();
+    people.customerLinear.assign(header->customerSlots, nullptr);
+    people.reuse.clear();
+
+    const auto customerStart = static_cast<int64_t>(sizeof(Header_s));
+
+    if (!mapCustomers(people, data, customerStart, customerStart + header->customerBytes, header->customerSlots))
+    {
+        // deltas appended to a truncated base could never restore it, start over with a full base
+        Logger::get().error("checkpoint " + fileName + " has a bad customer record, skipping remainder.");
+        state.forceFull = true;
+    }
+
+    const auto attrStart = customerStart + header->customerBytes;
+
+    mapAttrs(parts->attributes, data, attrStart, attrStart + header->attrBytes);
+
+    // deltas newer than the base, in order. Batches after a torn or damaged
+    // one are not applied, the next checkpoint writes a new base.
+    auto batches = 0;
+
+    for (const auto generation : deltas)
+    {
+        if (generation <= header->generation)
+            continue;
+
+        const auto deltaName = getDeltaFile(tableName, parts->partition, generation);
+
+        state.mappings.emplace_back(new openset::IO::MappedFile());
+        auto& delta = *state.mappings.back();
+
+        if (!delta.map(deltaName))
+        {
+            Logger::get().error("could not map checkpoint " + deltaName + ", skipping remainder.");
+            state.forceFull = true;
+            break;
+        }
+
+        const auto deltaData = delta.getData();
+        int64_t offset = 0;
+
+        while (offset < delta.getLength())
+        {
+            const auto batchBytes = checkBatch(deltaData, delta.getLength(), offset, parts->partition);
+
+            if (batchBytes == -1 || !mapBatch(parts, deltaData, offset))
+            {
+                Logger::get().error("checkpoint " + deltaName + " has a torn batch, skipping remainder.");
+                state.forceFull = true;
+                break;
+            }
+
+            segment = recast<Header_s*>(deltaData + offset)->segment;
+            walOffset = recast<Header_s*>(deltaData + offset)->walOffset;
+            state.deltaBytes += batchBytes;
+
+            offset += batchBytes;
+            ++batches;
+        }
+
+        if (state.forceFull)
+            break;
+    }
+
+    for (auto i = 0; i < static_cast<int>(people.customerLinear.size()); ++i)
+    {
+        if (!people.customerLinear[i])
+            people.reuse.push_back(i);
+    }
+
+    state.segment = segment;
+    state.walOffset = walOffset;
+
+    parts->checkBuckets();
+
+    Logger::get().info(
+        "mapped checkpoint for " + tableName + " partition " + to_string(parts->partition) +
+        " (" + to_string(people.customerMap.size()) + " customers, " +
+        to_string(parts->attributes.propertyIndex.size()) + " indexes, " +
+        to_string(batches) + " delta batches).");
+
+    return segment;
+}
+
+void Checkpoint::dropPartition(TablePartitioned* parts)
+{
+    if (!isEnabled())
+        return;
+
+    const auto tableName = parts->table->getName();
+
+    csLock lock(compactCS);
+
+    parts->checkpoint->dropped = true;
+
+    openset::IO::File::FileDelete(getPartitionFile(tableName, parts->partition));
+    removeDeltas(tableName, parts->partition, std::numeric_limits<int64_t>::max());
+}
+
+void Checkpoint::dropTable(const std::string& tableName)
+{
+    if (!isEnabled())
+        return;
+
+    csLock lock(compactCS);
+
+    openset::IO::Directory dir;
+    auto mask = getTablePath(tableName) + "*";
+
+    if (!dir.Open(mask))
+        return;
+
+    std::string fileName;
+    auto more = dir.FirstFile(fileName);
+
+    while (more)
+    {
+        openset::IO::File::FileDelete(getTablePath(tableName) + fileName);
+        more = dir.NextFile(fileName);
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include "common.h"
+#include "file/file.h"
+
+namespace openset::db
+{
+    class Database;
+    class Table;
+    class TablePartitioned;
+
+    // checkpoint bookkeeping for one partition, owned by the TablePartitioned
+    // and shared with the compactor while it merges the partition's files
+    struct CheckpointState_s
+    {
+        // mapped base and delta files, customers and indexes may point into them
+        std::vector<std::unique_ptr<openset::IO::MappedFile>> mappings;
+
+        int64_t generation { 1 };  // delta file currently appended to
+        int64_t segment { -1 };    // write ahead log segment of the last write
+        int64_t walOffset { -1 };  // offset in `segment` of the last event written, -1 for none
+        int64_t deltaBytes { 0 };  // bytes written to deltas since the last base
+        std::atomic<int64_t> baseBytes { 0 };
+
+        bool hasBase { false };
+        bool forceFull { false };  // partition was replaced wholesale (i.e. a transfer)
+        bool dropped { false };    // guarded by the compactor lock
+
+        std::atomic<bool> compacting { false };
+    };
+
+    /*
+     * Checkpoint - table definitions and partition snapshots on disk
+     *
+     *   <data path>/checkpoint/<table>/table.json              - properties, settings, triggers
+     *   <data path>/checkpoint/<table>/<partition>.chk         - base snapshot
+     *   <data path>/checkpoint/<table>/<partition>.<gen>.delta - changes since the base
+     *
+     * A partition snapshot is laid out to be used in place. Each customer
+     * (PersonData_s), customer props blob and index (Attr_s) record is preceded by
+     * a PoolMem header marked MemConstants::PoolMemExternal, so after the file
+     * is mapped `customerLinear` and `propertyIndex` point straight into the
+     * mapping. When a mapped record is later replaced its PoolMem::freePtr is
+     * ignored, the pages go when the partition (and its mappings) is released.
+     *
+     * The first checkpoint of a partition writes a full base. After that only
+     * customers and indexes that changed (Customers::changed, Attributes::changed)
+     * are written, as a batch appended to the current delta file. Each batch
+     * carries the records that changed, tombstones for the ones that were
+     * dropped, and a trailer (length and hash) so a torn batch is detected
+     * on load. Records in a batch use the same layout as the base and are
+     * mapped in place the same way.
+     *
+     * When the deltas grow to half the size of the base the partition moves
+     * on to a new delta file and the compactor thread merges the base and the
+     * older deltas into a new base (newest record wins). Bases are written to
+     * a temp file and renamed into place, mappings of the previous files remain
+     * valid after the rename.
+     *
+     * Each base and batch records the oldest write ahead log segment the
+     * partition still needs, the SideLog keeps that segment (and later ones)
+     * until the next checkpoint. With it goes the offset of the last event in
+     * that segment the snapshot holds, after a restart the partition resumes
+     * reading the replayed log just past it.
+     */
+    class Checkpoint
+    {
+    public:
+
+        static bool isEnabled();
+
+        static std::string getTablePath(const std::string& tableName);
+        static std::string getPartitionFile(const std::string& tableName, const int32_t partition);
+        static std::string getDeltaFile(const std::string& tableName, const int32_t partition, const int64_t generation);
+
+        // write table.json (and the dictionaries it lists) for a table, only
+        // when the schema, settings, triggers or dictionaries have changed
+        // since it was last written. Called by `save`.
+        static void saveTable(Table* table);
+
+        // create the tables found on disk, partitions belonging to
+        // this node will map their snapshots as they are created.
+        // Returns the number of tables loaded.
+        static int64_t loadTables(Database* database);
+
+        // checkpoint a partition, writes a base or a delta as needed and queues
+        // compaction when the deltas get large. `segment` is the oldest write
+        // ahead log segment holding events that are not in the partition, and
+        // `walOffset` the offset in it of the last event that is (-1 for none).
+        static bool save(TablePartitioned* parts, const int64_t segment, const int64_t walOffset);
+
+        // full snapshot of a partition
+        static bool savePartition(TablePartitioned* parts, const int64_t segment, const int64_t walOffset);
+
+        // append the changes since the last checkpoint to the current delta file
+        static bool saveDelta(TablePartitioned* parts, const int64_t segment, const int64_t walOffset);
+
+        // map the base snapshot and deltas into an empty partition, returns the
+        // write ahead log segment of the newest batch applied (and its offset in
+        // `walOffset`), or -1 if there was no snapshot
+        static int64_t loadPartition(TablePartitioned* parts, int64_t& walOffset);
+
+        static void dropPartition(TablePartitioned* parts);
+        static void dropTable(const std::string& tableName);
+    };
+}
@@ -0,0 +1,166 @@
+#include "coldstore.h"
+
+#include "config.h"
+#include "grid.h"
+#include "file/file.h"
+#include "file/directory.h"
+#include "sba/sba.h"
+
+using namespace openset::db;
+
+ColdStore::ColdStore(const int32_t partition) :
+    partition(partition)
+{}
+
+ColdStore::~ColdStore()
+{
+    while (!chunks.empty())
+        removeChunk(chunks.size() - 1);
+}
+
+std::string ColdStore::chunkName(const int64_t chunk) const
+{
+    return path + to_string(partition) + "." + to_string(chunk) + ".cold";
+}
+
+void ColdStore::removeChunk(const size_t index)
+{
+    chunks[index].mapping->unmap();
+    openset::IO::File::FileDelete(chunkName(chunks[index].chunk));
+    chunks.erase(chunks.begin() + index);
+}
+
+void ColdStore::open(const std::string& tableName)
+{
+    path = globals::running->path + "cold/" + tableName + "/";
+
+    openset::IO::Directory dir;
+    auto mask = path + "*";
+
+    if (!dir.Open(mask))
+        return;
+
+    const auto prefix = to_string(partition) + ".";
+
+    std::string fileName;
+    auto more = dir.FirstFile(fileName);
+
+    while (more)
+    {
+        long long chunk;
+
+        if (fileName.compare(0, prefix.length(), prefix) == 0 &&
+            sscanf(fileName.c_str() + prefix.length(), "%lld.cold", &chunk) == 1)
+            openset::IO::File::FileDelete(path + fileName);
+
+        more = dir.NextFile(fileName);
+    }
+}
+
+std::vector<PersonData_s*> ColdStore::store(const std::vector<PersonData_s*>& people)
+{
+    std::vector<PersonData_s*> result;
+
+    if (people.empty())
+        return result;
+
+    openset::IO::Directory::mkdir(globals::running->path + "cold/");
+    openset::IO::Directory::mkdir(path);
+
+    const auto chunk = nextChunk++;
+    const auto fileName = chunkName(chunk);
+    const auto file = fopen(fileName.c_str(), "wb");
+
+    if (!file)
+    {
+        Logger::get().error("could not create cold chunk " + fileName);
+        return result;
+    }
+
+    setvbuf(file, nullptr, _IOFBF, 1024 * 1024);
+
+    // records are [padding][PoolMem header][PersonData_s], with PersonData_s 8 byte aligned
+    const char zeros[8] = {};
+    const auto poolIndex = MemConstants::PoolMemExternal;
+
+    std::vector<int64_t> offsets;
+    offsets.reserve(people.size());
+
+    int64_t offset = 0;
+    auto failed = false;
+
+    for (const auto person : people)
+    {
+        const auto size = person->size();
+        const auto padding = (8 - (size % 8)) % 8;
+
+        failed |= fwrite(zeros, 1, 4, file) != 4;
+        failed |= fwrite(&poolIndex, 1, sizeof(int32_t), file) != sizeof(int32_t);
+        failed |= fwrite(person, 1, size, file) != static_cast<size_t>(size);
+        failed |= fwrite(zeros, 1, padding, file) != static_cast<size_t>(padding);
+
+        offsets.push_back(offset + 8);
+        offset += 8 + size + padding;
+    }
+
+    fclose(file);
+
+    auto mapping = std::make_unique<openset::IO::MappedFile>();
+
+    if (failed || !mapping->map(fileName))
+    {
+        Logger::get().error("could not write cold chunk " + fileName);
+        openset::IO::File::FileDelete(fileName);
+        return result;
+    }
+
+    result.reserve(people.size());
+
+    for (const auto recordOffset : offsets)
+        result.push_back(recast<PersonData_s*>(mapping->getData() + recordOffset));
+
+    chunks.push_back(Chunk_s{ std::move(mapping), chunk, static_cast<int64_t>(people.size()), offset });
+    evicted += static_cast<int64_t>(people.size());
+
+    return result;
+}
+
+void ColdStore::release(const PersonData_s* person)
+{
+    const auto address = recast<const char*>(person);
+
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        const auto data = chunks[i].mapping->getData();
+
+        if (address < data || address >= data + chunks[i].mapping->getLength())
+            continue;
+
+        ++released;
+
+        if (--chunks[i].records == 0)
+            removeChunk(i);
+
+        return;
+    }
+}
+
+int64_t ColdStore::getColdCount() const
+{
+    int64_t count = 0;
+
+    for (const auto& chunk : chunks)
+        count += chunk.records;
+
+    return count;
+}
+
+int64_t ColdStore::getColdBytes() const
+{
+    int64_t bytes = 0;
+
+    for (const auto& chunk : chunks)
+        bytes += chunk.bytes;
+
+    return bytes;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "common.h"
+#include "file/file.h"
+
+namespace openset::db
+{
+    struct PersonData_s;
+
+    /*
+     * ColdStore - customers that have been paged out of PoolMem
+     *
+     *   <data path>/cold/<table>/<partition>.<chunk>.cold
+     *
+     * Each eviction writes the selected PersonData_s records (already LZ4
+     * compressed) to a new chunk file and maps it. Every record in a chunk is
+     * preceded by a PoolMem header marked MemConstants::PoolMemExternal, so
+     * `customerLinear` points straight into the mapping and nothing else in
+     * the engine needs to know a customer is cold. When an insert or a query
+     * mounts a cold customer the OS faults its pages back in, and when the
+     * customer is next committed it gets a new PoolMem record and the cold
+     * copy is released.
+     *
+     * Chunks are unmapped and deleted once none of their records are
+     * referenced. Chunks are a cache, durable copies of customers live in the
+     * checkpoint and write ahead log, so chunks left by a previous run are
+     * deleted on open.
+     */
+    class ColdStore
+    {
+        struct Chunk_s
+        {
+            std::unique_ptr<openset::IO::MappedFile> mapping;
+            int64_t chunk;
+            int64_t records; // records still referenced from customerLinear
+            int64_t bytes;
+        };
+
+        std::string path;
+        int32_t partition;
+        int64_t nextChunk { 1 };
+
+        std::vector<Chunk_s> chunks;
+
+        // LRU statistics
+        int64_t evicted { 0 };  // records paged out since start
+        int64_t released { 0 }; // cold records replaced or dropped since start
+
+        std::string chunkName(const int64_t chunk) const;
+        void removeChunk(const size_t index);
+
+    public:
+        explicit ColdStore(const int32_t partition);
+        ~ColdStore();
+
+        // sets the directory for a table and removes chunks left by a previous run
+        void open(const std::string& tableName);
+
+        // writes `people` to a new chunk, returns the mapped copies in the
+        // same order, or an empty vector if the chunk could not be written
+        std::vector<PersonData_s*> store(const std::vector<PersonData_s*>& people);
+
+        // a record is no longer referenced, ignored unless it lives in a chunk
+        void release(const PersonData_s* person);
+
+        int64_t getChunkCount() const
+        {
+            return static_cast<int64_t>(chunks.size());
+        }
+
+        int64_t getColdCount() const;
+        int64_t getColdBytes() const;
+
+        int64_t getEvicted() const
+        {
+            return evicted;
+        }
+
+        int64_t getReleased() const
+        {
+            return released;
+        }
+    };
+}
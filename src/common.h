@@ -19,7 +19,8 @@ const int32_t MAX_PROPERTIES = 4096;
 enum class serializedBlockType_e : int64_t
 {
 	attributes = 1,
-	people = 2
+	people = 2,
+	dictionaries = 3
 };
 
 /*
@@ -30,7 +30,13 @@ Config::Config(openset::config::CommandlineArgs args) :
 	host(args.hostLocal),
 	port(args.portLocal),
 	hostExternal(args.hostExternal),
-	portExternal(args.portExternal)
+	portExternal(args.portExternal),
+	walSyncInterval(args.walSyncInterval),
+	checkpointInterval(args.checkpointInterval),
+	decodeCacheBytes(args.decodeCacheBytes),
+	indexCacheBytes(args.indexCacheBytes),
+	planCacheSize(args.planCacheSize),
+	opCounts(args.opCounts)
 {
 	globals::running = this;
 	setRootPath(args.path);
@@ -26,6 +26,12 @@ namespace openset
 			std::string hostExternal = "127.0.0.1";
 			int portExternal = 8080;
 			std::string path = "./";
+			int64_t walSyncInterval = 50;
+			int64_t checkpointInterval = 300'000;
+			int64_t decodeCacheBytes = 32LL * 1024LL * 1024LL;
+			int64_t indexCacheBytes = 8LL * 1024LL * 1024LL;
+			bool opCounts = false;
+			int64_t planCacheSize = 64;
 
 			void fix()
 			{
@@ -63,8 +69,28 @@ namespace openset
 			string nodeName{ "empty" };
 			int64_t nodeId{ 0 };
 
+			// write ahead log - max milliseconds between fsyncs (0 = every commit, -1 = never)
+			int64_t walSyncInterval{ 50 };
+			int64_t walSegmentBytes{ 64LL * 1024LL * 1024LL };
+
+			// partition checkpoints - milliseconds between snapshots (0 = disabled)
+			int64_t checkpointInterval{ 300'000 };
+
+			// expanded customers cached by each worker thread - bytes (0 = disabled)
+			int64_t decodeCacheBytes{ 32LL * 1024LL * 1024LL };
+
+			// decoded index bits cached by each partition - bytes (0 = disabled)
+			int64_t indexCacheBytes{ 8LL * 1024LL * 1024LL };
+
+			// compiled scripts cached by each table - entries (0 = disabled)
+			int64_t planCacheSize{ 64 };
+
+			// count executed OSL op codes (and adjacent pairs) for the status call
+			bool opCounts{ false };
+
 			NodeState_e state{ NodeState_e::ready_wait };
 			bool testMode{ false };
+			bool testCheckpoints{ false }; // checkpoints stay on in testMode (checkpoint unit tests)
 			bool existingConfig{ false };
 			
 			explicit Config(openset::config::CommandlineArgs args);
@@ -2,6 +2,7 @@
 #include "table.h"
 #include "logger.h"
 #include "tablepartitioned.h"
+#include "decodecache.h"
 
 using namespace openset::db;
 
@@ -43,6 +44,7 @@ bool Customer::mapTable(Table* tablePtr, int Partition)
     people = &parts->people;
     blob = attributes->getBlob();
 
+    grid.setCustomers(people);
     mapSchemaAll();
 
     return true;
@@ -68,6 +70,7 @@ bool Customer::mapTable(Table* tablePtr, int Partition, vector<string> &columnNa
     people = &parts->people;
     blob = attributes->getBlob();
 
+    grid.setCustomers(people);
     mapSchemaList(columnNames);
 
     return true;
@@ -93,7 +96,24 @@ void Customer::mount(PersonData_s* personData)
 
 void Customer::prepare()
 {
+    const auto record = grid.getMeta();
+
+    if (!record || !record->bytes || !people)
+    {
+        grid.prepare();
+        return;
+    }
+
+    // customers expanded recently on this worker are copied back from its cache
+    auto& cache = DecodeCache::getCache();
+    const DecodeCache::Key_s key { table, partition, record->linId };
+    const auto version = people->getVersion(record->linId);
+
+    if (cache.restore(key, version, &grid))
+        return;
+
     grid.prepare();
+    cache.store(key, version, &grid);
 }
 
 void Customer::insert(cjson* rowData)
@@ -105,5 +125,26 @@ PersonData_s* Customer::commit()
 {
     const auto data = grid.commit();
     people->replaceCustomerRecord(data);
+
+    // the rows just written are what the next prepare of this customer expands
+    if (data && data->bytes)
+        DecodeCache::getCache().store({ table, partition, data->linId }, people->getVersion(data->linId), &grid);
+
+    return data;
+}
+
+bool Customer::append(vector<cjson>& rows)
+{
+    if (!grid.append(rows))
+        return false;
+
+    people->replaceCustomerRecord(grid.getMeta());
+    return true;
+}
+
+PersonData_s* Customer::fold()
+{
+    const auto data = grid.fold();
+    people->replaceCustomerRecord(data);
     return data;
 }
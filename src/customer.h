@@ -116,6 +116,21 @@ namespace openset
 			 */
 			PersonData_s* commit();
 
+			/**
+			 * \brief append JSON rows to a mounted Customer without re-encoding
+			 *        its history (see Grid::append)
+			 *
+			 * \return false if the rows were not all newer than the Customer's
+			 *         last event, call prepare, insert and commit instead.
+			 */
+			bool append(vector<cjson>& rows);
+
+			/**
+			 * \brief re-encode a prepared Customer, folding appended rows into
+			 *        its columns. Updates Table.people like commit.
+			 */
+			PersonData_s* fold();
+
 		private:
 			/**
 			* map the entire schema to the Customer.grid object, called by
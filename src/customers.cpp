@@ -1,18 +1,28 @@
 #include "customers.h"
+#include "dictionary.h"
 #include "heapstack/heapstack.h"
 #include "sba/sba.h"
 
+#include <atomic>
+
 using namespace openset::db;
 
 Customers::Customers(const int partition) :
     //customerMap(ringHint_e::lt_5_million),
-    partition(partition)
+    partition(partition),
+    cold(partition)
 {}
 
 Customers::~Customers()
 {
     for (const auto &person: customerLinear)
+    {
+        if (!person) // dropped customers leave empty slots
+            continue;
+
+        Dictionaries::release(person->getDictionaryId());
         PoolMem::getPool().freePtr(person);
+    }
 }
 
 PersonData_s* Customers::getCustomerByID(int64_t userId)
@@ -20,7 +30,10 @@ PersonData_s* Customers::getCustomerByID(int64_t userId)
     int32_t linId;
 
     if (const auto entry = customerMap.find(userId); entry != customerMap.end())
+    {
+        touch(entry->second);
         return getCustomerByLIN(entry->second);
+    }
 
     return nullptr;
 }
@@ -82,6 +95,8 @@ PersonData_s* Customers::createCustomer(int64_t userId)
             customerLinear.push_back(newUser);
 
         customerMap[userId] = newUser->linId;
+        markChanged(newUser->linId);
+        touch(newUser->linId);
 
         return newUser;
     }
@@ -130,6 +145,8 @@ PersonData_s* Customers::createCustomer(string userIdString)
                 customerLinear.push_back(newUser);
 
             customerMap[hashId] = newUser->linId;
+            markChanged(newUser->linId);
+            touch(newUser->linId);
 
             return newUser;
         }
@@ -146,7 +163,26 @@ PersonData_s* Customers::createCustomer(string userIdString)
 void Customers::replaceCustomerRecord(PersonData_s* newRecord)
 {
     if (newRecord && customerLinear[newRecord->linId] != newRecord)
+    {
+        // the old record has been freed, if it was cold its chunk can let it go
+        cold.release(customerLinear[newRecord->linId]);
+
         customerLinear[newRecord->linId] = newRecord;
+        markChanged(newRecord->linId);
+        touch(newRecord->linId);
+        bumpVersion(newRecord->linId);
+    }
+}
+
+void Customers::bumpVersion(const int32_t linId)
+{
+    // versions come from one counter so a linId reused by another partition
+    // object (i.e. after a transfer) doesn't repeat a version
+    static std::atomic<uint32_t> nextVersion { 0 };
+
+    if (linId >= static_cast<int32_t>(versions.size()))
+        versions.resize(linId + 1, 0);
+    versions[linId] = ++nextVersion;
 }
 
 int64_t Customers::customerCount() const
@@ -164,12 +200,38 @@ void Customers::drop(const int64_t userId)
     //customerMap.erase(userId);
 
     customerLinear[info->linId] = nullptr;
+    markChanged(info->linId);
+    bumpVersion(info->linId);
 
     reuse.push_back(info->linId);
 
+    cold.release(info);
+    Dictionaries::release(info->getDictionaryId());
     PoolMem::getPool().freePtr(info);
 }
 
+int64_t Customers::evict(const vector<int32_t>& linIds)
+{
+    vector<PersonData_s*> people;
+    people.reserve(linIds.size());
+
+    for (const auto linId : linIds)
+        people.push_back(customerLinear[linId]);
+
+    const auto coldPeople = cold.store(people);
+
+    if (coldPeople.empty())
+        return 0;
+
+    for (size_t i = 0; i < linIds.size(); ++i)
+    {
+        customerLinear[linIds[i]] = coldPeople[i];
+        PoolMem::getPool().freePtr(people[i]);
+    }
+
+    return static_cast<int64_t>(linIds.size());
+}
+
 void Customers::serialize(HeapStack* mem)
 {
     // grab 8 bytes, and set the block type at that address
@@ -214,6 +276,7 @@ int64_t Customers::deserialize(char* mem)
     customerLinear.clear();
     customerLinear.reserve(sectionLength);
     reuse.clear();
+    touched.clear();
 
     // end is the length of the block after the 16 bytes of header
     const auto end = read + sectionLength;
@@ -233,6 +296,7 @@ int64_t Customers::deserialize(char* mem)
         // index this customer
         customerLinear[customer->linId] = customer;
         customerMap[customer->id] = customer->linId;
+        Dictionaries::retain(customer->getDictionaryId());
 
         // next block please
         read += size;
@@ -244,6 +308,8 @@ int64_t Customers::deserialize(char* mem)
             reuse.push_back(i);
     }
 
+    // everyone we received counts as just touched
+    touched.assign(customerLinear.size(), static_cast<uint32_t>(Now() / 1000));
 
     return sectionLength + 16;
 }
@@ -7,8 +7,14 @@
 #include "robin_hood.h"
 #include "mem/blhash.h"
 #include "grid.h"
+#include "coldstore.h"
 
 #include <vector>
+#include <unordered_set>
+
+#ifdef _MSC_VER
+#include <xmmintrin.h>
+#endif
 
 using namespace std;
 
@@ -25,6 +31,22 @@ namespace openset
             vector<PersonData_s*> customerLinear;
             vector<int32_t> reuse;
             int partition;
+
+            // linIds of customers created, replaced or dropped since the last
+            // checkpoint, only tracked when `trackChanges` is set
+            std::unordered_set<int32_t> changed;
+            bool trackChanges { false };
+
+            // last time (in seconds) each customer was looked up by id, created
+            // or replaced. Scans by linId (queries, segments) don't count.
+            vector<uint32_t> touched;
+
+            // changes whenever a customer's record is replaced or dropped, rows
+            // cached from a record (DecodeCache) are valid for one version
+            vector<uint32_t> versions;
+
+            // customers paged out of PoolMem
+            ColdStore cold;
         public:
             explicit Customers(int partition);
             ~Customers();
@@ -33,6 +55,29 @@ namespace openset
             PersonData_s* getCustomerByID(const string& userIdString);
             PersonData_s* getCustomerByLIN(const int64_t linId);
 
+            // how far ahead of the customer being run scans prefetch records
+            static const int64_t PREFETCH_AHEAD = 4;
+
+            // start loading the head of a customer's record into cache, so a
+            // scan can overlap the memory wait with running the one before it
+            void prefetch(const int64_t linId) const
+            {
+                if (linId < 0 || linId >= static_cast<int64_t>(customerLinear.size()))
+                    return;
+
+                const auto record = recast<const char*>(customerLinear[linId]);
+
+                if (!record)
+                    return;
+#ifdef _MSC_VER
+                _mm_prefetch(record, _MM_HINT_T0);
+                _mm_prefetch(record + 64, _MM_HINT_T0);
+#else
+                __builtin_prefetch(record);
+                __builtin_prefetch(record + 64);
+#endif
+            }
+
             // will return a "found" customer if one exists
             // or create a new one
             PersonData_s* createCustomer(int64_t userId);
@@ -44,6 +89,34 @@ namespace openset
 
             void drop(const int64_t userId);
 
+            void markChanged(const int32_t linId)
+            {
+                if (trackChanges)
+                    changed.insert(linId);
+            }
+
+            void touch(const int32_t linId)
+            {
+                if (linId >= static_cast<int32_t>(touched.size()))
+                    touched.resize(linId + 1, 0);
+                touched[linId] = static_cast<uint32_t>(Now() / 1000);
+            }
+
+            uint32_t getTouched(const int32_t linId) const
+            {
+                return linId < static_cast<int32_t>(touched.size()) ? touched[linId] : 0;
+            }
+
+            void bumpVersion(const int32_t linId);
+
+            uint32_t getVersion(const int32_t linId) const
+            {
+                return linId < static_cast<int32_t>(versions.size()) ? versions[linId] : 0;
+            }
+
+            // move customers to a new cold chunk, returns the number moved
+            int64_t evict(const vector<int32_t>& linIds);
+
             void serialize(HeapStack* mem);
             int64_t deserialize(char* mem);
         };
@@ -3,6 +3,8 @@
 #include "database.h"
 #include "config.h"
 #include "asyncpool.h"
+#include "checkpoint.h"
+#include "sidelog.h"
 
 namespace openset
 {
@@ -62,6 +64,9 @@ void Database::dropTable(const std::string& tableName)
     csLock lock(cs);
     tables.erase(tableName);
     openset::globals::async->resumeAsync();
+
+    SideLog::getSideLog().removeReadHeadsByTable(table->getTableHash());
+    Checkpoint::dropTable(tableName);
 }
 
 std::vector<std::string> Database::getTableNames()
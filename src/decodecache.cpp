@@ -0,0 +1,80 @@
+#include "decodecache.h"
+
+#include "config.h"
+#include "grid.h"
+
+using namespace openset::db;
+
+DecodeCache::Cache::Stats_s DecodeCache::stats;
+
+DecodeCache& DecodeCache::getCache()
+{
+    thread_local DecodeCache cache;
+    return cache;
+}
+
+bool DecodeCache::restore(const Key_s& key, const uint32_t version, Grid* grid)
+{
+    const auto rows = cache.get(key);
+
+    if (!rows)
+    {
+        cache.miss();
+        return false;
+    }
+
+    // the record changed since it was cached
+    if (rows->version != version || rows->record != grid->getMeta())
+    {
+        cache.erase(key);
+        cache.miss();
+        return false;
+    }
+
+    // the cached rows may not have every property this grid maps
+    if (!grid->importRows(rows->properties, rows->values, rows->rowCount, rows->sets))
+    {
+        cache.miss();
+        return false;
+    }
+
+    cache.hit();
+
+    return true;
+}
+
+void DecodeCache::store(const Key_s& key, const uint32_t version, const Grid* grid)
+{
+    const auto budget = globals::running ? globals::running->decodeCacheBytes : 0;
+
+    if (budget <= 0)
+        return;
+
+    std::vector<int32_t> properties;
+    std::vector<int64_t> values;
+    std::vector<int64_t> sets;
+
+    grid->exportRows(properties, values, sets);
+
+    const auto bytes = static_cast<int64_t>(
+        sizeof(Rows_s) +
+        properties.size() * sizeof(int32_t) +
+        (values.size() + sets.size()) * sizeof(int64_t));
+
+    const auto rows = cache.store(key, bytes, budget);
+
+    if (!rows)
+        return;
+
+    rows->version = version;
+    rows->record = grid->getMeta();
+    rows->rowCount = grid->getColumns()->rowCount;
+    rows->properties = std::move(properties);
+    rows->values = std::move(values);
+    rows->sets = std::move(sets);
+}
+
+void DecodeCache::clear()
+{
+    cache.clear();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+
+#include "common.h"
+#include "robin_hood.h"
+#include "lrucache.h"
+
+namespace openset::db
+{
+    class Table;
+    class Grid;
+    struct PersonData_s;
+
+    /*
+     * DecodeCache - customers expanded recently on this worker thread
+     *
+     * onInsert segments, customer lookups and back to back queries expand the
+     * same customers again and again. Customer::prepare keeps a copy of the rows
+     * it expands here, keyed by table, partition and linId, and valid for one
+     * record version (Customers::getVersion). A later prepare of the same record
+     * copies the rows back instead of decompressing, provided the cached rows
+     * hold every property the grid maps.
+     *
+     * Each worker has its own cache (no locking), the least recently used
+     * customers go when it holds more than Config::decodeCacheBytes (see
+     * LruCache).
+     */
+    class DecodeCache
+    {
+    public:
+        struct Key_s
+        {
+            const Table* table;
+            int32_t partition;
+            int32_t linId;
+
+            bool operator==(const Key_s& other) const
+            {
+                return table == other.table && partition == other.partition && linId == other.linId;
+            }
+        };
+
+    private:
+        struct KeyHash_s
+        {
+            size_t operator()(const Key_s& key) const
+            {
+                return robin_hood::hash_int(
+                    reinterpret_cast<uintptr_t>(key.table) ^
+                    (static_cast<uint64_t>(key.partition) << 32) ^
+                    static_cast<uint32_t>(key.linId));
+            }
+        };
+
+        struct Rows_s
+        {
+            uint32_t version;
+            const PersonData_s* record;
+            int64_t rowCount;
+            std::vector<int32_t> properties;
+            std::vector<int64_t> values;
+            std::vector<int64_t> sets;
+        };
+
+        using Cache = LruCache<Key_s, Rows_s, KeyHash_s>;
+
+        static Cache::Stats_s stats;
+
+        Cache cache { stats };
+
+    public:
+        DecodeCache() = default;
+
+        // the cache for the calling thread
+        static DecodeCache& getCache();
+
+        // expand a mounted (not prepared) customer from the cache, false on a miss
+        bool restore(const Key_s& key, const uint32_t version, Grid* grid);
+
+        // remember the rows of a prepared customer
+        void store(const Key_s& key, const uint32_t version, const Grid* grid);
+
+        void clear();
+
+        static int64_t getHits() { return stats.hits; }
+        static int64_t getMisses() { return stats.misses; }
+        static int64_t getBytes() { return stats.bytes; }
+    };
+}
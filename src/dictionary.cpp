@@ -0,0 +1,449 @@
+#include "dictionary.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "robin_hood.h"
+
+using namespace openset::db;
+
+namespace
+{
+    CriticalSection registryCS;
+    std::unordered_map<int32_t, std::shared_ptr<const Dictionary_s>> registry;
+    std::unordered_map<int32_t, int64_t> uses; // records per dictionary id, may precede registration
+
+    // training works on k-grams (byte sequences of GRAM_BYTES) and picks
+    // SEGMENT_BYTES long segments of the samples for the dictionary
+    const int32_t GRAM_BYTES = 8;
+    const int32_t SEGMENT_BYTES = 64;
+
+    uint64_t gramAt(const char* data)
+    {
+        uint64_t gram;
+        memcpy(&gram, data, sizeof(uint64_t));
+        return gram * 0x9E3779B97F4A7C15ULL;
+    }
+
+    struct Segment_s
+    {
+        const char* data;
+        int32_t length;
+        int64_t score;
+    };
+
+    // dictionary content for `samples`: the segments containing the byte
+    // sequences shared by the most samples, empty if there are none
+    std::vector<char> trainDictionary(const std::vector<char>& samples, const std::vector<int32_t>& sampleLengths)
+    {
+        // count the samples each k-gram appears in
+        robin_hood::unordered_map<uint64_t, int32_t> gramSamples;
+        std::unordered_set<uint64_t> seen;
+
+        auto offset = 0;
+
+        for (const auto length : sampleLengths)
+        {
+            const auto sample = samples.data() + offset;
+            seen.clear();
+
+            for (auto i = 0; i + GRAM_BYTES <= length; ++i)
+                if (const auto gram = gramAt(sample + i); seen.insert(gram).second)
+                    ++gramSamples[gram];
+
+            offset += length;
+        }
+
+        // score segments by the grams in them that other samples share
+        const auto score = [&](const char* data, const int32_t length) -> int64_t
+        {
+            int64_t total = 0;
+            for (auto i = 0; i + GRAM_BYTES <= length; ++i)
+                if (const auto count = gramSamples[gramAt(data + i)]; count > 1)
+                    total += count;
+            return total;
+        };
+
+        std::vector<Segment_s> segments;
+        offset = 0;
+
+        for (const auto length : sampleLengths)
+        {
+            const auto sample = samples.data() + offset;
+            offset += length;
+
+            // short samples are taken whole
+            if (length <= SEGMENT_BYTES)
+            {
+                if (const auto total = score(sample, length); total)
+                    segments.push_back(Segment_s{ sample, length, total });
+                continue;
+            }
+
+            for (auto start = 0; start < length; start += SEGMENT_BYTES / 2)
+            {
+                const auto segmentStart = std::min(start, length - SEGMENT_BYTES);
+
+                if (const auto total = score(sample + segmentStart, SEGMENT_BYTES); total)
+                    segments.push_back(Segment_s{ sample + segmentStart, SEGMENT_BYTES, total });
+
+                if (segmentStart != start)
+                    break;
+            }
+        }
+
+        std::sort(
+            segments.begin(),
+            segments.end(),
+            [](const Segment_s& left, const Segment_s& right) -> bool
+            {
+                return left.score > right.score;
+            });
+
+        // take the best segments, skipping those that mostly repeat what was taken already
+        std::vector<const Segment_s*> chosen;
+        std::unordered_set<uint64_t> covered;
+        auto dictionaryBytes = 0;
+
+        for (const auto& segment : segments)
+        {
+            if (dictionaryBytes + segment.length > DictionaryTrainer::DICTIONARY_BYTES)
+                continue;
+
+            int64_t uncovered = 0;
+            for (auto i = 0; i + GRAM_BYTES <= segment.length; ++i)
+                if (const auto gram = gramAt(segment.data + i); !covered.count(gram))
+                    uncovered += std::max(gramSamples[gram] - 1, 0);
+
+            if (uncovered * 2 < segment.score)
+                continue;
+
+            for (auto i = 0; i + GRAM_BYTES <= segment.length; ++i)
+                covered.insert(gramAt(segment.data + i));
+
+            chosen.push_back(&segment);
+            dictionaryBytes += segment.length;
+
+            if (dictionaryBytes + GRAM_BYTES > DictionaryTrainer::DICTIONARY_BYTES)
+                break;
+        }
+
+        if (chosen.empty())
+            return {};
+
+        // the best segments go last, closest to the data being compressed
+        std::vector<char> dictionaryData;
+        dictionaryData.reserve(dictionaryBytes);
+
+        for (auto iter = chosen.rbegin(); iter != chosen.rend(); ++iter)
+            dictionaryData.insert(dictionaryData.end(), (*iter)->data, (*iter)->data + (*iter)->length);
+
+        return dictionaryData;
+    }
+}
+
+std::shared_ptr<const Dictionary_s> Dictionaries::add(const char* data, const int32_t length)
+{
+    if (!data || length <= 0)
+        return nullptr;
+
+    // ids are positive and 0 means "no dictionary"
+    auto id = static_cast<int32_t>(MakeHash(data, length) & 0x7fffffff);
+    if (!id)
+        id = 1;
+
+    csLock lock(registryCS);
+
+    if (const auto iter = registry.find(id); iter != registry.end())
+    {
+        const auto& existing = iter->second->data;
+
+        if (static_cast<int32_t>(existing.size()) == length && !memcmp(existing.data(), data, length))
+            return iter->second;
+
+        Logger::get().error("dictionary " + to_string(id) + " collides with a registered dictionary, refused.");
+        return nullptr;
+    }
+
+    const auto dictionary = std::make_shared<Dictionary_s>();
+    dictionary->id = id;
+    dictionary->data.assign(data, data + length);
+
+    LZ4_initStream(&dictionary->stream, sizeof(LZ4_stream_t));
+    LZ4_loadDict(&dictionary->stream, dictionary->data.data(), length);
+
+    registry.emplace(id, dictionary);
+
+    return dictionary;
+}
+
+std::shared_ptr<const Dictionary_s> Dictionaries::get(const int32_t id)
+{
+    csLock lock(registryCS);
+
+    const auto iter = registry.find(id);
+    return iter == registry.end() ? nullptr : iter->second;
+}
+
+void Dictionaries::retain(const std::shared_ptr<const Dictionary_s>& dictionary)
+{
+    if (!dictionary)
+        return;
+
+    csLock lock(registryCS);
+
+    registry.emplace(dictionary->id, dictionary);
+    ++uses[dictionary->id];
+}
+
+void Dictionaries::retain(const int32_t id)
+{
+    if (!id)
+        return;
+
+    csLock lock(registryCS);
+    ++uses[id];
+}
+
+void Dictionaries::release(const int32_t id)
+{
+    if (!id)
+        return;
+
+    csLock lock(registryCS);
+
+    const auto iter = uses.find(id);
+
+    if (iter == uses.end() || --iter->second > 0)
+        return;
+
+    uses.erase(iter);
+    registry.erase(id);
+}
+
+void Dictionaries::retire(const int32_t id)
+{
+    csLock lock(registryCS);
+
+    if (uses.find(id) == uses.end())
+        registry.erase(id);
+}
+
+int Dictionaries::compress(
+    const Dictionary_s* dictionary,
+    const char* source,
+    char* dest,
+    const int sourceBytes,
+    const int maxBytes,
+    const int acceleration)
+{
+    if (!dictionary)
+        return LZ4_compress_fast(source, dest, sourceBytes, maxBytes, acceleration);
+
+    // a copy of the loaded dictionary stream is cheaper than loading the dictionary again
+    thread_local LZ4_stream_t working;
+    memcpy(&working, &dictionary->stream, sizeof(LZ4_stream_t));
+
+    return LZ4_compress_fast_continue(&working, source, dest, sourceBytes, maxBytes, acceleration);
+}
+
+bool Dictionaries::decompress(
+    const int32_t id,
+    const char* source,
+    char* dest,
+    const int compressedBytes,
+    const int bytes)
+{
+    if (!id)
+        return LZ4_decompress_safe(source, dest, compressedBytes, bytes) == bytes;
+
+    const auto dictionary = get(id);
+
+    if (!dictionary)
+    {
+        Logger::get().error("compression dictionary " + to_string(id) + " is not registered.");
+        return false;
+    }
+
+    return LZ4_decompress_safe_usingDict(
+        source,
+        dest,
+        compressedBytes,
+        bytes,
+        dictionary->data.data(),
+        static_cast<int>(dictionary->data.size())) == bytes;
+}
+
+void Dictionaries::serialize(HeapStack* mem, DictionaryTrainer& trainer)
+{
+    // grab 8 bytes, and set the block type at that address
+    *recast<serializedBlockType_e*>(mem->newPtr(sizeof(int64_t))) = serializedBlockType_e::dictionaries;
+
+    // grab 8 more bytes, this will be the length of the dictionary data within the block
+    const auto sectionLength = recast<int64_t*>(mem->newPtr(sizeof(int64_t)));
+    (*sectionLength) = 0;
+
+    for (const auto id : trainer.getHistory())
+    {
+        const auto dictionary = get(id);
+
+        if (!dictionary)
+            continue;
+
+        const auto length = static_cast<int32_t>(dictionary->data.size());
+
+        *recast<int32_t*>(mem->newPtr(sizeof(int32_t))) = length;
+        memcpy(mem->newPtr(length), dictionary->data.data(), length);
+
+        *sectionLength += sizeof(int32_t) + length;
+    }
+}
+
+int64_t Dictionaries::deserialize(char* mem, DictionaryTrainer& trainer)
+{
+    auto read = mem;
+
+    if (*recast<serializedBlockType_e*>(read) != serializedBlockType_e::dictionaries)
+        return 0;
+
+    read += sizeof(int64_t);
+
+    const auto blockSize = *recast<int64_t*>(read);
+    read += sizeof(int64_t);
+
+    const auto end = read + blockSize;
+
+    while (read < end)
+    {
+        const auto length = *recast<int32_t*>(read);
+        read += sizeof(int32_t);
+
+        if (const auto dictionary = add(read, length); dictionary)
+            trainer.addHistory(dictionary->id);
+
+        read += length;
+    }
+
+    return blockSize + static_cast<int64_t>(sizeof(int64_t) * 2);
+}
+
+void DictionaryTrainer::sample(const char* data, const int32_t length)
+{
+    if (length < GRAM_BYTES || length > MAX_DICTIONARY_INPUT)
+        return;
+
+    // compressors on every partition offer blocks, only the kept ones take the lock
+    if (++offered % SAMPLE_EVERY)
+        return;
+
+    std::vector<char> trainingSamples;
+    std::vector<int32_t> trainingLengths;
+
+    {
+        csLock lock(cs);
+
+        // keep the newer half of the samples when full
+        if (static_cast<int64_t>(samples.size()) + length > MAX_SAMPLE_BYTES)
+        {
+            int64_t dropBytes = 0;
+            const auto dropCount = sampleLengths.size() / 2;
+
+            for (size_t i = 0; i < dropCount; ++i)
+                dropBytes += sampleLengths[i];
+
+            samples.erase(samples.begin(), samples.begin() + dropBytes);
+            sampleLengths.erase(sampleLengths.begin(), sampleLengths.begin() + dropCount);
+        }
+
+        samples.insert(samples.end(), data, data + length);
+        sampleLengths.push_back(length);
+        ++sampled;
+
+        if (training || !((!std::atomic_load(&active) && sampled >= MIN_SAMPLES) || sampled >= RETRAIN_SAMPLES))
+            return;
+
+        // other compressors keep sampling (and committing) while this one trains
+        training = true;
+        sampled = 0;
+        trainingSamples = samples;
+        trainingLengths = sampleLengths;
+    }
+
+    train(trainingSamples, trainingLengths);
+}
+
+void DictionaryTrainer::train(const std::vector<char>& trainingSamples, const std::vector<int32_t>& trainingLengths)
+{
+    const auto dictionaryData = trainDictionary(trainingSamples, trainingLengths);
+
+    if (dictionaryData.empty())
+    {
+        csLock lock(cs);
+        training = false;
+        return;
+    }
+
+    const auto dictionary = Dictionaries::add(dictionaryData.data(), static_cast<int32_t>(dictionaryData.size()));
+
+    // refused, the active dictionary stays until the next training
+    if (!dictionary)
+    {
+        csLock lock(cs);
+        training = false;
+        return;
+    }
+
+    {
+        csLock lock(cs);
+
+        if (std::find(history.begin(), history.end(), dictionary->id) == history.end())
+            history.push_back(dictionary->id);
+
+        training = false;
+    }
+
+    replaceActive(dictionary);
+
+    Logger::get().debug(
+        "trained compression dictionary " + to_string(dictionary->id) + " (" +
+        to_string(dictionaryData.size()) + " bytes from " + to_string(trainingLengths.size()) + " samples).");
+}
+
+void DictionaryTrainer::setActive(const int32_t id)
+{
+    if (const auto dictionary = Dictionaries::get(id); dictionary)
+    {
+        addHistory(id);
+        replaceActive(dictionary);
+    }
+}
+
+void DictionaryTrainer::replaceActive(const std::shared_ptr<const Dictionary_s>& dictionary)
+{
+    const auto previous = std::atomic_exchange(&active, dictionary);
+
+    // a commit still compressing with `previous` registers it again when it retains it
+    if (previous && previous != dictionary)
+        Dictionaries::retire(previous->id);
+}
+
+void DictionaryTrainer::addHistory(const int32_t id)
+{
+    csLock lock(cs);
+
+    if (std::find(history.begin(), history.end(), id) == history.end())
+        history.push_back(id);
+}
+
+std::vector<int32_t> DictionaryTrainer::getHistory()
+{
+    csLock lock(cs);
+
+    // forget dictionaries that were dropped from the registry
+    history.erase(
+        std::remove_if(history.begin(), history.end(), [](const int32_t id) { return !Dictionaries::get(id); }),
+        history.end());
+
+    return history;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <memory>
+
+#include "common.h"
+#include "threads/locks.h"
+#include "lz4.h"
+#include "heapstack/heapstack.h"
+
+namespace openset::db
+{
+    // a trained LZ4 dictionary, immutable once registered
+    struct Dictionary_s
+    {
+        int32_t id;               // hash of the content, recorded with the data it compressed
+        std::vector<char> data;
+        LZ4_stream_t stream;      // `data` loaded with LZ4_loadDict, copied for each compression
+    };
+
+    class DictionaryTrainer;
+
+    /*
+     * Dictionaries - registry of every LZ4 dictionary known to this node
+     *
+     * Dictionary ids are a hash of their content, so a record compressed with
+     * a dictionary can be decompressed on any node (or after a restart) that
+     * has registered the same dictionary, regardless of which table or
+     * partition trained it. Ids are 31 bits, a dictionary whose id is already
+     * held by one with different content is refused rather than registered
+     * under a second id no other node would agree on.
+     *
+     * Customer records count the dictionary they were compressed with
+     * (retain/release), a dictionary is dropped when the last record using it
+     * goes away, or when it is rotated out before any record used it.
+     */
+    class Dictionaries
+    {
+    public:
+        // registers a dictionary (or finds the one with the same content),
+        // nullptr if its id is taken by a dictionary with different content
+        static std::shared_ptr<const Dictionary_s> add(const char* data, const int32_t length);
+
+        // nullptr if `id` has not been registered
+        static std::shared_ptr<const Dictionary_s> get(const int32_t id);
+
+        // a record compressed with `dictionary` was added, registers it again
+        // if it was dropped while the record was being compressed
+        static void retain(const std::shared_ptr<const Dictionary_s>& dictionary);
+
+        // a record compressed with dictionary `id` (0 for none) was added or removed
+        static void retain(const int32_t id);
+        static void release(const int32_t id);
+
+        // drop dictionary `id` if no record uses it
+        static void retire(const int32_t id);
+
+        // LZ4 compress `source` with `dictionary` (plain LZ4 if nullptr)
+        static int compress(
+            const Dictionary_s* dictionary,
+            const char* source,
+            char* dest,
+            const int sourceBytes,
+            const int maxBytes,
+            const int acceleration);
+
+        // decompress data written by `compress` with dictionary `id` (0 for none),
+        // returns false if the dictionary is unknown or the data is damaged
+        static bool decompress(
+            const int32_t id,
+            const char* source,
+            char* dest,
+            const int compressedBytes,
+            const int bytes);
+
+        // append a serializedBlockType_e::dictionaries block holding the
+        // dictionaries a trainer knows about (for partition transfers)
+        static void serialize(HeapStack* mem, DictionaryTrainer& trainer);
+
+        // register the dictionaries in a block made by serialize and add them to
+        // `trainer`, returns the bytes read (0 if `mem` is not a dictionary block)
+        static int64_t deserialize(char* mem, DictionaryTrainer& trainer);
+    };
+
+    /*
+     * DictionaryTrainer - per table sampling, training and rotation of a dictionary
+     *
+     * Compressors offer the raw blocks they are about to compress to `sample`,
+     * every SAMPLE_EVERY'th block is kept. Once enough samples are held a
+     * dictionary is trained from them (the segments containing the byte
+     * sequences shared by the most samples) and becomes active. Training
+     * repeats every RETRAIN_SAMPLES samples so the dictionary follows the
+     * data, earlier dictionaries remain registered for decoding.
+     *
+     * Dictionaries help small blocks most, blocks over MAX_DICTIONARY_INPUT
+     * bytes are compressed without one.
+     */
+    class DictionaryTrainer
+    {
+    public:
+        const static int32_t DICTIONARY_BYTES = 16 * 1024;
+        const static int32_t MAX_DICTIONARY_INPUT = 8 * 1024;
+
+    private:
+        const static int64_t SAMPLE_EVERY = 16;
+        const static int64_t MIN_SAMPLES = 256;
+        const static int64_t RETRAIN_SAMPLES = 16384;
+        const static int32_t MAX_SAMPLE_BYTES = 256 * 1024;
+
+        CriticalSection cs;
+
+        std::vector<char> samples;
+        std::vector<int32_t> sampleLengths;
+        std::atomic<int64_t> offered { 0 }; // counted outside the lock
+        int64_t sampled { 0 };
+        bool training { false }; // a copy of the samples is being trained on
+
+        std::shared_ptr<const Dictionary_s> active; // std::atomic_load/atomic_store
+        std::vector<int32_t> history; // every dictionary this table has trained or loaded
+
+        // compression statistics, bytes before and after
+        std::atomic<int64_t> rawBytes { 0 };
+        std::atomic<int64_t> compBytes { 0 };
+
+        // trains on a copy of the samples, without holding `cs`
+        void train(const std::vector<char>& trainingSamples, const std::vector<int32_t>& trainingLengths);
+
+        // make `dictionary` active, the one it replaces is dropped if no record used it
+        void replaceActive(const std::shared_ptr<const Dictionary_s>& dictionary);
+
+    public:
+        DictionaryTrainer() = default;
+
+        // keeps every SAMPLE_EVERY'th block offered, trains when due
+        void sample(const char* data, const int32_t length);
+
+        // dictionary to compress `length` bytes with, nullptr for none
+        std::shared_ptr<const Dictionary_s> getDictionary(const int32_t length) const
+        {
+            return length <= MAX_DICTIONARY_INPUT ? std::atomic_load(&active) : nullptr;
+        }
+
+        int32_t getActiveId() const
+        {
+            const auto dictionary = std::atomic_load(&active);
+            return dictionary ? dictionary->id : 0;
+        }
+
+        // makes a registered dictionary active (i.e. after loading a checkpoint)
+        void setActive(const int32_t id);
+
+        // remember a registered dictionary as belonging to this table
+        void addHistory(const int32_t id);
+
+        // the dictionaries of this table that are still registered
+        std::vector<int32_t> getHistory();
+
+        void record(const int64_t raw, const int64_t comp)
+        {
+            rawBytes += raw;
+            compBytes += comp;
+        }
+
+        int64_t getRawBytes() const { return rawBytes; }
+        int64_t getCompBytes() const { return compBytes; }
+    };
+}
@@ -1,5 +1,6 @@
 #include "grid.h"
 #include "table.h"
+#include "dictionary.h"
 #include "lz4.h"
 #include "time/epoch.h"
 #include "sba/sba.h"
@@ -7,6 +8,221 @@
 
 using namespace openset::db;
 
+namespace
+{
+    /*
+     * Customer events are stored as independently compressed columns. The
+     * record (PersonData_s) starts with a column directory, so a grid mapped
+     * to a few properties only decompresses the columns it needs:
+     *
+     *   PersonData_s
+     *   id bytes
+     *   ColumnDirectory_s
+     *   int32 dictionary id (COLUMN_DIRECTORY_DICTIONARY only)
+     *   ZoneMap_s (COLUMN_DIRECTORY_ZONED only) - stamps, row count and event
+     *          bloom of the columns and tail
+     *   ColumnEntry_s[columnCount]
+     *   column payloads in directory order, LZ4 compressed (stored as is if
+     *   compression doesn't make them smaller, `comp == bytes`). Columns
+     *   flagged COLUMN_WITH_DICTIONARY were compressed with the table's
+     *   trained dictionary (see Dictionaries) named in the directory.
+     *   tail - events appended since the columns were written (Grid::append)
+     *          as uncompressed rows, see below. Runs to the end of the record.
+     *
+     * A column payload is a presence bitmap (1 bit per row, omitted for
+     * COLUMN_DENSE columns) followed by values in the column's encoding.
+     *
+     * Earlier records hold one LZ4 block instead. An LZ4 block never starts
+     * with a byte below 0x10 (the first sequence always has literals) so the
+     * directory format byte tells them apart. The block holds either
+     *
+     *   columns - COLUMNAR_MARKER, version, varint row count, uint16 column
+     *             count, then per column an int16 property, uint8 encoding,
+     *             varint payload bytes and the payload
+     *
+     *   rows    - Cast_s records ending in a -1 row marker, these start with
+     *             a property index (>= 0) or a row marker
+     *
+     * Both are still read by Grid::prepare and are rewritten with a directory
+     * on their next commit.
+     */
+    const uint8_t COLUMN_DIRECTORY = 1;
+    const uint8_t COLUMN_DIRECTORY_DICTIONARY = 2;
+    const uint8_t COLUMN_DIRECTORY_ZONED = 4; // flag on either format
+
+    // appends fall back to a full re-encode once the tail reaches this multiple of
+    // the table's `tail_fold`, in case folding (OpenLoopFold) falls behind
+    const int64_t TAIL_FOLD_LIMIT = 4;
+
+    const int16_t COLUMNAR_MARKER = -2;
+
+#pragma pack(push,1)
+    struct ColumnDirectory_s
+    {
+        uint8_t format;
+        uint16_t columnCount;
+        int32_t rowCount;
+    };
+
+    struct ColumnEntry_s
+    {
+        int16_t propIndex;
+        uint8_t encoding;   // ColumnEncoding_e (| COLUMN_DENSE)
+        int32_t bytes;      // payload bytes
+        int32_t comp;       // compressed payload bytes
+    };
+#pragma pack(pop)
+
+    enum class ColumnEncoding_e : uint8_t
+    {
+        plain = 0,        // zigzag varint per value
+        deltaOfDelta = 1, // first value, then zigzag varints of the change in delta (stamps)
+        dictionary = 2,   // distinct values, then a varint id per value
+        set = 3           // distinct values, then a varint count and ids per row
+    };
+
+    // flags on the encoding byte, every row has a value so there is no presence
+    // bitmap, and the column was compressed with the directory's dictionary
+    const uint8_t COLUMN_DENSE = 0x80;
+    const uint8_t COLUMN_WITH_DICTIONARY = 0x40;
+
+    bool isDirectory(const char* comp)
+    {
+        const auto format = static_cast<uint8_t>(*comp) & ~COLUMN_DIRECTORY_ZONED;
+        return format == COLUMN_DIRECTORY || format == COLUMN_DIRECTORY_DICTIONARY;
+    }
+
+    struct DirectoryInfo_s
+    {
+        const ColumnDirectory_s* directory;
+        int32_t dictionaryId;
+        const ZoneMap_s* zone; // nullptr if not COLUMN_DIRECTORY_ZONED
+        const ColumnEntry_s* entries;
+        const char* payload; // first column payload
+    };
+
+    DirectoryInfo_s readDirectory(const char* comp)
+    {
+        DirectoryInfo_s info { recast<const ColumnDirectory_s*>(comp), 0, nullptr, nullptr, nullptr };
+        auto read = comp + sizeof(ColumnDirectory_s);
+
+        if ((info.directory->format & ~COLUMN_DIRECTORY_ZONED) == COLUMN_DIRECTORY_DICTIONARY)
+        {
+            info.dictionaryId = *recast<const int32_t*>(read);
+            read += sizeof(int32_t);
+        }
+
+        if (info.directory->format & COLUMN_DIRECTORY_ZONED)
+        {
+            info.zone = recast<const ZoneMap_s*>(read);
+            read += sizeof(ZoneMap_s);
+        }
+
+        info.entries = recast<const ColumnEntry_s*>(read);
+        info.payload = read + info.directory->columnCount * sizeof(ColumnEntry_s);
+
+        return info;
+    }
+
+    // the zone map of the rows in `rows` (which are in stamp order)
+    ZoneMap_s makeZone(const Rows& rows)
+    {
+        ZoneMap_s zone { rows.front()->cols[PROP_STAMP], rows.back()->cols[PROP_STAMP], static_cast<int32_t>(rows.size()), 0 };
+
+        for (const auto row : rows)
+            zone.addEvent(row->cols[PROP_EVENT]);
+
+        return zone;
+    }
+
+    // a column payload, decompressed into `buffer` unless it was stored as is,
+    // nullptr if it can't be decompressed
+    const char* expandColumn(
+        const ColumnEntry_s& entry,
+        const char* compressed,
+        const int32_t dictionaryId,
+        std::vector<char>& buffer)
+    {
+        if (entry.comp == entry.bytes)
+            return compressed;
+
+        if (static_cast<int32_t>(buffer.size()) < entry.bytes)
+            buffer.resize(entry.bytes);
+
+        if (!Dictionaries::decompress(
+            (entry.encoding & COLUMN_WITH_DICTIONARY) ? dictionaryId : 0,
+            compressed,
+            buffer.data(),
+            entry.comp,
+            entry.bytes))
+            return nullptr;
+
+        return buffer.data();
+    }
+
+    uint64_t zigzag(const int64_t value)
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    int64_t unzigzag(const uint64_t value)
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    int varintLength(uint64_t value)
+    {
+        auto length = 1;
+        while (value >= 0x80)
+        {
+            value >>= 7;
+            ++length;
+        }
+        return length;
+    }
+
+    void putVarint(std::vector<char>& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    uint64_t getVarint(const char*& read)
+    {
+        uint64_t value = 0;
+        auto shift = 0;
+
+        while (true)
+        {
+            const auto byte = static_cast<uint8_t>(*read++);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+            if (!(byte & 0x80))
+                return value;
+
+            shift += 7;
+        }
+    }
+
+    // stamp of an inbound event in milliseconds (negative if it can't be parsed)
+    int64_t getEventStamp(cjson* rowData)
+    {
+        const auto stampNode = rowData->xPath("/stamp");
+
+        if (!stampNode)
+            return 0;
+
+        if (stampNode->type() == cjson::Types_e::STR)
+            return Epoch::fixMilli(Epoch::ISO8601ToEpoch(stampNode->getString()));
+
+        return Epoch::fixMilli(stampNode->getInt());
+    }
+}
+
 void IndexDiffing::reset()
 {
     before.clear();
@@ -152,6 +368,11 @@ void IndexDiffing::add(const Grid* grid, Mode_e mode)
                 }
             }
         }
+
+        // rows leaving a day or week may empty its bucket
+        const auto day = stampToDay(r->cols[PROP_STAMP]);
+        add(PROP_DAY, day, mode);
+        add(PROP_WEEK, dayToWeek(day), mode);
     }
 }
 
@@ -169,6 +390,32 @@ void IndexDiffing::iterRemoved(const std::function<void(int32_t, int64_t)>& cb)
             cb(b.first.first, b.first.second);
 }
 
+bool PersonData_s::getZone(ZoneMap_s& zone) const
+{
+    const auto record = events + idBytes;
+
+    if (!comp || !isDirectory(record))
+        return false;
+
+    const auto info = readDirectory(record);
+
+    if (!info.zone)
+        return false;
+
+    memcpy(&zone, info.zone, sizeof(ZoneMap_s));
+    return true;
+}
+
+int32_t PersonData_s::getDictionaryId() const
+{
+    const auto record = events + idBytes;
+
+    if (!comp || !isDirectory(record))
+        return 0;
+
+    return readDirectory(record).dictionaryId;
+}
+
 Grid::~Grid()
 {
     if (propertyMap && table)
@@ -177,6 +424,8 @@ Grid::~Grid()
 
 void Grid::reset()
 {
+    columnsValid = false;
+    rowsValid = true;
     rows.clear(); // release the rows - likely to not free vector internals
     mem.reset();  // release the memory to the pool - will always leave one page
     rawData = nullptr;
@@ -193,6 +442,7 @@ void Grid::reinitialize()
     table = nullptr;
     blob = nullptr;
     attributes = nullptr;
+    people = nullptr;
 }
 
 bool Grid::mapSchema(Table* tablePtr, Attributes* attributesPtr)
@@ -229,6 +479,8 @@ AttributeBlob* Grid::getAttributeBlob() const { return attributes->blob; }
 
 cjson Grid::toJSON()
 {
+    ensureRows();
+
     auto properties = table->getProperties();
     cjson doc;
 
@@ -391,7 +643,7 @@ cjson Grid::toJSON()
     return doc;
 }
 
-Col_s* Grid::newRow()
+Col_s* Grid::newRow() const
 {
     // NOTE: gcc seems to find the for loop below some sort of undefined
     // behavior, and with -o# it compiles incorrectly, it will segfault while
@@ -437,7 +689,11 @@ void Grid::setProps(cvar& var)
     if (var == NONE || var.len() == 0)
     {
         if (rawData->props)
+        {
             PoolMem::getPool().freePtr(rawData->props);
+            if (people)
+                people->markChanged(rawData->linId);
+        }
         rawData->props = nullptr;
         return;
     }
@@ -454,6 +710,9 @@ void Grid::setProps(cvar& var)
         rawData->props = propMem.flatten();
         propMem.reset();
 
+        if (people)
+            people->markChanged(rawData->linId);
+
         diff.iterRemoved(
             [&](const int32_t col, const int64_t val)
             {
@@ -487,24 +746,180 @@ void Grid::prepare()
     if (!propertyMap || !rawData || !rawData->bytes || !propertyMap->propertyCount)
         return;
 
+    columnsValid = false;
+    rowsValid = true;
     setData.clear();
 
+    if (isDirectory(rawData->getComp()))
+    {
+        prepareDirectory();
+        return;
+    }
+
     const auto expandedBytes = cast<char*>(PoolMem::getPool().getPtr(rawData->bytes));
-    LZ4_decompress_fast(rawData->getComp(), expandedBytes, rawData->bytes);
 
+    // records can come from mapped checkpoint and cold files, a damaged one
+    // leaves the grid empty rather than parsing part of a buffer
+    if (!Dictionaries::decompress(0, rawData->getComp(), expandedBytes, rawData->comp, rawData->bytes))
+    {
+        PoolMem::getPool().freePtr(expandedBytes);
+        Logger::get().error("customer record could not be decompressed.");
+        return;
+    }
+
+    if (*recast<int16_t*>(expandedBytes) == COLUMNAR_MARKER)
+        prepareColumns(expandedBytes, expandedBytes + rawData->bytes);
+    else
+        prepareRows(expandedBytes, expandedBytes + rawData->bytes);
+
+    PoolMem::getPool().freePtr(expandedBytes);
+}
+
+const GridColumns_s* Grid::getColumns() const
+{
+    // columns are only invalid when the rows hold the customer
+    if (columnsValid)
+        return &columns;
+
+    const auto rowCount = static_cast<int64_t>(rows.size());
+    const auto propertyCount = propertyMap ? static_cast<int64_t>(propertyMap->propertyCount) : 0;
+
+    const auto stride = rowCount + 1;
+
+    newColumns(rowCount);
+
+    // read each row once, the writes go to propertyCount sequential streams
+    const auto data = columns.data.data();
+
+    for (auto r = 0; r < rowCount; ++r)
+    {
+        const auto row = rows[r]->cols;
+        for (auto c = 0; c < propertyCount; ++c)
+            data[c * stride + r] = row[c];
+    }
+
+    columnsValid = true;
+    return &columns;
+}
+
+void Grid::newColumns(const int64_t rowCount) const
+{
+    const auto propertyCount = propertyMap ? static_cast<int64_t>(propertyMap->propertyCount) : 0;
+    const auto stride = rowCount + 1;
+
+    columns.rowCount = rowCount;
+    columns.data.assign(stride * propertyCount, NONE);
+
+    if (propertyMap && propertyMap->uuidPropIndex != -1 && rawData)
+        std::fill_n(columns.data.data() + propertyMap->uuidPropIndex * stride, rowCount, rawData->id);
+
+    columns.stamps = propertyCount > PROP_STAMP ? columns.column(PROP_STAMP) : nullptr;
+    columns.events = propertyCount > PROP_EVENT ? columns.column(PROP_EVENT) : nullptr;
+}
+
+void Grid::ensureRows() const
+{
+    if (rowsValid)
+        return;
+
+    const auto rowCount = columns.rowCount;
+    const auto propertyCount = static_cast<int64_t>(propertyMap->propertyCount);
+    const auto stride = rowCount + 1;
+    const auto data = columns.data.data();
+
+    newRows(static_cast<int32_t>(rowCount));
+
+    for (auto r = 0; r < rowCount; ++r)
+    {
+        const auto row = rows[r]->cols;
+        for (auto c = 0; c < propertyCount; ++c)
+            row[c] = data[c * stride + r];
+    }
+
+    rowsValid = true;
+}
+
+void Grid::exportRows(vector<int32_t>& properties, vector<int64_t>& values, vector<int64_t>& sets) const
+{
+    properties.clear();
+    values.clear();
+
+    for (auto c = 0; c < propertyMap->propertyCount; ++c)
+        if (c != propertyMap->uuidPropIndex && c != propertyMap->sessionPropIndex)
+            properties.push_back(propertyMap->propertyMap[c]);
+
+    const auto gridColumns = getColumns();
+    values.reserve(gridColumns->rowCount * properties.size());
+
+    for (auto r = 0; r < gridColumns->rowCount; ++r)
+        for (auto c = 0; c < propertyMap->propertyCount; ++c)
+            if (c != propertyMap->uuidPropIndex && c != propertyMap->sessionPropIndex)
+                values.push_back(gridColumns->column(c)[r]);
+
+    sets = setData;
+}
+
+bool Grid::importRows(
+    const vector<int32_t>& properties,
+    const vector<int64_t>& values,
+    const int64_t rowCount,
+    const vector<int64_t>& sets)
+{
+    if (!propertyMap || !rawData || !rows.empty() || !rowsValid)
+        return false;
+
+    // where each grid property is in a row of `values`
+    importMap.assign(propertyMap->propertyCount, -1);
+
+    for (auto c = 0; c < propertyMap->propertyCount; ++c)
+    {
+        if (c == propertyMap->uuidPropIndex || c == propertyMap->sessionPropIndex)
+            continue;
+
+        const auto iter = std::find(properties.begin(), properties.end(), propertyMap->propertyMap[c]);
+
+        if (iter == properties.end())
+            return false;
+
+        importMap[c] = static_cast<int32_t>(iter - properties.begin());
+    }
+
+    setData = sets;
+
+    // like a directory, the customer is expanded into columns
+    newColumns(rowCount);
+    columnsValid = true;
+    rowsValid = false;
+
+    const auto stride = static_cast<int64_t>(properties.size());
+    const auto columnStride = rowCount + 1;
+    const auto data = columns.data.data();
+    auto read = values.data();
+
+    for (auto r = 0; r < rowCount; ++r)
+    {
+        for (auto c = 0; c < propertyMap->propertyCount; ++c)
+            if (importMap[c] != -1)
+                data[c * columnStride + r] = read[importMap[c]];
+        read += stride;
+    }
+
+    numberSessions();
+
+    return true;
+}
+
+void Grid::prepareRows(const char* read, const char* end)
+{
     // make a blank row
     auto row = newRow();
-    // read pointer - will increment through the compacted set
-    auto read = expandedBytes;
-    // end pointer - when we get here we are done
-    const auto end = read + rawData->bytes;
     auto session = 0;
     int64_t lastSessionTime = 0;
     auto properties = table->getProperties();
 
     while (read < end)
     {
-        const auto cursor = reinterpret_cast<Cast_s*>(read);
+        const auto cursor = reinterpret_cast<const Cast_s*>(read);
         /**
         * when we are querying we only need the properties
         * referenced in the query, as such, many properties
@@ -533,14 +948,14 @@ void Grid::prepare()
             if (propInfo->isSet)
             {
                 read += sizeof(int16_t); // += 2
-                const auto count = static_cast<int>(*reinterpret_cast<int16_t*>(read));
+                const auto count = static_cast<int>(*reinterpret_cast<const int16_t*>(read));
                 read += sizeof(int16_t); // += 2
                 const auto startIdx = setData.size();
                 auto counted = 0;
 
                 while (counted < count)
                 {
-                    setData.push_back(*reinterpret_cast<int64_t*>(read));
+                    setData.push_back(*reinterpret_cast<const int64_t*>(read));
                     read += sizeof(int64_t);
                     ++counted;
                 }
@@ -568,109 +983,734 @@ void Grid::prepare()
         else
             read += sizeOfCast;
     }
-    PoolMem::getPool().freePtr(expandedBytes);
 }
 
-PersonData_s* Grid::commit()
+void Grid::prepareDirectory()
 {
+    const auto info = readDirectory(rawData->getComp());
+    const auto rowCount = info.directory->rowCount;
 
-    if (!hasInsert)
-        return rawData;
+    // appended rows always come after the rows in the columns, they are
+    // parsed first so the columns can be sized to hold them as well
+    auto payload = info.payload;
 
-    // this is the worst case scenario temp buffer size for this data.
-    // (properties * rows) + (properties * row headers) + number_of_set_values
-    const auto rowCount = rows.size();
-    const auto tempBufferSize =
-        (rowCount * (propertyMap->propertyCount * sizeOfCast)) +
-        (rowCount * sizeOfCastHeader) + (setData.size() * sizeof(int64_t)) + // the set data
-        ((rowCount * propertyMap->propertyCount) * (sizeOfCastHeader + sizeof(int32_t))); // the NONES at the end of the list
+    for (auto column = 0; column < info.directory->columnCount; ++column)
+        payload += info.entries[column].comp;
 
-    // make an intermediate buffer that is fully uncompressed
-    const auto intermediateBuffer = recast<char*>(PoolMem::getPool().getPtr(tempBufferSize));
-    auto write = intermediateBuffer;
+    const auto end = rawData->getComp() + rawData->comp;
 
-    Cast_s* cursor;
-    auto bytesNeeded = 0;
-    auto properties = table->getProperties();
+    if (payload < end)
+        prepareRows(payload, end);
+
+    const auto tailRows = static_cast<int64_t>(rows.size());
 
-    // lambda to encode and minimize an row
-    const auto pushRow = [&](Row* r)
+    newColumns(rowCount + tailRows);
+    columnsValid = true;
+    rowsValid = false;
+
+    // column payloads follow the directory
+    payload = info.payload;
+
+    for (auto column = 0; column < info.directory->columnCount; ++column)
     {
-        for (auto c = 0; c < propertyMap->propertyCount; ++c)
+        const auto& entry = info.entries[column];
+        const auto compressed = payload;
+        payload += entry.comp;
+
+        // only the properties mapped for this grid are decompressed
+        if (entry.propIndex < 0 ||
+            entry.propIndex >= MAX_PROPERTIES ||
+            propertyMap->reverseMap[entry.propIndex] < 0)
+            continue;
+
+        if (const auto read = expandColumn(entry, compressed, info.dictionaryId, decodeBuffer); read)
+            decodeColumn(entry.propIndex, entry.encoding, read, rowCount);
+    }
+
+    if (tailRows)
+    {
+        const auto stride = columns.rowCount + 1;
+        const auto data = columns.data.data() + rowCount;
+
+        for (auto r = 0; r < tailRows; ++r)
         {
-            const auto actualProperty = propertyMap->propertyMap[c];
+            const auto row = rows[r]->cols;
+            for (auto c = 0; c < propertyMap->propertyCount; ++c)
+                data[c * stride + r] = row[c];
+        }
 
-            // skip NONE values, placeholder (non-event) properties and auto-generated properties (like session)
-            if (r->cols[c] == NONE || (actualProperty >= PROP_INDEX_OMIT_FIRST && actualProperty <= PROP_INDEX_OMIT_LAST))
+        rows.clear();
+    }
+
+    numberSessions();
+}
+
+int64_t Grid::getTailBytes() const
+{
+    if (!rawData || !rawData->comp || !isDirectory(rawData->getComp()))
+        return 0;
+
+    const auto info = readDirectory(rawData->getComp());
+
+    int64_t columnBytes = info.payload - rawData->getComp();
+
+    for (auto column = 0; column < info.directory->columnCount; ++column)
+        columnBytes += info.entries[column].comp;
+
+    return rawData->comp - columnBytes;
+}
+
+int64_t Grid::getLastStamp()
+{
+    const auto info = readDirectory(rawData->getComp());
+
+    if (info.zone)
+        return info.zone->lastStamp;
+    const auto properties = table->getProperties();
+
+    auto payload = info.payload;
+    const char* stampColumn = nullptr;
+    const ColumnEntry_s* stampEntry = nullptr;
+
+    for (auto column = 0; column < info.directory->columnCount; ++column)
+    {
+        if (info.entries[column].propIndex == PROP_STAMP)
+        {
+            stampColumn = payload;
+            stampEntry = &info.entries[column];
+        }
+        payload += info.entries[column].comp;
+    }
+
+    // the newest appended row if there is a tail
+    const auto end = rawData->getComp() + rawData->comp;
+    auto read = payload;
+    int64_t lastStamp = NONE;
+
+    while (read < end)
+    {
+        const auto cursor = recast<const Cast_s*>(read);
+
+        if (cursor->propIndex == -1)
+        {
+            read += sizeOfCastHeader;
+            continue;
+        }
+
+        if (const auto propInfo = properties->getProperty(cursor->propIndex); propInfo && propInfo->isSet)
+        {
+            read += sizeof(int16_t);
+            read += sizeof(int16_t) + *recast<const int16_t*>(read) * sizeof(int64_t);
+            continue;
+        }
+
+        if (cursor->propIndex == PROP_STAMP)
+            lastStamp = cursor->val64;
+
+        read += sizeOfCast;
+    }
+
+    if (lastStamp != NONE || !stampEntry)
+        return lastStamp;
+
+    // otherwise the last value in the stamp column
+    auto stamps = expandColumn(*stampEntry, stampColumn, info.dictionaryId, decodeBuffer);
+
+    if (!stamps)
+        return NONE;
+
+    const auto rowCount = info.directory->rowCount;
+    const auto dense = (stampEntry->encoding & COLUMN_DENSE) != 0;
+    const auto bitmap = recast<const uint8_t*>(stamps);
+
+    if (!dense)
+        stamps += (rowCount + 7) / 8;
+
+    auto first = true;
+    uint64_t value = 0;
+    uint64_t delta = 0;
+
+    for (auto r = 0; r < rowCount; ++r)
+    {
+        if (!dense && !(bitmap[r >> 3] & (1 << (r & 7))))
+            continue;
+
+        if (first)
+        {
+            value = static_cast<uint64_t>(unzigzag(getVarint(stamps)));
+            first = false;
+        }
+        else
+        {
+            delta += static_cast<uint64_t>(unzigzag(getVarint(stamps)));
+            value += delta;
+        }
+    }
+
+    return first ? NONE : static_cast<int64_t>(value);
+}
+
+bool Grid::append(vector<cjson>& events)
+{
+    if (!table->tailFold ||
+        !rawData ||
+        !rawData->bytes ||
+        !isDirectory(rawData->getComp()) ||
+        getTailBytes() >= table->tailFold * TAIL_FOLD_LIMIT)
+        return false;
+
+    // appending keeps the rows in order only if every event is newer than the last
+    auto lastStamp = getLastStamp();
+
+    if (lastStamp == NONE)
+        return false;
+
+    for (auto& event : events)
+    {
+        const auto stamp = getEventStamp(&event);
+
+        if (stamp < 0)
+            continue;
+
+        if (stamp <= lastStamp)
+            return false;
+
+        lastStamp = stamp;
+    }
+
+    setData.clear();
+    columnBuffer.clear();
+
+    const auto properties = table->getProperties();
+
+    ZoneMap_s zone {};
+    const auto hasZone = rawData->getZone(zone);
+
+    for (auto& event : events)
+    {
+        const auto stamp = getEventStamp(&event);
+
+        if (stamp < 0)
+            continue;
+
+        const auto insertRow = newRow();
+        const auto insertType = insertParse(properties, &event, insertRow);
+
+        if (insertType == RowType_e::junk || insertType == RowType_e::prop)
+            continue;
+
+        insertRow->cols[PROP_STAMP] = stamp;
+        indexBuckets(stamp);
+        encodeRow(insertRow, columnBuffer);
+
+        zone.lastStamp = stamp;
+        ++zone.rowCount;
+        zone.addEvent(insertRow->cols[PROP_EVENT]);
+    }
+
+    // the rows were never prepared, there is nothing for commit to do
+    hasInsert = false;
+
+    if (columnBuffer.empty())
+        return true;
+
+    const auto tailBytes = static_cast<int32_t>(columnBuffer.size());
+    const auto newPerson = recast<PersonData_s*>(PoolMem::getPool().getPtr(rawData->size() + tailBytes));
+
+    memcpy(newPerson, rawData, rawData->size());
+    memcpy(recast<char*>(newPerson) + rawData->size(), columnBuffer.data(), tailBytes);
+
+    newPerson->comp += tailBytes;
+    newPerson->bytes += tailBytes;
+
+    // the zone map sits at the same offset in the copy
+    if (hasZone)
+    {
+        const auto info = readDirectory(newPerson->getComp());
+        memcpy(const_cast<ZoneMap_s*>(info.zone), &zone, sizeof(ZoneMap_s));
+    }
+
+    PoolMem::getPool().freePtr(rawData);
+
+    rawData = newPerson;
+    return true;
+}
+
+PersonData_s* Grid::fold()
+{
+    hasInsert = true;
+    return commit();
+}
+
+void Grid::encodeRow(const Row* row, vector<char>& out) const
+{
+    const auto properties = table->getProperties();
+
+    const auto put = [&](const void* data, const size_t length)
+    {
+        out.insert(out.end(), recast<const char*>(data), recast<const char*>(data) + length);
+    };
+
+    for (auto c = 0; c < propertyMap->propertyCount; ++c)
+    {
+        const auto actualProperty = propertyMap->propertyMap[c];
+
+        // skip NONE values, placeholder (non-event) properties and auto-generated properties (like session)
+        if (row->cols[c] == NONE || (actualProperty >= PROP_INDEX_OMIT_FIRST && actualProperty <= PROP_INDEX_OMIT_LAST))
+            continue;
+
+        const auto propInfo = properties->getProperty(actualProperty);
+
+        if (!propInfo)
+            continue;
+
+        const auto propIndex = static_cast<int16_t>(actualProperty);
+
+        if (propInfo->isSet)
+        {
+            // int16_t property, int16_t count, int64_t values[]
+            const auto info = reinterpret_cast<const SetInfo_s*>(&row->cols[c]);
+            const auto count = static_cast<int16_t>(info->length);
+
+            put(&propIndex, sizeof(int16_t));
+            put(&count, sizeof(int16_t));
+            put(setData.data() + info->offset, count * sizeof(int64_t));
+        }
+        else
+        {
+            const Cast_s cursor { propIndex, row->cols[c] };
+            put(&cursor, sizeOfCast);
+        }
+    }
+
+    const int16_t rowEnd = -1;
+    put(&rowEnd, sizeOfCastHeader);
+}
+
+void Grid::prepareColumns(const char* read, const char* end)
+{
+    read += sizeof(int16_t) + sizeof(uint8_t); // marker and version
+
+    const auto rowCount = static_cast<int32_t>(getVarint(read));
+
+    uint16_t columnCount;
+    memcpy(&columnCount, read, sizeof(uint16_t));
+    read += sizeof(uint16_t);
+
+    newColumns(rowCount);
+    columnsValid = true;
+    rowsValid = false;
+
+    for (auto column = 0; column < columnCount && read < end; ++column)
+    {
+        int16_t propIndex;
+        memcpy(&propIndex, read, sizeof(int16_t));
+        read += sizeof(int16_t);
+
+        const auto flags = static_cast<uint8_t>(*read++);
+        const auto payloadBytes = static_cast<int64_t>(getVarint(read));
+
+        decodeColumn(propIndex, flags, read, rowCount);
+
+        read += payloadBytes;
+    }
+
+    numberSessions();
+}
+
+void Grid::newRows(const int32_t rowCount) const
+{
+    rows.reserve(rowCount);
+    for (auto r = 0; r < rowCount; ++r)
+        rows.push_back(newRow());
+}
+
+void Grid::numberSessions()
+{
+    if (propertyMap->sessionPropIndex == -1)
+        return;
+
+    auto session = 0;
+    int64_t lastSessionTime = 0;
+
+    if (!rowsValid)
+    {
+        const auto stride = columns.rowCount + 1;
+        const auto sessions = columns.data.data() + propertyMap->sessionPropIndex * stride;
+
+        for (auto r = 0; r < columns.rowCount; ++r)
+        {
+            if (columns.stamps[r] - lastSessionTime > sessionTime)
+                ++session;
+            lastSessionTime = columns.stamps[r];
+            sessions[r] = session;
+        }
+
+        return;
+    }
+
+    for (auto row : rows)
+    {
+        if (row->cols[PROP_STAMP] - lastSessionTime > sessionTime)
+            ++session;
+        lastSessionTime = row->cols[PROP_STAMP];
+        row->cols[propertyMap->sessionPropIndex] = session;
+    }
+}
+
+void Grid::decodeColumn(const int16_t propIndex, const uint8_t flags, const char* read, const int32_t rowCount)
+{
+    const auto encoding = static_cast<ColumnEncoding_e>(flags & ~(COLUMN_DENSE | COLUMN_WITH_DICTIONARY));
+    const auto dense = (flags & COLUMN_DENSE) != 0;
+
+    const auto mappedProperty = propIndex >= 0 && propIndex < MAX_PROPERTIES ?
+        propertyMap->reverseMap[propIndex] :
+        -1;
+    const auto propInfo = table->getProperties()->getProperty(propIndex);
+
+    if (mappedProperty < 0 ||
+        mappedProperty >= propertyMap->propertyCount ||
+        !propInfo ||
+        propInfo->isSet != (encoding == ColumnEncoding_e::set))
+        return;
+
+    const auto bitmap = recast<const uint8_t*>(read);
+
+    if (!dense)
+        read += (rowCount + 7) / 8;
+
+    // decoded straight into the property's column
+    const auto out = columns.data.data() + mappedProperty * (columns.rowCount + 1);
+
+    const auto isPresent = [&](const int32_t r) -> bool
+    {
+        return dense || (bitmap[r >> 3] & (1 << (r & 7)));
+    };
+
+    switch (encoding)
+    {
+    case ColumnEncoding_e::plain:
+        for (auto r = 0; r < rowCount; ++r)
+            if (isPresent(r))
+                out[r] = unzigzag(getVarint(read));
+        break;
+
+    case ColumnEncoding_e::deltaOfDelta:
+    {
+        auto first = true;
+        uint64_t value = 0;
+        uint64_t delta = 0;
+
+        for (auto r = 0; r < rowCount; ++r)
+        {
+            if (!isPresent(r))
                 continue;
 
-            if (const auto propInfo = properties->getProperty(actualProperty); propInfo)
+            if (first)
             {
-                if (propInfo->isSet)
-                {
-                    /* Output stream looks like this:
-                    *
-                    *  int16_t property
-                    *  int16_t length
-                    *  int64_t values[]
-                    */
-
-                    // write out property id
-                    *reinterpret_cast<int16_t*>(write) = actualProperty;
-                    write += sizeof(int16_t);
-                    bytesNeeded += sizeof(int16_t);
+                value = static_cast<uint64_t>(unzigzag(getVarint(read)));
+                first = false;
+            }
+            else
+            {
+                delta += static_cast<uint64_t>(unzigzag(getVarint(read)));
+                value += delta;
+            }
 
-                    // cast SetInfo_s over the value and get offset and length
-                    // write out count
-                    const auto start = static_cast<int32_t>(reinterpret_cast<SetInfo_s*>(&r->cols[c])->offset);
-                    auto& count = *reinterpret_cast<int16_t*>(write);
+            out[r] = static_cast<int64_t>(value);
+        }
+    }
+    break;
 
-                    count = static_cast<int16_t>(reinterpret_cast<SetInfo_s*>(&r->cols[c])->length);
-                    write += sizeof(int16_t);
-                    bytesNeeded += sizeof(int16_t); // write out values
+    case ColumnEncoding_e::dictionary:
+    case ColumnEncoding_e::set:
+    {
+        const auto dictionarySize = getVarint(read);
 
-                    for (auto idx = start; idx < start + count; ++idx)
-                    {
-                        *recast<int64_t*>(write) = setData[idx];
-                        write += sizeof(int64_t);
-                        bytesNeeded += sizeof(int64_t);
-                    }
+        dictionaryValues.clear();
+        for (uint64_t i = 0; i < dictionarySize; ++i)
+            dictionaryValues.push_back(unzigzag(getVarint(read)));
+
+        for (auto r = 0; r < rowCount; ++r)
+        {
+            if (!isPresent(r))
+                continue;
+
+            if (encoding == ColumnEncoding_e::dictionary)
+            {
+                out[r] = dictionaryValues[getVarint(read)];
+                continue;
+            }
+
+            const auto count = static_cast<int32_t>(getVarint(read));
+            const auto startIdx = static_cast<int32_t>(setData.size());
+
+            for (auto i = 0; i < count; ++i)
+                setData.push_back(dictionaryValues[getVarint(read)]);
+
+            // let our row use an encoded value for the property.
+            SetInfo_s info { count, startIdx };
+            out[r] = *reinterpret_cast<int64_t*>(&info);
+        }
+    }
+    break;
+
+    default:
+        break;
+    }
+}
+
+int32_t Grid::encodeColumns()
+{
+    ensureRows();
+
+    encodeBuffer.clear();
+    compressBuffer.clear();
+    encodeDictionary = nullptr;
+
+    const auto rowCount = static_cast<int64_t>(rows.size());
+
+    if (!rowCount)
+        return 0;
+
+    // columns are compressed with the table's trained dictionary once it has one
+    auto& trainer = table->customerDictionary;
+    encodeDictionary = trainer.getDictionary(0);
+    const auto dictionary = encodeDictionary.get();
+
+    // directory header, column count filled in at the end
+    encodeBuffer.resize(sizeof(ColumnDirectory_s));
+
+    ColumnDirectory_s directory {
+        static_cast<uint8_t>((dictionary ? COLUMN_DIRECTORY_DICTIONARY : COLUMN_DIRECTORY) | COLUMN_DIRECTORY_ZONED),
+        0,
+        static_cast<int32_t>(rowCount)
+    };
+
+    if (dictionary)
+    {
+        const auto idPtr = recast<const char*>(&dictionary->id);
+        encodeBuffer.insert(encodeBuffer.end(), idPtr, idPtr + sizeof(int32_t));
+    }
+
+    const auto zone = makeZone(rows);
+    const auto zonePtr = recast<const char*>(&zone);
+    encodeBuffer.insert(encodeBuffer.end(), zonePtr, zonePtr + sizeof(ZoneMap_s));
+
+    int32_t bytes = 0;
+
+    auto properties = table->getProperties();
+    const auto bitmapBytes = (rowCount + 7) / 8;
+
+    for (auto c = 0; c < propertyMap->propertyCount; ++c)
+    {
+        const auto actualProperty = propertyMap->propertyMap[c];
+
+        // skip placeholder (non-event) properties and auto-generated properties (like session)
+        if (actualProperty >= PROP_INDEX_OMIT_FIRST && actualProperty <= PROP_INDEX_OMIT_LAST)
+            continue;
+
+        const auto propInfo = properties->getProperty(actualProperty);
+
+        if (!propInfo)
+            continue;
+
+        int64_t present = 0;
+        for (auto r : rows)
+            if (r->cols[c] != NONE)
+                ++present;
+
+        if (!present)
+            continue;
+
+        const auto dense = present == rowCount;
+
+        columnBuffer.clear();
+
+        if (!dense)
+        {
+            columnBuffer.resize(bitmapBytes, 0);
+            for (auto r = 0; r < rowCount; ++r)
+                if (rows[r]->cols[c] != NONE)
+                    columnBuffer[r >> 3] |= static_cast<char>(1 << (r & 7));
+        }
+
+        // build a dictionary of the values in this column (set members for sets)
+        dictionaryValues.clear();
+        dictionaryIds.clear();
+
+        const auto addToDictionary = [&](const int64_t value) -> uint64_t
+        {
+            if (const auto iter = dictionaryIds.find(value); iter != dictionaryIds.end())
+                return iter->second;
+            const auto id = static_cast<int32_t>(dictionaryValues.size());
+            dictionaryIds.emplace(value, id);
+            dictionaryValues.push_back(value);
+            return id;
+        };
+
+        const auto putDictionary = [&]()
+        {
+            putVarint(columnBuffer, dictionaryValues.size());
+            for (const auto value : dictionaryValues)
+                putVarint(columnBuffer, zigzag(value));
+        };
+
+        ColumnEncoding_e encoding;
+
+        if (propInfo->isSet)
+        {
+            encoding = ColumnEncoding_e::set;
+
+            for (auto r : rows)
+            {
+                if (r->cols[c] == NONE)
+                    continue;
+                const auto info = reinterpret_cast<const SetInfo_s*>(&r->cols[c]);
+                for (auto idx = info->offset; idx < info->offset + info->length; ++idx)
+                    addToDictionary(setData[idx]);
+            }
+
+            putDictionary();
+
+            for (auto r : rows)
+            {
+                if (r->cols[c] == NONE)
+                    continue;
+                const auto info = reinterpret_cast<const SetInfo_s*>(&r->cols[c]);
+                putVarint(columnBuffer, info->length);
+                for (auto idx = info->offset; idx < info->offset + info->length; ++idx)
+                    putVarint(columnBuffer, dictionaryIds[setData[idx]]);
+            }
+        }
+        else if (actualProperty == PROP_STAMP)
+        {
+            // stamps are sorted, the change in delta is usually small
+            encoding = ColumnEncoding_e::deltaOfDelta;
+
+            auto first = true;
+            uint64_t last = 0;
+            uint64_t delta = 0;
+
+            for (auto r : rows)
+            {
+                if (r->cols[c] == NONE)
+                    continue;
+
+                const auto value = static_cast<uint64_t>(r->cols[c]);
+
+                if (first)
+                {
+                    putVarint(columnBuffer, zigzag(static_cast<int64_t>(value)));
+                    first = false;
                 }
                 else
                 {
-                    cursor = recast<Cast_s*>(write);
-                    cursor->propIndex = actualProperty;
-                    cursor->val64 = r->cols[c];
-
-                    write += sizeOfCast;
-                    bytesNeeded += sizeOfCast;
+                    const auto nextDelta = value - last;
+                    putVarint(columnBuffer, zigzag(static_cast<int64_t>(nextDelta - delta)));
+                    delta = nextDelta;
                 }
+
+                last = value;
             }
         }
+        else
+        {
+            // plain varints or dictionary ids, whichever is smaller
+            int64_t plainBytes = 0;
+            int64_t idBytes = 0;
 
-        cursor = recast<Cast_s*>(write); // END OF ROW - write a "row" marker at the end of the row
-        cursor->propIndex = -1;
+            for (auto r : rows)
+            {
+                if (r->cols[c] == NONE)
+                    continue;
+                plainBytes += varintLength(zigzag(r->cols[c]));
+                idBytes += varintLength(addToDictionary(r->cols[c]));
+            }
 
-        write += sizeOfCastHeader;
+            auto dictionaryBytes = static_cast<int64_t>(varintLength(dictionaryValues.size())) + idBytes;
+            for (const auto value : dictionaryValues)
+                dictionaryBytes += varintLength(zigzag(value));
 
-        bytesNeeded += sizeOfCastHeader;
-    };
+            if (dictionaryBytes < plainBytes)
+            {
+                encoding = ColumnEncoding_e::dictionary;
+                putDictionary();
 
-    // push the rows through the encode
-    for (auto r : rows)
-        pushRow(r);
+                for (auto r : rows)
+                    if (r->cols[c] != NONE)
+                        putVarint(columnBuffer, dictionaryIds[r->cols[c]]);
+            }
+            else
+            {
+                encoding = ColumnEncoding_e::plain;
 
-    const auto maxBytes = LZ4_compressBound(bytesNeeded);
-    const auto compBuffer = cast<char*>(PoolMem::getPool().getPtr(maxBytes));
+                for (auto r : rows)
+                    if (r->cols[c] != NONE)
+                        putVarint(columnBuffer, zigzag(r->cols[c]));
+            }
+        }
 
-    const auto oldCompBytes = rawData->comp;
-    const auto newCompBytes = LZ4_compress_fast(
-        intermediateBuffer,
-        compBuffer,
-        bytesNeeded,
-        maxBytes,
-        table->personCompression);
+        ColumnEntry_s entry {
+            static_cast<int16_t>(actualProperty),
+            static_cast<uint8_t>(static_cast<uint8_t>(encoding) | (dense ? COLUMN_DENSE : 0)),
+            static_cast<int32_t>(columnBuffer.size()),
+            0
+        };
+
+        trainer.sample(columnBuffer.data(), entry.bytes);
+
+        // compress the column on its own, keep it as is if that doesn't help
+        const auto columnDictionary = entry.bytes <= DictionaryTrainer::MAX_DICTIONARY_INPUT ? dictionary : nullptr;
+        const auto offset = compressBuffer.size();
+        const auto maxBytes = LZ4_compressBound(entry.bytes);
+        compressBuffer.resize(offset + maxBytes);
+
+        entry.comp = Dictionaries::compress(
+            columnDictionary,
+            columnBuffer.data(),
+            compressBuffer.data() + offset,
+            entry.bytes,
+            maxBytes,
+            table->personCompression);
+
+        if (entry.comp <= 0 || entry.comp >= entry.bytes)
+        {
+            entry.comp = entry.bytes;
+            memcpy(compressBuffer.data() + offset, columnBuffer.data(), entry.bytes);
+        }
+        else if (columnDictionary)
+        {
+            entry.encoding |= COLUMN_WITH_DICTIONARY;
+        }
 
+        compressBuffer.resize(offset + entry.comp);
+
+        const auto entryPtr = recast<const char*>(&entry);
+        encodeBuffer.insert(encodeBuffer.end(), entryPtr, entryPtr + sizeof(ColumnEntry_s));
+
+        bytes += entry.bytes;
+        ++directory.columnCount;
+    }
+
+    memcpy(encodeBuffer.data(), &directory, sizeof(ColumnDirectory_s));
+
+    trainer.record(bytes, static_cast<int64_t>(compressBuffer.size()));
+
+    return bytes;
+}
+
+PersonData_s* Grid::commit()
+{
+
+    if (!hasInsert)
+        return rawData;
+
+    // column directory into encodeBuffer, compressed columns into compressBuffer
+    const auto bytes = encodeColumns();
+    const auto newCompBytes = static_cast<int32_t>(encodeBuffer.size() + compressBuffer.size());
+
+    const auto oldCompBytes = rawData->comp;
     const auto newPersonSize = (rawData->size() - oldCompBytes) + newCompBytes;
 
     // size() includes data, we adjust
@@ -678,17 +1718,22 @@ PersonData_s* Grid::commit()
     memcpy(newPerson, rawData, PERSON_DATA_SIZE);
 
     newPerson->comp = newCompBytes; // adjust offsets
-    newPerson->bytes = bytesNeeded; // copy old id bytes
+    newPerson->bytes = bytes; // copy old id bytes
 
     if (rawData->idBytes)
-        memcpy(newPerson->getIdPtr(), rawData->getIdPtr(), static_cast<size_t>(rawData->idBytes)); // copy NEW flags
+        memcpy(newPerson->getIdPtr(), rawData->getIdPtr(), static_cast<size_t>(rawData->idBytes));
 
-    // copy NEW compressed events
+    // copy the directory and the compressed columns
     if (newCompBytes)
-        memcpy(newPerson->getComp(), compBuffer, static_cast<size_t>(newCompBytes)); // get rid of the intermediate copy
+    {
+        memcpy(newPerson->getComp(), encodeBuffer.data(), encodeBuffer.size());
+        memcpy(newPerson->getComp() + encodeBuffer.size(), compressBuffer.data(), compressBuffer.size());
+    }
+
+    // the new record takes over from the old one in Customers, count the dictionaries they use
+    Dictionaries::retain(encodeDictionary);
+    Dictionaries::release(rawData->getDictionaryId());
 
-    PoolMem::getPool().freePtr(intermediateBuffer);
-    PoolMem::getPool().freePtr(compBuffer); // release the original
     PoolMem::getPool().freePtr(rawData);    // it probably got longer!
 
     rawData = newPerson;
@@ -697,6 +1742,8 @@ PersonData_s* Grid::commit()
 
 bool Grid::cull()
 {
+    ensureRows();
+
     // empty? no cull
     if (rows.empty())
         return false; // not at row limit, and first event is within time window? no cull
@@ -704,6 +1751,8 @@ bool Grid::cull()
     if (rows.size() < static_cast<size_t>(table->eventMax) && rows[0]->cols[PROP_STAMP] > Now() - table->eventTtl)
         return false;
 
+    columnsValid = false;
+
     diff.reset();
     auto removed = false;
     auto rowCount = rows.size();
@@ -748,6 +1797,34 @@ bool Grid::cull()
     return removed;
 }
 
+void Grid::indexBuckets()
+{
+    ensureRows();
+
+    auto lastDay = NONE;
+
+    for (const auto row : rows)
+    {
+        // rows are in time order, so each day is only indexed once
+        if (const auto day = stampToDay(row->cols[PROP_STAMP]); day != lastDay)
+        {
+            indexBuckets(row->cols[PROP_STAMP]);
+            lastDay = day;
+        }
+    }
+}
+
+void Grid::indexBuckets(const int64_t stamp) const
+{
+    const auto day = stampToDay(stamp);
+
+    attributes->getMake(PROP_DAY, day);
+    attributes->setDirty(rawData->linId, PROP_DAY, day);
+
+    attributes->getMake(PROP_WEEK, dayToWeek(day));
+    attributes->setDirty(rawData->linId, PROP_WEEK, dayToWeek(day));
+}
+
 int Grid::getGridProperty(const int propIndex) const
 {
     return propertyMap->reverseMap[propIndex];
@@ -1198,7 +2275,9 @@ void Grid::insertEvent(cjson* rowData)
     if (!attrNode)
         return;
 
-    const auto stampNode = rowData->xPath("/stamp");
+    ensureRows();
+    columnsValid = false;
+
     const auto eventName = rowData->xPathString("/event", "");
 
     const auto insertRow = newRow();
@@ -1211,18 +2290,13 @@ void Grid::insertEvent(cjson* rowData)
     if (insertType == RowType_e::junk || insertType == RowType_e::prop)
         return;
 
-    int64_t stamp = 0;
-
-    // check for stamps
-    if (stampNode && stampNode->type() == cjson::Types_e::STR)
-        stamp = Epoch::fixMilli(Epoch::ISO8601ToEpoch(stampNode->getString()));
-    else if (stampNode)
-        stamp = Epoch::fixMilli(stampNode->getInt());
+    const auto stamp = getEventStamp(rowData);
 
     if (stamp < 0)
         return;
 
     insertRow->cols[PROP_STAMP] = stamp;
+    indexBuckets(stamp);
 
     auto rowCount = rows.size();
     const auto lastRowStamp = rowCount ? rows.back()->cols[PROP_STAMP] : 0;
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <limits>
+#include <memory>
 #include <unordered_map>
 #include <cstring>
 
@@ -21,7 +22,9 @@ namespace openset
         class Table;
         class Attributes;
         class AttributeBlob;
+        class Customers;
         class PropertyMapping;
+        struct Dictionary_s;
         class Grid;
         struct PropertyMap_s;
         const int64_t int16_min = numeric_limits<int16_t>::min();
@@ -54,6 +57,56 @@ namespace openset
         };
 
 #pragma pack(push,1)
+        /*
+         * ZoneMap_s - the span of a customer's events, kept in the column
+         * directory of its record (see grid.cpp) and updated by appends, so a
+         * customer can be ruled out without decompressing its events.
+         *
+         * `events` is a one word bloom filter of the event hashes, two bits
+         * per event, the same modulo scheme as lib/mem/bloom.h.
+         */
+        struct ZoneMap_s
+        {
+            int64_t firstStamp;
+            int64_t lastStamp;
+            int32_t rowCount;
+            uint64_t events;
+
+            static uint64_t eventBits(const int64_t eventHash)
+            {
+                const auto key = static_cast<uint64_t>(eventHash);
+                return (1ULL << (key % 64)) | (1ULL << ((key >> 32) % 64));
+            }
+
+            void addEvent(const int64_t eventHash)
+            {
+                events |= eventBits(eventHash);
+            }
+
+            bool mayHaveEvent(const int64_t eventHash) const
+            {
+                const auto bits = eventBits(eventHash);
+                return (events & bits) == bits;
+            }
+
+            // false if no event is between `start` and `end` (inclusive), or
+            // none of `anyEvents` (if any are given) occurred
+            bool mayMatch(const int64_t start, const int64_t end, const std::vector<int64_t>& anyEvents) const
+            {
+                if (firstStamp > end || lastStamp < start)
+                    return false;
+
+                if (anyEvents.empty())
+                    return true;
+
+                for (const auto eventHash : anyEvents)
+                    if (mayHaveEvent(eventHash))
+                        return true;
+
+                return false;
+            }
+        };
+
         struct PersonData_s
         {
             /*
@@ -65,7 +118,9 @@ namespace openset
             *  ------------
             *  flags_s records
             *  ------------
-            *  compressed event rows
+            *  column directory
+            *  ------------
+            *  compressed event columns (see grid.cpp)
             *
             */
             int64_t id;
@@ -96,6 +151,13 @@ namespace openset
             int64_t size() const { return (sizeof(PersonData_s) - 1LL) + comp + idBytes; }
             char* getIdPtr() { return events; }
             char* getComp() { return events + idBytes; }
+
+            // copies the zone map of the record, false if it has none (no
+            // events, or written before zone maps)
+            bool getZone(ZoneMap_s& zone) const;
+
+            // id of the dictionary the record was compressed with, 0 for none
+            int32_t getDictionaryId() const;
         };
 
         const int64_t PERSON_DATA_SIZE = sizeof(PersonData_s) - 1LL;
@@ -108,6 +170,31 @@ namespace openset
         using Row = Col_s;
         using Rows = vector<Row*>;
 
+        /*
+         * Grid rows in column-major order, one contiguous array per grid
+         * property, so a scan of one property (i.e. the stamps in an each_row
+         * loop) reads sequential memory instead of a row stride per row.
+         *
+         * A customer with a column directory is decoded straight into these
+         * arrays (rows are only made if something asks for them), otherwise
+         * they are built from the rows on first use (Grid::getColumns) and
+         * rebuilt after the rows change. Each array ends with a NONE past the
+         * last row, so reading row `rowCount` (i.e. row 0 of a customer
+         * without events) reads an empty value like Grid::getEmptyRow.
+         */
+        struct GridColumns_s
+        {
+            vector<int64_t> data;        // propertyCount arrays of rowCount + 1 values
+            int64_t rowCount { 0 };
+            const int64_t* stamps { nullptr };
+            const int64_t* events { nullptr };
+
+            const int64_t* column(const int32_t gridProperty) const
+            {
+                return data.data() + gridProperty * (rowCount + 1);
+            }
+        };
+
         struct SetInfo_s
         {
             int32_t length { 0 };
@@ -136,18 +223,23 @@ namespace openset
             const static int sizeOfCast = sizeof(Cast_s);
             PropertyMap_s* propertyMap { nullptr }; // we will get our memory via stack
             // so rows have tight cache affinity
-            HeapStack mem;
-            Rows rows;
+            mutable HeapStack mem;
+            mutable Rows rows;
             Row* emptyRow { nullptr };
             SetVector setData;
 
             PersonData_s* rawData { nullptr };
 
+            mutable GridColumns_s columns;
+            mutable bool columnsValid { false };
+            mutable bool rowsValid { true }; // false while only `columns` holds the rows
+
             int64_t sessionTime { 60'000LL * 30LL }; // 30 minutes
 
             Table* table { nullptr };
             Attributes* attributes { nullptr };
             AttributeBlob* blob { nullptr };
+            Customers* people { nullptr }; // told when props change in place
 
             bool hasInsert { false };
 
@@ -156,6 +248,16 @@ namespace openset
             // mutable - sorry
             mutable int64_t propHash { 0 };
             mutable HeapStack propMem;
+
+            // scratch for the columnar encoder/decoder, reused between customers
+            vector<char> encodeBuffer;
+            vector<char> compressBuffer;
+            std::shared_ptr<const Dictionary_s> encodeDictionary; // the dictionary compressBuffer used
+            vector<char> columnBuffer;
+            vector<char> decodeBuffer;
+            SetVector dictionaryValues;
+            robin_hood::unordered_map<int64_t, int32_t, robin_hood::hash<int64_t>> dictionaryIds;
+            vector<int32_t> importMap;
         public:
             Grid() = default;
             ~Grid();
@@ -171,6 +273,7 @@ namespace openset
             bool mapSchema(Table* tablePtr, Attributes* attributesPtr);
             bool mapSchema(Table* tablePtr, Attributes* attributesPtr, const vector<string>& propertyNames);
             void setSessionTime(const int64_t sessionTime) { this->sessionTime = sessionTime; }
+            void setCustomers(Customers* customersPtr) { people = customersPtr; }
             cvar getProps(const bool propsMayChange);
             void setProps(cvar& var);
             void mount(PersonData_s* personData);
@@ -190,10 +293,25 @@ namespace openset
             // re-encodes and compresses the row data after inserts
             PersonData_s* commit();
 
+            // adds events to the tail of a mounted (not prepared) customer without
+            // re-encoding its history. Returns false, having changed nothing, unless
+            // every event is newer than the customer's last event.
+            bool append(vector<cjson>& events);
+
+            // bytes of appended rows not yet folded into the columns
+            int64_t getTailBytes() const;
+
+            // re-encodes a prepared customer, folding the tail into the columns
+            PersonData_s* fold();
+
             // remove old records, or trim sets that have gotten to large.
             // returns true if culling occured - de-index unreferenced items
             bool cull();
 
+            // index the day and week buckets (PROP_DAY, PROP_WEEK) of every row,
+            // for customers stored before the buckets were kept
+            void indexBuckets();
+
             // given an actual schema property, what is the
             // property in the grid (which is compact)
             int getGridProperty(int propIndex) const;
@@ -212,6 +330,7 @@ namespace openset
 
             const Rows* getRows() const
             {
+                ensureRows();
                 return &rows;
             }
 
@@ -220,6 +339,22 @@ namespace openset
                 return emptyRow;
             }
 
+            // the rows in column-major order, valid until the rows change
+            const GridColumns_s* getColumns() const;
+
+            // copy the prepared rows (for DecodeCache), `properties` are the schema
+            // properties held in each row of `values`. Derived properties (uuid,
+            // session) are not copied.
+            void exportRows(vector<int32_t>& properties, vector<int64_t>& values, vector<int64_t>& sets) const;
+
+            // expand a mounted customer from rows made by exportRows, returns false
+            // (changing nothing) unless they hold every property this grid maps
+            bool importRows(
+                const vector<int32_t>& properties,
+                const vector<int64_t>& values,
+                const int64_t rowCount,
+                const vector<int64_t>& sets);
+
             const SetVector& getSetData() const { return setData; }
             Attributes* getAttributes() const { return attributes; }
             PersonData_s* getMeta() const { return rawData; }
@@ -229,7 +364,33 @@ namespace openset
             cjson toJSON(); // brings object back to zero state
             void reinitialize();
         private:
-            Col_s* newRow();
+            Col_s* newRow() const;
+
+            // make `rows` from `columns` if the customer was decoded into columns
+            void ensureRows() const;
+
+            // size `columns` for `rowCount` rows of NONE (with the customer id in the uuid column)
+            void newColumns(const int64_t rowCount) const;
+
+            // decompress and decode the columns in the directory that are mapped in this
+            // grid into `columns`, appended rows are copied in after them
+            void prepareDirectory();
+
+            // decode a single LZ4 block of rows or columns (records written before the directory)
+            void prepareRows(const char* read, const char* end);
+            void prepareColumns(const char* read, const char* end);
+
+            int64_t getLastStamp();
+            void indexBuckets(const int64_t stamp) const;
+            void encodeRow(const Row* row, vector<char>& out) const;
+
+            void newRows(const int32_t rowCount) const;
+            void numberSessions();
+            void decodeColumn(const int16_t propIndex, const uint8_t flags, const char* read, const int32_t rowCount);
+
+            // encode `rows` as compressed columns, the directory goes in encodeBuffer and
+            // the columns in compressBuffer. Returns the uncompressed bytes.
+            int32_t encodeColumns();
 
             void reset();
         };
@@ -1,5 +1,7 @@
 #include "indexbits.h"
+#include "bitkernels.h"
 #include "dbtypes.h"
+#include "dictionary.h"
 #include "sba/sba.h"
 #include "lz4.h"
 #include <cassert>
@@ -7,6 +9,125 @@
 using namespace std;
 using namespace openset::db;
 
+namespace
+{
+    /*
+     * Stored index bits (Attr_s) are a list of containers, one for each 65536
+     * bit chunk holding set bits, in whichever of these forms is smallest:
+     *
+     *   array  - sorted uint16 positions of the set bits (sparse chunks)
+     *   bitmap - the chunk's words as they are (dense, scattered chunks)
+     *   run    - uint16 start and uint16 length - 1 of each run of set bits
+     *            (nearly full or clustered chunks)
+     *
+     * Mounting writes the containers straight into the words, nothing is
+     * decompressed, and opOrStored ORs them into bits that are already
+     * mounted. Stored bits are flagged with an `offset` of CONTAINERS and
+     * `length` holds the number of containers.
+     *
+     * Bits stored before containers are LZ4 blocks, see IndexBits::mount.
+     */
+    const int32_t CONTAINERS = -1;
+    const int64_t CHUNK_WORDS = 1024; // 65536 bits
+
+    enum class ContainerType_e : uint8_t
+    {
+        array = 0,
+        bitmap = 1,
+        run = 2
+    };
+
+#pragma pack(push,1)
+    struct Container_s
+    {
+        int32_t chunk;  // first bit >> 16
+        uint8_t type;   // ContainerType_e
+        int32_t count;  // positions, words or runs that follow
+    };
+
+    struct Run_s
+    {
+        uint16_t start;
+        uint16_t length; // length - 1
+    };
+#pragma pack(pop)
+
+    int64_t countBits(const uint64_t word)
+    {
+#ifdef _MSC_VER
+        return __popcnt64(word);
+#else
+        return __builtin_popcountll(word);
+#endif
+    }
+
+    int64_t trailingZeros(const uint64_t word)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, word);
+        return index;
+#else
+        return __builtin_ctzll(word);
+#endif
+    }
+
+    // calls `onRun(start, length)` for each run of set bits in `words`
+    template<typename T>
+    void forEachRun(const uint64_t* words, const int64_t count, T onRun)
+    {
+        const auto end = count * 64;
+        int64_t bit = 0;
+
+        while (bit < end)
+        {
+            // skip the clear bits
+            if (const auto word = words[bit >> 6] >> (bit & 63); !word)
+            {
+                bit = (bit | 63) + 1;
+                continue;
+            }
+            else
+            {
+                bit += trailingZeros(word);
+            }
+
+            const auto start = bit;
+
+            // and then the set bits
+            while (bit < end)
+            {
+                if (const auto clear = ~words[bit >> 6] >> (bit & 63); !clear)
+                {
+                    bit = (bit | 63) + 1;
+                }
+                else
+                {
+                    bit += trailingZeros(clear);
+                    break;
+                }
+            }
+
+            onRun(start, std::min(bit, end) - start);
+        }
+    }
+
+    void setRange(uint64_t* words, int64_t start, const int64_t length)
+    {
+        const auto end = start + length;
+
+        while (start < end)
+        {
+            const auto shift = start & 63;
+            const auto span = std::min<int64_t>(64 - shift, end - start);
+            const auto mask = span == 64 ? ~0ULL : ((1ULL << span) - 1) << shift;
+
+            words[start >> 6] |= mask;
+            start += span;
+        }
+    }
+}
+
 IndexBits::IndexBits()
     : bits(nullptr),
       ints(0),
@@ -106,6 +227,7 @@ void IndexBits::mount(
     const int32_t integers,
     const int32_t offset,
     const int32_t length,
+    const int32_t compBytes,
     const int32_t linId)
 {
     reset();
@@ -129,27 +251,199 @@ void IndexBits::mount(
 
     assert(bytes);
 
+    ints = integers;
+    bits = recast<uint64_t*>(output);
+
+    if (offset == CONTAINERS)
+    {
+        mountContainers(compressedData, length);
+
+        if (linId >= 0)
+            bitSet(linId);
+        return;
+    }
+
     const int64_t offsetPtr  = offset * 8;
-    const int32_t byteLength = length * 8;
+    const int32_t byteLength = std::abs(length) * 8;
+
+    // a dictionary compressed block starts with the id of the dictionary
+    const auto dictionaryId = length < 0 ? *recast<int32_t*>(compressedData) : 0;
+    const auto headerBytes  = length < 0 ? static_cast<int32_t>(sizeof(int32_t)) : 0;
+
+    // damaged blocks are left as zeros rather than read past the stored bytes
+    if (offsetPtr + byteLength > static_cast<int64_t>(bytes) ||
+        !Dictionaries::decompress(
+            dictionaryId,
+            compressedData + headerBytes,
+            output + offsetPtr,
+            compBytes - headerBytes,
+            byteLength))
+    {
+        memset(output, 0, bytes);
+        Logger::get().error("index bits could not be decompressed.");
+    }
+
+    if (linId >= 0)
+        bitSet(linId);
+}
 
-    // TODO - check for int overflow here
-    const auto code = LZ4_decompress_fast(compressedData, output + offsetPtr, byteLength);
+void IndexBits::mountContainers(const char* data, const int32_t containerCount) const
+{
+    auto read = data;
 
-    assert(code > 0);
+    for (auto i = 0; i < containerCount; ++i)
+    {
+        const auto container = recast<const Container_s*>(read);
+        read += sizeof(Container_s);
 
-    ints = integers;
-    bits = recast<uint64_t*>(output);
+        const auto payload = read;
+        const auto type = static_cast<ContainerType_e>(container->type);
+
+        switch (type)
+        {
+        case ContainerType_e::array:
+            read += container->count * sizeof(uint16_t);
+            break;
+        case ContainerType_e::bitmap:
+            read += container->count * sizeof(uint64_t);
+            break;
+        case ContainerType_e::run:
+            read += container->count * sizeof(Run_s);
+            break;
+        }
+
+        // bits past `ints` (the index was stored longer than it is mounted) are dropped
+        const auto firstWord = container->chunk * CHUNK_WORDS;
+
+        if (firstWord >= ints)
+            continue;
+
+        const auto words = bits + firstWord;
+        const auto available = std::min(CHUNK_WORDS, ints - firstWord) * 64;
+
+        switch (type)
+        {
+        case ContainerType_e::array:
+        {
+            const auto positions = recast<const uint16_t*>(payload);
+            for (auto p = 0; p < container->count; ++p)
+                if (positions[p] < available)
+                    words[positions[p] >> 6] |= BITMASK[positions[p] & 63];
+        }
+        break;
+        case ContainerType_e::bitmap:
+        {
+            // ORed rather than copied, opOrStored applies containers to bits that are already set
+            const auto count = std::min<int64_t>(container->count, available / 64);
+            for (auto w = 0; w < count; ++w)
+            {
+                uint64_t word; // payloads follow packed headers, so may not be aligned
+                memcpy(&word, payload + w * sizeof(uint64_t), sizeof(uint64_t));
+                words[w] |= word;
+            }
+        }
+        break;
+        case ContainerType_e::run:
+        {
+            const auto runs = recast<const Run_s*>(payload);
+            for (auto r = 0; r < container->count; ++r)
+                if (runs[r].start < available)
+                    setRange(words, runs[r].start, std::min<int64_t>(runs[r].length + 1, available - runs[r].start));
+        }
+        break;
+        }
+    }
+}
+
+void IndexBits::opOrStored(
+    char* compressedData,
+    const int32_t integers,
+    const int32_t offset,
+    const int32_t length,
+    const int32_t compBytes,
+    const int32_t linId)
+{
+    if (placeHolder)
+        return;
+
+    // bits stored before containers have to be decompressed somewhere
+    if (integers && linId < 0 && offset != CONTAINERS)
+    {
+        IndexBits stored;
+        stored.mount(compressedData, integers, offset, length, compBytes, linId);
+        opOr(stored);
+        return;
+    }
+
+    // as wide as the stored bits would mount
+    grow(integers && linId < 0 ? integers : 1);
+
+    if (integers && linId < 0)
+        mountContainers(compressedData, length);
 
     if (linId >= 0)
         bitSet(linId);
 }
 
+int64_t IndexBits::storedPopulation(
+    const char* compressedData,
+    const int32_t integers,
+    const int32_t offset,
+    const int32_t length,
+    const int32_t linId)
+{
+    if (!integers || linId >= 0)
+        return linId >= 0 ? 1 : 0;
+
+    if (offset != CONTAINERS)
+        return -1;
+
+    int64_t population = 0;
+    auto read = compressedData;
+
+    for (auto i = 0; i < length; ++i)
+    {
+        const auto container = recast<const Container_s*>(read);
+        read += sizeof(Container_s);
+
+        switch (static_cast<ContainerType_e>(container->type))
+        {
+        case ContainerType_e::array:
+            population += container->count;
+            read += container->count * sizeof(uint16_t);
+            break;
+        case ContainerType_e::bitmap:
+        {
+            const auto words = recast<const uint64_t*>(read);
+            for (auto w = 0; w < container->count; ++w)
+                population += countBits(words[w]);
+            read += container->count * sizeof(uint64_t);
+        }
+        break;
+        case ContainerType_e::run:
+        {
+            const auto runs = recast<const Run_s*>(read);
+            for (auto r = 0; r < container->count; ++r)
+                population += runs[r].length + 1;
+            read += container->count * sizeof(Run_s);
+        }
+        break;
+        }
+    }
+
+    return population;
+}
+
 int64_t IndexBits::getSizeBytes() const
 {
     return ints * sizeof(int64_t);
 }
 
-char* IndexBits::store(int64_t& compressedBytes, int64_t& linId, int32_t& offset, int32_t& length, const int compRatio)
+char* IndexBits::store(
+    int64_t& compressedBytes,
+    int64_t& linId,
+    int32_t& offset,
+    int32_t& length)
 {
     if (!ints)
         grow(1);
@@ -173,41 +467,85 @@ char* IndexBits::store(int64_t& compressedBytes, int64_t& linId, int32_t& offset
         return nullptr;
     }
 
-    // find start
+    // one container per chunk holding set bits, sized to the smallest form
+    const auto chunks = (ints + CHUNK_WORDS - 1) / CHUNK_WORDS;
+
+    int64_t maxBytes = 0;
+    for (auto chunk = 0; chunk < chunks; ++chunk)
+        maxBytes += sizeof(Container_s) + std::min(CHUNK_WORDS, ints - chunk * CHUNK_WORDS) * sizeof(uint64_t);
 
-    auto idx      = 0;
-    auto firstIdx = -1;
-    auto lastIdx  = -1;
+    const auto buffer = cast<char*>(PoolMem::getPool().getPtr(maxBytes));
+    auto write = buffer;
+    auto containerCount = 0;
 
-    while (idx < ints)
+    for (auto chunk = 0; chunk < chunks; ++chunk)
     {
-        if (bits[idx])
+        const auto words = bits + chunk * CHUNK_WORDS;
+        const auto wordCount = std::min(CHUNK_WORDS, ints - chunk * CHUNK_WORDS);
+
+        int64_t population = 0;
+        for (auto w = 0; w < wordCount; ++w)
+            population += countBits(words[w]);
+
+        if (!population)
+            continue;
+
+        int64_t runCount = 0;
+        forEachRun(words, wordCount, [&](int64_t, int64_t) { ++runCount; });
+
+        const auto arrayBytes = population * static_cast<int64_t>(sizeof(uint16_t));
+        const auto runBytes = runCount * static_cast<int64_t>(sizeof(Run_s));
+        const auto bitmapBytes = wordCount * static_cast<int64_t>(sizeof(uint64_t));
+
+        const auto container = recast<Container_s*>(write);
+        container->chunk = chunk;
+        write += sizeof(Container_s);
+
+        if (runBytes <= arrayBytes && runBytes < bitmapBytes)
         {
-            if (firstIdx == -1)
-                firstIdx = idx;
-            lastIdx = idx;
-        }
-        ++idx;
-    }
+            container->type = static_cast<uint8_t>(ContainerType_e::run);
+            container->count = static_cast<int32_t>(runCount);
 
-    offset = firstIdx;
-    length = (lastIdx - firstIdx) + 1;
+            forEachRun(words, wordCount, [&](const int64_t start, const int64_t length)
+            {
+                const Run_s run { static_cast<uint16_t>(start), static_cast<uint16_t>(length - 1) };
+                memcpy(write, &run, sizeof(Run_s));
+                write += sizeof(Run_s);
+            });
+        }
+        else if (arrayBytes < bitmapBytes)
+        {
+            container->type = static_cast<uint8_t>(ContainerType_e::array);
+            container->count = static_cast<int32_t>(population);
 
-    const auto maxBytes          = LZ4_compressBound(length * sizeof(int64_t));
-    const auto compressionBuffer = cast<char*>(PoolMem::getPool().getPtr(maxBytes));
+            for (auto w = 0; w < wordCount; ++w)
+            {
+                for (auto word = words[w]; word; word &= word - 1)
+                {
+                    const auto position = static_cast<uint16_t>(w * 64 + trailingZeros(word));
+                    memcpy(write, &position, sizeof(uint16_t));
+                    write += sizeof(uint16_t);
+                }
+            }
+        }
+        else
+        {
+            container->type = static_cast<uint8_t>(ContainerType_e::bitmap);
+            container->count = static_cast<int32_t>(wordCount);
 
-    //memset(compressionBuffer, 0, maxBytes);
+            memcpy(write, words, bitmapBytes);
+            write += bitmapBytes;
+        }
 
-    compressedBytes = LZ4_compress_fast(
-        recast<char*>(bits + offset),
-        compressionBuffer,
-        length * sizeof(int64_t),
-        maxBytes,
-        compRatio);
+        ++containerCount;
+    }
 
+    compressedBytes = write - buffer;
+    offset = CONTAINERS;
+    length = containerCount;
     linId = -1;
 
-    return compressionBuffer;
+    return buffer;
 }
 
 void IndexBits::grow(int64_t required, bool exact)
@@ -295,9 +633,6 @@ int64_t IndexBits::population(int stopBit) const
     if (!bits || !ints)
         return 0;
 
-    int64_t count = 0;
-    auto pSource  = bits;
-
     // truncates to the one we want
     int64_t lastInt = stopBit / 64LL;
 
@@ -314,21 +649,39 @@ int64_t IndexBits::population(int stopBit) const
         stopBit = lastInt * 64;
     }
 
-    const auto pEnd = pSource + lastInt;
+    auto count = BitKernels::population(bits, lastInt);
+
+    // count any dangling bits in the last partial word
+    if (lastInt < ints && stopBit > lastInt * 64)
+        count += countBits(bits[lastInt] & ((1ULL << (stopBit - lastInt * 64)) - 1));
+
+    return count;
+}
+
+int64_t IndexBits::andPopulation(const IndexBits& source, int stopBit) const
+{
+    // as opAnd would, a placeholder leaves these bits as they are
+    if (placeHolder || source.placeHolder)
+        return population(stopBit);
+
+    if (!bits || !ints || !source.bits || !source.ints)
+        return 0;
+
+    // words past the shorter buffer are zero in the intersection
+    const auto common = std::min(ints, source.ints);
+
+    int64_t lastInt = stopBit / 64LL;
 
-    while (pSource < pEnd)
+    if (lastInt > common)
     {
-#ifdef _MSC_VER
-        count += __popcnt64(*pSource);
-#else
-        count += __builtin_popcountll(*pSource);
-#endif
-        ++pSource;
+        lastInt = common;
+        stopBit = lastInt * 64;
     }
 
-    // count any dangling single bits
-    for (auto idx = lastInt * 64; idx < stopBit; ++idx)
-        count += bitState(idx) ? 1 : 0;
+    auto count = BitKernels::andPopulation(bits, source.bits, lastInt);
+
+    if (lastInt < common && stopBit > lastInt * 64)
+        count += countBits(bits[lastInt] & source.bits[lastInt] & ((1ULL << (stopBit - lastInt * 64)) - 1));
 
     return count;
 }
@@ -350,6 +703,54 @@ void IndexBits::opCopyNot(IndexBits& source)
     opNot();
 }
 
+void IndexBits::opCopyAnd(const IndexBits& left, const IndexBits& right)
+{
+    if (left.placeHolder || right.placeHolder)
+    {
+        opCopy(left);
+        return;
+    }
+
+    if (this == &left || this == &right)
+    {
+        const IndexBits leftCopy(left), rightCopy(right);
+        opCopyAnd(leftCopy, rightCopy);
+        return;
+    }
+
+    reset();
+    grow(std::max(left.ints, right.ints));
+
+    BitKernels::opCopyAnd(bits, left.bits, right.bits, std::min(left.ints, right.ints));
+}
+
+void IndexBits::opCopyAndNot(const IndexBits& left, const IndexBits& right)
+{
+    if (left.placeHolder || right.placeHolder)
+    {
+        opCopy(left);
+        return;
+    }
+
+    if (this == &left || this == &right)
+    {
+        const IndexBits leftCopy(left), rightCopy(right);
+        opCopyAndNot(leftCopy, rightCopy);
+        return;
+    }
+
+    reset();
+    grow(std::max(left.ints, right.ints));
+
+    const auto common = std::min(left.ints, right.ints);
+
+    BitKernels::opCopyAndNot(bits, left.bits, right.bits, common);
+
+    // nothing to remove past the end of `right`
+    if (left.ints > common)
+        memcpy(bits + common, left.bits + common, (left.ints - common) * sizeof(uint64_t));
+}
+
 void IndexBits::opAnd(IndexBits& source)
 {
     if (placeHolder || source.placeHolder)
@@ -363,16 +764,7 @@ void IndexBits::opAnd(IndexBits& source)
     else if (source.ints < ints)
         source.grow(ints);
 
-    volatile auto pSource    = source.bits;
-    volatile auto pDest      = bits;
-    const volatile auto pEnd = source.bits + source.ints;
-
-    while (pSource < pEnd)
-    {
-        *pDest = ((*pDest) & (*pSource));
-        ++pSource;
-        ++pDest;
-    }
+    BitKernels::opAnd(bits, source.bits, source.ints);
 }
 
 void IndexBits::opOr(IndexBits& source)
@@ -388,16 +780,7 @@ void IndexBits::opOr(IndexBits& source)
     else if (source.ints < ints)
         source.grow(ints);
 
-    volatile auto pSource    = source.bits;
-    volatile auto pDest      = bits;
-    const volatile auto pEnd = source.bits + source.ints;
-
-    while (pSource < pEnd)
-    {
-        *pDest = ((*pDest) | (*pSource));
-        ++pSource;
-        ++pDest;
-    }
+    BitKernels::opOr(bits, source.bits, source.ints);
 }
 
 void IndexBits::opAndNot(IndexBits& source)
@@ -413,16 +796,7 @@ void IndexBits::opAndNot(IndexBits& source)
     else if (source.ints < ints)
         source.grow(ints);
 
-    volatile auto pSource    = source.bits;
-    volatile auto pDest      = bits;
-    const volatile auto pEnd = source.bits + source.ints;
-
-    while (pSource < pEnd)
-    {
-        *pDest = ((*pDest) & (~(*pSource)));
-        ++pSource;
-        ++pDest;
-    }
+    BitKernels::opAndNot(bits, source.bits, source.ints);
 }
 
 void IndexBits::opNot() const
@@ -433,14 +807,7 @@ void IndexBits::opNot() const
     if (!ints || !bits)
         return;
 
-    volatile auto pSource    = bits;
-    const volatile auto pEnd = bits + ints;
-
-    while (pSource < pEnd)
-    {
-        *pSource = (~(*pSource));
-        ++pSource;
-    }
+    BitKernels::opNot(bits, ints);
 }
 
 string IndexBits::debugBits(const IndexBits& bits, int limit)
@@ -489,29 +856,59 @@ bool IndexBits::linearIter(int64_t& linId, const int64_t stopBit) const
     ++linId;
 
     auto currentInt = linId / 64LL;
+    const auto lastInt = std::min<int64_t>(ints, (stopBit + 63) / 64);
+
+    if (currentInt >= lastInt)
+        return false;
+
+    // ignore the bits before linId in the first word
+    auto word = bits[currentInt] & (~0ULL << (linId & 63));
 
-    while (currentInt < ints)
+    while (!word)
     {
-        if (bits[currentInt])
+        if (++currentInt >= lastInt)
+            return false;
+        word = bits[currentInt];
+    }
+
+    linId = currentInt * 64LL + trailingZeros(word);
+
+    return linId < stopBit;
+}
+
+int64_t IndexBits::linearBatch(int64_t& linId, const int64_t stopBit, int64_t* linIds, const int64_t count) const
+{
+    const auto start = linId + 1;
+
+    auto currentInt = start / 64LL;
+    const auto lastInt = std::min<int64_t>(ints, (stopBit + 63) / 64);
+
+    if (currentInt >= lastInt)
+        return 0;
+
+    auto word = bits[currentInt] & (~0ULL << (start & 63));
+    int64_t found = 0;
+
+    while (true)
+    {
+        // take the lowest set bit, then clear it
+        for (; word; word &= word - 1)
         {
-            const int64_t bitNumber = linId % 64;
+            const auto id = currentInt * 64LL + trailingZeros(word);
 
-            //if (bitIndex >= stopBit)
-            if (linId >= stopBit)
-                return false;
+            if (id >= stopBit)
+                return found;
 
-            for (auto i = bitNumber; i < 64LL; i++)
-            {
-                if (bits[currentInt] & BITMASK[i])
-                {
-                    linId = (currentInt * 64LL) + i;
-                    return true;
-                }
-            }
+            linIds[found++] = id;
+            linId = id;
+
+            if (found == count)
+                return found;
         }
-        currentInt++;
-        linId = (currentInt * 64);
-    }
 
-    return false;
+        if (++currentInt >= lastInt)
+            return found;
+
+        word = bits[currentInt];
+    }
 }
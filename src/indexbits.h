@@ -28,14 +28,39 @@ namespace openset
             // index is number of bits, state is 1 or 0
             void makeBits(int64_t index, int state);
 
-            // takes buffer to compressed data and actual size as parameters
+            // takes buffer to stored data and actual size as parameters
             // note: actual size is number of long longs (in64_t)
-            void mount(char* compressedData, int32_t integers, int32_t offset, int32_t length, int32_t linId);
+            // an offset of -1 means containers (see store), otherwise the data is
+            // an LZ4 block of compBytes, a negative length means it starts with
+            // the int32 id of the dictionary it was compressed with
+            void mount(char* compressedData, int32_t integers, int32_t offset, int32_t length, int32_t compBytes, int32_t linId);
+
+            // ORs `containerCount` containers written by store into the bits
+            void mountContainers(const char* data, const int32_t containerCount) const;
+
+            // ORs stored bits (mount parameters) into these bits, containers are
+            // applied as they are rather than mounted into bits of their own first
+            void opOrStored(char* compressedData, int32_t integers, int32_t offset, int32_t length, int32_t compBytes, int32_t linId);
+
+            // population of stored bits (mount parameters) read from the container
+            // headers without mounting them, -1 for bits stored before containers
+            static int64_t storedPopulation(
+                const char* compressedData,
+                int32_t integers,
+                int32_t offset,
+                int32_t length,
+                int32_t linId);
 
             int64_t getSizeBytes() const;
 
             // returns a POOL buffer ptr, and the number of bytes
-            char* store(int64_t& compressedBytes, int64_t& linId, int32_t& offset, int32_t& length, int compRatio = 1);
+            // the bits are written as array, bitmap or run containers with offset
+            // set to -1 and length to the container count
+            char* store(
+                int64_t& compressedBytes,
+                int64_t& linId,
+                int32_t& offset,
+                int32_t& length);
 
             void grow(int64_t required, bool exact = true);
 
@@ -46,8 +71,15 @@ namespace openset
 
             int64_t population(int stopBit) const;
 
+            // population(stopBit) of these bits AND source, without changing either
+            int64_t andPopulation(const IndexBits& source, int stopBit) const;
+
             void opCopy(const IndexBits& source);
             void opCopyNot(IndexBits& source);
+
+            // single pass opCopy(left) then opAnd(right) or opAndNot(right)
+            void opCopyAnd(const IndexBits& left, const IndexBits& right);
+            void opCopyAndNot(const IndexBits& left, const IndexBits& right);
             void opAnd(IndexBits& source);
             void opOr(IndexBits& source);
             void opAndNot(IndexBits& source);
@@ -55,6 +87,10 @@ namespace openset
 
             bool linearIter(int64_t& linId, int64_t stopBit) const;
 
+            // like linearIter, but fills `linIds` with up to `count` set bits
+            // after `linId`, leaving `linId` at the last one. Returns the number found.
+            int64_t linearBatch(int64_t& linId, int64_t stopBit, int64_t* linIds, int64_t count) const;
+
             class BitProxy
             {
             public:
@@ -102,5 +138,64 @@ namespace openset
                 return os;
             }
         };
+
+        /*
+         * LinearBatch - the set bits of an IndexBits, a batch at a time
+         *
+         * Loops that visit every customer in an index call `next` in place of
+         * linearIter. The upcoming linIds are known ahead of time, so a loop can
+         * `peek` at them to prefetch customer records, and check the clock once
+         * per batch (`isEmpty`) rather than once per customer.
+         */
+        class LinearBatch
+        {
+        public:
+            static const int64_t SIZE = 64;
+
+        private:
+            int64_t linIds[SIZE];
+            int64_t count { 0 };
+            int64_t position { 0 };
+            int64_t cursor { -1 }; // last linId taken from the bits
+
+        public:
+            LinearBatch() = default;
+
+            // the next linId in `linId`, false when there are no more
+            bool next(const IndexBits* bits, const int64_t stopBit, int64_t& linId)
+            {
+                if (position == count)
+                {
+                    position = 0;
+                    count = bits->linearBatch(cursor, stopBit, linIds, SIZE);
+
+                    if (!count)
+                        return false;
+                }
+
+                linId = linIds[position++];
+                return true;
+            }
+
+            // linId `ahead` places after the last one returned, -1 if it isn't
+            // in this batch
+            int64_t peek(const int64_t ahead) const
+            {
+                const auto at = position - 1 + ahead;
+                return at < count ? linIds[at] : -1;
+            }
+
+            bool isEmpty() const
+            {
+                return position == count;
+            }
+
+            void reset()
+            {
+                count = 0;
+                position = 0;
+                cursor = -1;
+            }
+        };
     };
 };
@@ -0,0 +1,42 @@
+#include "indexcache.h"
+
+#include "config.h"
+
+using namespace openset::db;
+
+IndexCache::Cache::Stats_s IndexCache::stats;
+
+bool IndexCache::restore(const Attr_s* attr, IndexBits& bits)
+{
+    const auto cached = cache.get(attr);
+
+    if (!cached)
+    {
+        cache.miss();
+        return false;
+    }
+
+    bits.opCopy(*cached);
+    cache.hit();
+
+    return true;
+}
+
+void IndexCache::store(const Attr_s* attr, const IndexBits& bits)
+{
+    const auto budget = globals::running ? globals::running->indexCacheBytes : 0;
+    const auto bytes = static_cast<int64_t>(sizeof(IndexBits)) + bits.ints * static_cast<int64_t>(sizeof(uint64_t));
+
+    if (const auto cached = cache.store(attr, bytes, budget))
+        cached->opCopy(bits);
+}
+
+void IndexCache::erase(const Attr_s* attr)
+{
+    cache.erase(attr);
+}
+
+void IndexCache::clear()
+{
+    cache.clear();
+}
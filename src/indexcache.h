@@ -0,0 +1,61 @@
+#pragma once
+
+#include "common.h"
+#include "indexbits.h"
+#include "lrucache.h"
+
+namespace openset::db
+{
+    struct Attr_s;
+
+    /*
+     * IndexCache - decompressed index bits of one partition
+     *
+     * Queries that filter on the same values again and again (dashboards
+     * asking for `event == 'purchase'` every few seconds) would otherwise
+     * decode the same indexes on every run. Attributes::getBits keeps the
+     * bits it decodes (with any pending delta merged) here and hands out
+     * copies, a copy being a memcpy where decoding walks every container.
+     * Query leaves OR indexes without a delta straight from their containers
+     * (Attributes::orBits), which is cheaper than a copy, so they skip it.
+     *
+     * Entries are keyed by the Attr_s they were decoded from. Attributes
+     * erases an entry whenever that index changes (its delta grows in
+     * clearDirty, it is rewritten, swapped or dropped), so a cached entry is
+     * always current. The least recently used entries go when the cache holds
+     * more than Config::indexCacheBytes (see LruCache).
+     *
+     * Partitions are only touched by their own worker, so there is no locking.
+     */
+    class IndexCache
+    {
+        using Cache = LruCache<const Attr_s*, IndexBits>;
+
+        static Cache::Stats_s stats;
+
+        Cache cache { stats };
+
+    public:
+        IndexCache() = default;
+
+        IndexCache(const IndexCache&) = delete;
+        IndexCache& operator=(const IndexCache&) = delete;
+
+        // copy the cached bits of `attr` into `bits`, false on a miss
+        bool restore(const Attr_s* attr, IndexBits& bits);
+
+        // remember the decoded bits of `attr`
+        void store(const Attr_s* attr, const IndexBits& bits);
+
+        // forget `attr`, call whenever its bits change or it is freed
+        void erase(const Attr_s* attr);
+
+        void clear();
+
+        int64_t getPartitionBytes() const { return cache.getBytes(); }
+
+        static int64_t getHits() { return stats.hits; }
+        static int64_t getMisses() { return stats.misses; }
+        static int64_t getBytes() { return stats.bytes; }
+    };
+}
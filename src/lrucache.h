@@ -0,0 +1,134 @@
+#pragma once
+
+#include <list>
+#include <atomic>
+
+#include "common.h"
+#include "robin_hood.h"
+
+namespace openset::db
+{
+    /*
+     * LruCache - a byte budgeted, least recently used map
+     *
+     * The bookkeeping shared by DecodeCache and IndexCache. Callers say what
+     * an entry costs when they store it and what the cache may hold, the
+     * least recently used entries go once it holds more than that. An entry
+     * costing more than a quarter of the budget isn't worth the others it
+     * would push out, so it is never stored.
+     *
+     * Counters (hits, misses and bytes held) are kept in a Stats_s owned by
+     * the caller, so every cache of one kind reports together. There is no
+     * locking, each cache belongs to one thread.
+     */
+    template <typename Key, typename Value, typename Hash = robin_hood::hash<Key>>
+    class LruCache
+    {
+    public:
+        struct Stats_s
+        {
+            std::atomic<int64_t> hits { 0 };
+            std::atomic<int64_t> misses { 0 };
+            std::atomic<int64_t> bytes { 0 };
+        };
+
+    private:
+        struct Entry_s
+        {
+            Key key;
+            Value value;
+            int64_t bytes;
+        };
+
+        using EntryList = std::list<Entry_s>;
+
+        EntryList entries; // most recently used first
+        robin_hood::unordered_map<Key, typename EntryList::iterator, Hash> index;
+        int64_t bytes { 0 };
+        Stats_s& stats;
+
+        void evict(const int64_t budget)
+        {
+            while (bytes > budget && !entries.empty())
+                erase(std::prev(entries.end()));
+        }
+
+        void erase(const typename EntryList::iterator iter)
+        {
+            bytes -= iter->bytes;
+            stats.bytes -= iter->bytes;
+            index.erase(iter->key);
+            entries.erase(iter);
+        }
+
+    public:
+        explicit LruCache(Stats_s& stats) :
+            stats(stats)
+        {}
+
+        ~LruCache()
+        {
+            clear();
+        }
+
+        LruCache(const LruCache&) = delete;
+        LruCache& operator=(const LruCache&) = delete;
+
+        // the value cached under `key` (now the most recently used), nullptr if there is none
+        Value* get(const Key& key)
+        {
+            const auto found = index.find(key);
+
+            if (found == index.end())
+                return nullptr;
+
+            const auto iter = found->second;
+            entries.splice(entries.begin(), entries, iter);
+
+            return &iter->value;
+        }
+
+        // a new value for `key` (replacing any cached one) for the caller to
+        // fill, nullptr when an entry of `entryBytes` doesn't fit `budget`
+        Value* store(const Key& key, const int64_t entryBytes, const int64_t budget)
+        {
+            erase(key);
+
+            if (budget <= 0 || entryBytes > budget / 4)
+                return nullptr;
+
+            entries.emplace_front();
+            auto& entry = entries.front();
+
+            entry.key = key;
+            entry.bytes = entryBytes;
+
+            index.emplace(key, entries.begin());
+            bytes += entryBytes;
+            stats.bytes += entryBytes;
+
+            evict(budget);
+
+            return &entry.value;
+        }
+
+        void erase(const Key& key)
+        {
+            if (const auto found = index.find(key); found != index.end())
+                erase(found->second);
+        }
+
+        void clear()
+        {
+            stats.bytes -= bytes;
+            bytes = 0;
+            index.clear();
+            entries.clear();
+        }
+
+        void hit() const { ++stats.hits; }
+        void miss() const { ++stats.misses; }
+
+        int64_t getBytes() const { return bytes; }
+    };
+}
@@ -75,6 +75,18 @@ int main(const int argc, char* argv[])
                 args.portExternal = std::stoi(nextArg);
             else if (arg == "--data"s)
                 args.path = argv[i + 1];
+            else if (arg == "--wal-sync"s)
+                args.walSyncInterval = std::stoll(nextArg);
+            else if (arg == "--checkpoint"s)
+                args.checkpointInterval = std::stoll(nextArg);
+            else if (arg == "--decode-cache"s)
+                args.decodeCacheBytes = std::stoll(nextArg) * 1024LL * 1024LL;
+            else if (arg == "--index-cache"s)
+                args.indexCacheBytes = std::stoll(nextArg) * 1024LL * 1024LL;
+            else if (arg == "--plan-cache"s)
+                args.planCacheSize = std::stoll(nextArg);
+            else if (arg == "--op-counts"s)
+                args.opCounts = true;
             else if (arg == "--test"s)
                 test = true;
             else if (arg == "--help"s)
@@ -96,6 +108,12 @@ int main(const int argc, char* argv[])
         cout << "    --os-host  <host/ip, defaults to hostname>  ; optional external host/ip" << endl;
         cout << "    --os-port  <port, defaults to --port value> ; optional external port" << endl;
         cout << "    --data     <relative or absolute path>      ; where commits will be stored" << endl;
+        cout << "    --wal-sync <ms, defaults to 50>             ; max time between log fsyncs (0 = always, -1 = never)" << endl;
+        cout << "    --checkpoint <ms, defaults to 300000>       ; time between partition checkpoints (0 = disabled)" << endl;
+        cout << "    --decode-cache <MB, defaults to 32>         ; expanded customers cached per worker (0 = disabled)" << endl;
+        cout << "    --index-cache <MB, defaults to 8>           ; decoded index bits cached per partition (0 = disabled)" << endl;
+        cout << "    --plan-cache <entries, defaults to 64>      ; compiled scripts cached per table (0 = disabled)" << endl;
+        cout << "    --op-counts                                 ; count executed query op codes (see status)" << endl;
         cout << "    --test                                      ; will run unit tests" << endl;
         cout << endl;
         exit(0);
@@ -0,0 +1,60 @@
+#include "oloop_checkpoint.h"
+
+#include "config.h"
+#include "checkpoint.h"
+#include "sidelog.h"
+#include "table.h"
+#include "tablepartitioned.h"
+
+using namespace std;
+using namespace openset::async;
+using namespace openset::db;
+
+OpenLoopCheckpoint::OpenLoopCheckpoint(const openset::db::Database::TablePtr table) :
+    OpenLoop(table->getName()),
+    table(table)
+{}
+
+void OpenLoopCheckpoint::prepare()
+{
+    parts = table->getPartitionObjects(loop->partition, false);
+
+    if (!parts)
+        suicide();
+}
+
+void OpenLoopCheckpoint::respawn()
+{
+    OpenLoop* newCell = new OpenLoopCheckpoint(table);
+    newCell->scheduleFuture(globals::running->checkpointInterval);
+
+    spawn(newCell); // add replacement to scheduler
+    suicide(); // kill this cell.
+}
+
+bool OpenLoopCheckpoint::run()
+{
+    // inserts for this partition run on this thread, so nothing
+    // changes while we write. Flush pending index changes (and the
+    // deltas beside the indexes) first.
+    parts->attributes.compact();
+
+    if (!parts->segmentUsageCount)
+        parts->storeAllChangedSegments();
+
+    int64_t walOffset;
+    const auto segment = SideLog::getSideLog().getReadPosition(table.get(), loop->partition, walOffset);
+    const auto started = Now();
+
+    if (Checkpoint::save(parts, segment, walOffset))
+    {
+        SideLog::getSideLog().setCheckpointSegment(table.get(), loop->partition, segment);
+
+        Logger::get().debug(
+            "checkpoint " + table->getName() + " partition " + to_string(loop->partition) +
+            " (" + to_string(Now() - started) + "ms).");
+    }
+
+    respawn();
+    return false;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "oloop.h"
+#include "database.h"
+
+namespace openset
+{
+    namespace db
+    {
+        class Table;
+        class TablePartitioned;
+    };
+};
+
+namespace openset
+{
+    namespace async
+    {
+
+        class OpenLoopCheckpoint : public OpenLoop
+        {
+            openset::db::Database::TablePtr table;
+            db::TablePartitioned* parts { nullptr };
+
+        public:
+            explicit OpenLoopCheckpoint(const openset::db::Database::TablePtr table);
+            ~OpenLoopCheckpoint() final = default;
+
+            void respawn();
+
+            void prepare() final;
+            bool run() final;
+            void partitionRemoved() final {};
+        };
+    };
+};
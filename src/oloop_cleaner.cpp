@@ -29,6 +29,8 @@ void OpenLoopCleaner::prepare()
         return;
     }
 
+    backfill = !parts->bucketsComplete;
+
     //parts->triggers->checkForConfigChange();
 }
 
@@ -48,12 +50,17 @@ bool OpenLoopCleaner::run()
     const auto maxLinearId = parts->people.customerCount();
 
     auto dirty = false;
+    auto visited = 0;
+
+    // same test as Grid::cull, made against the zone map so young customers aren't decompressed
+    const auto cullStamp = Now() - table->eventTtl;
 
     Logger::get().info("+ cleaner running for " + table->getName() + ".");
 
     while (true)
     {
-        if (sliceComplete())
+        // the clock is checked once per batch of customers
+        if (visited++ % LinearBatch::SIZE == 0 && sliceComplete())
         {
             if (dirty)
                 parts->attributes.clearDirty();
@@ -62,16 +69,38 @@ bool OpenLoopCleaner::run()
 
         if (linearId > maxLinearId)
         {
-            if (dirty)
-                parts->attributes.clearDirty();
+            if (backfill)
+                parts->bucketsComplete = true;
+
+            // a quiet moment, write the index deltas into their indexes
+            parts->attributes.compact();
             respawn();
             return false;
         }
 
+        parts->people.prefetch(linearId + Customers::PREFETCH_AHEAD);
+
         if (const auto personData = parts->people.getCustomerByLIN(linearId); personData)
         {
+            if (ZoneMap_s zone;
+                !backfill &&
+                personData->getZone(zone) &&
+                zone.rowCount < table->eventMax &&
+                zone.firstStamp > cullStamp)
+            {
+                ++linearId;
+                continue;
+            }
+
             person.mount(personData);
             person.prepare();
+
+            if (backfill)
+            {
+                person.getGrid()->indexBuckets();
+                dirty = true;
+            }
+
             if (person.getGrid()->cull())
             {
                 if (person.getGrid()->getRows()->empty())
@@ -23,6 +23,7 @@ namespace openset
             openset::db::Database::TablePtr table;
             openset::db::Customer person;
             int64_t linearId; // used as iterator
+            bool backfill { false }; // index time buckets on this pass
 
             db::TablePartitioned* parts { nullptr };
 
@@ -0,0 +1,127 @@
+#include "oloop_coldstore.h"
+
+#include <algorithm>
+
+#include "asyncpool.h"
+#include "customers.h"
+#include "table.h"
+#include "tablepartitioned.h"
+#include "sba/sba.h"
+
+using namespace std;
+using namespace openset::async;
+using namespace openset::db;
+
+namespace
+{
+    const int64_t COLD_STORE_INTERVAL = 60'000; // check the partition every minute
+}
+
+OpenLoopColdStore::OpenLoopColdStore(const openset::db::Database::TablePtr table) :
+    OpenLoop(table->getName()),
+    table(table)
+{}
+
+void OpenLoopColdStore::prepare()
+{
+    parts = table->getPartitionObjects(loop->partition, false);
+
+    if (!parts)
+        suicide();
+}
+
+void OpenLoopColdStore::respawn()
+{
+    OpenLoop* newCell = new OpenLoopColdStore(table);
+    newCell->scheduleFuture(COLD_STORE_INTERVAL);
+
+    spawn(newCell); // add replacement to scheduler
+    suicide(); // kill this cell.
+}
+
+bool OpenLoopColdStore::run()
+{
+    // paging is off for this table (settings can change at any time, so we keep checking)
+    if (!table->coldAfter && !table->memoryBudget)
+    {
+        respawn();
+        return false;
+    }
+
+    const auto maxLinearId = parts->people.customerCount();
+
+    while (true)
+    {
+        if (sliceComplete())
+            return true; // let some other open loops run
+
+        if (linearId >= maxLinearId)
+        {
+            evict();
+            respawn();
+            return false;
+        }
+
+        const auto linId = static_cast<int32_t>(linearId);
+
+        if (const auto personData = parts->people.getCustomerByLIN(linId);
+            personData && !PoolMem::isExternal(personData))
+        {
+            hotBytes += personData->size();
+            candidates.push_back(Candidate_s{ parts->people.getTouched(linId), linId });
+        }
+
+        ++linearId;
+    }
+}
+
+void OpenLoopColdStore::evict()
+{
+    const auto now = static_cast<int64_t>(Now() / 1000);
+    const auto cutoff = table->coldAfter ? now - table->coldAfter / 1000 : 0;
+    // memoryBudget is per node, each partition held here gets an even share
+    const auto budget = table->memoryBudget ?
+        table->memoryBudget / std::max<int64_t>(1, table->getPartitionCount()) :
+        0;
+
+    // least recently touched first
+    std::sort(
+        candidates.begin(),
+        candidates.end(),
+        [](const Candidate_s& left, const Candidate_s& right) -> bool
+        {
+            return left.touched < right.touched;
+        });
+
+    vector<int32_t> linIds;
+    auto remaining = hotBytes;
+
+    for (const auto& candidate : candidates)
+    {
+        const auto tooOld = candidate.touched < cutoff;
+        const auto overBudget = budget && remaining > budget;
+
+        if (!tooOld && !overBudget)
+            break;
+
+        // the walk took a few slices, skip anyone that has changed since we saw them
+        const auto personData = parts->people.getCustomerByLIN(candidate.linId);
+
+        if (!personData ||
+            PoolMem::isExternal(personData) ||
+            parts->people.getTouched(candidate.linId) != candidate.touched)
+            continue;
+
+        linIds.push_back(candidate.linId);
+        remaining -= personData->size();
+    }
+
+    const auto evicted = parts->people.evict(linIds);
+
+    if (evicted)
+        Logger::get().debug(
+            "paged out " + to_string(evicted) + " customers from " + table->getName() +
+            " partition " + to_string(loop->partition) + " (" +
+            to_string(parts->people.cold.getColdCount()) + " cold, " +
+            to_string(remaining) + " bytes hot).");
+}
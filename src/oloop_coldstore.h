@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+#include "oloop.h"
+#include "database.h"
+
+namespace openset
+{
+    namespace db
+    {
+        class Table;
+        class TablePartitioned;
+    };
+};
+
+namespace openset
+{
+    namespace async
+    {
+
+        /*
+         * OpenLoopColdStore - pages customers out of PoolMem
+         *
+         * Walks the partition (a slice at a time) collecting the customers held
+         * in PoolMem along with when they were last touched. At the end of the
+         * walk customers untouched for the table's `cold_after` are moved to the
+         * partition's ColdStore, followed by least recently touched customers
+         * until this partition is within its share of the table's `memory_budget`.
+         */
+        class OpenLoopColdStore : public OpenLoop
+        {
+            struct Candidate_s
+            {
+                uint32_t touched;
+                int32_t linId;
+            };
+
+            openset::db::Database::TablePtr table;
+            db::TablePartitioned* parts { nullptr };
+
+            int64_t linearId { 0 }; // used as iterator
+            int64_t hotBytes { 0 };
+            std::vector<Candidate_s> candidates;
+
+            void evict();
+
+        public:
+            explicit OpenLoopColdStore(const openset::db::Database::TablePtr table);
+            ~OpenLoopColdStore() final = default;
+
+            void respawn();
+
+            void prepare() final;
+            bool run() final;
+            void partitionRemoved() final {};
+        };
+    };
+};
@@ -0,0 +1,80 @@
+#include "oloop_fold.h"
+
+#include "customers.h"
+#include "customer.h"
+#include "table.h"
+#include "tablepartitioned.h"
+
+using namespace std;
+using namespace openset::async;
+using namespace openset::db;
+
+namespace
+{
+    const int64_t FOLD_INTERVAL = 10'000; // check the partition every 10 seconds
+}
+
+OpenLoopFold::OpenLoopFold(const openset::db::Database::TablePtr table) :
+    OpenLoop(table->getName()),
+    table(table)
+{}
+
+void OpenLoopFold::prepare()
+{
+    parts = table->getPartitionObjects(loop->partition, false);
+
+    if (!parts || !person.mapTable(table.get(), loop->partition))
+        suicide();
+}
+
+void OpenLoopFold::respawn()
+{
+    OpenLoop* newCell = new OpenLoopFold(table);
+    newCell->scheduleFuture(FOLD_INTERVAL);
+
+    spawn(newCell); // add replacement to scheduler
+    suicide(); // kill this cell.
+}
+
+bool OpenLoopFold::run()
+{
+    // appending is off for this table (settings can change at any time, so we keep checking)
+    if (!table->tailFold)
+    {
+        respawn();
+        return false;
+    }
+
+    const auto maxLinearId = parts->people.customerCount();
+
+    while (true)
+    {
+        if (sliceComplete())
+            return true; // let some other open loops run
+
+        if (linearId >= maxLinearId)
+        {
+            if (folded)
+                Logger::get().debug(
+                    "folded " + to_string(folded) + " customers in " + table->getName() +
+                    " partition " + to_string(loop->partition) + ".");
+
+            respawn();
+            return false;
+        }
+
+        if (const auto personData = parts->people.getCustomerByLIN(linearId); personData)
+        {
+            person.mount(personData);
+
+            if (person.getGrid()->getTailBytes() >= table->tailFold)
+            {
+                person.prepare();
+                person.fold();
+                ++folded;
+            }
+        }
+
+        ++linearId;
+    }
+}
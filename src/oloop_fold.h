@@ -0,0 +1,50 @@
+#pragma once
+
+#include "oloop.h"
+#include "customer.h"
+#include "database.h"
+
+namespace openset
+{
+    namespace db
+    {
+        class Table;
+        class TablePartitioned;
+    };
+};
+
+namespace openset
+{
+    namespace async
+    {
+
+        /*
+         * OpenLoopFold - folds appended events into customer columns
+         *
+         * Inserts that are newer than a customer's history are appended to the
+         * tail of the customer record (Grid::append) rather than re-encoding
+         * every row. This cell walks the partition (a slice at a time) and
+         * re-encodes customers whose tail has reached the table's `tail_fold`
+         * bytes.
+         */
+        class OpenLoopFold : public OpenLoop
+        {
+            openset::db::Database::TablePtr table;
+            openset::db::Customer person;
+            db::TablePartitioned* parts { nullptr };
+
+            int64_t linearId { 0 }; // used as iterator
+            int64_t folded { 0 };
+
+        public:
+            explicit OpenLoopFold(const openset::db::Database::TablePtr table);
+            ~OpenLoopFold() final = default;
+
+            void respawn();
+
+            void prepare() final;
+            bool run() final;
+            void partitionRemoved() final {};
+        };
+    };
+};
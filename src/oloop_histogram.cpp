@@ -233,12 +233,13 @@ bool OpenLoopHistogram::run()
 {
     while (true)
     {
-        if (sliceComplete())
+        // the clock is checked between batches of customers
+        if (batch.isEmpty() && sliceComplete())
             return true;
 
         // are we done? This will return the index of the
         // next set bit until there are no more, or maxLinId is met
-        if (interpreter->error.inError() || !index->linearIter(currentLinId, maxLinearId))
+        if (interpreter->error.inError() || !batch.next(index, maxLinearId, currentLinId))
         {
             shuttle->reply(
                 0,
@@ -252,6 +253,8 @@ bool OpenLoopHistogram::run()
             return false;
         }
 
+        parts->people.prefetch(batch.peek(openset::db::Customers::PREFETCH_AHEAD));
+
         if (const auto personData = parts->people.getCustomerByLIN(currentLinId); personData != nullptr)
         {
             ++runCount;
@@ -39,6 +39,7 @@ namespace openset
             int population;
             openset::query::Indexing indexing;
             openset::db::IndexBits* index;
+            openset::db::LinearBatch batch;
             openset::result::ResultSet* result;
             // loop locals
             result::RowKey rowKey;
@@ -44,6 +44,17 @@ void OpenLoopInsert::prepare()
 
 void OpenLoopInsert::OnInsert(const std::string& uuid, SegmentPartitioned_s* segment)
 {
+    const auto personData = tablePartitioned->people.createCustomer(uuid);
+    const auto& macros = segment->interpreter->macros;
+
+    // customers whose events can't match leave the segment without being decompressed
+    if (ZoneMap_s zone; personData->getZone(zone) && !zone.mayMatch(macros.zoneStart, macros.zoneEnd, macros.zoneEvents))
+    {
+        if (segment->setBit(personData->linId, false) != SegmentPartitioned_s::SegmentChange_e::noChange)
+            tablePartitioned->pushMessage(segment->segmentHash, SegmentPartitioned_s::SegmentChange_e::exit, personData->getIdStr());
+        return;
+    }
+
     Customer person;
 
     // map a table, partition and entire schema to the Customer object
@@ -52,7 +63,6 @@ void OpenLoopInsert::OnInsert(const std::string& uuid, SegmentPartitioned_s* seg
         return;
 
     // mount the customer
-    const auto personData = tablePartitioned->people.createCustomer(uuid);
     person.mount(personData);
     person.prepare();
 
@@ -155,13 +165,19 @@ bool OpenLoopInsert::run()
             tablePartitioned->people.createCustomer(stoll(uuid.first)) :
             tablePartitioned->people.createCustomer(uuid.first);
         person.mount(personData);
-        person.prepare();
 
-        // insert events for this uuid
-        for (auto &json : uuid.second)
-            person.insert(&json);
+        // events newer than the customer's history go on its tail, otherwise
+        // the customer is expanded and the events are inserted in order
+        if (!person.append(uuid.second))
+        {
+            person.prepare();
 
-        person.commit();
+            // insert events for this uuid
+            for (auto &json : uuid.second)
+                person.insert(&json);
+
+            person.commit();
+        }
 
         // run any segments flagged for "onInsert" in proper z-order
         const auto insertSegments = tablePartitioned->getOnInsertSegments();
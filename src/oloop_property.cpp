@@ -127,9 +127,8 @@ void OpenLoopProperty::prepare()
     auto idx = 0;
     for (auto s : segments)
     {
-        auto bits = all->getBits();
-        bits->opAnd(*s);
-        aggs->columns[idx].value = bits->population(stopBit);
+        auto bits = parts->attributes.getBits(all);
+        aggs->columns[idx].value = bits->andPopulation(*s, stopBit);
         delete bits;
 
         ++idx;
@@ -263,15 +262,13 @@ bool OpenLoopProperty::run()
                     if (!attr)
                         continue;
 
-                    const auto bits = attr->getBits();
+                    const auto bits = parts->attributes.getBits(attr);
                     sumBits->opOr(*bits);
                     delete bits;
                 }
 
-                // remove bits not in the segment
-                sumBits->opAnd(*s);
-
-                aggs->columns[columnIndex].value = sumBits->population(stopBit);
+                // count only the bits in the segment
+                aggs->columns[columnIndex].value = sumBits->andPopulation(*s, stopBit);
                 delete sumBits;
 
                 // we are going to handle text a little different here
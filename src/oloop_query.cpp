@@ -124,12 +124,13 @@ bool OpenLoopQuery::run()
 {
     while (true)
     {
-        if (sliceComplete())
+        // the clock is checked between batches of customers
+        if (batch.isEmpty() && sliceComplete())
             return true;
 
         // are we done? This will return the index of the
         // next set bit until there are no more, or maxLinId is met
-        if (interpreter->error.inError() || !index->linearIter(currentLinId, maxLinearId))
+        if (interpreter->error.inError() || !batch.next(index, maxLinearId, currentLinId))
         {
             result->setAccTypesFromMacros(macros);
 
@@ -147,8 +148,14 @@ bool OpenLoopQuery::run()
             return false;
         }
 
+        parts->people.prefetch(batch.peek(openset::db::Customers::PREFETCH_AHEAD));
+
         if (const auto personData = parts->people.getCustomerByLIN(currentLinId); personData != nullptr)
         {
+            // customers whose events can't match aren't decompressed
+            if (openset::db::ZoneMap_s zone; personData->getZone(zone) && !zone.mayMatch(macros.zoneStart, macros.zoneEnd, macros.zoneEvents))
+                continue;
+
             ++runCount;
             person.mount(personData);
             person.prepare();
@@ -169,6 +169,7 @@ bool OpenLoopSegmentRefresh::nextExpired()
 
         // reset the linear iterator current index
         currentLinId = -1;
+        batch.reset();
 
         ++segmentsIter;
 
@@ -221,13 +222,14 @@ bool OpenLoopSegmentRefresh::run()
 
     while (true)
     {
-        if (sliceComplete())
+        // the clock is checked between batches of customers
+        if (batch.isEmpty() && sliceComplete())
             break; // let some other cells run
 
         // are we out of bits to analyze?
         // lets move to the next expired segment
         if (interpreter->error.inError() ||
-            !index->linearIter(currentLinId, maxLinearId))
+            !batch.next(index, maxLinearId, currentLinId))
         {
 
             // TODO - log error
@@ -245,9 +247,21 @@ bool OpenLoopSegmentRefresh::run()
             return true;
         }
 
+        parts->people.prefetch(batch.peek(openset::db::Customers::PREFETCH_AHEAD));
+
         if (currentLinId < maxLinearId &&
             (personData = parts->people.getCustomerByLIN(currentLinId)) != nullptr)
         {
+            const auto& macros = interpreter->macros;
+
+            // customers whose events can't match leave the segment without being decompressed
+            if (openset::db::ZoneMap_s zone; personData->getZone(zone) && !zone.mayMatch(macros.zoneStart, macros.zoneEnd, macros.zoneEvents))
+            {
+                if (segmentInfo->setBit(currentLinId, false) != SegmentPartitioned_s::SegmentChange_e::noChange)
+                    parts->pushMessage(segmentHash, SegmentPartitioned_s::SegmentChange_e::exit, personData->getIdStr());
+                continue;
+            }
+
             ++runCount;
             person.mount(personData);
             person.prepare();
@@ -35,6 +35,7 @@ namespace openset
 
             openset::query::Indexing indexing;
             openset::db::IndexBits* index {nullptr};
+            openset::db::LinearBatch batch;
             openset::db::IndexBits* bits {nullptr};
 
             std::unordered_map<std::string, SegmentPartitioned_s>::iterator segmentsIter;
@@ -235,6 +235,7 @@ bool OpenLoopSegment::nextMacro()
 
         // reset the linear iterator current index
         currentLinId = -1;
+        batch.reset();
 
         ++macroIter;
 
@@ -273,7 +274,8 @@ bool OpenLoopSegment::run()
     openset::db::PersonData_s* personData;
     while (true)
     {
-        if (sliceComplete())
+        // the clock is checked between batches of customers
+        if (batch.isEmpty() && sliceComplete())
             return true; // let some other cells run
 
         if (!interpreter)
@@ -300,7 +302,7 @@ bool OpenLoopSegment::run()
         }
 
         // are we out of bits to analyze?
-        if (!index->linearIter(currentLinId, maxLinearId))
+        if (!batch.next(index, maxLinearId, currentLinId))
         {
 
             // add to resultBits upon query completion
@@ -315,6 +317,8 @@ bool OpenLoopSegment::run()
             return true;
         }
 
+        parts->people.prefetch(batch.peek(openset::db::Customers::PREFETCH_AHEAD));
+
         if (currentLinId < maxLinearId &&
             (personData = parts->people.getCustomerByLIN(currentLinId)) != nullptr)
         {
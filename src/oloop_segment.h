@@ -39,6 +39,7 @@ namespace openset
 
             openset::query::Indexing indexing;
             openset::db::IndexBits* index;
+            openset::db::LinearBatch batch;
             openset::db::IndexBits beforeBits;
             openset::result::ResultSet* result;
 
@@ -0,0 +1,101 @@
+#include "plancache.h"
+
+#include <algorithm>
+
+#include "config.h"
+
+using namespace openset::query;
+
+std::atomic<int64_t> PlanCache::hits { 0 };
+std::atomic<int64_t> PlanCache::misses { 0 };
+std::atomic<int64_t> PlanCache::savedMicros { 0 };
+
+std::string PlanCache::makeKey(const std::string& script, const ParamVars* params, const int64_t schemaVersion)
+{
+    auto key = script + '\x1e' + std::to_string(schemaVersion);
+
+    if (!params)
+        return key;
+
+    // ParamVars is unordered, sort the names so the same parameters make the same key
+    std::vector<std::string> names;
+    for (const auto& param : *params)
+        names.push_back(param.first);
+
+    std::sort(names.begin(), names.end());
+
+    for (const auto& name : names)
+    {
+        const auto& value = params->at(name);
+        key += '\x1e' + name + '\x1f' + std::to_string(static_cast<int>(value.typeOf())) + '\x1f' + value.getString();
+    }
+
+    return key;
+}
+
+bool PlanCache::restore(const std::string& key, Macro_s& macros)
+{
+    const auto hash = MakeHash(key);
+
+    csLock lock(cs);
+
+    const auto found = index.find(hash);
+
+    if (found == index.end() || found->second->key != key)
+    {
+        ++misses;
+        return false;
+    }
+
+    const auto iter = found->second;
+
+    macros = iter->macros;
+
+    entries.splice(entries.begin(), entries, iter);
+    ++hits;
+    savedMicros += iter->compileMicros;
+
+    return true;
+}
+
+void PlanCache::store(const std::string& key, const Macro_s& macros, const int64_t compileMicros)
+{
+    const auto budget = globals::running ? globals::running->planCacheSize : 0;
+
+    if (budget <= 0)
+        return;
+
+    const auto hash = MakeHash(key);
+
+    csLock lock(cs);
+
+    // replaces an entry with the same hash (the same key, or a collision)
+    const auto found = index.find(hash);
+    if (found != index.end())
+    {
+        entries.erase(found->second);
+        index.erase(found);
+    }
+
+    entries.push_front(Entry_s { hash, key, macros, compileMicros });
+    index.emplace(hash, entries.begin());
+
+    while (static_cast<int64_t>(entries.size()) > budget)
+    {
+        index.erase(entries.back().hash);
+        entries.pop_back();
+    }
+}
+
+void PlanCache::clear()
+{
+    csLock lock(cs);
+    entries.clear();
+    index.clear();
+}
+
+int64_t PlanCache::getEntries()
+{
+    csLock lock(cs);
+    return static_cast<int64_t>(entries.size());
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <list>
+#include <atomic>
+
+#include "common.h"
+#include "robin_hood.h"
+#include "threads/locks.h"
+#include "querycommon.h"
+
+namespace openset::query
+{
+    /*
+     * PlanCache - compiled scripts of one table
+     *
+     * Dashboards send the same few scripts over and over, and every node a
+     * query is forked to receives the script text again. RpcQuery looks the
+     * compiled Macro_s up here before running QueryParser::compileQuery, and
+     * stores what it compiles.
+     *
+     * Entries are keyed by a hash of the script, its inline parameters and
+     * the schema version of the table (Properties::version), so a script
+     * compiled against an older schema is never handed out. RpcTable clears
+     * the cache when properties are added or dropped. The least recently used
+     * entries go when a table holds more than Config::planCacheSize.
+     *
+     * Queries arrive on many threads, so the cache is locked.
+     */
+    class PlanCache
+    {
+        struct Entry_s
+        {
+            int64_t hash;
+            std::string key;
+            Macro_s macros;
+            int64_t compileMicros; // what a hit saves
+        };
+
+        using EntryList = std::list<Entry_s>;
+
+        CriticalSection cs;
+        EntryList entries; // most recently used first
+        robin_hood::unordered_map<int64_t, EntryList::iterator, robin_hood::hash<int64_t>> index;
+
+        static std::atomic<int64_t> hits;
+        static std::atomic<int64_t> misses;
+        static std::atomic<int64_t> savedMicros;
+
+    public:
+        PlanCache() = default;
+
+        PlanCache(const PlanCache&) = delete;
+        PlanCache& operator=(const PlanCache&) = delete;
+
+        // the text a compiled script is cached under
+        static std::string makeKey(const std::string& script, const ParamVars* params, const int64_t schemaVersion);
+
+        // copy the compiled script for `key` into `macros`, false on a miss
+        bool restore(const std::string& key, Macro_s& macros);
+
+        // remember a script that compiled without error
+        void store(const std::string& key, const Macro_s& macros, const int64_t compileMicros);
+
+        void clear();
+
+        int64_t getEntries();
+
+        static int64_t getHits() { return hits; }
+        static int64_t getMisses() { return misses; }
+        static int64_t getSavedMicros() { return savedMicros; }
+    };
+}
@@ -65,6 +65,7 @@ void Properties::deleteProperty(Property_s* propInfo)
         customerPropertyMap.erase(propInfo->name);
 
     propInfo->name = "___deleted";
+    ++version;
 }
 
 int Properties::getPropertyCount() const
@@ -78,7 +79,8 @@ void Properties::setProperty(
     const PropertyTypes_e type,
     const bool isSet,
     const bool isCustomerProp,
-    const bool deleted)
+    const bool deleted,
+    const bool isSliced)
 {
     csLock _lck(lock);
 
@@ -101,6 +103,7 @@ void Properties::setProperty(
     properties[index].isSet = isSet;
     properties[index].isCustomerProperty = isCustomerProp;
     properties[index].deleted = deleted;
+    properties[index].isSliced = isSliced && canSlice(type, isSet, isCustomerProp);
 
     if (!isCustomerProp && customerPropertyMap.count(name))
         customerPropertyMap.erase(name);
@@ -112,6 +115,8 @@ void Properties::setProperty(
     for (const auto& c : properties)
         if (c.type != PropertyTypes_e::freeProp)
             ++propertyCount;
+
+    ++version;
 }
 
 bool Properties::validPropertyName(const std::string& name)
@@ -5,6 +5,7 @@
 //#include <unordered_map>
 #include "robin_hood.h"
 #include <unordered_set>
+#include <atomic>
 
 #include "threads/locks.h"
 #include "dbtypes.h"
@@ -34,6 +35,7 @@ namespace openset
                 bool isSet{ false };
                 bool isCustomerProperty{ false };
                 bool deleted{ false };
+                bool isSliced{ false }; // also kept as a SlicedIndex (see canSlice)
             };
 
             using PropsMap = robin_hood::unordered_map<std::string, Property_s*, robin_hood::hash<std::string>>;
@@ -46,6 +48,9 @@ namespace openset
             PropsMap customerPropertyMap;
             int propertyCount{ 0 };
 
+            // bumped on every change, compiled scripts are cached per version (see PlanCache)
+            std::atomic<int64_t> version{ 0 };
+
             Properties();
             ~Properties();
 
@@ -69,10 +74,19 @@ namespace openset
                 const PropertyTypes_e type,
                 const bool isSet,
                 const bool isCustomerProp = false,
-                const bool deleted = false);
+                const bool deleted = false,
+                const bool isSliced = false);
 
             static bool validPropertyName(const std::string& name);
 
+            // a bit-sliced index holds one number per customer, so only int and
+            // double customer properties that are not sets can be sliced
+            static bool canSlice(const PropertyTypes_e type, const bool isSet, const bool isCustomerProp)
+            {
+                return isCustomerProp && !isSet &&
+                    (type == PropertyTypes_e::intProp || type == PropertyTypes_e::doubleProp);
+            }
+
         };
     };
 };
@@ -126,7 +126,11 @@ namespace openset
             RETURN,      // Pops the call stack leaves last item on stack
             TERM,        // this script is done
             LGCNSTAND,
-            LGCNSTOR
+            LGCNSTOR,
+            PSHCOLEQ,    // fused PSHTBLCOL, PSHLITINT/PSHLITSTR, OPEQ (see QueryParser::fuse)
+            TALLYCOL,    // fused PSHTBLCOL x `value`, MARSHAL tally
+            CALL_EACH_EQ, // CALL_EACH where the logic is property == literal
+            OP_COUNT     // number of op codes (not an op)
         }; // Marshal Functions
         enum class Marshals_e : int64_t
         {
@@ -223,7 +227,7 @@ namespace openset
             PUSH_TBL,
             BIT_OR,
             BIT_AND,
-
+            STAMP_RANGE, // customers with events between two stamps (value, rangeEnd)
         };
     }
 }
@@ -411,7 +415,12 @@ namespace openset
             { OpCode_e::CALL_TST, "CALLTST" },
             { OpCode_e::CALL_ROW, "CALLROW" },
             { OpCode_e::RETURN, "RETURN" },
-            { OpCode_e::TERM, "TERM" }
+            { OpCode_e::TERM, "TERM" },
+            { OpCode_e::LGCNSTAND, "LGCNSTAND" },
+            { OpCode_e::LGCNSTOR, "LGCNSTOR" },
+            { OpCode_e::PSHCOLEQ, "PSHCOLEQ" },
+            { OpCode_e::TALLYCOL, "TALLYCOL" },
+            { OpCode_e::CALL_EACH_EQ, "CALLEACHEQ" }
 
         };
         static const unordered_map<string, Modifiers_e> TimeModifiers = {
@@ -603,6 +612,7 @@ namespace openset
             { HintOp_e::BIT_AND, "AND" },
             { HintOp_e::PUSH_VAL, "PSH_VAL" },
             { HintOp_e::PUSH_TBL, "PSH_TBL" },
+            { HintOp_e::STAMP_RANGE, "STAMP_RNG" },
         };
         static const unordered_map<std::string, HintOp_e> OpToHintOp = {
             { ">=", HintOp_e::GTE },
@@ -622,6 +632,7 @@ namespace openset
             HintOp_e op;
             cvar value;
             int64_t hash {NONE};
+            int64_t rangeEnd {NONE};
 
             HintOp_s(const HintOp_e op, const int value)
                 : op(op),
@@ -647,6 +658,13 @@ namespace openset
                   hash(MakeHash(text))
             {}
 
+            HintOp_s(const HintOp_e op, const int64_t start, const int64_t end)
+                : op(op),
+                  value(start),
+                  hash(start),
+                  rangeEnd(end)
+            {}
+
             explicit HintOp_s(const HintOp_e op)
                 : op(op),
                   value(0)
@@ -778,6 +796,103 @@ namespace openset
 
         using InstructionList = vector<Instruction_s>;
 
+        /*
+         * Typed register code
+         *
+         * Logic lambdas (`where` clauses, `if` conditions, aggregate filters) made
+         * only of property to literal comparisons, `&&`, `||`, `!` and row or ever
+         * filters are also compiled to typed instructions (QueryParser::compileTyped).
+         * Registers hold a raw int64, a double or a bool, so these run without cvar
+         * temporaries, and text compares by hash instead of looking up the string.
+         *
+         * Registers are allocated by stack depth, a program needs at most
+         * TYPED_REGISTERS. Lambdas that can't be typed run in opRunner.
+         */
+        enum class TypedOp_e : int32_t
+        {
+            COL,      // reg[dest].i = raw property `value` of the row
+            COLDBL,   // reg[dest].d = property `value` of the row divided by `dblValue` (NONE as a double)
+            EQ,       // reg[dest].b = reg[left].i == value
+            NEQ,      // reg[dest].b = reg[left].i != value
+            LT,       // reg[dest].b = reg[left].i < value
+            LTE,      // reg[dest].b = reg[left].i <= value
+            GT,       // reg[dest].b = reg[left].i > value
+            GTE,      // reg[dest].b = reg[left].i >= value
+            EQDBL,    // reg[dest].b = reg[left].d == dblValue
+            NEQDBL,   // reg[dest].b = reg[left].d != dblValue
+            LTDBL,    // reg[dest].b = reg[left].d < dblValue
+            LTEDBL,   // reg[dest].b = reg[left].d <= dblValue
+            GTDBL,    // reg[dest].b = reg[left].d > dblValue
+            GTEDBL,   // reg[dest].b = reg[left].d >= dblValue
+            EQBOOL,   // reg[dest].b = reg[left].i is set and (reg[left].i != 0) == value
+            NEQBOOL,  // reg[dest].b = !EQBOOL
+            AND,      // reg[dest].b = reg[left].b && reg[right].b
+            OR,       // reg[dest].b = reg[left].b || reg[right].b
+            NOT,      // reg[dest].b = !reg[left].b
+            FILTER,   // reg[dest].b = row or ever filter `value` (its evalBlock is typed)
+            RET       // the lambda returns reg[left].b
+        };
+
+        static const unordered_map<TypedOp_e, string> TypedDebugStrings = {
+            { TypedOp_e::COL, "COL" },
+            { TypedOp_e::COLDBL, "COLDBL" },
+            { TypedOp_e::EQ, "EQ" },
+            { TypedOp_e::NEQ, "NEQ" },
+            { TypedOp_e::LT, "LT" },
+            { TypedOp_e::LTE, "LTE" },
+            { TypedOp_e::GT, "GT" },
+            { TypedOp_e::GTE, "GTE" },
+            { TypedOp_e::EQDBL, "EQDBL" },
+            { TypedOp_e::NEQDBL, "NEQDBL" },
+            { TypedOp_e::LTDBL, "LTDBL" },
+            { TypedOp_e::LTEDBL, "LTEDBL" },
+            { TypedOp_e::GTDBL, "GTDBL" },
+            { TypedOp_e::GTEDBL, "GTEDBL" },
+            { TypedOp_e::EQBOOL, "EQBOOL" },
+            { TypedOp_e::NEQBOOL, "NEQBOOL" },
+            { TypedOp_e::AND, "AND" },
+            { TypedOp_e::OR, "OR" },
+            { TypedOp_e::NOT, "NOT" },
+            { TypedOp_e::FILTER, "FILTER" },
+            { TypedOp_e::RET, "RET" }
+        };
+
+        const int TYPED_REGISTERS = 16;
+
+        union TypedRegister_u
+        {
+            int64_t i;
+            double d;
+            bool b;
+        };
+
+        struct TypedInstruction_s
+        {
+            TypedOp_e op;
+            int32_t dest;
+            int32_t left;
+            int32_t right;
+            int64_t value;   // grid property, int literal, text hash or filter
+            double dblValue; // double literal or divisor
+
+            TypedInstruction_s(
+                const TypedOp_e op,
+                const int32_t dest,
+                const int32_t left,
+                const int32_t right,
+                const int64_t value,
+                const double dblValue = 0)
+                : op(op),
+                  dest(dest),
+                  left(left),
+                  right(right),
+                  value(value),
+                  dblValue(dblValue)
+            {}
+        };
+
+        using TypedInstructionList = vector<TypedInstruction_s>;
+
         struct TextLiteral_s
         {
             int64_t hashValue; // xxhash of string
@@ -844,6 +959,7 @@ namespace openset
             bool isNext {false};
             bool isLookAhead {false}; // for within
             bool isLookBack {false}; // for within
+            bool isStampKnown {false}; // rangeStart and rangeEnd hold the scope, set when its params are literals
 
             int evalBlock {-1};
             int continueBlock {-1};
@@ -893,11 +1009,22 @@ namespace openset
             PropLookAside props;
             FilterList filters;
             InstructionList code;
+            TypedInstructionList typedCode;
+            std::vector<int32_t> typedLambdas; // per lambda, start of its typed code or -1 (empty if none are typed)
+            std::vector<bool> selectLambdas; // per lambda, typed code that only compares properties (see Interpreter::selectRows)
             HintPairs indexes;
             std::string capturedIndex;
             std::string rawIndex;
             HintOpList index;
             bool indexIsCountable { false };
+
+            // what a customer's events must span to match (see ZoneMap_s), the
+            // stamps of every indexed condition and events one of which is
+            // required (empty for any)
+            int64_t zoneStart { LLONG_MIN };
+            int64_t zoneEnd { LLONG_MAX };
+            std::vector<int64_t> zoneEvents;
+
             string segmentName;
             SegmentList segments;
             MarshalSet marshalsReferenced;
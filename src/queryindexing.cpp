@@ -5,6 +5,40 @@
 using namespace openset::query;
 using namespace openset::db;
 
+namespace
+{
+    Attributes::listMode_e toListMode(const HintOp_e op)
+    {
+        switch (op)
+        {
+        case HintOp_e::NEQ:
+            return Attributes::listMode_e::NEQ;
+        case HintOp_e::GT:
+            return Attributes::listMode_e::GT;
+        case HintOp_e::GTE:
+            return Attributes::listMode_e::GTE;
+        case HintOp_e::LT:
+            return Attributes::listMode_e::LT;
+        case HintOp_e::LTE:
+            return Attributes::listMode_e::LTE;
+        default:
+            return Attributes::listMode_e::EQ;
+        }
+    }
+
+    bool isComparison(const HintOp_e op)
+    {
+        return op == HintOp_e::EQ || op == HintOp_e::NEQ ||
+            op == HintOp_e::GT || op == HintOp_e::GTE ||
+            op == HintOp_e::LT || op == HintOp_e::LTE;
+    }
+
+    bool isLeaf(const HintOp_e op)
+    {
+        return isComparison(op) || op == HintOp_e::STAMP_RANGE;
+    }
+}
+
 openset::query::Indexing::Indexing() :
     table(nullptr),
     parts(nullptr),
@@ -17,6 +51,7 @@ Indexing::~Indexing() = default;
 void Indexing::mount(Table* tablePtr, Macro_s& queryMacros, int partitionNumber, int stopAtBit)
 {
     indexes.clear();
+    plans.clear();
     table = tablePtr;
     macros = queryMacros;
     partition = partitionNumber;
@@ -27,7 +62,7 @@ void Indexing::mount(Table* tablePtr, Macro_s& queryMacros, int partitionNumber,
     // in a vector of indexes using an std::pair of name and index
     for (auto &p : queryMacros.indexes)
     {
-        const auto index = buildIndex(p.second, queryMacros.indexIsCountable);
+        const auto index = buildIndex(p.first, p.second, queryMacros.indexIsCountable);
         indexes.emplace_back(p.first, index, queryMacros.indexIsCountable);
     }
 }
@@ -61,6 +96,11 @@ openset::db::IndexBits Indexing::compositeBits(Attributes::listMode_e mode)
 
     const auto propInfo = table->getProperties()->getProperty(entry.columnName);
 
+    // double properties are indexed (and sliced) in 10,000ths (see Grid), the
+    // hint holds a double literal in millionths and an int literal unscaled
+    if (propInfo->type == PropertyTypes_e::doubleProp && entry.hash != NONE)
+        entry.hash = static_cast<int64_t>(entry.value.getDouble() * 10'000);
+
     // if the value side is NONE we go check for presence
 
     auto negate = false;
@@ -78,32 +118,49 @@ openset::db::IndexBits Indexing::compositeBits(Attributes::listMode_e mode)
             negate = true; // != VAL -- anything other than VAL
     }
 
-    auto attrList = parts->attributes.getPropertyValues(propInfo->idx, mode, entry.hash);
-
     auto& resultBits = entry.bits; // where our bits will all accumulate
-    resultBits.reset();
-    auto initialized = false;
 
-    for (auto attr: attrList)
+    // ranges over a sliced property are answered from its slices rather
+    // than by OR'ing the index of every value in the range
+    if (propInfo->isSliced && entry.hash != NONE)
     {
-        // get the bits
-        const auto workBits = attr->getBits();
+        auto rangeMode = SlicedIndex::Range_e::gt;
+        auto isRange = true;
 
-        if (initialized)
+        switch (mode)
         {
-            resultBits.opOr(*workBits);
+        case Attributes::listMode_e::GT:
+            rangeMode = SlicedIndex::Range_e::gt;
+            break;
+        case Attributes::listMode_e::GTE:
+            rangeMode = SlicedIndex::Range_e::gte;
+            break;
+        case Attributes::listMode_e::LT:
+            rangeMode = SlicedIndex::Range_e::lt;
+            break;
+        case Attributes::listMode_e::LTE:
+            rangeMode = SlicedIndex::Range_e::lte;
+            break;
+        default:
+            isRange = false;
         }
-        else
+
+        if (const auto sliced = isRange ? parts->attributes.getSliced(propInfo->idx) : nullptr; sliced)
         {
-            resultBits.opCopy(*workBits);
-            initialized = true;
+            sliced->range(rangeMode, entry.hash, resultBits);
+            return resultBits;
         }
-
-        // clean up them bits
-        delete workBits;
     }
 
-    if (!initialized)
+    auto attrList = parts->attributes.getPropertyValues(propInfo->idx, mode, entry.hash);
+
+    resultBits.reset();
+
+    // each index is ORed in from its containers, none are mounted on their own
+    for (auto attr: attrList)
+        parts->attributes.orBits(attr, resultBits);
+
+    if (attrList.empty())
         resultBits.makeBits(64, 0);
 
     if (negate)
@@ -144,15 +201,8 @@ OR             |
 OR             |
 OR             |
  */
-IndexBits Indexing::buildIndex(HintOpList &index, bool countable)
+IndexBits Indexing::buildIndex(const std::string& name, HintOpList &index, bool countable)
 {
-
-    struct IndexStack_s
-    {
-        IndexBits bits;
-
-    };
-
     const auto maxLinId = parts->people.customerCount();
 
     if (!stopBit)
@@ -164,90 +214,360 @@ IndexBits Indexing::buildIndex(HintOpList &index, bool countable)
         return bits;
     }
 
-    std::string columnName;
+    plans.emplace_back();
+    auto& plan = plans.back();
+    plan.name = name;
+    plan.root = makePlan(index, plan);
+
+    // No Index Hints?
+    if (plan.root == -1)
+    {
+        IndexBits bits;
+        bits.makeBits(maxLinId, 1);
+        countable = false;
+        return bits;
+    }
+
+    estimate(plan, plan.root);
+
+    auto res = evaluate(plan, plan.root);
+    res.grow((stopBit / 64) + 1);
+    return res;
+}
 
-    auto count = 0;
+/*
+ The hint list is postfix, the plan is the tree it describes. AND and OR are
+ commutative so their operands can run in any order, the order is chosen in
+ evaluate from the estimates.
+
+ Returns the root node, or -1 if there is nothing to index on.
+ */
+int32_t Indexing::makePlan(HintOpList& index, Plan_s& plan) const
+{
+    std::vector<int32_t> operands;
+    std::string columnName;
 
-    for (auto &op : index)
+    for (auto& op : index)
     {
         switch (op.op)
         {
-        case HintOp_e::UNSUPPORTED: break;
-        case HintOp_e::EQ:
-            compositeBits(Attributes::listMode_e::EQ);
-            ++count;
+        case HintOp_e::PUSH_TBL:
+            columnName = op.value.getString();
             break;
-        case HintOp_e::NEQ:
-            compositeBits(Attributes::listMode_e::NEQ);
-            ++count;
+        case HintOp_e::PUSH_VAL:
+        {
+            PlanNode_s node;
+            node.columnName = columnName;
+            node.value = op.value;
+            node.hash = op.hash;
+
+            plan.nodes.push_back(std::move(node));
+            operands.push_back(static_cast<int32_t>(plan.nodes.size()) - 1);
+        }
             break;
+        case HintOp_e::EQ:
+        case HintOp_e::NEQ:
         case HintOp_e::GT:
-            compositeBits(Attributes::listMode_e::GT);
-            ++count;
-            break;
         case HintOp_e::GTE:
-            compositeBits(Attributes::listMode_e::GTE);
-            ++count;
-            break;
         case HintOp_e::LT:
-            compositeBits(Attributes::listMode_e::LT);
-            ++count;
-            break;
         case HintOp_e::LTE:
-            compositeBits(Attributes::listMode_e::LTE);
-            ++count;
-            break;
-        case HintOp_e::PUSH_VAL:
-            if (!columnName.length())
-            {
-                // THROW
-            }
-            stack.emplace_back(columnName, op.value, op.hash);
-            break;
-        case HintOp_e::PUSH_TBL:
-            columnName = op.value.getString();
+            if (operands.empty() || plan.nodes[operands.back()].op != HintOp_e::UNSUPPORTED)
+                return -1;
+
+            plan.nodes[operands.back()].op = op.op;
             break;
-        case HintOp_e::BIT_OR:
+        case HintOp_e::STAMP_RANGE:
         {
-            auto left = stack.back().bits;
-            stack.pop_back();
-            auto right = stack.back().bits;
-            stack.pop_back();
-
-            left.opOr(right);
-                stack.emplace_back(left);
-
-            ++count;
+            PlanNode_s node;
+            node.op = op.op;
+            node.value = op.value;
+            node.hash = op.hash;
+            node.rangeEnd = op.rangeEnd;
+
+            plan.nodes.push_back(std::move(node));
+            operands.push_back(static_cast<int32_t>(plan.nodes.size()) - 1);
         }
             break;
+        case HintOp_e::BIT_OR:
         case HintOp_e::BIT_AND:
         {
-            auto left = stack.back().bits;
-            stack.pop_back();
-            auto right = stack.back().bits;
-            stack.pop_back();
+            if (operands.size() < 2)
+                return -1;
+
+            PlanNode_s node;
+            node.op = op.op;
+
+            for (const auto child : { operands[operands.size() - 2], operands.back() })
+            {
+                const auto& childNode = plan.nodes[child];
 
-            left.opAnd(right);
-                stack.emplace_back(left);
+                if (childNode.op == HintOp_e::UNSUPPORTED)
+                    return -1;
 
-            ++count;
+                // (a AND b) AND c is one chain of three
+                if (childNode.op == op.op)
+                    node.children.insert(node.children.end(), childNode.children.begin(), childNode.children.end());
+                else
+                    node.children.push_back(child);
+            }
+
+            operands.pop_back();
+            operands.pop_back();
+
+            plan.nodes.push_back(std::move(node));
+            operands.push_back(static_cast<int32_t>(plan.nodes.size()) - 1);
         }
             break;
         default: ;
         }
     }
 
-    // No Index Hints?
-    if (!stack.size() || !count)
+    if (operands.empty() || plan.nodes[operands.back()].op == HintOp_e::UNSUPPORTED)
+        return -1;
+
+    return operands.back();
+}
+
+int64_t Indexing::estimate(Plan_s& plan, const int32_t node)
+{
+    int64_t result;
+
+    switch (plan.nodes[node].op)
     {
-        IndexBits bits;
-        bits.makeBits(maxLinId, 1);
-        countable = false;
-        return bits;
+    case HintOp_e::BIT_AND:
+        // no more than the smallest operand
+        result = stopBit;
+        for (const auto child : plan.nodes[node].children)
+            result = std::min(result, estimate(plan, child));
+        break;
+    case HintOp_e::BIT_OR:
+        // no more than the operands together
+        result = 0;
+        for (const auto child : plan.nodes[node].children)
+            result += estimate(plan, child);
+        result = std::min<int64_t>(result, stopBit);
+        break;
+    default:
+        result = estimateLeaf(plan.nodes[node]);
     }
 
-    auto res = stack.back().bits;
-    res.grow((stopBit / 64) + 1);
-    return res;
+    plan.nodes[node].estimate = result;
+    return result;
+}
+
+/*
+ Leaves are estimated from the populations stored with each index (see
+ Attributes::getPopulation), nothing is decoded.
+ */
+int64_t Indexing::estimateLeaf(const PlanNode_s& node)
+{
+    if (node.op == HintOp_e::STAMP_RANGE)
+    {
+        if (!parts->bucketsComplete)
+            return stopBit;
+
+        int64_t total = 0;
+        for (const auto attr : parts->attributes.getTimeBuckets(node.hash, node.rangeEnd))
+            total += parts->attributes.getPopulation(attr);
+
+        return std::min<int64_t>(total, stopBit);
+    }
+
+    const auto propInfo = table->getProperties()->getProperty(node.columnName);
+
+    if (!propInfo)
+        return 0;
+
+    auto& attributes = parts->attributes;
+
+    // doubles are looked up at the scale they are indexed, as in compositeBits
+    const auto hash = propInfo->type == PropertyTypes_e::doubleProp && node.hash != NONE ?
+        static_cast<int64_t>(node.value.getDouble() * 10'000) :
+        node.hash;
+
+    const auto populationOf = [&](const Attributes::listMode_e mode, const int64_t value) -> int64_t
+    {
+        int64_t total = 0;
+        for (const auto attr : attributes.getPropertyValues(propInfo->idx, mode, value))
+            total += attributes.getPopulation(attr);
+        return total;
+    };
+
+    int64_t result;
+
+    switch (node.op)
+    {
+    case HintOp_e::EQ:
+        result = hash == NONE ?
+            stopBit - populationOf(Attributes::listMode_e::PRESENT, 0) :
+            populationOf(Attributes::listMode_e::EQ, hash);
+        break;
+    case HintOp_e::NEQ:
+        result = hash == NONE ?
+            populationOf(Attributes::listMode_e::PRESENT, 0) :
+            stopBit - populationOf(Attributes::listMode_e::EQ, hash);
+        break;
+    default:
+        result = populationOf(toListMode(node.op), hash);
+    }
+
+    return std::max<int64_t>(0, std::min<int64_t>(result, stopBit));
+}
+
+/*
+ AND chains run the smallest operand first and stop once the result is
+ empty, OR chains run the largest first and stop once every customer is in
+ the result. Operands after the stop are never decoded.
+ */
+IndexBits Indexing::evaluate(Plan_s& plan, const int32_t node)
+{
+    IndexBits result;
+
+    const auto op = plan.nodes[node].op;
+
+    if (!isLeaf(op))
+    {
+        const auto isAnd = op == HintOp_e::BIT_AND;
+        auto order = plan.nodes[node].children;
+
+        std::stable_sort(
+            order.begin(),
+            order.end(),
+            [&](const int32_t left, const int32_t right) -> bool
+            {
+                return isAnd ?
+                    plan.nodes[left].estimate < plan.nodes[right].estimate :
+                    plan.nodes[left].estimate > plan.nodes[right].estimate;
+            });
+
+        plan.nodes[node].children = order;
+
+        auto first = true;
+        int64_t population = 0;
+
+        for (const auto child : order)
+        {
+            if (first)
+            {
+                result = evaluate(plan, child);
+                first = false;
+            }
+            else
+            {
+                auto bits = evaluate(plan, child);
+
+                if (isAnd)
+                    result.opAnd(bits);
+                else
+                    result.opOr(bits);
+            }
+
+            population = result.population(stopBit);
+
+            if (isAnd ? population == 0 : population >= stopBit)
+                break;
+        }
+
+        plan.nodes[node].population = population;
+        return result;
+    }
+
+    auto& leaf = plan.nodes[node];
+
+    if (op == HintOp_e::STAMP_RANGE)
+    {
+        result = stampBits(leaf);
+        leaf.population = result.population(stopBit);
+        return result;
+    }
+
+    stack.emplace_back(leaf.columnName, leaf.value, leaf.hash);
+    compositeBits(toListMode(op));
+
+    result = std::move(stack.back().bits);
+    stack.pop_back();
+
+    leaf.population = result.population(stopBit);
+    return result;
+}
+
+/*
+ The customers with events between two stamps are the OR of the week and day
+ buckets covering them. Until every customer in the partition has been put in
+ its buckets (see TablePartitioned::bucketsComplete) this is everyone.
+ */
+IndexBits Indexing::stampBits(const PlanNode_s& node)
+{
+    IndexBits result;
+
+    if (!parts->bucketsComplete)
+    {
+        result.makeBits(stopBit, 1);
+        return result;
+    }
+
+    const auto buckets = parts->attributes.getTimeBuckets(node.hash, node.rangeEnd);
+
+    for (const auto attr : buckets)
+        parts->attributes.orBits(attr, result);
+
+    if (buckets.empty())
+        result.makeBits(64, 0);
+
+    return result;
+}
+
+std::string Indexing::explain() const
+{
+    std::stringstream out;
+
+    for (const auto& plan : plans)
+    {
+        out << "index " << plan.name << ":" << endl;
+
+        if (plan.root == -1)
+            out << "    every customer (no index hints)" << endl;
+        else
+            explainNode(plan, plan.root, 1, out);
+    }
+
+    return out.str();
+}
+
+void Indexing::explainNode(const Plan_s& plan, const int32_t node, const int depth, std::stringstream& out)
+{
+    static const std::unordered_map<HintOp_e, std::string> symbols = {
+        { HintOp_e::EQ, "==" },
+        { HintOp_e::NEQ, "!=" },
+        { HintOp_e::GT, ">" },
+        { HintOp_e::GTE, ">=" },
+        { HintOp_e::LT, "<" },
+        { HintOp_e::LTE, "<=" },
+        { HintOp_e::BIT_AND, "AND" },
+        { HintOp_e::BIT_OR, "OR" },
+    };
+
+    const auto& item = plan.nodes[node];
+    const auto symbol = symbols.find(item.op);
+
+    out << std::string(depth * 4, ' ');
+
+    if (isComparison(item.op))
+        out << "@" << item.columnName << " " << symbol->second << " " << (item.hash == NONE ? "nil"s : item.value.getString());
+    else if (item.op == HintOp_e::STAMP_RANGE)
+        out << "events from " << item.hash << " to " << item.rangeEnd;
+    else
+        out << (symbol == symbols.end() ? "?"s : symbol->second);
+
+    out << "  (estimate " << item.estimate << ", ";
+
+    if (item.population == -1)
+        out << "skipped)";
+    else
+        out << "population " << item.population << ")";
+
+    out << endl;
 
+    for (const auto child : item.children)
+        explainNode(plan, child, depth + 1, out);
 }
@@ -5,6 +5,7 @@
 #include "indexbits.h"
 #include "table.h"
 #include <stack>
+#include <sstream>
 
 namespace openset
 {
@@ -36,6 +37,31 @@ namespace openset
             using IndexPair = std::tuple<std::string, openset::db::IndexBits, bool>;
             using IndexList = std::vector<IndexPair>;
 
+            // a node in an index plan. Leaves compare a property to a value (or
+            // select customers with events between two stamps), branches AND or
+            // OR their children (a chain of the same operator is flattened into
+            // one branch so it can be reordered)
+            struct PlanNode_s
+            {
+                HintOp_e op { HintOp_e::UNSUPPORTED };
+                std::string columnName;
+                cvar value { NONE };
+                int64_t hash { NONE };
+                int64_t rangeEnd { NONE };     // STAMP_RANGE, `hash` is the start
+                std::vector<int32_t> children; // in the order they were evaluated
+                int64_t estimate { 0 };        // expected population
+                int64_t population { -1 };     // actual population, -1 if skipped
+            };
+
+            struct Plan_s
+            {
+                std::string name;
+                std::vector<PlanNode_s> nodes;
+                int32_t root { -1 };
+            };
+
+            using PlanList = std::vector<Plan_s>;
+
             Stack stack;
 
             Macro_s macros;
@@ -44,6 +70,7 @@ namespace openset
             int partition;
             int stopBit;
             IndexList indexes;
+            PlanList plans;
 
             Indexing();
             ~Indexing();
@@ -58,8 +85,19 @@ namespace openset
 
             openset::db::IndexBits* getIndex(std::string name, bool &countable);
 
+            // the plans chosen for the indexes, as text
+            std::string explain() const;
+
         private:
-            openset::db::IndexBits buildIndex(HintOpList &index, bool countable);
+            openset::db::IndexBits buildIndex(const std::string& name, HintOpList &index, bool countable);
+
+            int32_t makePlan(HintOpList& index, Plan_s& plan) const;
+            int64_t estimate(Plan_s& plan, const int32_t node);
+            int64_t estimateLeaf(const PlanNode_s& node);
+            openset::db::IndexBits evaluate(Plan_s& plan, const int32_t node);
+            openset::db::IndexBits stampBits(const PlanNode_s& node);
+
+            static void explainNode(const Plan_s& plan, const int32_t node, const int depth, std::stringstream& out);
         };
     };
 };
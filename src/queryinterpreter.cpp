@@ -1,13 +1,21 @@
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include "queryinterpreter.h"
 #include "time/epoch.h"
 #include "table.h"
 #include "properties.h"
 #include "grid.h"
+#include "config.h"
+#include "bitkernels.h"
 //const int MAX_EXEC_COUNT = 1'000'000'000;
 const int MAX_RECURSE_COUNT = 10;
 const int STACK_DEPTH       = 64;
+const int SELECT_BATCH      = 512; // rows selected at a time for each_row filters (see selectRows)
+const int SELECT_MIN_ROWS   = 64;  // customers with fewer rows test one row at a time
+
+std::atomic<int64_t> openset::query::Interpreter::opCounts[static_cast<int>(OpCode_e::OP_COUNT)];
+std::atomic<int64_t> openset::query::Interpreter::opPairCounts[static_cast<int>(OpCode_e::OP_COUNT) * static_cast<int>(OpCode_e::OP_COUNT)];
 
 openset::query::Interpreter::Interpreter(Macro_s& macros, const InterpretMode_e interpretMode)
     : macros(macros),
@@ -17,6 +25,7 @@ openset::query::Interpreter::Interpreter(Macro_s& macros, const InterpretMode_e
 {
     stack    = new cvar[STACK_DEPTH];
     stackPtr = stack;
+    countOps = globals::running && globals::running->opCounts;
 }
 
 openset::query::Interpreter::~Interpreter()
@@ -97,8 +106,8 @@ void openset::query::Interpreter::mount(Customer* person)
     grid     = person->getGrid(); // const
     blob     = grid->getAttributeBlob();
     attrs    = grid->getAttributes();
-    rows     = grid->getRows(); // const
-    rowCount = rows->size();
+    gridColumns = grid->getColumns(); // const
+    rowCount    = static_cast<int>(gridColumns->rowCount);
 
     if (firstRun)
     {
@@ -130,7 +139,7 @@ void openset::query::Interpreter::mount(Customer* person)
         linid = person->getMeta()->linId;
     }
     stackPtr = stack;
-    if (!isConfigured && rows->size())
+    if (!isConfigured && rowCount)
         configure();
 }
 
@@ -164,156 +173,168 @@ void openset::query::Interpreter::extractMarshalParams(const int paramCount)
     }
 }
 
-void openset::query::Interpreter::marshal_tally(const int paramCount, const Col_s* columns, const int currentRow)
+int64_t openset::query::Interpreter::tallyKey(const cvar& value)
 {
-    if (paramCount <= 0)
-        return;                       // pop the stack into a pre-allocated array of cvars in reverse order
-    extractMarshalParams(paramCount); // strings, doubles, and bools are all ints internally,
+    // strings, doubles, and bools are all ints internally,
     // this will ensure non-int types are represented as ints
     // during grouping
-    const auto fixToInt = [&](const cvar& value) -> int64_t
+    switch (value.typeOf())
+    {
+    case cvar::valueType::INT32: case cvar::valueType::INT64:
+        return value.getInt64();
+    case cvar::valueType::FLT: case cvar::valueType::DBL:
+        return value.getDouble() * 10000;
+    case cvar::valueType::STR:
+    {
+        const auto tString = value.getString();
+        const auto hash    = MakeHash(tString);
+        result->addLocalText(hash, tString); // cache this text
+        return hash;
+    }
+    case cvar::valueType::BOOL:
+        return value.getBool()
+                   ? 1
+                   : 0;
+    default:
+        return NONE;
+    }
+}
+
+openset::result::ResultTypes_e openset::query::Interpreter::tallyType(const cvar& value)
+{
+    switch (value.typeOf())
+    {
+    case cvar::valueType::INT32:
+    case cvar::valueType::INT64:
+        return result::ResultTypes_e::Int;
+    case cvar::valueType::FLT:
+    case cvar::valueType::DBL:
+        return result::ResultTypes_e::Double;
+    case cvar::valueType::STR:
+        return result::ResultTypes_e::Text;
+    case cvar::valueType::BOOL:
+        return result::ResultTypes_e::Bool;
+    default:
+        return result::ResultTypes_e::None;
+    }
+}
+
+void openset::query::Interpreter::tallyColumns(result::Accumulator* resultColumns, const int currentRow)
+{
+    // sometimes we have no rows (customer props only), the empty row is full of NONE values
+    const auto emptyRow = currentRow >= rowCount || currentRow < 0 ? grid->getEmptyRow() : nullptr;
+    const auto cell = [&](const int32_t column)
     {
-        switch (value.typeOf())
-        {
-        case cvar::valueType::INT32: case cvar::valueType::INT64:
-            return value.getInt64();
-        case cvar::valueType::FLT: case cvar::valueType::DBL:
-            return value.getDouble() * 10000;
-        case cvar::valueType::STR:
-        {
-            const auto tString = value.getString();
-            const auto hash    = MakeHash(tString);
-            result->addLocalText(hash, tString); // cache this text
-            return hash;
-        }
-        case cvar::valueType::BOOL:
-            return value.getBool()
-                       ? 1
-                       : 0;
-        default:
-            return NONE;
-        }
+        return emptyRow ? emptyRow->cols[column] : gridColumns->column(column)[currentRow];
     };
-    const auto getType = [&](const cvar& value) -> result::ResultTypes_e
-    {
-        switch (value.typeOf())
-        {
-        case cvar::valueType::INT32:
-        case cvar::valueType::INT64:
-            return result::ResultTypes_e::Int;
-        case cvar::valueType::FLT:
-        case cvar::valueType::DBL:
-            return result::ResultTypes_e::Double;
-        case cvar::valueType::STR:
-            return result::ResultTypes_e::Text;
-        case cvar::valueType::BOOL:
-            return result::ResultTypes_e::Bool;
-        default:
-            return result::ResultTypes_e::None;
+
+    for (auto& resCol : macros.vars.columnVars)
+    {
+        if (!resCol.nonDistinct) // if the 'all' flag was NOT used on an aggregator
+        {
+            /*
+             * This is where we make the "counting key" for our aggregator. If we have already seen
+             * a key we will never aggregate again using that key (the keys cache/hash "eventDistinct" is reset
+             * upon when we switch to another customer record before we re-execute the query script on that customer.
+             *
+             * The key is a compound key made by taking in the following parameters:
+             *
+             *   - index: the index of the property being counted in this iterator of "columnVars"
+             *   - distinct: usually the value of the property in an event row, or an alternate property to count distinctly
+             *               in the event row... or when it is a variable (rather than an event property) the
+             *               value of that variable.
+             *   - countKey: when counting people, stamp is zero (because we don't want to count a customer more than once),
+             *               otherwise it is set to the row-number so we don't count a value for a row twice... or
+             *               when we are counting with the special flag "useStampedRowIds" we use the timestamp of the row
+             *               allowing multiple rows with the same stamp to be counted as if they were part of one larger
+             *               row.
+             *   - property:   integer version of the pointer to the result set ("resultColumns"). This is because each
+             *               result grouping has it's own "resultColumns" and we must distinguish whether we have counted
+             *               for a specific group or not before (i.e. the keys above could potentially be met on another group)
+             *
+             */
+            distinctKey.set(
+                resCol.index,
+                (resCol.modifier == Modifiers_e::var) ?
+                    tallyKey(resCol.value) :
+                    cell(resCol.distinctColumn),
+                (resCol.schemaColumn == PROP_UUID || resCol.modifier == Modifiers_e::dist_count_person) ?
+                    0 :
+                   (macros.useStampedRowIds ?
+                           cell(PROP_STAMP) :
+                           currentRow),
+                reinterpret_cast<int64_t>(resultColumns));
+            if (eventDistinct.count(distinctKey))
+                continue;
+            eventDistinct.emplace(distinctKey, 1);
         }
-    };
-    const auto aggColumns = [&](result::Accumulator* resultColumns)
-    {
-        for (auto& resCol : macros.vars.columnVars)
-        {
-            if (!resCol.nonDistinct) // if the 'all' flag was NOT used on an aggregator
-            {
-                /*
-                 * This is where we make the "counting key" for our aggregator. If we have already seen
-                 * a key we will never aggregate again using that key (the keys cache/hash "eventDistinct" is reset
-                 * upon when we switch to another customer record before we re-execute the query script on that customer.
-                 *
-                 * The key is a compound key made by taking in the following parameters:
-                 *
-                 *   - index: the index of the property being counted in this iterator of "columnVars"
-                 *   - distinct: usually the value of the property in an event row, or an alternate property to count distinctly
-                 *               in the event row... or when it is a variable (rather than an event property) the
-                 *               value of that variable.
-                 *   - countKey: when counting people, stamp is zero (because we don't want to count a customer more than once),
-                 *               otherwise it is set to the row-number so we don't count a value for a row twice... or
-                 *               when we are counting with the special flag "useStampedRowIds" we use the timestamp of the row
-                 *               allowing multiple rows with the same stamp to be counted as if they were part of one larger
-                 *               row.
-                 *   - property:   integer version of the pointer to the result set ("resultColumns"). This is because each
-                 *               result grouping has it's own "resultColumns" and we must distinguish whether we have counted
-                 *               for a specific group or not before (i.e. the keys above could potentially be met on another group)
-                 *
-                 */
-                distinctKey.set(
-                    resCol.index,
-                    (resCol.modifier == Modifiers_e::var) ?
-                        fixToInt(resCol.value) :
-                        columns->cols[resCol.distinctColumn],
-                    (resCol.schemaColumn == PROP_UUID || resCol.modifier == Modifiers_e::dist_count_person) ?
-                        0 :
-                       (macros.useStampedRowIds ?
-                               columns->cols[PROP_STAMP] :
-                               currentRow),
-                    reinterpret_cast<int64_t>(resultColumns));
-                if (eventDistinct.count(distinctKey))
-                    continue;
-                eventDistinct.emplace(distinctKey, 1);
+        const auto resultIndex = resCol.index + segmentColumnShift;
+        switch (resCol.modifier)
+        {
+        case Modifiers_e::sum:
+            if (cell(resCol.column) != NONE)
+            {
+                if (resultColumns->columns[resultIndex].value == NONE)
+                    resultColumns->columns[resultIndex].value = cell(resCol.column);
+                else
+                    resultColumns->columns[resultIndex].value += cell(resCol.column);
             }
-            const auto resultIndex = resCol.index + segmentColumnShift;
-            switch (resCol.modifier)
+            break;
+        case Modifiers_e::min:
+            if (cell(resCol.column) != NONE && (resultColumns->columns[resultIndex].value == NONE ||
+                resultColumns->columns[resultIndex].value > cell(resCol.column)))
+                resultColumns->columns[resultIndex].value = cell(resCol.column);
+            break;
+        case Modifiers_e::max:
+            if (cell(resCol.column) != NONE && (resultColumns->columns[resultIndex].value == NONE ||
+                resultColumns->columns[resultIndex].value < cell(resCol.column)))
+                resultColumns->columns[resultIndex].value = cell(resCol.column);
+            break;
+        case Modifiers_e::avg:
+            if (cell(resCol.column) != NONE)
             {
-            case Modifiers_e::sum:
-                if (columns->cols[resCol.column] != NONE)
+                if (resultColumns->columns[resultIndex].value == NONE)
                 {
-                    if (resultColumns->columns[resultIndex].value == NONE)
-                        resultColumns->columns[resultIndex].value = columns->cols[resCol.column];
-                    else
-                        resultColumns->columns[resultIndex].value += columns->cols[resCol.column];
+                    resultColumns->columns[resultIndex].value = cell(resCol.column);
+                    resultColumns->columns[resultIndex].count = 1;
                 }
-                break;
-            case Modifiers_e::min:
-                if (columns->cols[resCol.column] != NONE && (resultColumns->columns[resultIndex].value == NONE ||
-                    resultColumns->columns[resultIndex].value > columns->cols[resCol.column]))
-                    resultColumns->columns[resultIndex].value = columns->cols[resCol.column];
-                break;
-            case Modifiers_e::max:
-                if (columns->cols[resCol.column] != NONE && (resultColumns->columns[resultIndex].value == NONE ||
-                    resultColumns->columns[resultIndex].value < columns->cols[resCol.column]))
-                    resultColumns->columns[resultIndex].value = columns->cols[resCol.column];
-                break;
-            case Modifiers_e::avg:
-                if (columns->cols[resCol.column] != NONE)
-                {
-                    if (resultColumns->columns[resultIndex].value == NONE)
-                    {
-                        resultColumns->columns[resultIndex].value = columns->cols[resCol.column];
-                        resultColumns->columns[resultIndex].count = 1;
-                    }
-                    else
-                    {
-                        resultColumns->columns[resultIndex].value += columns->cols[resCol.column];
-                        resultColumns->columns[resultIndex].count++;
-                    }
-                }
-                break;
-            case Modifiers_e::dist_count_person: case Modifiers_e::count:
-                if (columns->cols[resCol.column] != NONE)
+                else
                 {
-                    if (resultColumns->columns[resultIndex].value == NONE)
-                        resultColumns->columns[resultIndex].value = 1;
-                    else
-                        resultColumns->columns[resultIndex].value++;
+                    resultColumns->columns[resultIndex].value += cell(resCol.column);
+                    resultColumns->columns[resultIndex].count++;
                 }
-                break;
-            case Modifiers_e::value:
-                resultColumns->columns[resultIndex].value = columns->cols[resCol.column];
-                break;
-            case Modifiers_e::var:
+            }
+            break;
+        case Modifiers_e::dist_count_person: case Modifiers_e::count:
+            if (cell(resCol.column) != NONE)
+            {
                 if (resultColumns->columns[resultIndex].value == NONE)
-                    resultColumns->columns[resultIndex].value = 1; //fixToInt(resCol.value);
+                    resultColumns->columns[resultIndex].value = 1;
                 else
-                    resultColumns->columns[resultIndex].value++; //+= fixToInt(resCol.value);
-                break;
-            default:
-                break;
+                    resultColumns->columns[resultIndex].value++;
             }
+            break;
+        case Modifiers_e::value:
+            resultColumns->columns[resultIndex].value = cell(resCol.column);
+            break;
+        case Modifiers_e::var:
+            if (resultColumns->columns[resultIndex].value == NONE)
+                resultColumns->columns[resultIndex].value = 1; //tallyKey(resCol.value);
+            else
+                resultColumns->columns[resultIndex].value++; //+= tallyKey(resCol.value);
+            break;
+        default:
+            break;
         }
-    };
+    }
+}
+
+void openset::query::Interpreter::marshal_tally(const int paramCount, const int currentRow)
+{
+    if (paramCount <= 0)
+        return;                       // pop the stack into a pre-allocated array of cvars in reverse order
+    extractMarshalParams(paramCount);
+
     rowKey.clear(); // run property lambdas!
     if (macros.vars.columnLambdas.size())
         for (auto lambdaIndex : macros.vars.columnLambdas)
@@ -326,13 +347,72 @@ void openset::query::Interpreter::marshal_tally(const int paramCount, const Col_
     {
         if (depth == paramCount || (item.typeOf() != cvar::valueType::STR && item == NONE))
             break;
-        rowKey.key[depth]   = fixToInt(item);
-        rowKey.types[depth] = getType(item); //result->setAtDepth(rowKey, set_cb);
-        aggColumns(result->getMakeAccumulator(rowKey));
+        rowKey.key[depth]   = tallyKey(item);
+        rowKey.types[depth] = tallyType(item); //result->setAtDepth(rowKey, set_cb);
+        tallyColumns(result->getMakeAccumulator(rowKey), currentRow);
         ++depth;
     }
 }
 
+void openset::query::Interpreter::tallyProperties(const Instruction_s* inst, const int currentRow)
+{
+    // the same grouping marshal_tally makes from the pushed properties, read
+    // from the grid, params are popped in reverse so the last property is the top group
+    const auto paramCount = static_cast<int>(inst->value);
+    const auto inRange = currentRow >= 0 && currentRow < rowCount;
+
+    rowKey.clear();
+    if (macros.vars.columnLambdas.size())
+        for (auto lambdaIndex : macros.vars.columnLambdas)
+            opRunner(
+                // call the property lambda
+                &macros.code.front() + lambdaIndex,
+                currentRow);
+
+    for (auto depth = 0; depth < paramCount; ++depth)
+    {
+        const auto& var = macros.vars.tableVars[(inst + paramCount - 1 - depth)->index];
+        const auto value = inRange ? gridColumns->column(var.column)[currentRow] : NONE;
+
+        if (value == NONE)
+            break;
+
+        switch (var.schemaType)
+        {
+        case PropertyTypes_e::intProp:
+            rowKey.key[depth]   = value;
+            rowKey.types[depth] = result::ResultTypes_e::Int;
+            break;
+        case PropertyTypes_e::doubleProp:
+            // as a pushed double would be
+            rowKey.key[depth]   = static_cast<int64_t>((value / 10000.0) * 10000);
+            rowKey.types[depth] = result::ResultTypes_e::Double;
+            break;
+        case PropertyTypes_e::boolProp:
+            rowKey.key[depth]   = value ? 1 : 0;
+            rowKey.types[depth] = result::ResultTypes_e::Bool;
+            break;
+        default:
+        {
+            // text is stored as the hash of the string
+            const auto attr = attrs->get(var.schemaColumn, value);
+            rowKey.key[depth] = value;
+
+            if (attr && attr->text)
+            {
+                result->addLocalText(value, attr->text, static_cast<int32_t>(strlen(attr->text)));
+                rowKey.types[depth] = result::ResultTypes_e::Text;
+            }
+            else
+                rowKey.types[depth] = result::ResultTypes_e::Int;
+        }
+        break;
+        }
+
+        tallyColumns(result->getMakeAccumulator(rowKey), currentRow);
+    }
+}
+
 void __nestItercvar(const cvar* value, string& result)
 {
     if (value->typeOf() == cvar::valueType::DICT)
@@ -715,9 +795,8 @@ void openset::query::Interpreter::marshal_intersection(const int paramCount)
         return;
     }
 
-    // copy then AND to get the intersection of these two segments
-    bits->opCopy(*aBits);
-    bits->opAnd(*bBits);
+    // AND into a copy to get the intersection of these two segments
+    bits->opCopyAnd(*aBits, *bBits);
 }
 
 void openset::query::Interpreter::marshal_union(const int paramCount)
@@ -876,9 +955,8 @@ void openset::query::Interpreter::marshal_difference(const int paramCount)
         return;
     }
 
-    // copy then AND NOT to get the compliment of these two segments
-    bits->opCopy(*aBits);
-    bits->opAndNot(*bBits);
+    // AND NOT into a copy to get the compliment of these two segments
+    bits->opCopyAndNot(*aBits, *bBits);
 
     if (aDelete)
         delete aBits;
@@ -1109,7 +1187,7 @@ void openset::query::Interpreter::marshal_get_row(const int paramCount) const
     if (*(stackPtr - 1) == NONE) // leave None on the stack
         return;
 
-    if (rows->size() == 0)
+    if (rowCount == 0)
     {
         *(stackPtr - 1) = NONE;
         return;
@@ -1134,7 +1212,7 @@ void openset::query::Interpreter::marshal_get_row(const int paramCount) const
         if (tableVar.isProp)
             colValue = propRow->cols[tableVar.column];
         else
-            colValue = (*rows)[currentRow]->cols[tableVar.column];
+            colValue = gridColumns->column(tableVar.column)[currentRow];
         if (colValue == NONE)
             continue;
         switch (tableVar.schemaType)
@@ -1232,9 +1310,6 @@ bool openset::query::Interpreter::marshal(Instruction_s* inst, int64_t& currentR
     // note: param order is reversed, last item on the stack
     // is also last param in function call
 
-    // sometimes we have no rows (customer props only), the empty row is full of NONE values
-    const auto rowData =  currentRow >= rowCount || currentRow < 0 ? grid->getEmptyRow() : (*rows)[currentRow];
-
     switch (cast<Marshals_e>(inst->index))
     {
     case Marshals_e::marshal_tally:
@@ -1249,7 +1324,7 @@ bool openset::query::Interpreter::marshal(Instruction_s* inst, int64_t& currentR
             ++stackPtr;
             return true;
         }*/
-        marshal_tally(inst->extra, rowData, currentRow);
+        marshal_tally(inst->extra, currentRow);
     }
     break;
     case Marshals_e::marshal_now:
@@ -1261,11 +1336,11 @@ bool openset::query::Interpreter::marshal(Instruction_s* inst, int64_t& currentR
         ++stackPtr;
         break;
     case Marshals_e::marshal_last_stamp:
-        *stackPtr = rowCount ? rows->back()->cols[PROP_STAMP] : NONE;
+        *stackPtr = rowCount ? gridColumns->stamps[rowCount - 1] : NONE;
         ++stackPtr;
         break;
     case Marshals_e::marshal_first_stamp:
-        *stackPtr = rowCount ? rows->front()->cols[PROP_STAMP] : NONE;
+        *stackPtr = rowCount ? gridColumns->stamps[0] : NONE;
         ++stackPtr;
         break;
     case Marshals_e::marshal_bucket:
@@ -1578,7 +1653,7 @@ bool openset::query::Interpreter::marshal(Instruction_s* inst, int64_t& currentR
         if (macros.sessionColumn == -1)
             throw std::runtime_error("session property could not be found");
         ++stackPtr;
-        *(stackPtr - 1) = rowCount ? rows->back()->cols[macros.sessionColumn] : 0;
+        *(stackPtr - 1) = rowCount ? gridColumns->column(macros.sessionColumn)[rowCount - 1] : 0;
         break;
     case Marshals_e::marshal_str_split:
         marshal_split(inst->extra);
@@ -1641,6 +1716,272 @@ cvar* openset::query::Interpreter::lambda(int lambdaId, int currentRow)
     return stackPtr;
 }
 
+bool openset::query::Interpreter::test(const int lambdaId, const int currentRow)
+{
+    if (!macros.typedLambdas.empty())
+        if (const auto start = macros.typedLambdas[lambdaId]; start != -1)
+            return runTyped(start, currentRow);
+
+    return lambda(lambdaId, currentRow)->isEvalTrue();
+}
+
+bool openset::query::Interpreter::runTyped(const int32_t start, const int currentRow)
+{
+    TypedRegister_u regs[TYPED_REGISTERS];
+
+    for (auto inst = macros.typedCode.data() + start;; ++inst)
+    {
+        auto& dest = regs[inst->dest];
+        const auto& left = regs[inst->left];
+
+        switch (inst->op)
+        {
+        case TypedOp_e::COL:
+            dest.i = gridColumns->column(static_cast<int32_t>(inst->value))[currentRow];
+            break;
+        case TypedOp_e::COLDBL:
+        {
+            const auto value = gridColumns->column(static_cast<int32_t>(inst->value))[currentRow];
+            // a missing value is pushed as an int NONE and compares as a double
+            dest.d = value == NONE ? static_cast<double>(NONE) : static_cast<double>(value) / inst->dblValue;
+        }
+        break;
+        case TypedOp_e::EQ:
+            dest.b = left.i == inst->value;
+            break;
+        case TypedOp_e::NEQ:
+            dest.b = left.i != inst->value;
+            break;
+        case TypedOp_e::LT:
+            dest.b = left.i < inst->value;
+            break;
+        case TypedOp_e::LTE:
+            dest.b = left.i <= inst->value;
+            break;
+        case TypedOp_e::GT:
+            dest.b = left.i > inst->value;
+            break;
+        case TypedOp_e::GTE:
+            dest.b = left.i >= inst->value;
+            break;
+        case TypedOp_e::EQDBL:
+            dest.b = left.d == inst->dblValue;
+            break;
+        case TypedOp_e::NEQDBL:
+            dest.b = left.d != inst->dblValue;
+            break;
+        case TypedOp_e::LTDBL:
+            dest.b = left.d < inst->dblValue;
+            break;
+        case TypedOp_e::LTEDBL:
+            dest.b = left.d <= inst->dblValue;
+            break;
+        case TypedOp_e::GTDBL:
+            dest.b = left.d > inst->dblValue;
+            break;
+        case TypedOp_e::GTEDBL:
+            dest.b = left.d >= inst->dblValue;
+            break;
+        case TypedOp_e::EQBOOL:
+            dest.b = left.i != NONE && (left.i != 0) == (inst->value != 0);
+            break;
+        case TypedOp_e::NEQBOOL:
+            dest.b = !(left.i != NONE && (left.i != 0) == (inst->value != 0));
+            break;
+        case TypedOp_e::AND:
+            dest.b = left.b && regs[inst->right].b;
+            break;
+        case TypedOp_e::OR:
+            dest.b = left.b || regs[inst->right].b;
+            break;
+        case TypedOp_e::NOT:
+            dest.b = !left.b;
+            break;
+        case TypedOp_e::FILTER:
+            dest.b = typedFilter(macros.filters[inst->value], currentRow);
+            break;
+        case TypedOp_e::RET:
+            return left.b;
+        }
+    }
+}
+
+bool openset::query::Interpreter::typedFilter(const Filter_s& filter, const int currentRow)
+{
+    const auto evalStart = macros.typedLambdas[filter.evalBlock];
+    auto pass = false;
+
+    if (filter.isRow)
+    {
+        pass = runTyped(evalStart, currentRow);
+    }
+    else
+    {
+        // the same scan as PSHTBLFLT, ranges are inherited from `each` or `if` filters
+        auto startStamp = LLONG_MIN;
+        auto endStamp   = LLONG_MAX;
+
+        if (filterRangeStack.size() && filterRangeStack.back().first != LLONG_MIN)
+        {
+            startStamp = filterRangeStack.back().first;
+            endStamp   = filterRangeStack.back().second;
+        }
+
+        auto row = 0;
+
+        while (row < rowCount && row >= 0)
+        {
+            if (gridColumns->stamps[row] < startStamp)
+            {
+                if (filter.isReverse)
+                    break;
+                ++row;
+                continue;
+            }
+
+            if (gridColumns->stamps[row] > endStamp)
+            {
+                if (filter.isReverse)
+                {
+                    --row;
+                    continue;
+                }
+                break;
+            }
+
+            if (runTyped(evalStart, row))
+            {
+                pass = true;
+                break;
+            }
+
+            filter.isReverse ? --row : ++row;
+        }
+    }
+
+    return filter.isNegated ? !pass : pass;
+}
+
+int openset::query::Interpreter::selectRows(const int lambdaId, const int fromRow, const int count, int32_t* selected)
+{
+    using BitKernels = db::BitKernels;
+    using Compare_e  = BitKernels::Compare_e;
+
+    // registers hold a bit per row in the batch, or (COL, COLDBL) the column being compared
+    uint64_t masks[TYPED_REGISTERS][SELECT_BATCH / 64];
+    uint64_t scratch[SELECT_BATCH / 64];
+    const int64_t* columns[TYPED_REGISTERS];
+    double divisors[TYPED_REGISTERS];
+
+    const auto words = (count + 63) / 64;
+
+    const auto compare = [&](const TypedInstruction_s* inst, const Compare_e op)
+    {
+        BitKernels::compare(masks[inst->dest], columns[inst->left], inst->value, op, count);
+    };
+
+    const auto compareScaled = [&](const TypedInstruction_s* inst, const Compare_e op)
+    {
+        BitKernels::compareScaled(
+            masks[inst->dest], columns[inst->left], divisors[inst->left], inst->dblValue, op, count);
+    };
+
+    for (auto inst = macros.typedCode.data() + macros.typedLambdas[lambdaId];; ++inst)
+    {
+        const auto dest = masks[inst->dest];
+        const auto left = masks[inst->left];
+
+        switch (inst->op)
+        {
+        case TypedOp_e::COL:
+            columns[inst->dest] = gridColumns->column(static_cast<int32_t>(inst->value)) + fromRow;
+            break;
+        case TypedOp_e::COLDBL:
+            columns[inst->dest]  = gridColumns->column(static_cast<int32_t>(inst->value)) + fromRow;
+            divisors[inst->dest] = inst->dblValue;
+            break;
+        case TypedOp_e::EQ:
+            compare(inst, Compare_e::eq);
+            break;
+        case TypedOp_e::NEQ:
+            compare(inst, Compare_e::neq);
+            break;
+        case TypedOp_e::LT:
+            compare(inst, Compare_e::lt);
+            break;
+        case TypedOp_e::LTE:
+            compare(inst, Compare_e::lte);
+            break;
+        case TypedOp_e::GT:
+            compare(inst, Compare_e::gt);
+            break;
+        case TypedOp_e::GTE:
+            compare(inst, Compare_e::gte);
+            break;
+        case TypedOp_e::EQDBL:
+            compareScaled(inst, Compare_e::eq);
+            break;
+        case TypedOp_e::NEQDBL:
+            compareScaled(inst, Compare_e::neq);
+            break;
+        case TypedOp_e::LTDBL:
+            compareScaled(inst, Compare_e::lt);
+            break;
+        case TypedOp_e::LTEDBL:
+            compareScaled(inst, Compare_e::lte);
+            break;
+        case TypedOp_e::GTDBL:
+            compareScaled(inst, Compare_e::gt);
+            break;
+        case TypedOp_e::GTEDBL:
+            compareScaled(inst, Compare_e::gte);
+            break;
+        case TypedOp_e::EQBOOL:
+        case TypedOp_e::NEQBOOL:
+            // == true is set and non-zero, == false is zero (see runTyped)
+            if (inst->value != 0)
+            {
+                BitKernels::compare(dest, columns[inst->left], NONE, Compare_e::neq, count);
+                BitKernels::compare(scratch, columns[inst->left], 0, Compare_e::neq, count);
+                BitKernels::opAnd(dest, scratch, words);
+            }
+            else
+            {
+                BitKernels::compare(dest, columns[inst->left], 0, Compare_e::eq, count);
+            }
+
+            if (inst->op == TypedOp_e::NEQBOOL)
+                BitKernels::opNot(dest, words);
+            break;
+        case TypedOp_e::AND:
+        case TypedOp_e::OR:
+        {
+            // dest may be either operand
+            auto source = masks[inst->right];
+            if (dest == source)
+                source = left;
+            else if (dest != left)
+                std::memcpy(dest, left, words * sizeof(uint64_t));
+
+            if (inst->op == TypedOp_e::AND)
+                BitKernels::opAnd(dest, source, words);
+            else
+                BitKernels::opOr(dest, source, words);
+        }
+        break;
+        case TypedOp_e::NOT:
+            if (dest != left)
+                std::memcpy(dest, left, words * sizeof(uint64_t));
+            BitKernels::opNot(dest, words);
+            break;
+        case TypedOp_e::FILTER: // not in selectable lambdas (see QueryParser::compileTyped)
+            break;
+        case TypedOp_e::RET:
+            return BitKernels::select(left, count, fromRow, selected);
+        }
+    }
+}
+
 void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentRow)
 {
     /*
@@ -1649,7 +1990,7 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
            as it's valid for a customer to have no event rows, but have customer props
 
     // count allows for now row pointer, and no mounted customer
-    if ((!rows || rows->empty()) && interpretMode != InterpretMode_e::count)
+    if ((!gridColumns || !rowCount) && interpretMode != InterpretMode_e::count)
     {
         loopState = LoopState_e::in_exit;
         *stackPtr = NONE;
@@ -1671,6 +2012,9 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
         --recursion;
         return;
     }
+
+    auto lastOp = -1; // previous op in this frame, for pair counts
+
     while (loopState == LoopState_e::run && !error.inError() && !inReturn)
     {
         // tracks the last known script line number
@@ -1709,10 +2053,39 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
             return;
         }
 
+        if (countOps)
+        {
+            const auto op = static_cast<int>(inst->op);
+            opCounts[op].fetch_add(1, std::memory_order_relaxed);
+            if (lastOp != -1)
+                opPairCounts[lastOp * static_cast<int>(OpCode_e::OP_COUNT) + op].fetch_add(1, std::memory_order_relaxed);
+            lastOp = op;
+        }
+
         switch (inst->op)
         {
         case OpCode_e::NOP: // do nothing... nothing to see here... move on
             break;
+        case OpCode_e::PSHCOLEQ: // fused PSHTBLCOL, PSHLITINT/PSHLITSTR, OPEQ - compares the raw grid value
+        {
+            const auto literal = inst + 1;
+            const auto value   = literal->op == OpCode_e::PSHLITSTR
+                ? macros.vars.literals[literal->index].hashValue
+                : literal->value;
+            *stackPtr = gridColumns->column(macros.vars.tableVars[inst->index].column)[currentRow] == value;
+            ++stackPtr;
+            inst += 2; // skip the literal, the loop steps past OPEQ
+        }
+        break;
+        case OpCode_e::TALLYCOL: // fused PSHTBLCOL x `value`, MARSHAL tally
+        {
+            // marshal_tally does nothing when counting, and returns from the block
+            if (interpretMode == InterpretMode_e::count)
+                return;
+            tallyProperties(inst, static_cast<int>(currentRow));
+            inst += inst->value; // skip the property pushes, the loop steps past MARSHAL
+        }
+        break;
         case OpCode_e::PSHTBLCOL: // push a property value
         {
             // if it's row iterator variable, we get its value, otherwise we use the current row
@@ -1737,7 +2110,7 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
                 // }
                 //else
                 //{
-                colValue = (*rows)[readRow]->cols[macros.vars.tableVars[inst->index].column];
+                colValue = gridColumns->column(macros.vars.tableVars[inst->index].column)[readRow];
                 //}
 
                 switch (macros.vars.tableVars[inst->index].schemaType)
@@ -1869,7 +2242,7 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
             {
                 // push mapped property value into
                 // TODO range check
-                *stackPtr = (*rows)[currentRow]->cols[macros.vars.columnVars[inst->index].column];
+                *stackPtr = gridColumns->column(macros.vars.columnVars[inst->index].column)[currentRow];
                 ++stackPtr;
             }
             else
@@ -2408,7 +2781,7 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
         case OpCode_e::CALL_IF: // execute lambda, and if not 0 on stack
         {
             // anything not 0 is true
-            if (lambda(inst->extra, currentRow)->isEvalTrue())
+            if (test(inst->extra, currentRow))
             {
                 lambda(inst->index, currentRow);
                 if (inReturn)
@@ -2428,14 +2801,31 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
         }
         break;
         case OpCode_e::CALL_EACH:
+        case OpCode_e::CALL_EACH_EQ:
         {
             const auto codeBlock   = inst->index;
             const auto logicLambda = inst->extra;
             const auto filter      = macros.filters[inst->value];
 
-            const auto rowCount = static_cast<int>(rows->size());
             const auto savedRow = currentRow; // reset row position if using ITFORR, ITFORRC, ITFORRCF
 
+            // logic that only compares properties selects its rows a batch at a time,
+            // the loop then steps from one selected row to the next
+            const auto selecting = logicLambda != -1 &&
+                rowCount >= SELECT_MIN_ROWS &&
+                !macros.selectLambdas.empty() &&
+                macros.selectLambdas[logicLambda];
+
+            // CALL_EACH_EQ - the logic is `property == literal`, compare the property column directly
+            const int64_t* eqColumn = nullptr;
+            auto eqValue            = NONE;
+            if (inst->op == OpCode_e::CALL_EACH_EQ && !selecting)
+            {
+                const auto typed = macros.typedCode.data() + macros.typedLambdas[logicLambda];
+                eqColumn         = gridColumns->column(static_cast<int32_t>(typed[0].value));
+                eqValue          = typed[1].value;
+            }
+
             // .continue - are we continuing from a specific row
             if (filter.isContinue)
             {
@@ -2500,6 +2890,74 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
 
             filterRangeStack.emplace_back(startStamp, endStamp);
 
+            // selected rows for [batchStart, batchEnd), batches stay inside the rows of the stamp window
+            int32_t selected[SELECT_BATCH];
+            auto selectedCount = 0;
+            auto batchStart    = 0;
+            auto batchEnd      = 0;
+            auto windowStart   = 0;
+            auto windowEnd     = rowCount;
+
+            if (selecting)
+            {
+                const auto stamps = gridColumns->stamps;
+                windowStart = static_cast<int>(std::lower_bound(stamps, stamps + rowCount, startStamp) - stamps);
+                windowEnd   = static_cast<int>(std::upper_bound(stamps, stamps + rowCount, endStamp) - stamps);
+            }
+
+            // the nearest selected row from `row` in the direction of the loop, -1 if there are none
+            const auto nextSelected = [&](int64_t row) -> int64_t
+            {
+                while (true)
+                {
+                    if (filter.isReverse)
+                    {
+                        if (row >= windowEnd)
+                            row = windowEnd - 1;
+                        if (row < windowStart)
+                            return -1;
+                    }
+                    else
+                    {
+                        if (row < windowStart)
+                            row = windowStart;
+                        if (row >= windowEnd)
+                            return -1;
+                    }
+
+                    if (row < batchStart || row >= batchEnd)
+                    {
+                        if (filter.isReverse)
+                        {
+                            batchEnd   = static_cast<int>(row) + 1;
+                            batchStart = std::max(windowStart, batchEnd - SELECT_BATCH);
+                        }
+                        else
+                        {
+                            batchStart = static_cast<int>(row);
+                            batchEnd   = std::min(windowEnd, batchStart + SELECT_BATCH);
+                        }
+
+                        selectedCount = selectRows(logicLambda, batchStart, batchEnd - batchStart, selected);
+                    }
+
+                    if (filter.isReverse)
+                    {
+                        const auto iter = std::upper_bound(selected, selected + selectedCount, row);
+                        if (iter != selected)
+                            return *(iter - 1);
+                        row = batchStart - 1;
+                    }
+                    else
+                    {
+                        const auto iter = std::lower_bound(selected, selected + selectedCount, row);
+                        if (iter != selected + selectedCount)
+                            return *iter;
+                        row = batchEnd;
+                    }
+                }
+            };
+
             ++nestDepth;
 
             // Iterate
@@ -2514,7 +2972,14 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
                     return;
                 } // set the value of referenced `for variable` to the current row number
 
-                if ((*rows)[currentRow]->cols[PROP_STAMP] < startStamp)
+                if (selecting)
+                {
+                    currentRow = nextSelected(currentRow);
+                    if (currentRow == -1)
+                        break;
+                }
+
+                if (gridColumns->stamps[currentRow] < startStamp)
                 {
                     if (filter.isReverse)
                         break;
@@ -2522,7 +2987,7 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
                     continue;
                 }
 
-                if ((*rows)[currentRow]->cols[PROP_STAMP] > endStamp)
+                if (gridColumns->stamps[currentRow] > endStamp)
                 {
                     if (filter.isReverse)
                     {
@@ -2532,7 +2997,10 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
                     break;
                 }
 
-                if (logicLambda == -1 || lambda(logicLambda, currentRow)->isEvalTrue())
+                if (selecting ||
+                    (eqColumn
+                        ? eqColumn[currentRow] == eqValue
+                        : logicLambda == -1 || test(logicLambda, currentRow)))
                 {
                     lambda(codeBlock, currentRow);
 
@@ -2590,7 +3058,6 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
             const auto logicLambda = inst->extra;
             const auto filter      = macros.filters[inst->value];
 
-            const auto rowCount = static_cast<int>(rows->size());
             const auto savedRow = currentRow;
 
             // .continue - are we continuing from a specific row
@@ -2689,7 +3156,7 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
                     return;
                 }
 
-                if ((*rows)[currentRow]->cols[PROP_STAMP] < startStamp)
+                if (gridColumns->stamps[currentRow] < startStamp)
                 {
                     if (filter.isReverse)
                         break;
@@ -2697,7 +3164,7 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
                     continue;
                 }
 
-                if ((*rows)[currentRow]->cols[PROP_STAMP] > endStamp)
+                if (gridColumns->stamps[currentRow] > endStamp)
                 {
                     if (filter.isReverse)
                     {
@@ -2707,7 +3174,7 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
                     break;
                 }
 
-                if (logicLambda == -1 || lambda(logicLambda, currentRow)->isEvalTrue())
+                if (logicLambda == -1 || test(logicLambda, currentRow))
                 {
                     lastMatchingRow = currentRow;
 
@@ -2817,7 +3284,6 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
         case OpCode_e::PSHTBLFLT:
         {
             const auto filter   = macros.filters[inst->value];
-            const auto rowCount = static_cast<int>(rows->size());
             const auto savedRow = currentRow; // reset row position if using ITFORR, ITFORRC, ITFORRCF
 
             // THROW (in compiler?) isNext but not isLookAhead or isLookBack
@@ -2878,14 +3344,14 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
 
             if (filter.isRow)
             {
-                pass = lambda(filter.evalBlock, currentRow)->isEvalTrue();
+                pass = test(filter.evalBlock, currentRow);
             }
             else if (filter.isEver)
             {
                 currentRow = 0;
                 while (currentRow < rowCount && currentRow >= 0)
                 {
-                    if ((*rows)[currentRow]->cols[PROP_STAMP] < startStamp)
+                    if (gridColumns->stamps[currentRow] < startStamp)
                     {
                         if (filter.isReverse)
                             break;
@@ -2893,7 +3359,7 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
                         continue;
                     }
 
-                    if ((*rows)[currentRow]->cols[PROP_STAMP] > endStamp)
+                    if (gridColumns->stamps[currentRow] > endStamp)
                     {
                         if (filter.isReverse)
                         {
@@ -2903,7 +3369,7 @@ void openset::query::Interpreter::opRunner(Instruction_s* inst, int64_t currentR
                         break;
                     }
 
-                    if (lambda(filter.evalBlock, currentRow)->isEvalTrue())
+                    if (test(filter.evalBlock, currentRow))
                     {
                         pass = true;
                         break;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <vector>
 #include <unordered_map>
 
@@ -126,6 +127,10 @@ namespace openset
             const int64_t breakAllHash = MakeHash("all");
             const int64_t breakTopHash = MakeHash("top");
 
+            // executed op codes and adjacent op code pairs, across all interpreters (--op-counts)
+            static std::atomic<int64_t> opCounts[static_cast<int>(OpCode_e::OP_COUNT)];
+            static std::atomic<int64_t> opPairCounts[static_cast<int>(OpCode_e::OP_COUNT) * static_cast<int>(OpCode_e::OP_COUNT)];
+
             // execution
             Macro_s& macros;
             cvar* stack;
@@ -137,7 +142,7 @@ namespace openset
 
             // database objects
             Grid* grid{ nullptr };
-            const Rows* rows{ nullptr };
+            const GridColumns_s* gridColumns{ nullptr }; // the customer's rows, column-major
             const Row* propRow{ nullptr };
             int rowCount{ 0 };
 
@@ -169,6 +174,7 @@ namespace openset
             InterpretMode_e interpretMode{ InterpretMode_e::query };
             LoopState_e loopState{ LoopState_e::run }; // run, continue, break, exit
             bool isConfigured{ false };
+            bool countOps{ false }; // --op-counts
 
             // debug - log entries are entered in order by calling debug
             DebugLog debugLog;
@@ -235,7 +241,12 @@ namespace openset
 
             void extractMarshalParams(const int paramCount);
 
-            void marshal_tally(const int paramCount, const Col_s* columns, const int currentRow);
+            int64_t tallyKey(const cvar& value);
+            static result::ResultTypes_e tallyType(const cvar& value);
+            void tallyColumns(result::Accumulator* resultColumns, const int currentRow);
+            void marshal_tally(const int paramCount, const int currentRow);
+            // TALLYCOL - tally of plain properties read straight from the grid
+            void tallyProperties(const Instruction_s* inst, const int currentRow);
 
             void marshal_log(const int paramCount);
             void marshal_break(const int paramCount);
@@ -270,6 +281,13 @@ namespace openset
 
             bool marshal(Instruction_s* inst, int64_t& currentRow);
             cvar* lambda(int lambdaId, int currentRow);
+
+            // does logic lambda `lambdaId` pass, typed lambdas (see TypedOp_e) skip opRunner
+            bool test(int lambdaId, int currentRow);
+            bool runTyped(int32_t start, int currentRow);
+            bool typedFilter(const Filter_s& filter, int currentRow);
+            // rows in [fromRow, fromRow + count) that pass selectable lambda `lambdaId`, ascending, returns how many
+            int selectRows(int lambdaId, int fromRow, int count, int32_t* selected);
             void opRunner(Instruction_s* inst, int64_t currentRow = 0);
 
             void setScheduleCB(const function<void (int64_t functionHash, int seconds)> &cb);
@@ -220,6 +220,9 @@ string openset::query::MacroDbg(Macro_s& macro)
         case HintOp_e::PUSH_VAL:
             ss << padding(i.value.getString(), 20, false);
             break;
+        case HintOp_e::STAMP_RANGE:
+            ss << i.value.getString() << " to " << to_string(i.rangeEnd);
+            break;
         }
         ss << endl;
     }
@@ -265,5 +268,38 @@ string openset::query::MacroDbg(Macro_s& macro)
         ++count;
     }
     outSpacer();
+
+    ss << endl << endl;
+    ss << "Typed Lambdas:" << endl;
+    outSpacer();
+    ss << "LMB  | OFS  | OP           | DEST | LEFT | RGHT | VALUE" << endl;
+    outSpacer();
+    if (macro.typedLambdas.size())
+    {
+        for (auto lambdaId = 0; lambdaId < static_cast<int>(macro.typedLambdas.size()); ++lambdaId)
+        {
+            if (macro.typedLambdas[lambdaId] == -1)
+                continue;
+
+            for (auto ofs = macro.typedLambdas[lambdaId]; ofs < static_cast<int>(macro.typedCode.size()); ++ofs)
+            {
+                const auto& m = macro.typedCode[ofs];
+                ss << padding(lambdaId, 4, true, '0') << " | ";
+                ss << padding(ofs, 4, true, '0') << " | ";
+                ss << padding(TypedDebugStrings.find(m.op)->second, 12, false) << " | ";
+                ss << padding(m.dest, 4) << " | ";
+                ss << padding(m.left, 4) << " | ";
+                ss << padding(m.right, 4) << " | ";
+                ss << (m.dblValue != 0 ? to_string(m.dblValue) : to_string(m.value));
+                ss << endl;
+
+                if (m.op == TypedOp_e::RET)
+                    break;
+            }
+        }
+    }
+    else
+        ss << "NONE" << endl;
+    outSpacer();
     return ss.str();
 }
@@ -9,6 +9,7 @@
 #include "properties.h"
 #include "errors.h"
 #include "var/var.h"
+#include "time/epoch.h"
 #include <queue>
 
 namespace openset::query
@@ -299,6 +300,15 @@ namespace openset::query
 
         Blocks::Line indexLogic;
 
+        // the stamps every condition in indexLogic is scoped to, while each of
+        // them belongs to an `each_row` with a literal .range or .within
+        bool windowed { true };
+        int64_t windowStart { LLONG_MAX };
+        int64_t windowEnd { LLONG_MIN };
+
+        // the last filter chain parsed
+        Filter_s lastFilter;
+
         Tracking userVars;
         Tracking stringLiterals;
         Tracking columns;
@@ -370,6 +380,56 @@ namespace openset::query
             return (isString(value) || isNumeric(value));
         }
 
+        // a param that is a literal stamp (ISO 8601 or epoch), as milliseconds
+        static bool isLiteralStamp(const Blocks::Line& param, int64_t& stamp)
+        {
+            if (param.size() != 1)
+                return false;
+
+            const auto& value = param[0];
+
+            if (isString(value))
+            {
+                const auto text = stripQuotes(value);
+
+                if (!Epoch::isISO8601(text))
+                    return false;
+
+                stamp = Epoch::ISO8601ToEpoch(text);
+                return stamp != -1;
+            }
+
+            if (!isNumeric(value) || isFloat(value))
+                return false;
+
+            stamp = Epoch::fixMilli(std::stoll(value));
+            return true;
+        }
+
+        // narrow the known stamps of a filter to [start, end]
+        static void scopeStamps(Filter_s& filter, const int64_t start, const int64_t end)
+        {
+            filter.rangeStart = filter.isStampKnown ? std::max(filter.rangeStart, start) : start;
+            filter.rangeEnd = filter.isStampKnown ? std::min(filter.rangeEnd, end) : end;
+            filter.isStampKnown = true;
+        }
+
+        // scope a .within style filter when its window and start are literals
+        static void scopeWithin(Filter_s& filter, const Blocks::Line& window, const Blocks::Line& start)
+        {
+            int64_t startStamp;
+
+            if (window.size() != 1 || !isNumeric(window[0]) || isFloat(window[0]) || !isLiteralStamp(start, startStamp))
+                return;
+
+            const auto windowSize = std::stoll(window[0]);
+
+            scopeStamps(
+                filter,
+                filter.isLookAhead ? startStamp : startStamp - windowSize,
+                filter.isLookBack ? startStamp : startStamp + windowSize);
+        }
+
         static bool isNameOrNumber(const std::string& value)
         {
             return isString(value) || isNumeric(value) || isTextual(value);
@@ -767,7 +827,7 @@ namespace openset::query
             return -1;
         }
 
-        void pushLogic(const Blocks::Line& words, const int start = 0, int end = -1)
+        void pushLogic(const Blocks::Line& words, const int start = 0, int end = -1, const Filter_s* scope = nullptr)
         {
             if (end == -1)
                 end = static_cast<int>(words.size());
@@ -782,6 +842,16 @@ namespace openset::query
             if (!logicFound)
                 return;
 
+            if (scope && scope->isStampKnown)
+            {
+                windowStart = std::min(windowStart, scope->rangeStart);
+                windowEnd = std::max(windowEnd, scope->rangeEnd);
+            }
+            else
+            {
+                windowed = false;
+            }
+
             if (indexLogic.size())
                 indexLogic.push_back("||");
 
@@ -2349,6 +2419,7 @@ namespace openset::query
                     filter.withinWindowBlock = addLinesAsBlock(params[1].first);
                     filter.withinStartBlock = addLinesAsBlock(params[0].first);
                     filter.isWithin = true;
+                    scopeWithin(filter, params[1].first, params[0].first);
 
                     ++count;
                 }
@@ -2369,6 +2440,7 @@ namespace openset::query
                     filter.withinWindowBlock = addLinesAsBlock(params[1].first);
                     filter.withinStartBlock = addLinesAsBlock(params[0].first);
                     filter.isLookAhead = true;
+                    scopeWithin(filter, params[1].first, params[0].first);
                     ++count;
                 }
                 else if (token == "__chain_look_back")
@@ -2388,6 +2460,7 @@ namespace openset::query
                     filter.withinWindowBlock = addLinesAsBlock(params[1].first);
                     filter.withinStartBlock = addLinesAsBlock(params[0].first);
                     filter.isLookBack = true;
+                    scopeWithin(filter, params[1].first, params[0].first);
                     ++count;
                 }
                 else if (token == "__chain_range")
@@ -2408,6 +2481,10 @@ namespace openset::query
                     filter.rangeEndBlock = addLinesAsBlock(params[0].first);
                     filter.isRange = true;
 
+                    int64_t startStamp, endStamp;
+                    if (isLiteralStamp(params[1].first, startStamp) && isLiteralStamp(params[0].first, endStamp))
+                        scopeStamps(filter, startStamp, endStamp);
+
                     ++count;
                 }
                 else if (token == "__chain_continue" && !isColumn)
@@ -2506,6 +2583,8 @@ namespace openset::query
                     };
             }
 
+            lastFilter = filter;
+
             const auto filterOp = isColumn ? MiddleOp_e::column_filter : MiddleOp_e::logic_filter;
             if (count)
             {
@@ -2588,7 +2667,9 @@ namespace openset::query
 
                 ++idx; // skip past where look for logic
                 const Blocks::Line logic(words.begin() + idx, words.end());
-                pushLogic(logic);
+
+                // rows outside the scope of the filter never reach the loop body
+                pushLogic(logic, 0, -1, &lastFilter);
 
                 // if there is no logic, just straight iteration we push the logic block as -1
                 // the interpreter will run in a true state for the logic if it sees -1
@@ -3707,6 +3788,76 @@ namespace openset::query
             return idx + 1;
         }
 
+        /*
+         * Events one of which every customer matching `index` must have, from
+         * the `event == value` tests the index can't do without. An AND needs
+         * either side (the shorter list is kept), an OR needs both. Empty if
+         * there are none.
+         */
+        static std::vector<int64_t> requiredEvents(const HintOpList& index)
+        {
+            struct Required_s
+            {
+                bool any { true };
+                std::vector<int64_t> events;
+            };
+
+            std::vector<Required_s> stack;
+            std::string column;
+            int64_t value = NONE;
+
+            for (const auto& op : index)
+            {
+                switch (op.op)
+                {
+                case HintOp_e::PUSH_TBL:
+                    column = op.value.getString();
+                    break;
+                case HintOp_e::PUSH_VAL:
+                    value = op.hash;
+                    break;
+                case HintOp_e::EQ:
+                    if (column == "event" && value != NONE)
+                        stack.push_back(Required_s{ false, { value } });
+                    else
+                        stack.emplace_back();
+                    break;
+                case HintOp_e::BIT_AND:
+                case HintOp_e::BIT_OR:
+                {
+                    if (stack.size() < 2)
+                        return {};
+
+                    auto right = std::move(stack.back());
+                    stack.pop_back();
+                    auto& left = stack.back();
+
+                    if (op.op == HintOp_e::BIT_AND)
+                    {
+                        if (left.any || (!right.any && right.events.size() < left.events.size()))
+                            left = std::move(right);
+                    }
+                    else if (left.any || right.any)
+                    {
+                        left = Required_s{};
+                    }
+                    else
+                    {
+                        left.events.insert(left.events.end(), right.events.begin(), right.events.end());
+                    }
+                }
+                    break;
+                default:
+                    stack.emplace_back();
+                }
+            }
+
+            if (stack.size() != 1 || stack.back().any)
+                return {};
+
+            return stack.back().events;
+        }
+
         void compileIndex(Macro_s& inMacros)
         {
             for (const auto &word: indexLogic)
@@ -3717,12 +3868,421 @@ namespace openset::query
             inMacros.indexIsCountable = processLogic();
             parseIndex(inMacros.index, indexLogic, 0);
 
+            // every condition needs an event in the window, so customers without
+            // one can't match. Buckets are whole days, so the index can't count.
+            if (windowed && !inMacros.index.empty())
+            {
+                inMacros.index.emplace_back(HintOp_e::STAMP_RANGE, windowStart, windowEnd);
+                inMacros.index.emplace_back(HintOp_e::BIT_AND);
+                inMacros.indexIsCountable = false;
+
+                inMacros.zoneStart = windowStart;
+                inMacros.zoneEnd = windowEnd;
+            }
+
+            inMacros.zoneEvents = requiredEvents(inMacros.index);
+
             inMacros.indexes.emplace_back("_", inMacros.index);
 
             for (const auto &word: indexLogic)
                 inMacros.rawIndex += word + " ";
         }
 
+        // compile lambda `lambdaId` to typed register code (see TypedOp_e), returns
+        // false (leaving nothing behind) if any part of it can't be typed
+        static bool compileTypedLambda(Macro_s& inMacros, const int lambdaId)
+        {
+            auto& typedLambdas = inMacros.typedLambdas;
+
+            if (typedLambdas[lambdaId] != -1)
+                return true;
+
+            // an operand is a register holding a bool, a property not loaded
+            // yet, or a literal
+            enum class Operand_e
+            {
+                reg,
+                column,
+                intValue,
+                dblValue,
+                textValue,
+                boolValue,
+                nilValue
+            };
+
+            struct Operand_s
+            {
+                Operand_e kind;
+                int64_t value;
+                double dblValue;
+            };
+
+            TypedInstructionList code;
+            std::vector<Operand_s> stack;
+
+            const auto compare = [&](OpCode_e op) -> bool
+            {
+                if (stack.size() < 2)
+                    return false;
+
+                auto right = stack.back();
+                stack.pop_back();
+                auto left = stack.back();
+                stack.pop_back();
+
+                // literal on the left, flip the comparison
+                if (right.kind == Operand_e::column && left.kind != Operand_e::column)
+                {
+                    std::swap(left, right);
+
+                    switch (op)
+                    {
+                    case OpCode_e::OPGT: op = OpCode_e::OPLT; break;
+                    case OpCode_e::OPLT: op = OpCode_e::OPGT; break;
+                    case OpCode_e::OPGTE: op = OpCode_e::OPLTE; break;
+                    case OpCode_e::OPLTE: op = OpCode_e::OPGTE; break;
+                    default: break;
+                    }
+
+                    // bool compares aren't symmetric in cvar (None is false on the right)
+                    if (left.kind == Operand_e::column &&
+                        inMacros.vars.tableVars[left.value].schemaType == db::PropertyTypes_e::boolProp)
+                        return false;
+                }
+
+                if (left.kind != Operand_e::column || right.kind == Operand_e::column || right.kind == Operand_e::reg)
+                    return false;
+
+                const auto& var = inMacros.vars.tableVars[left.value];
+                const auto dest = static_cast<int32_t>(stack.size());
+                const auto isEquality = op == OpCode_e::OPEQ || op == OpCode_e::OPNEQ;
+
+                const auto intOp = [&]() -> TypedOp_e
+                {
+                    switch (op)
+                    {
+                    case OpCode_e::OPEQ: return TypedOp_e::EQ;
+                    case OpCode_e::OPNEQ: return TypedOp_e::NEQ;
+                    case OpCode_e::OPLT: return TypedOp_e::LT;
+                    case OpCode_e::OPLTE: return TypedOp_e::LTE;
+                    case OpCode_e::OPGT: return TypedOp_e::GT;
+                    default: return TypedOp_e::GTE;
+                    }
+                };
+
+                const auto dblOp = [&]() -> TypedOp_e
+                {
+                    switch (op)
+                    {
+                    case OpCode_e::OPEQ: return TypedOp_e::EQDBL;
+                    case OpCode_e::OPNEQ: return TypedOp_e::NEQDBL;
+                    case OpCode_e::OPLT: return TypedOp_e::LTDBL;
+                    case OpCode_e::OPLTE: return TypedOp_e::LTEDBL;
+                    case OpCode_e::OPGT: return TypedOp_e::GTDBL;
+                    default: return TypedOp_e::GTEDBL;
+                    }
+                };
+
+                // `== nil` and `!= nil` test for a missing value (bools are compared as bools in cvar)
+                if (right.kind == Operand_e::nilValue)
+                {
+                    if (!isEquality || var.schemaType == db::PropertyTypes_e::boolProp)
+                        return false;
+
+                    code.emplace_back(TypedOp_e::COL, dest, 0, 0, var.column);
+                    code.emplace_back(intOp(), dest, dest, 0, NONE);
+                }
+                else switch (var.schemaType)
+                {
+                case db::PropertyTypes_e::intProp:
+                    if (right.kind == Operand_e::intValue)
+                    {
+                        code.emplace_back(TypedOp_e::COL, dest, 0, 0, var.column);
+                        code.emplace_back(intOp(), dest, dest, 0, right.value);
+                    }
+                    else if (right.kind == Operand_e::dblValue)
+                    {
+                        code.emplace_back(TypedOp_e::COLDBL, dest, 0, 0, var.column, 1.0);
+                        code.emplace_back(dblOp(), dest, dest, 0, 0, right.dblValue);
+                    }
+                    else
+                        return false;
+                    break;
+                case db::PropertyTypes_e::doubleProp:
+                    if (right.kind == Operand_e::intValue || right.kind == Operand_e::dblValue)
+                    {
+                        code.emplace_back(TypedOp_e::COLDBL, dest, 0, 0, var.column, 10000.0);
+                        code.emplace_back(
+                            dblOp(),
+                            dest,
+                            dest,
+                            0,
+                            0,
+                            right.kind == Operand_e::intValue ? static_cast<double>(right.value) : right.dblValue);
+                    }
+                    else
+                        return false;
+                    break;
+                case db::PropertyTypes_e::boolProp:
+                    if (right.kind != Operand_e::boolValue || !isEquality)
+                        return false;
+                    code.emplace_back(TypedOp_e::COL, dest, 0, 0, var.column);
+                    code.emplace_back(
+                        op == OpCode_e::OPEQ ? TypedOp_e::EQBOOL : TypedOp_e::NEQBOOL, dest, dest, 0, right.value);
+                    break;
+                case db::PropertyTypes_e::textProp:
+                    // text is stored as the hash of the string, only equality survives hashing
+                    if (right.kind != Operand_e::textValue || !isEquality)
+                        return false;
+                    code.emplace_back(TypedOp_e::COL, dest, 0, 0, var.column);
+                    code.emplace_back(intOp(), dest, dest, 0, right.value);
+                    break;
+                default:
+                    return false;
+                }
+
+                stack.push_back(Operand_s{ Operand_e::reg, 0, 0 });
+                return true;
+            };
+
+            const auto logic = [&](const TypedOp_e op) -> bool
+            {
+                if (stack.size() < 2 || stack.back().kind != Operand_e::reg || stack[stack.size() - 2].kind != Operand_e::reg)
+                    return false;
+
+                stack.pop_back();
+                const auto dest = static_cast<int32_t>(stack.size() - 1);
+                code.emplace_back(op, dest, dest, dest + 1, 0);
+                return true;
+            };
+
+            // the LAMBDA marker is followed by the lambda's code, up to its RETURN
+            auto inst = inMacros.code.begin() + inMacros.lambdas[lambdaId];
+            if (inst->op == OpCode_e::LAMBDA)
+                ++inst;
+
+            for (; inst != inMacros.code.end() && inst->op != OpCode_e::RETURN; ++inst)
+            {
+                if (static_cast<int>(stack.size()) >= TYPED_REGISTERS)
+                    return false;
+
+                switch (inst->op)
+                {
+                case OpCode_e::PSHTBLCOL:
+                {
+                    const auto& var = inMacros.vars.tableVars[inst->index];
+
+                    // iterator rows, sets and ids need the interpreter
+                    if (inst->extra != NONE || var.isSet || var.schemaColumn == db::PROP_UUID)
+                        return false;
+
+                    stack.push_back(Operand_s{ Operand_e::column, inst->index, 0 });
+                }
+                break;
+                case OpCode_e::PSHLITINT:
+                    stack.push_back(Operand_s{ Operand_e::intValue, inst->value, 0 });
+                    break;
+                case OpCode_e::PSHLITFLT:
+                    stack.push_back(Operand_s{ Operand_e::dblValue, 0, cast<double>(inst->value) / cast<double>(1'000'000) });
+                    break;
+                case OpCode_e::PSHLITSTR:
+                    stack.push_back(Operand_s{ Operand_e::textValue, inMacros.vars.literals[inst->index].hashValue, 0 });
+                    break;
+                case OpCode_e::PSHLITTRUE:
+                    stack.push_back(Operand_s{ Operand_e::boolValue, 1, 0 });
+                    break;
+                case OpCode_e::PSHLITFALSE:
+                    stack.push_back(Operand_s{ Operand_e::boolValue, 0, 0 });
+                    break;
+                case OpCode_e::PSHLITNUL:
+                    stack.push_back(Operand_s{ Operand_e::nilValue, 0, 0 });
+                    break;
+                case OpCode_e::PSHTBLFLT:
+                {
+                    const auto& filter = inMacros.filters[inst->value];
+
+                    // row and ever tests over the scope inherited from the enclosing loop
+                    if ((!filter.isRow && !filter.isEver) ||
+                        (!filter.isRow && filter.isNext) ||
+                        filter.isRange || filter.isWithin || filter.isLookAhead || filter.isLookBack ||
+                        filter.evalBlock == -1 ||
+                        !compileTypedLambda(inMacros, filter.evalBlock))
+                        return false;
+
+                    code.emplace_back(TypedOp_e::FILTER, static_cast<int32_t>(stack.size()), 0, 0, inst->value);
+                    stack.push_back(Operand_s{ Operand_e::reg, 0, 0 });
+                }
+                break;
+                case OpCode_e::OPEQ:
+                case OpCode_e::OPNEQ:
+                case OpCode_e::OPLT:
+                case OpCode_e::OPLTE:
+                case OpCode_e::OPGT:
+                case OpCode_e::OPGTE:
+                    if (!compare(inst->op))
+                        return false;
+                    break;
+                case OpCode_e::OPNOT:
+                    if (stack.empty() || stack.back().kind != Operand_e::reg)
+                        return false;
+                    code.emplace_back(
+                        TypedOp_e::NOT,
+                        static_cast<int32_t>(stack.size() - 1),
+                        static_cast<int32_t>(stack.size() - 1),
+                        0,
+                        0);
+                    break;
+                case OpCode_e::LGCAND:
+                    if (!logic(TypedOp_e::AND))
+                        return false;
+                    break;
+                case OpCode_e::LGCOR:
+                    if (!logic(TypedOp_e::OR))
+                        return false;
+                    break;
+                default:
+                    return false;
+                }
+            }
+
+            if (stack.size() != 1 || stack.back().kind != Operand_e::reg)
+                return false;
+
+            code.emplace_back(TypedOp_e::RET, 0, 0, 0, 0);
+
+            typedLambdas[lambdaId] = static_cast<int32_t>(inMacros.typedCode.size());
+            inMacros.typedCode.insert(inMacros.typedCode.end(), code.begin(), code.end());
+
+            return true;
+        }
+
+        // type every lambda that can be, the rest run in the interpreter
+        static void compileTyped(Macro_s& inMacros)
+        {
+            inMacros.typedCode.clear();
+            inMacros.typedLambdas.assign(inMacros.lambdas.size(), -1);
+
+            auto typed = false;
+
+            // lambda zero is the script body
+            for (auto i = 1; i < static_cast<int>(inMacros.lambdas.size()); ++i)
+                typed = compileTypedLambda(inMacros, i) || typed;
+
+            if (!typed)
+            {
+                inMacros.typedLambdas.clear();
+                inMacros.selectLambdas.clear();
+                return;
+            }
+
+            // without FILTER ops (ever/never scans) a lambda can be run over a batch of rows at once
+            inMacros.selectLambdas.assign(inMacros.lambdas.size(), false);
+
+            for (auto i = 1; i < static_cast<int>(inMacros.lambdas.size()); ++i)
+            {
+                if (inMacros.typedLambdas[i] == -1)
+                    continue;
+
+                auto selectable = true;
+                for (auto inst = inMacros.typedCode.data() + inMacros.typedLambdas[i]; inst->op != TypedOp_e::RET; ++inst)
+                    if (inst->op == TypedOp_e::FILTER)
+                        selectable = false;
+
+                inMacros.selectLambdas[i] = selectable;
+            }
+        }
+
+        // peephole pass, rewrites the first op of common sequences into a
+        // superinstruction. The rest of the sequence stays in place (the fused op
+        // reads its operands from it and skips over it) so code offsets don't move.
+        static void fuse(Macro_s& inMacros)
+        {
+            auto& code = inMacros.code;
+
+            // a property the fused ops can read straight from the grid
+            const auto isPlainColumn = [&](const Instruction_s& inst) -> bool
+            {
+                if (inst.op != OpCode_e::PSHTBLCOL || inst.extra != NONE)
+                    return false;
+
+                const auto& var = inMacros.vars.tableVars[inst.index];
+                return !var.isSet && var.schemaColumn != db::PROP_UUID && var.schemaType != db::PropertyTypes_e::freeProp;
+            };
+
+            for (auto idx = 0; idx < static_cast<int>(code.size()); ++idx)
+            {
+                auto& inst = code[idx];
+
+                if (inst.op == OpCode_e::CALL_EACH)
+                {
+                    // `each_row where property == literal` with no modifiers can scan the property
+                    const auto& filter = inMacros.filters[inst.value];
+
+                    if (inst.extra == -1 ||
+                        inMacros.typedLambdas.empty() ||
+                        inMacros.typedLambdas[inst.extra] == -1 ||
+                        filter.isContinue || filter.isNext || filter.isLimit || filter.isReverse ||
+                        filter.isRange || filter.isWithin || filter.isLookAhead || filter.isLookBack)
+                        continue;
+
+                    const auto typed = inMacros.typedCode.data() + inMacros.typedLambdas[inst.extra];
+
+                    if (typed[0].op == TypedOp_e::COL && typed[1].op == TypedOp_e::EQ && typed[2].op == TypedOp_e::RET)
+                        inst.op = OpCode_e::CALL_EACH_EQ;
+
+                    continue;
+                }
+
+                if (!isPlainColumn(inst))
+                    continue;
+
+                const auto& var = inMacros.vars.tableVars[inst.index];
+
+                // property == literal, compared as raw values (text by hash)
+                if (idx + 2 < static_cast<int>(code.size()) && code[idx + 2].op == OpCode_e::OPEQ)
+                {
+                    const auto literal = code[idx + 1].op;
+
+                    if ((var.schemaType == db::PropertyTypes_e::intProp && literal == OpCode_e::PSHLITINT) ||
+                        (var.schemaType == db::PropertyTypes_e::textProp && literal == OpCode_e::PSHLITSTR))
+                    {
+                        inst.op = OpCode_e::PSHCOLEQ;
+                        idx += 2;
+                        continue;
+                    }
+                }
+
+                // properties pushed straight into a tally
+                auto count = 1;
+                while (idx + count < static_cast<int>(code.size()) && isPlainColumn(code[idx + count]))
+                    ++count;
+
+                if (idx + count < static_cast<int>(code.size()) &&
+                    code[idx + count].op == OpCode_e::MARSHAL &&
+                    code[idx + count].index == static_cast<int64_t>(Marshals_e::marshal_tally) &&
+                    code[idx + count].extra == count)
+                {
+                    inst.op = OpCode_e::TALLYCOL;
+                    inst.value = count;
+                    idx += count;
+                }
+            }
+        }
+
+        // set user variables named in `params` to the parameter values, names the
+        // script doesn't use are ignored
+        static void bindParams(Macro_s& inMacros, const ParamVars& params)
+        {
+            for (auto& var : inMacros.vars.userVars)
+            {
+                if (const auto iter = params.find(var.actual); iter != params.end())
+                {
+                    var.value = iter->second;
+                    var.startingValue = iter->second;
+                }
+            }
+        }
+
         bool compileQuery(const std::string& query, openset::db::Properties* columnsPtr, Macro_s& inMacros, ParamVars* templateVars)
         {
 
@@ -3736,6 +4296,12 @@ namespace openset::query
                 rawScript = query;
                 inMacros.rawScript = rawScript;
 
+                // template variables are parameter slots, the script can use them
+                // without assigning them
+                if (templateVars)
+                    for (const auto& param : *templateVars)
+                        incUserVarAssignmentCount(param.first);
+
                 initialParse(query);
 
 
@@ -3756,6 +4322,11 @@ namespace openset::query
 
                 compile(inMacros);
                 compileIndex(inMacros);
+                compileTyped(inMacros);
+                fuse(inMacros);
+
+                if (templateVars)
+                    bindParams(inMacros, *templateVars);
 
                 return true;
             }
@@ -51,6 +51,19 @@ namespace openset::comms
         { "GET", std::regex(R"(^/v1/tables(\/|\?|\#|)$)"), RpcTable::table_list, {} },
         // RpcQuery
         { "POST", std::regex(R"(^/v1/query/([a-z0-9_]+)/event(\/|\?|\#|)$)"), RpcQuery::event, { { 1, "table" } } },
+        { "POST", std::regex(R"(^/v1/query/([a-z0-9_]+)/prepare(\/|\?|\#|)$)"), RpcQuery::prepare, { { 1, "table" } } },
+        {
+            "DELETE",
+            std::regex(R"(^/v1/query/([a-z0-9_]+)/prepare/([a-f0-9]+)(\/|\?|\#|)$)"),
+            RpcQuery::prepare_drop,
+            { { 1, "table" }, { 2, "handle" } }
+        },
+        {
+            "POST",
+            std::regex(R"(^/v1/query/([a-z0-9_]+)/execute/([a-f0-9]+)(\/|\?|\#|)$)"),
+            RpcQuery::event,
+            { { 1, "table" }, { 2, "handle" } }
+        },
         { "POST", std::regex(R"(^/v1/query/([a-z0-9_]+)/segment(\/|\?|\#|)$)"), RpcQuery::segment, { { 1, "table" } } },
         { "GET", std::regex(R"(^/v1/query/([a-z0-9_]+)/customer(\/|\?|\#|)$)"), RpcQuery::customer, { { 1, "table" } } },
         {
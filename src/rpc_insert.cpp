@@ -99,6 +99,18 @@ void RpcInsert::insertRetry(const openset::web::MessagePtr& message, const RpcMa
 
     SideLog::getSideLog().lock();
 
+    if (!SideLog::getSideLog().isAccepting())
+    {
+        RpcError(
+            openset::errors::Error{
+                openset::errors::errorClass_e::insert,
+                openset::errors::errorCode_e::general_error,
+                "write ahead log failed, inserts are disabled" },
+                message);
+        SideLog::getSideLog().unlock();
+        return;
+    }
+
     for (auto row : rows)
     {
         const auto personNode = row->xPath("/id");
@@ -111,6 +123,7 @@ void RpcInsert::insertRetry(const openset::web::MessagePtr& message, const RpcMa
                     openset::errors::errorCode_e::general_error,
                     "missing customer id" },
                     message);
+            SideLog::getSideLog().unlock();
             return;
         }
 
@@ -122,6 +135,7 @@ void RpcInsert::insertRetry(const openset::web::MessagePtr& message, const RpcMa
                     openset::errors::errorCode_e::general_error,
                     "this table is configured for numeric customer ids" },
                     message);
+            SideLog::getSideLog().unlock();
             return;
         }
 
@@ -133,6 +147,7 @@ void RpcInsert::insertRetry(const openset::web::MessagePtr& message, const RpcMa
                     openset::errors::errorCode_e::general_error,
                     "this table is configured for textual customer ids" },
                     message);
+            SideLog::getSideLog().unlock();
             return;
         }
 
@@ -157,7 +172,17 @@ void RpcInsert::insertRetry(const openset::web::MessagePtr& message, const RpcMa
         SideLog::getSideLog().add(table.get(), destination, cjson::stringifyCstr(row, len));
     }
 
-    SideLog::getSideLog().unlock();
+    // the events are not acknowledged until they are in the write ahead log
+    if (!SideLog::getSideLog().unlock())
+    {
+        RpcError(
+            openset::errors::Error{
+                openset::errors::errorClass_e::insert,
+                openset::errors::errorCode_e::general_error,
+                "insert could not be written to the write ahead log" },
+                message);
+        return;
+    }
 
     const auto localEndTime = Now();
 
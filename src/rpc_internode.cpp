@@ -186,6 +186,9 @@ void RpcInternode::transfer_init(const openset::web::MessagePtr& message, const
                 // serialize the people
                 part->people.serialize(&mem);
 
+                // the dictionaries the customers may be compressed with
+                Dictionaries::serialize(&mem, t->customerDictionary);
+
                 blockPtr = mem.flatten();
                 blockSize = mem.getBytes();
             } // HeapStack mem gets release here
@@ -258,6 +261,17 @@ void RpcInternode::transfer_receive(const openset::web::MessagePtr& message, con
     read += parts->attributes.deserialize(read);
     read += parts->people.deserialize(read);
 
+    parts->checkBuckets();
+
+    // the customer dictionaries follow, unless the sender predates them
+    const auto end = message->getPayload() + message->getPayloadLength();
+
+    if (read < end)
+        read += Dictionaries::deserialize(read, table->customerDictionary);
+
+    // nothing on disk describes what we just received
+    parts->checkpoint->forceFull = true;
+
     openset::globals::async->resumeAsync();
 
     Logger::get().info("transfer comlete");
@@ -1,6 +1,7 @@
 #include <stdexcept>
 #include <cinttypes>
 #include <regex>
+#include <chrono>
 #include "rpc_global.h"
 #include "rpc_query.h"
 #include "common.h"
@@ -23,6 +24,7 @@
 #include "result.h"
 #include "table.h"
 #include "tablepartitioned.h"
+#include "queryindexing.h"
 #include "errors.h"
 #include "internoderouter.h"
 #include "names.h"
@@ -309,7 +311,7 @@ openset::query::ParamVars getInlineVaraibles(const openset::web::MessagePtr& mes
         }
         else if (p.first.find("bool_") != string::npos)
         {
-            auto name = trim(p.first.substr(4));
+            auto name = trim(p.first.substr(5));
             if (name.length())
                 paramVars[name] = value.getBool();
         }
@@ -317,14 +319,47 @@ openset::query::ParamVars getInlineVaraibles(const openset::web::MessagePtr& mes
     return paramVars;
 }
 
+void compileCached(
+    Table* table,
+    const std::string& script,
+    openset::query::ParamVars* paramVars,
+    openset::query::Macro_s& queryMacros,
+    openset::query::QueryParser& parser)
+{
+    /*
+    * compileQuery through the table's plan cache. Scripts seen before with the
+    * same inline parameters (and schema) are copied from the cache, the rest are
+    * compiled and cached if they compile cleanly. Errors are reported on `parser`
+    * (or thrown) just like compileQuery.
+    */
+    const auto key = openset::query::PlanCache::makeKey(script, paramVars, table->getProperties()->version);
+
+    if (table->planCache.restore(key, queryMacros))
+        return;
+
+    const auto started = std::chrono::steady_clock::now();
+
+    parser.compileQuery(script, table->getProperties(), queryMacros, paramVars);
+
+    if (parser.error.inError())
+        return;
+
+    const auto compileMicros = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count();
+
+    table->planCache.store(key, queryMacros, compileMicros);
+}
+
 void RpcQuery::event(const openset::web::MessagePtr& message, const RpcMapping& matches)
 {
     auto database             = globals::database;
     const auto partitions     = globals::async;
     const auto request        = message->getJSON();
     const auto tableName      = matches.find("table"s)->second;
-    const auto queryCode      = std::string { message->getPayload(), message->getPayloadLength() };
+    const auto handle         = matches.count("handle"s) ? matches.find("handle"s)->second : ""s;
+    auto queryCode            = std::string { message->getPayload(), message->getPayloadLength() };
     const auto debug          = message->getParamBool("debug");
+    const auto explain        = message->getParamBool("explain");
     const auto isFork         = message->getParamBool("fork");
     const auto useStampCounts = message->getParamBool("stamp_counts");
     const auto trimSize       = message->getParamInt("trim", -1);
@@ -354,7 +389,7 @@ void RpcQuery::event(const openset::web::MessagePtr& message, const RpcMapping&
             message);
         return;
     }
-    if (!queryCode.length())
+    if (!handle.length() && !queryCode.length())
     {
         RpcError(
             errors::Error {
@@ -380,11 +415,56 @@ void RpcQuery::event(const openset::web::MessagePtr& message, const RpcMapping&
 
     const auto sessionTime     = message->getParamInt("session_time", table->getSessionTime());
     query::ParamVars paramVars = getInlineVaraibles(message);
+
+    /*
+    * Executing a prepared query. The script is compiled with the defaults given
+    * to prepare (so it's a plan cache hit after the first run on a node) and
+    * the inline variables on this request are bound over them. Forks carry
+    * the handle and the values, never the script.
+    */
+    query::ParamVars bindVars;
+    if (handle.length())
+    {
+        PreparedQuery_s prepared;
+        if (!table->getPreparedQuery(handle, prepared))
+        {
+            RpcError(
+                errors::Error {
+                    errors::errorClass_e::query,
+                    errors::errorCode_e::general_error,
+                    "prepared query could not be found"
+                },
+                message);
+            return;
+        }
+
+        for (const auto& param : paramVars)
+        {
+            if (!prepared.params.count(param.first))
+            {
+                RpcError(
+                    errors::Error {
+                        errors::errorClass_e::query,
+                        errors::errorCode_e::general_error,
+                        "'" + param.first + "' is not a parameter of the prepared query"
+                    },
+                    message);
+                return;
+            }
+        }
+
+        queryCode = prepared.script;
+        bindVars  = std::move(paramVars);
+        paramVars = std::move(prepared.params);
+    }
+
     query::Macro_s queryMacros; // this is our compiled code block
     query::QueryParser p;
     try
     {
-        p.compileQuery(queryCode.c_str(), table->getProperties(), queryMacros, &paramVars);
+        compileCached(table.get(), queryCode, &paramVars, queryMacros, p);
+        if (!p.error.inError())
+            query::QueryParser::bindParams(queryMacros, bindVars);
         queryMacros.useStampedRowIds = useStampCounts;
     }
     catch (const std::runtime_error& ex)
@@ -435,6 +515,37 @@ void RpcQuery::event(const openset::web::MessagePtr& message, const RpcMapping&
         message->reply(http::StatusCode::success_ok, &debugOutput[0], debugOutput.length());
         return;
     }
+    if (explain)
+    {
+        // plan the indexes on this node's partitions, workers are paused
+        // so the indexes hold still while we read them
+        std::string explainOutput;
+
+        globals::async->suspendAsync();
+
+        for (auto partition = 0; partition < globals::running->partitionMax; ++partition)
+        {
+            const auto parts = table->getPartitionObjects(partition, false);
+
+            if (!parts)
+                continue;
+
+            parts->attributes.clearDirty();
+
+            query::Indexing indexing;
+            indexing.mount(table.get(), queryMacros, partition, parts->people.customerCount());
+
+            explainOutput += "partition " + to_string(partition) + "\n" + indexing.explain() + "\n";
+        }
+
+        globals::async->resumeAsync();
+
+        if (explainOutput.empty())
+            explainOutput = "no partitions on this node\n";
+
+        message->reply(http::StatusCode::success_ok, &explainOutput[0], explainOutput.length());
+        return;
+    }
     auto sortColumn = 0;
     if (sortMode != ResultSortMode_e::key && sortColumnName.size())
     {
@@ -609,6 +720,131 @@ void RpcQuery::event(const openset::web::MessagePtr& message, const RpcMapping&
         });
 }
 
+void RpcQuery::prepare(const openset::web::MessagePtr& message, const RpcMapping& matches)
+{
+    // prepared queries are kept on every node so execute only has to fork the handle
+    if (ForwardRequest(message) != ForwardStatus_e::alreadyForwarded)
+        return;
+
+    auto database         = globals::database;
+    const auto tableName  = matches.find("table"s)->second;
+    const auto queryCode  = std::string { message->getPayload(), message->getPayloadLength() };
+
+    Logger::get().info("Inbound prepare query");
+    if (!tableName.length())
+    {
+        RpcError(
+            errors::Error {
+                errors::errorClass_e::query,
+                errors::errorCode_e::general_error,
+                "missing or invalid table name"
+            },
+            message);
+        return;
+    }
+    if (!queryCode.length())
+    {
+        RpcError(
+            errors::Error {
+                errors::errorClass_e::query,
+                errors::errorCode_e::general_error,
+                "missing query code (POST query as text)"
+            },
+            message);
+        return;
+    }
+    auto table = database->getTable(tableName);
+    if (!table)
+    {
+        RpcError(
+            errors::Error {
+                errors::errorClass_e::query,
+                errors::errorCode_e::general_error,
+                "table could not be found"
+            },
+            message);
+        return;
+    }
+
+    // the inline variables name the parameter slots and give their defaults
+    query::ParamVars paramVars = getInlineVaraibles(message);
+    query::Macro_s queryMacros;
+    query::QueryParser p;
+    try
+    {
+        compileCached(table.get(), queryCode, &paramVars, queryMacros, p);
+    }
+    catch (const std::runtime_error& ex)
+    {
+        RpcError(
+            errors::Error {
+                errors::errorClass_e::parse,
+                errors::errorCode_e::syntax_error,
+                std::string { ex.what() }
+            },
+            message);
+        return;
+    }
+    if (p.error.inError())
+    {
+        Logger::get().error(p.error.getErrorJSON());
+        message->reply(http::StatusCode::client_error_bad_request, p.error.getErrorJSON());
+        return;
+    }
+
+    const auto handle = table->setPreparedQuery(queryCode, paramVars);
+
+    cjson response;
+    response.set("handle", handle);
+    auto paramNodes = response.setArray("params");
+    for (const auto& param : paramVars)
+        paramNodes->push(param.first);
+
+    message->reply(http::StatusCode::success_ok, response);
+}
+
+void RpcQuery::prepare_drop(const openset::web::MessagePtr& message, const RpcMapping& matches)
+{
+    // every node holds a copy, so every node drops it
+    if (ForwardRequest(message) != ForwardStatus_e::alreadyForwarded)
+        return;
+
+    auto database         = globals::database;
+    const auto tableName  = matches.find("table"s)->second;
+    const auto handle     = matches.find("handle"s)->second;
+
+    auto table = database->getTable(tableName);
+    if (!table)
+    {
+        RpcError(
+            errors::Error {
+                errors::errorClass_e::query,
+                errors::errorCode_e::general_error,
+                "table could not be found"
+            },
+            message);
+        return;
+    }
+
+    if (!table->dropPreparedQuery(handle))
+    {
+        RpcError(
+            errors::Error {
+                errors::errorClass_e::query,
+                errors::errorCode_e::general_error,
+                "prepared query could not be found"
+            },
+            message);
+        return;
+    }
+
+    cjson response;
+    response.set("message", "removed");
+    response.set("handle", handle);
+
+    message->reply(http::StatusCode::success_ok, response);
+}
+
 void RpcQuery::segment(const openset::web::MessagePtr& message, const RpcMapping& matches)
 {
     auto database         = globals::database;
@@ -672,7 +908,7 @@ void RpcQuery::segment(const openset::web::MessagePtr& message, const RpcMapping
             continue;
         query::Macro_s queryMacros; // this is our compiled code block
         query::QueryParser p;
-        p.compileQuery(r.code.c_str(), table->getProperties(), queryMacros, &paramVars);
+        compileCached(table.get(), r.code, &paramVars, queryMacros, p);
 
         if (p.error.inError())
         {
@@ -1441,7 +1677,7 @@ void RpcQuery::histogram(openset::web::MessagePtr& message, const RpcMapping& ma
     query::QueryParser p;
     try
     {
-        p.compileQuery(queryCode.c_str(), table->getProperties(), queryMacros, &paramVars);
+        compileCached(table.get(), queryCode, &paramVars, queryMacros, p);
     }
     catch (const std::runtime_error& ex)
     {
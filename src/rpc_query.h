@@ -14,7 +14,12 @@ namespace openset::comms
     {
     public:
         // POST /v1/query/{table}/event
+        // POST /v1/query/{table}/execute/{handle} (a prepared event query)
         static void event(const openset::web::MessagePtr& message, const RpcMapping& matches);
+        // POST /v1/query/{table}/prepare
+        static void prepare(const openset::web::MessagePtr& message, const RpcMapping& matches);
+        // DELETE /v1/query/{table}/prepare/{handle}
+        static void prepare_drop(const openset::web::MessagePtr& message, const RpcMapping& matches);
         // POST /v1/query/{table}/segment
         static void segment(const openset::web::MessagePtr& message, const RpcMapping& matches);
         // POST /v1/query/{table}/property/{name}?{various optional query params}
@@ -1,13 +1,66 @@
 #include "rpc_status.h"
 
+#include <algorithm>
+
 #include "cjson/cjson.h"
 
 #include "common.h"
 #include "rpc_global.h"
 #include "sentinel.h"
 #include "database.h"
+#include "table.h"
+#include "decodecache.h"
+#include "indexcache.h"
 #include "internoderouter.h"
 #include "http_serve.h"
+#include "queryinterpreter.h"
+
+namespace
+{
+    // bytes in and out of LZ4 on this node, and the dictionary in use
+    void setCompression(cjson* node, const openset::db::DictionaryTrainer& trainer)
+    {
+        const auto raw = trainer.getRawBytes();
+        const auto comp = trainer.getCompBytes();
+
+        node->set("raw_bytes", raw);
+        node->set("compressed_bytes", comp);
+        node->set("ratio", comp ? static_cast<double>(raw) / static_cast<double>(comp) : 0.0);
+        node->set("dictionary", static_cast<int64_t>(trainer.getActiveId()));
+    }
+
+    // executed op codes, and the most frequent adjacent pairs (candidates for fusing)
+    void setOpCounts(cjson* node)
+    {
+        using namespace openset::query;
+
+        const auto opCount = static_cast<int>(OpCode_e::OP_COUNT);
+        const auto opName = [](const int op) -> std::string
+        {
+            const auto iter = OpDebugStrings.find(static_cast<OpCode_e>(op));
+            return iter == OpDebugStrings.end() ? std::to_string(op) : iter->second;
+        };
+
+        auto opsNode = node->setObject("ops");
+        for (auto op = 0; op < opCount; ++op)
+            if (const auto count = Interpreter::opCounts[op].load(std::memory_order_relaxed))
+                opsNode->set(opName(op), count);
+
+        std::vector<std::pair<int64_t, int>> pairs;
+        for (auto pair = 0; pair < opCount * opCount; ++pair)
+            if (const auto count = Interpreter::opPairCounts[pair].load(std::memory_order_relaxed))
+                pairs.emplace_back(count, pair);
+
+        std::sort(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+        if (pairs.size() > 25)
+            pairs.resize(25);
+
+        auto pairsNode = node->setObject("pairs");
+        for (const auto& pair : pairs)
+            pairsNode->set(opName(pair.second / opCount) + " > " + opName(pair.second % opCount), pair.first);
+    }
+}
 
 void openset::comms::RpcStatus::status(const openset::web::MessagePtr & message, const RpcMapping & matches)
 {
@@ -28,5 +81,42 @@ void openset::comms::RpcStatus::status(const openset::web::MessagePtr & message,
     for (auto &t : tables)
         tableNode->push(t);
 
+    auto cacheNode = doc.setObject("decode_cache");
+    cacheNode->set("hits", openset::db::DecodeCache::getHits());
+    cacheNode->set("misses", openset::db::DecodeCache::getMisses());
+    cacheNode->set("bytes", openset::db::DecodeCache::getBytes());
+
+    auto indexCacheNode = doc.setObject("index_cache");
+    indexCacheNode->set("hits", openset::db::IndexCache::getHits());
+    indexCacheNode->set("misses", openset::db::IndexCache::getMisses());
+    indexCacheNode->set("bytes", openset::db::IndexCache::getBytes());
+
+    auto planCacheNode = doc.setObject("plan_cache");
+    planCacheNode->set("hits", openset::query::PlanCache::getHits());
+    planCacheNode->set("misses", openset::query::PlanCache::getMisses());
+    planCacheNode->set("compile_ms_saved", openset::query::PlanCache::getSavedMicros() / 1000);
+
+    auto planEntriesNode = planCacheNode->setObject("entries");
+
+    for (auto &t : tables)
+        if (const auto table = openset::globals::database->getTable(t))
+            planEntriesNode->set(t, table->planCache.getEntries());
+
+    if (globals::running->opCounts)
+        setOpCounts(doc.setObject("op_counts"));
+
+    auto compressionNode = doc.setObject("compression");
+
+    for (auto &t : tables)
+    {
+        const auto table = openset::globals::database->getTable(t);
+
+        if (!table)
+            continue;
+
+        auto node = compressionNode->setObject(t);
+        setCompression(node->setObject("customers"), table->customerDictionary);
+    }
+
     message->reply(http::StatusCode::success_ok, doc);
 }
@@ -161,6 +161,7 @@ void RpcTable::table_create(const openset::web::MessagePtr& message, const RpcMa
         const auto type = n->xPathString("/type", "");
         const auto isSet = n->xPathBool("/is_set", false);
         const auto isProp = n->xPathBool("/is_customer", false);
+        const auto isSliced = n->xPathBool("/is_sliced", false);
 
         PropertyTypes_e colType;
 
@@ -184,7 +185,19 @@ void RpcTable::table_create(const openset::web::MessagePtr& message, const RpcMa
             return;
         }
 
-        columns->setProperty(columnEnum, name, colType, isSet, isProp);
+        if (isSliced && !openset::db::Properties::canSlice(colType, isSet, isProp))
+        {
+            RpcError(
+                openset::errors::Error{
+                    openset::errors::errorClass_e::config,
+                    openset::errors::errorCode_e::general_config_error,
+                    "is_sliced requires an int or double customer property that is not a set" },
+                    message);
+
+            return;
+        }
+
+        columns->setProperty(columnEnum, name, colType, isSet, isProp, false, isSliced);
         ++columnEnum;
     }
 
@@ -333,6 +346,8 @@ void RpcTable::table_describe(const openset::web::MessagePtr& message, const Rpc
                 columnRecord->set("is_set", true);
             if (c.isCustomerProperty)
                 columnRecord->set("is_customer", true);
+            if (c.isSliced)
+                columnRecord->set("is_sliced", true);
         }
 
     auto eventOrder = response.setArray("event_order");
@@ -367,6 +382,7 @@ void RpcTable::column_add(const openset::web::MessagePtr& message, const RpcMapp
     const auto columnType = message->getParamString("type"s);
     const auto isSet = message->getParamBool("is_set"s);
     const auto isProp = message->getParamBool("is_customer"s);
+    const auto isSliced = message->getParamBool("is_sliced"s);
 
     if (!tableName.size())
     {
@@ -451,7 +467,21 @@ void RpcTable::column_add(const openset::web::MessagePtr& message, const RpcMapp
     else
         colType = PropertyTypes_e::boolProp;
 
-    columns->setProperty(lowest, columnName, colType, isSet, isProp);
+    if (isSliced && !openset::db::Properties::canSlice(colType, isSet, isProp))
+    {
+        RpcError(
+            openset::errors::Error{
+                openset::errors::errorClass_e::config,
+                openset::errors::errorCode_e::general_config_error,
+                "is_sliced requires an int or double customer property that is not a set" },
+                message);
+        return;
+    }
+
+    columns->setProperty(lowest, columnName, colType, isSet, isProp, false, isSliced);
+
+    // compiled scripts resolved names against the old properties
+    table->planCache.clear();
 
     Logger::get().info("added property '" + columnName + "' to table '" + tableName + "' created.");
 
@@ -524,6 +554,7 @@ void RpcTable::column_drop(const openset::web::MessagePtr& message, const RpcMap
 
     // delete the actual property
     table->getProperties()->deleteProperty(column);
+    table->planCache.clear();
 
     Logger::get().info("dropped property '" + columnName + "' from table '" + tableName + "' created.");
 
@@ -9,6 +9,8 @@
 #include "rpc.h"
 
 #include "sentinel.h"
+#include "sidelog.h"
+#include "checkpoint.h"
 
 #include "http_serve.h"
 
@@ -38,6 +40,13 @@ namespace openset
 
 		openset::db::Database db;
 
+		// reload any inserts that had not made it into a partition before
+		// the last shutdown, they replay once partitions are mapped
+		db::SideLog::getSideLog().openWriteAheadLog(
+			globals::running->path,
+			globals::running->walSyncInterval,
+			globals::running->walSegmentBytes);
+
 		// aysnc.run will create our thread pool o
 		//
 		// This thread will create a pool of thread (in 'run') that
@@ -49,8 +58,14 @@ namespace openset
 
 		// async loop will not be running if this node is not part of a cluster
 		if (async.isRunning())
+		{
 			async.mapPartitionsToAsyncWorkers();
 
+			// recreate tables from their checkpoints, our partitions
+			// map their snapshots and replay the write ahead log from there
+			db::Checkpoint::loadTables(&db);
+		}
+
 		openset::mapping::Sentinel teamster(&mapper, &db);
 
 		web::HttpServe httpd;
@@ -9,6 +9,7 @@
 
 #include "common.h"
 #include "table.h"
+#include "writeaheadlog.h"
 
 namespace openset::db
 {
@@ -17,14 +18,18 @@ namespace openset::db
         int64_t stamp{ Now() };
         int64_t tableHash{ 0 };
         int32_t partition{ -1 };
+        int64_t segment{ 0 }; // write ahead log segment holding this entry
+        int64_t offset{ 0 };  // where the entry starts in `segment`
         char* jsonData { nullptr };
         SideLogCursor_s* next { nullptr };
 
         SideLogCursor_s() = default;
 
-        SideLogCursor_s(const int64_t tableHash, const int32_t partition, char* data) :
+        SideLogCursor_s(const int64_t tableHash, const int32_t partition, char* data, const int64_t segment, const int64_t offset) :
             tableHash(tableHash),
             partition(partition),
+            segment(segment),
+            offset(offset),
             jsonData(data)
         { }
 
@@ -83,6 +88,9 @@ namespace openset::db
 
         CriticalSection cs;
 
+        // durable copy of the log, see writeaheadlog.h
+        WriteAheadLog wal;
+
         using JsonList = std::vector<char*>;
 
         // pair is <tableHash, parition>
@@ -91,6 +99,11 @@ namespace openset::db
         //LastMap writeHeads;
         ReadMap readHeads;
 
+        // pair is <tableHash, partition>, value is the oldest write ahead log
+        // segment the partition still needs (everything before it is in a checkpoint)
+        using CheckpointMap = std::unordered_map<std::pair<int64_t, int32_t>, int64_t>;
+        CheckpointMap checkpointSegments;
+
         int64_t lastTrim{ Now() };
 
         SideLog() = default;
@@ -170,6 +183,32 @@ namespace openset::db
             if (!head)
                 tail = nullptr;
 
+            // segments are retired whole, once the oldest live entry
+            // is in a later segment nothing in them will be read again.
+            // When checkpoints are running, segments are also kept until every
+            // partition has a checkpoint containing their entries.
+            auto retireSegment = head ? head->segment : wal.getActiveSegment();
+
+            for (const auto& checkpoint : checkpointSegments)
+                if (checkpoint.second < retireSegment)
+                    retireSegment = checkpoint.second;
+
+            wal.retire(retireSegment);
+            wal.sync();
+        }
+
+        // links an entry onto the end of the list
+        void link(SideLogCursor_s* entry)
+        {
+            ++logSize;
+
+            if (!head)
+                head = entry;
+
+            if (tail)
+                tail->next = entry;
+
+            tail = entry;
         }
 
         void resetReadHeads()
@@ -193,31 +232,93 @@ namespace openset::db
             cs.lock();
         }
 
-        void unlock()
+        // unlock also commits the batch of adds made under the lock to the
+        // write ahead log (group commit), returns false if the batch could not
+        // be written (it is written again by the next commit)
+        bool unlock()
         {
+            const auto committed = wal.commit();
             cs.unlock();
+            return committed;
+        }
+
+        // false once the write ahead log hit a write it could not repair, inserts
+        // are then refused rather than acknowledged without being durable
+        bool isAccepting() const
+        {
+            return !wal.isFailed();
+        }
+
+        /*
+         * openWriteAheadLog - opens the write ahead log under `dataPath` and replays
+         * any entries left in it by the previous run into the log.
+         *
+         * Replayed entries are re-stamped, so they get the same grace period a
+         * transferred translog gets before they can be trimmed. Partitions
+         * created after this start reading just past the last entry their
+         * checkpoint holds (see resumeReadHead), or at the head of the log.
+         */
+        void openWriteAheadLog(const std::string& dataPath, const int64_t syncMillis, const int64_t segmentBytes)
+        {
+            csLock lock(cs);
+
+            wal.open(dataPath, syncMillis, segmentBytes);
+
+            const auto replayStamp = Now();
+
+            const auto count = wal.replay(
+                [&](const int64_t segment, const int64_t offset, const int64_t, const int64_t tableHash, const int32_t partition, const char* json, const int32_t length)
+                {
+                    const auto jsonData = static_cast<char*>(PoolMem::getPool().getPtr(length + 1));
+                    memcpy(jsonData, json, length);
+                    jsonData[length] = 0x00;
+
+                    const auto newEntry =
+                        new (PoolMem::getPool().getPtr(sizeof(SideLogCursor_s)))
+                            SideLogCursor_s(tableHash, partition, jsonData, segment, offset);
+
+                    newEntry->stamp = replayStamp;
+
+                    link(newEntry);
+                });
+
+            resetReadHeads();
+
+            Logger::get().info("write ahead log replayed " + to_string(count) + " transactions.");
+        }
+
+        // stop logging, entries already in the log are kept
+        void closeWriteAheadLog()
+        {
+            csLock lock(cs);
+            wal.close();
+        }
+
+        // called from the maintenance loop every sync interval, so inserts that
+        // were acknowledged reach the disk even when no more inserts arrive
+        void syncWriteAheadLog()
+        {
+            csLock lock(cs);
+            wal.syncTimer();
         }
 
         // lock/unlock from caller using lock() and unlock() to accelerate inserts
         void add(const Table* table, const int32_t partition, char* json)
         {
             const auto tableHash = table->getTableHash();
+            const auto stamp = Now();
+
+            int64_t offset;
+            const auto segment = wal.append(stamp, tableHash, partition, json, static_cast<int32_t>(strlen(json)), offset);
 
             // create with placement new
             const auto newEntry =
                 new (PoolMem::getPool().getPtr(sizeof(SideLogCursor_s)))
-                    SideLogCursor_s(tableHash, partition, json);
-
-            ++logSize;
+                    SideLogCursor_s(tableHash, partition, json, segment, offset);
 
-            // link it onto the end of the list
-            if (!head)
-                head = newEntry;
-
-            if (tail)
-                tail->next = newEntry;
+            newEntry->stamp = stamp;
 
-            tail = newEntry;
+            link(newEntry);
         }
 
         JsonList read(const Table* table, const int32_t partition, const int limit, int64_t& readPosition)
@@ -281,6 +382,29 @@ namespace openset::db
             setLastRead(tableHash, partition, nullptr);
         }
 
+        // point a partition's read head at the last entry at or before `segment`
+        // and `offset` (see getReadPosition), the entries up to it are already in
+        // the partition's checkpoint. The log is in write ahead log order.
+        void resumeReadHead(const Table* table, const int32_t partition, const int64_t segment, const int64_t offset)
+        {
+            csLock lock(cs);
+
+            // without a write ahead log entries carry no position
+            if (!wal.isEnabled() || offset < 0)
+                return;
+
+            SideLogCursor_s* last = nullptr;
+
+            for (auto cursor = head; cursor; cursor = cursor->next)
+            {
+                if (cursor->segment > segment || (cursor->segment == segment && cursor->offset > offset))
+                    break;
+                last = cursor;
+            }
+
+            setLastRead(table->getTableHash(), partition, last);
+        }
+
         void removeReadHeadsByPartition(const int32_t partition)
         {
             csLock lock(cs);
@@ -292,6 +416,60 @@ namespace openset::db
                 else
                     ++iter;
             }
+
+            for (auto iter = checkpointSegments.begin(); iter != checkpointSegments.end();)
+            {
+                if (iter->first.second == partition)
+                    iter = checkpointSegments.erase(iter);
+                else
+                    ++iter;
+            }
+        }
+
+        void removeReadHeadsByTable(const int64_t tableHash)
+        {
+            csLock lock(cs);
+
+            for (auto iter = readHeads.begin(); iter != readHeads.end();)
+            {
+                if (iter->first.first == tableHash)
+                    iter = readHeads.erase(iter);
+                else
+                    ++iter;
+            }
+
+            for (auto iter = checkpointSegments.begin(); iter != checkpointSegments.end();)
+            {
+                if (iter->first.first == tableHash)
+                    iter = checkpointSegments.erase(iter);
+                else
+                    ++iter;
+            }
+        }
+
+        // returns the write ahead log segment of the last entry a partition read,
+        // everything in earlier segments has been inserted into the partition.
+        // `offset` is set to where that entry starts, -1 if nothing was read.
+        int64_t getReadPosition(const Table* table, const int32_t partition, int64_t& offset)
+        {
+            csLock lock(cs);
+
+            if (const auto cursor = getLastRead(table->getTableHash(), partition); cursor)
+            {
+                offset = cursor->offset;
+                return cursor->segment;
+            }
+
+            offset = -1;
+            return head ? head->segment : wal.getActiveSegment();
+        }
+
+        // a partition with a checkpoint segment holds back retirement of write
+        // ahead log segments until it checkpoints past them
+        void setCheckpointSegment(const Table* table, const int32_t partition, const int64_t segment)
+        {
+            csLock lock(cs);
+            checkpointSegments[std::make_pair(table->getTableHash(), partition)] = segment;
         }
 
         void serialize(HeapStack* mem)
@@ -334,6 +512,11 @@ namespace openset::db
             head = nullptr;
             tail = nullptr;
 
+            // the whole list is logged again below, into a fresh segment so the
+            // segments holding the old copies can be retired once it is written
+            const auto rotated = wal.rotate();
+            const auto firstSegment = wal.getActiveSegment();
+
             for (auto i = 0; i < sectionLength; ++i)
             {
                 // create with placement new
@@ -342,18 +525,15 @@ namespace openset::db
                         SideLogCursor_s();
 
                 newEntry->deserialize(read);
-
-                // link it onto the end of the list
-                if (!head)
-                    head = newEntry;
-
-                if (tail)
-                    tail->next = newEntry;
-
-                tail = newEntry;
-
-                ++logSize;
-
+                newEntry->segment = wal.append(
+                    newEntry->stamp,
+                    newEntry->tableHash,
+                    newEntry->partition,
+                    newEntry->jsonData,
+                    static_cast<int32_t>(strlen(newEntry->jsonData)),
+                    newEntry->offset);
+
+                link(newEntry);
             }
 
             // here we append (and update the sequence numbers)
@@ -374,6 +554,18 @@ namespace openset::db
                     cursor->stamp = newStamp;
                     cursor->next = nullptr;
 
+                    // re-log the entry so segments stay in list order
+                    cursor->segment = wal.append(
+                        cursor->stamp,
+                        cursor->tableHash,
+                        cursor->partition,
+                        cursor->jsonData,
+                        static_cast<int32_t>(strlen(cursor->jsonData)),
+                        cursor->offset);
+
+                    if (!head)
+                        head = cursor;
+
                     if (tail)
                         tail->next = cursor;
 
@@ -383,6 +575,14 @@ namespace openset::db
 
             }
 
+            // with the new copies on disk the old ones go, a restart
+            // replaying both would insert the old entries twice
+            if (wal.commit() && rotated)
+            {
+                wal.sync(true);
+                wal.retire(firstSegment);
+            }
+
             // reset the read-head so this entire new transaction log
             // will get replayed through the insert mechanism
             resetReadHeads();
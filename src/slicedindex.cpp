@@ -0,0 +1,134 @@
+#include "slicedindex.h"
+
+using namespace openset::db;
+
+bool SlicedIndex::get(const int64_t linId, int64_t& value) const
+{
+    if (!exists.bitState(linId))
+        return false;
+
+    uint64_t bits = 0;
+
+    for (auto slice = 0; slice < SLICES; ++slice)
+        if (isUsed(slice) && slices[slice].bitState(linId))
+            bits |= 1ULL << slice;
+
+    value = static_cast<int64_t>(bits);
+    return true;
+}
+
+void SlicedIndex::set(const int64_t linId, const int64_t value)
+{
+    const auto bits = static_cast<uint64_t>(value);
+
+    exists.bitSet(linId);
+
+    for (auto slice = 0; slice < SLICES; ++slice)
+    {
+        if ((bits >> slice) & 1)
+        {
+            slices[slice].bitSet(linId);
+            used |= 1ULL << slice;
+        }
+        else if (isUsed(slice))
+        {
+            slices[slice].bitClear(linId);
+        }
+    }
+}
+
+void SlicedIndex::clear(const int64_t linId, const int64_t value)
+{
+    // a customer changing value clears the old one, which may come after the new one is set
+    if (int64_t current; !get(linId, current) || current != value)
+        return;
+
+    exists.bitClear(linId);
+
+    for (auto slice = 0; slice < SLICES; ++slice)
+        if (isUsed(slice))
+            slices[slice].bitClear(linId);
+}
+
+void SlicedIndex::range(const Range_e mode, const int64_t value, IndexBits& result)
+{
+    /*
+     * Walk the slices from the top bit down, keeping the customers equal to
+     * `value` so far in `equal`. Where `value` has a 1 those without it are
+     * less, where it has a 0 those with it are greater.
+     *
+     * Values are two's complement, flipping the sign bit makes them
+     * compare as unsigned, so slice 63 is used inverted.
+     */
+    const auto target = static_cast<uint64_t>(value) ^ (1ULL << 63);
+
+    IndexBits equal;
+    IndexBits less;
+    IndexBits greater;
+    IndexBits work;
+
+    equal.opCopy(exists);
+    less.makeBits(exists.ints * 64, 0);
+    greater.makeBits(exists.ints * 64, 0);
+
+    for (auto slice = SLICES - 1; slice >= 0; --slice)
+    {
+        const auto targetBit = (target >> slice) & 1;
+
+        // an unused slice is all zeros (all ones in the sign slice)
+        if (!isUsed(slice))
+        {
+            const uint64_t sliceBit = slice == SLICES - 1 ? 1 : 0;
+
+            if (targetBit == sliceBit)
+                continue;
+
+            (targetBit ? less : greater).opOr(equal);
+            equal.reset();
+            break;
+        }
+
+        const IndexBits* bits = &slices[slice];
+
+        if (slice == SLICES - 1)
+        {
+            work.opCopyAndNot(exists, slices[slice]);
+            bits = &work;
+        }
+
+        IndexBits step;
+
+        if (targetBit)
+        {
+            step.opCopyAndNot(equal, *bits);
+            less.opOr(step);
+            step.opCopyAnd(equal, *bits);
+        }
+        else
+        {
+            step.opCopyAnd(equal, *bits);
+            greater.opOr(step);
+            step.opCopyAndNot(equal, *bits);
+        }
+
+        equal = std::move(step);
+    }
+
+    switch (mode)
+    {
+    case Range_e::gt:
+        result = std::move(greater);
+        break;
+    case Range_e::gte:
+        greater.opOr(equal);
+        result = std::move(greater);
+        break;
+    case Range_e::lt:
+        result = std::move(less);
+        break;
+    case Range_e::lte:
+        less.opOr(equal);
+        result = std::move(less);
+        break;
+    }
+}
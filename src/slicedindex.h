@@ -0,0 +1,63 @@
+#pragma once
+
+#include "common.h"
+#include "indexbits.h"
+
+namespace openset
+{
+    namespace db
+    {
+        /*
+         * SlicedIndex - a bit-sliced index of a numeric property
+         *
+         * Rather than one IndexBits per distinct value, slice `b` holds the
+         * customers whose value has bit `b` set (values are int64, doubles are
+         * scaled by 10,000 as everywhere else), and `exists` the customers that
+         * have a value. A range over a property with thousands of values is
+         * then at most 64 passes of bit operations.
+         *
+         * Only slices that have ever held a set bit are kept, so small
+         * positive values cost only the slices they use.
+         *
+         * Each customer has one value, so slicing is for customer properties
+         * that are not sets (see Properties::Property_s::isSliced).
+         */
+        class SlicedIndex
+        {
+        public:
+            enum class Range_e : int32_t
+            {
+                gt,
+                gte,
+                lt,
+                lte
+            };
+
+        private:
+            static const int32_t SLICES = 64;
+
+            IndexBits exists;
+            IndexBits slices[SLICES];
+            uint64_t used { 0 }; // a bit for each slice that has held a set bit
+
+            bool isUsed(const int32_t slice) const
+            {
+                return (used >> slice) & 1;
+            }
+
+        public:
+            SlicedIndex() = default;
+
+            // the value of linId, false if it has none
+            bool get(const int64_t linId, int64_t& value) const;
+
+            void set(const int64_t linId, const int64_t value);
+
+            // removes linId if it holds `value`
+            void clear(const int64_t linId, const int64_t value);
+
+            // customers with a value `mode` `value` (i.e. gt 5) in `result`
+            void range(const Range_e mode, const int64_t value, IndexBits& result);
+        };
+    };
+};
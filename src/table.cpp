@@ -9,6 +9,7 @@
 #include "asyncpool.h"
 #include "internoderouter.h"
 #include "queryinterpreter.h"
+#include "checkpoint.h"
 
 using namespace openset::db;
 
@@ -94,12 +95,23 @@ void Table::releasePartitionObjects(const int32_t partition)
 
     if (const auto part = partitions.find(partition); part != partitions.end())
     {
-        part->second->markForDeletion();
-        zombies.push(part->second);
+        const auto parts = part->second;
+
+        parts->markForDeletion();
+        zombies.push(parts);
         partitions.erase(partition);
+
+        // the partition has moved, a snapshot left here would be stale if it came back
+        Checkpoint::dropPartition(parts);
     }
 }
 
+int64_t Table::getPartitionCount()
+{
+    csLock lock(cs);
+    return static_cast<int64_t>(partitions.size());
+}
+
 void Table::setSegmentRefresh(
     const std::string& segmentName,
     const openset::query::Macro_s& macros,
@@ -133,6 +145,36 @@ void Table::removeSegmentRefresh(const std::string& segmentName)
         segmentRefresh.erase(segmentName);
 }
 
+std::string Table::setPreparedQuery(const std::string& script, const query::ParamVars& params)
+{
+    char handle[17];
+    snprintf(handle, sizeof(handle), "%016llx",
+        static_cast<unsigned long long>(MakeHash(query::PlanCache::makeKey(script, &params, 0))));
+
+    csLock lock(preparedCS);
+    prepared[handle] = PreparedQuery_s { handle, script, params };
+
+    return handle;
+}
+
+bool Table::getPreparedQuery(const std::string& handle, PreparedQuery_s& preparedQuery)
+{
+    csLock lock(preparedCS);
+
+    const auto iter = prepared.find(handle);
+    if (iter == prepared.end())
+        return false;
+
+    preparedQuery = iter->second;
+    return true;
+}
+
+bool Table::dropPreparedQuery(const std::string& handle)
+{
+    csLock lock(preparedCS);
+    return prepared.erase(handle) != 0;
+}
+
 void Table::serializeTable(cjson* doc)
 {
     auto pkNode = doc->setArray("z_order");
@@ -187,7 +229,43 @@ void Table::serializeTable(cjson* doc)
             columnRecord->set("deleted", c.deleted);
             columnRecord->set("is_set", c.isSet);
             columnRecord->set("is_prop", c.isCustomerProperty);
+            columnRecord->set("is_sliced", c.isSliced);
+        }
+
+    // prepared queries go wherever the schema goes (node joins, checkpoints)
+    auto preparedNodes = doc->setArray("prepared");
+
+    csLock lock(preparedCS);
+    for (auto &p : prepared)
+    {
+        auto preparedRecord = preparedNodes->pushObject();
+
+        preparedRecord->set("handle", p.second.handle);
+        preparedRecord->set("script", p.second.script);
+
+        auto paramNodes = preparedRecord->setObject("params");
+
+        for (auto &param : p.second.params)
+        {
+            switch (param.second.typeOf())
+            {
+            case cvar::valueType::INT32:
+            case cvar::valueType::INT64:
+                paramNodes->set(param.first, param.second.getInt64());
+                break;
+            case cvar::valueType::FLT:
+            case cvar::valueType::DBL:
+                paramNodes->set(param.first, param.second.getDouble());
+                break;
+            case cvar::valueType::BOOL:
+                paramNodes->set(param.first, param.second.getBool());
+                break;
+            default:
+                paramNodes->set(param.first, param.second.getString());
+                break;
+            }
         }
+    }
 }
 
 void Table::serializeSettings(cjson* doc) const
@@ -198,8 +276,10 @@ void Table::serializeSettings(cjson* doc) const
     doc->set("tz_offset", tzOffset);
     doc->set("maint_interval", maintInterval);
     doc->set("segment_interval", segmentInterval);
-    doc->set("index_compression", indexCompression);
     doc->set("person_compression", personCompression);
+    doc->set("cold_after", coldAfter);
+    doc->set("memory_budget", memoryBudget);
+    doc->set("tail_fold", tailFold);
 }
 
 void Table::serializeTriggers(cjson* doc)
@@ -231,6 +311,7 @@ void Table::deserializeTable(const cjson* doc)
         auto index = item->xPathInt("/index", -1);
         auto isSet = item->xPathBool("/is_set", false);
         auto isProp = item->xPathBool("/is_prop", false);
+        auto isSliced = item->xPathBool("/is_sliced", false);
         // was it deleted? > 0 = deleted, value is epoch time of deletion
         auto deleted = item->xPathInt("/deleted", 0);
 
@@ -250,7 +331,7 @@ void Table::deserializeTable(const cjson* doc)
         else
             return; // skip
 
-        properties.setProperty(index, colName, colType, isSet, isProp, deleted);
+        properties.setProperty(index, colName, colType, isSet, isProp, deleted, isSliced);
         count++;
     };
 
@@ -311,6 +392,49 @@ void Table::deserializeTable(const cjson* doc)
         for (auto n : columns)
             addToSchema(n);
     }
+
+    // load the prepared queries
+    const auto preparedNode = doc->xPath("/prepared");
+
+    if (preparedNode)
+    {
+        csLock lock(preparedCS);
+
+        for (auto n : preparedNode->getNodes())
+        {
+            const auto handle = n->xPathString("/handle", "");
+            const auto script = n->xPathString("/script", "");
+
+            if (!handle.length() || !script.length())
+                continue;
+
+            query::ParamVars params;
+
+            if (const auto paramNodes = n->xPath("/params"); paramNodes)
+            {
+                for (auto param : paramNodes->getNodes())
+                {
+                    switch (param->type())
+                    {
+                    case cjson::Types_e::INT:
+                        params[param->name()] = param->getInt();
+                        break;
+                    case cjson::Types_e::DBL:
+                        params[param->name()] = param->getDouble();
+                        break;
+                    case cjson::Types_e::BOOL:
+                        params[param->name()] = param->getBool();
+                        break;
+                    default:
+                        params[param->name()] = param->getString();
+                        break;
+                    }
+                }
+            }
+
+            prepared[handle] = PreparedQuery_s { handle, script, params };
+        }
+    }
 }
 
 void Table::deserializeSettings(const cjson* doc)
@@ -357,15 +481,6 @@ void Table::deserializeSettings(const cjson* doc)
             segmentInterval = 60'000;
     }
 
-    if (const auto node = doc->find("index_compression"); node)
-    {
-        indexCompression = node->getInt();
-        if (indexCompression < 1)
-            indexCompression = 1;
-        else if (indexCompression > 20)
-            indexCompression = 20;
-    }
-
     if (const auto node = doc->find("person_compression"); node)
     {
         personCompression = node->getInt();
@@ -375,6 +490,28 @@ void Table::deserializeSettings(const cjson* doc)
             personCompression = 20;
     }
 
+    if (const auto node = doc->find("cold_after"); node)
+    {
+        coldAfter = node->getInt();
+        if (coldAfter < 0)
+            coldAfter = 0;
+        else if (coldAfter && coldAfter < 60'000)
+            coldAfter = 60'000;
+    }
+
+    if (const auto node = doc->find("memory_budget"); node)
+    {
+        memoryBudget = node->getInt();
+        if (memoryBudget < 0)
+            memoryBudget = 0;
+    }
+
+    if (const auto node = doc->find("tail_fold"); node)
+    {
+        tailFold = node->getInt();
+        if (tailFold < 0)
+            tailFold = 0;
+    }
 }
 
 void Table::clearZombies()
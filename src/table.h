@@ -2,6 +2,7 @@
 
 #include "common.h"
 #include "customers.h"
+#include "dictionary.h"
 #include "database.h"
 #include "threads/locks.h"
 #include "properties.h"
@@ -9,6 +10,7 @@
 #include "querycommon.h"
 #include "var/var.h"
 #include "property_mapping.h"
+#include "plancache.h"
 
 using namespace std;
 
@@ -71,6 +73,24 @@ namespace openset
             }
         };
 
+        struct PreparedQuery_s
+        {
+            string handle;
+            string script;
+            query::ParamVars params; // parameter slots and their default values
+
+            PreparedQuery_s(
+                    const std::string& handle,
+                    const std::string& script,
+                    const query::ParamVars& params) :
+                handle(handle),
+                script(script),
+                params(params)
+            {}
+
+            PreparedQuery_s() = default;
+        };
+
         class Table
         {
             // partition specific object container
@@ -88,6 +108,10 @@ namespace openset
             // list of segments that auto update and the code to update them
             std::unordered_map<std::string, SegmentRefresh_s> segmentRefresh;
 
+            // prepared queries by handle, see RpcQuery::prepare
+            CriticalSection preparedCS;
+            std::unordered_map<std::string, PreparedQuery_s> prepared;
+
             // global variables
             CriticalSection globalVarCS;
             cvar globalVars;
@@ -125,11 +149,22 @@ namespace openset
             int64_t sessionTime{ 60'000LL * 30LL }; // 30 minutes
             int64_t maintInterval{ 86'400'000LL }; // trim, index, clean, etc (daily)
             int64_t segmentInterval{ 1'000 }; // update segments every second
-            int indexCompression{ 5 }; // 1-20 - 1 is slower, but smaller, 20 is faster and bigger
             int personCompression{ 5 }; // 1-20 - 1 is slower, but smaller, 20 is faster and bigger
+            int64_t coldAfter{ 0 }; // page out customers untouched this long (0 = never)
+            int64_t memoryBudget{ 0 }; // bytes of customer records kept in memory per node (0 = unlimited)
+            int64_t tailFold{ 4096 }; // appended event bytes a customer holds before they are re-encoded (0 = never append)
 
             int64_t tableHash;
 
+            // trained LZ4 dictionary for customer columns
+            DictionaryTrainer customerDictionary;
+
+            // hash of the last table.json written, see Checkpoint::saveTable
+            int64_t checkpointHash{ 0 };
+
+            // compiled scripts, see RpcQuery
+            query::PlanCache planCache;
+
             explicit Table(const string &name, const bool numericIds, openset::db::Database* database);
             ~Table();
 
@@ -141,6 +176,9 @@ namespace openset
             TablePartitioned* getPartitionObjects(const int32_t partition, const bool create);
             void releasePartitionObjects(const int32_t partition);
 
+            // partitions of this table held on this node
+            int64_t getPartitionCount();
+
             int64_t getSessionTime() const
             {
                 return sessionTime;
@@ -257,6 +295,13 @@ namespace openset
                 segmentTTL.emplace(segmentName, SegmentTtl_s{ segmentName, TTL });
             }
 
+            // stores a prepared query, returns its handle (the same script and
+            // parameters make the same handle on every node)
+            std::string setPreparedQuery(const std::string& script, const query::ParamVars& params);
+            bool getPreparedQuery(const std::string& handle, PreparedQuery_s& preparedQuery);
+            // false if there is no prepared query with this handle
+            bool dropPreparedQuery(const std::string& handle);
+
             void serializeTable(cjson* doc);
             void serializeTriggers(cjson* doc);
             void serializeSettings(cjson* doc) const;
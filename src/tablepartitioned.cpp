@@ -3,6 +3,10 @@
 #include "oloop_insert.h"
 #include "oloop_seg_refresh.h"
 #include "oloop_cleaner.h"
+#include "oloop_checkpoint.h"
+#include "oloop_coldstore.h"
+#include "oloop_fold.h"
+#include "checkpoint.h"
 #include "sidelog.h"
 #include "queryinterpreter.h"
 
@@ -24,8 +28,7 @@ openset::db::IndexBits* openset::db::SegmentPartitioned_s::prepare(Attributes& a
 
     changeCount = 0;
     const auto attr = attributes.getMake(PROP_SEGMENT, segmentName);
-    bits = new IndexBits();
-    bits->mount(attr->index, attr->ints, attr->ofs, attr->len, attr->linId);
+    bits = attributes.getBits(attr);
 
     return bits;
 }
@@ -88,6 +91,25 @@ TablePartitioned::TablePartitioned(
     // gets to work.
     SideLog::getSideLog().resetReadHead(table, partition);
 
+    people.cold.open(table->getName());
+
+    if (Checkpoint::isEnabled())
+    {
+        // map the last snapshot of this partition (if any), the write ahead
+        // log is held from the snapshot's segment until our next checkpoint
+        int64_t walOffset;
+        const auto segment = Checkpoint::loadPartition(this, walOffset);
+        SideLog::getSideLog().setCheckpointSegment(table, partition, segment == -1 ? 0 : segment);
+
+        // replayed entries the snapshot already holds are not inserted again
+        if (segment != -1)
+            SideLog::getSideLog().resumeReadHead(table, partition, segment, walOffset);
+
+        // from here on record what changes, so checkpoints can write just that
+        people.trackChanges = true;
+        attributes.trackChanges = true;
+    }
+
     const auto sharedTablePtr = table->getSharedPtr();
 
     async::OpenLoop* insertCell = new async::OpenLoopInsert(sharedTablePtr);
@@ -102,6 +124,21 @@ TablePartitioned::TablePartitioned(
     cleanerCell->scheduleFuture(table->maintInterval);
     asyncLoop->queueCell(cleanerCell);
 
+    async::OpenLoop* coldStoreCell = new async::OpenLoopColdStore(sharedTablePtr);
+    coldStoreCell->scheduleFuture(60'000);
+    asyncLoop->queueCell(coldStoreCell);
+
+    async::OpenLoop* foldCell = new async::OpenLoopFold(sharedTablePtr);
+    foldCell->scheduleFuture(10'000);
+    asyncLoop->queueCell(foldCell);
+
+    if (Checkpoint::isEnabled())
+    {
+        async::OpenLoop* checkpointCell = new async::OpenLoopCheckpoint(sharedTablePtr);
+        checkpointCell->scheduleFuture(globals::running->checkpointInterval);
+        asyncLoop->queueCell(checkpointCell);
+    }
+
 }
 
 TablePartitioned::~TablePartitioned()
@@ -223,7 +260,7 @@ std::function<openset::db::IndexBits*(const string&, bool&)> TablePartitioned::g
             return nullptr;
 
         deleteAfterUsing = true;
-        return attr->getBits();
+        return this->attributes.getBits(attr);
     };
 
 }
@@ -234,6 +271,12 @@ void TablePartitioned::storeAllChangedSegments()
         seg.second.commit(attributes);
 }
 
+void TablePartitioned::checkBuckets()
+{
+    // loaded data either has the week buckets or predates them
+    bucketsComplete = people.customerMap.empty() || !attributes.getSortedValues(PROP_WEEK).empty();
+}
+
 openset::db::IndexBits* TablePartitioned::getBits(std::string& segmentName)
 {
     if (this->segments.count(segmentName))
@@ -8,6 +8,7 @@
 #include "attributes.h"
 #include "message_broker.h"
 #include "config.h"
+#include "checkpoint.h"
 
 namespace openset
 {
@@ -90,6 +91,9 @@ namespace openset
         public:
             Table* table;
             int partition;
+            // checkpoint mappings, customers and indexes may point into them
+            // so this is declared before (and destroyed after) them
+            std::shared_ptr<CheckpointState_s> checkpoint { std::make_shared<CheckpointState_s>() };
             Attributes attributes;
             AttributeBlob* attributeBlob;
             Customers people;
@@ -114,6 +118,11 @@ namespace openset
 
             int64_t markedForDeleteStamp{ 0 };
 
+            // false while some customers have events not in the PROP_DAY/PROP_WEEK
+            // indexes (data from before they were kept), the cleaner adds them
+            // and sets this. Indexing ignores time windows until then.
+            bool bucketsComplete { true };
+
             // when an open-loop is using segments it will increment this value
             // when it is done it will decrement this value.
             //
@@ -194,6 +203,9 @@ namespace openset
 
             void storeAllChangedSegments();
 
+            // sets bucketsComplete after customers and indexes are loaded
+            void checkBuckets();
+
             openset::db::IndexBits* getBits(std::string& segmentName);
 
             void pushMessage(const int64_t segmentHash, const SegmentPartitioned_s::SegmentChange_e state, std::string uuid);
@@ -0,0 +1,343 @@
+#include "writeaheadlog.h"
+#include "file/file.h"
+#include "file/directory.h"
+#include "sba/sba.h"
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace openset::db;
+
+namespace
+{
+    // File::FileSetSize only grows files, this cuts one short
+    bool truncateFile(const std::string& fileName, const int64_t bytes)
+    {
+#ifdef _MSC_VER
+        const auto handle = _open(fileName.c_str(), _O_RDWR | _O_BINARY);
+
+        if (handle == -1)
+            return false;
+
+        const auto result = _chsize_s(handle, bytes) == 0;
+        _close(handle);
+        return result;
+#else
+        return truncate(fileName.c_str(), bytes) == 0;
+#endif
+    }
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    close();
+}
+
+std::string WriteAheadLog::segmentName(const int64_t segment) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "wal_%012lld.log", static_cast<long long>(segment));
+    return path + name;
+}
+
+void WriteAheadLog::open(const std::string& dataPath, const int64_t syncMillis, const int64_t maxSegmentBytes)
+{
+    path = dataPath + "wal/";
+    syncInterval = syncMillis;
+    segmentBytes = maxSegmentBytes;
+
+    openset::IO::Directory::mkdir(path);
+
+    // find the segments left behind by the last run
+    openset::IO::Directory dir;
+    auto mask = path + "*";
+
+    if (dir.Open(mask))
+    {
+        std::string fileName;
+        auto more = dir.FirstFile(fileName);
+
+        while (more)
+        {
+            long long segment;
+            if (sscanf(fileName.c_str(), "wal_%lld.log", &segment) == 1)
+                closedSegments.emplace_back(segment, openset::IO::File::FileSize(path + fileName));
+            more = dir.NextFile(fileName);
+        }
+    }
+
+    std::sort(
+        closedSegments.begin(),
+        closedSegments.end(),
+        [](const Segment_s& left, const Segment_s& right) -> bool
+        {
+            return left.segment < right.segment;
+        });
+
+    enabled = true;
+
+    // never append to a segment from a previous run, its tail may be torn
+    openSegment(closedSegments.empty() ? 1 : closedSegments.back().segment + 1);
+
+    Logger::get().info(
+        "write ahead log opened at '" + path + "' (" +
+        to_string(closedSegments.size()) + " segments to replay).");
+}
+
+void WriteAheadLog::openSegment(const int64_t segment)
+{
+    active = fopen(segmentName(segment).c_str(), "ab");
+
+    if (!active)
+    {
+        Logger::get().error("write ahead log could not open segment " + segmentName(segment) + ", logging disabled.");
+        enabled = false;
+        return;
+    }
+
+    activeSegment = segment;
+    activeBytes = 0;
+}
+
+void WriteAheadLog::closeActive()
+{
+    if (!active)
+        return;
+
+    fclose(active);
+    active = nullptr;
+
+    closedSegments.emplace_back(activeSegment, activeBytes);
+}
+
+void WriteAheadLog::repairActive()
+{
+    const auto fileName = segmentName(activeSegment);
+
+    // closing drops whatever part of the batch the stream still holds,
+    // then the segment is cut back to the end of the last whole commit
+    fclose(active);
+    active = fopen(fileName.c_str(), "ab");
+
+    if (!active || !truncateFile(fileName, activeBytes))
+    {
+        Logger::get().error(
+            "write ahead log segment " + fileName + " could not be repaired after a failed write, inserts will be refused.");
+        failed = true;
+    }
+}
+
+void WriteAheadLog::syncActive()
+{
+    if (!active)
+        return;
+
+    fflush(active);
+
+#ifdef _MSC_VER
+    _commit(_fileno(active));
+#else
+    fdatasync(fileno(active));
+#endif
+
+    dirty = false;
+    lastSync = Now();
+}
+
+int64_t WriteAheadLog::replay(const ReplayCB& cb)
+{
+    int64_t count = 0;
+
+    for (const auto& seg : closedSegments)
+    {
+        const auto fileName = segmentName(seg.segment);
+        const auto file = fopen(fileName.c_str(), "rb");
+
+        if (!file)
+            continue;
+
+        Record_s header;
+        int64_t good = 0; // end of the last whole record
+        auto torn = false;
+
+        while (good < seg.bytes)
+        {
+            // the header and the text it describes must fit in what is left of the file
+            if (seg.bytes - good < static_cast<int64_t>(sizeof(Record_s)) ||
+                fread(&header, sizeof(Record_s), 1, file) != 1 ||
+                header.length < 0 ||
+                header.length > seg.bytes - good - static_cast<int64_t>(sizeof(Record_s)))
+            {
+                torn = true;
+                break;
+            }
+
+            const auto json = static_cast<char*>(PoolMem::getPool().getPtr(header.length + 1));
+
+            if (fread(json, 1, header.length, file) != static_cast<size_t>(header.length) ||
+                MakeHash(json, header.length) != header.check)
+            {
+                PoolMem::getPool().freePtr(json);
+                torn = true;
+                break;
+            }
+
+            json[header.length] = 0;
+
+            cb(seg.segment, good, header.stamp, header.tableHash, header.partition, json, header.length);
+
+            PoolMem::getPool().freePtr(json);
+            good += static_cast<int64_t>(sizeof(Record_s)) + header.length;
+            ++count;
+        }
+
+        fclose(file);
+
+        // cut the segment back to its last whole record, so the torn tail is not read again
+        if (torn)
+        {
+            Logger::get().error(
+                "write ahead log segment " + fileName + " has a torn record at " + to_string(good) +
+                ", truncating.");
+            if (!truncateFile(fileName, good))
+                Logger::get().error("could not truncate write ahead log segment " + fileName);
+        }
+    }
+
+    return count;
+}
+
+int64_t WriteAheadLog::append(
+    const int64_t stamp,
+    const int64_t tableHash,
+    const int32_t partition,
+    const char* json,
+    const int32_t length,
+    int64_t& offset)
+{
+    offset = 0;
+
+    if (!enabled || failed)
+        return 0;
+
+    // segments are only rolled on a batch boundary, this way the segment
+    // we return is the segment the record is written to
+    if (pending.empty() && activeBytes >= segmentBytes)
+    {
+        if (dirty)
+            syncActive();
+        closeActive();
+        openSegment(activeSegment + 1);
+    }
+
+    offset = activeBytes + static_cast<int64_t>(pending.size());
+
+    Record_s header { stamp, tableHash, partition, length, MakeHash(json, length) };
+
+    const auto headerPtr = recast<const char*>(&header);
+    pending.insert(pending.end(), headerPtr, headerPtr + sizeof(Record_s));
+    pending.insert(pending.end(), json, json + length);
+
+    return activeSegment;
+}
+
+bool WriteAheadLog::commit()
+{
+    if (failed)
+        return false;
+
+    if (!enabled || pending.empty() || !active)
+        return true;
+
+    // a short write (disk full, I/O error) can leave part of the batch on the
+    // end of the segment. The segment is cut back and the batch kept, so the
+    // next commit writes it again at the offsets already handed out for it.
+    if (fwrite(pending.data(), 1, pending.size(), active) != pending.size() || fflush(active) != 0)
+    {
+        Logger::get().error("write ahead log write failed on segment " + segmentName(activeSegment));
+        repairActive();
+        return false;
+    }
+
+    activeBytes += static_cast<int64_t>(pending.size());
+    pending.clear();
+    dirty = true;
+
+    if (syncInterval == 0)
+        syncActive();
+    else
+        sync();
+
+    return true;
+}
+
+void WriteAheadLog::sync(const bool force)
+{
+    if (!enabled || !dirty || !active)
+        return;
+
+    if (force || (syncInterval > 0 && lastSync + syncInterval <= Now()))
+        syncActive();
+    else if (syncInterval < 0)
+        fflush(active);
+}
+
+void WriteAheadLog::syncTimer()
+{
+    // write a batch a failed commit left behind
+    commit();
+
+    // with an interval of 0 commits already synced, with a negative one the OS flushes
+    if (syncInterval > 0)
+        sync(true);
+}
+
+bool WriteAheadLog::rotate()
+{
+    if (!enabled || !active || !commit())
+        return false;
+
+    if (dirty)
+        syncActive();
+    closeActive();
+    openSegment(activeSegment + 1);
+
+    return enabled;
+}
+
+void WriteAheadLog::retire(const int64_t segment)
+{
+    if (!enabled)
+        return;
+
+    auto retired = 0;
+
+    while (!closedSegments.empty() && closedSegments.front().segment < segment)
+    {
+        openset::IO::File::FileDelete(segmentName(closedSegments.front().segment));
+        closedSegments.erase(closedSegments.begin());
+        ++retired;
+    }
+
+    if (retired)
+        Logger::get().debug("write ahead log retired " + to_string(retired) + " segments.");
+}
+
+void WriteAheadLog::close()
+{
+    if (!enabled)
+        return;
+
+    commit();
+    sync(true);
+    closeActive();
+
+    closedSegments.clear();
+    enabled = false;
+}
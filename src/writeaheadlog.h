@@ -0,0 +1,149 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdio>
+
+#include "common.h"
+
+namespace openset::db
+{
+    /*
+     * WriteAheadLog - append-only segment files behind the SideLog
+     *
+     * Every event handed to SideLog::add is appended to the active segment
+     * (`<data path>/wal/wal_<segment>.log`). Appends are buffered and written
+     * as a group when the inserting thread releases the SideLog lock, so a
+     * whole insert batch costs one write call.
+     *
+     * fsync is batched by time; `syncInterval` is the longest (in ms) committed
+     * data can sit in the OS cache. An interval of 0 syncs on every commit and
+     * a negative interval leaves flushing to the OS. Commits sync once the
+     * interval has passed, `syncTimer` (run every interval by the maintenance
+     * loop) syncs what is left when no more commits come.
+     *
+     * A commit that cannot be written whole is cut back off the segment and
+     * kept for the next commit. If the segment cannot be cut back the log is
+     * marked failed, and from then on nothing more is accepted.
+     *
+     * Segments are never modified once closed, they are deleted by `retire`
+     * when the SideLog has trimmed every entry they contain.
+     *
+     * On startup `replay` walks the segments in order and hands each record
+     * back to the SideLog. A torn record at the tail of a segment (crash
+     * during write) ends replay of that segment, which is truncated at the
+     * last whole record.
+     */
+    class WriteAheadLog
+    {
+#pragma pack(push,1)
+        struct Record_s
+        {
+            int64_t stamp;
+            int64_t tableHash;
+            int32_t partition;
+            int32_t length; // bytes of json text that follow the header
+            int64_t check;  // hash of the json text
+        };
+#pragma pack(pop)
+
+        struct Segment_s
+        {
+            int64_t segment;
+            int64_t bytes;
+
+            Segment_s(const int64_t segment, const int64_t bytes) :
+                segment(segment),
+                bytes(bytes)
+            {}
+        };
+
+        std::string path;
+        std::vector<Segment_s> closedSegments;
+
+        FILE* active { nullptr };
+        int64_t activeSegment { 0 };
+        int64_t activeBytes { 0 };
+
+        std::vector<char> pending;
+
+        bool enabled { false };
+        bool failed { false }; // a write could not be repaired, appends are refused
+        bool dirty { false };
+        int64_t lastSync { 0 };
+
+        int64_t syncInterval { 50 };
+        int64_t segmentBytes { 64LL * 1024LL * 1024LL };
+
+        std::string segmentName(const int64_t segment) const;
+        void openSegment(const int64_t segment);
+        void closeActive();
+        void repairActive();
+        void syncActive();
+
+    public:
+        using ReplayCB = std::function<void(int64_t segment, int64_t offset, int64_t stamp, int64_t tableHash, int32_t partition, const char* json, int32_t length)>;
+
+        WriteAheadLog() = default;
+        ~WriteAheadLog();
+
+        // opens (or creates) the wal directory under `dataPath` and
+        // starts a fresh active segment after any existing segments
+        void open(const std::string& dataPath, const int64_t syncMillis, const int64_t maxSegmentBytes);
+
+        // reads every closed segment in order, returns the number of records replayed
+        int64_t replay(const ReplayCB& cb);
+
+        // buffers a record, returns the segment the record will live in and
+        // sets `offset` to where the record starts in that segment
+        int64_t append(
+            const int64_t stamp,
+            const int64_t tableHash,
+            const int32_t partition,
+            const char* json,
+            const int32_t length,
+            int64_t& offset);
+
+        // writes any buffered records (group commit), and syncs if due. Returns
+        // false if they could not be written, they stay buffered for the next commit
+        bool commit();
+
+        // sync if there is unsynced data and the interval has passed (or `force`)
+        void sync(const bool force = false);
+
+        // sync any unsynced data, called every `syncInterval` ms
+        void syncTimer();
+
+        // commit and sync the active segment and start the next one, returns
+        // false (and keeps the active segment) if the commit failed
+        bool rotate();
+
+        // delete closed segments with an id lower than `segment`
+        void retire(const int64_t segment);
+
+        // commit, sync and close the active segment, appends are
+        // ignored until the log is opened again
+        void close();
+
+        bool isEnabled() const
+        {
+            return enabled;
+        }
+
+        bool isFailed() const
+        {
+            return failed;
+        }
+
+        int64_t getActiveSegment() const
+        {
+            return activeSegment;
+        }
+
+        int64_t getSegmentCount() const
+        {
+            return static_cast<int64_t>(closedSegments.size()) + (active ? 1 : 0);
+        }
+    };
+}
@@ -0,0 +1,528 @@
+#pragma once
+
+#include "testing.h"
+
+#include "../lib/cjson/cjson.h"
+#include "../lib/file/file.h"
+#include "../lib/file/directory.h"
+#include "../src/config.h"
+#include "../src/database.h"
+#include "../src/table.h"
+#include "../src/tablepartitioned.h"
+#include "../src/customer.h"
+#include "../src/checkpoint.h"
+#include "../src/writeaheadlog.h"
+#include "../src/sidelog.h"
+
+#include <cstdio>
+#include <vector>
+#include <string>
+
+/* Checkpoints are off in testMode (see Checkpoint::isEnabled). These tests turn
+ * them on with Config::testCheckpoints and point the data path at a scratch
+ * directory while they run, they use the Config and AsyncPool made by test_db.
+ */
+inline Tests test_checkpoint()
+{
+    // a scratch data path with checkpoints enabled, the previous path and
+    // setting are restored (and the scratch files removed) on scope exit
+    struct ScratchPath_s
+    {
+        std::string root;
+        std::string path;
+        std::string tableName;
+        bool lastCheckpoints;
+
+        explicit ScratchPath_s(const std::string& tableName) :
+            root(openset::globals::running->path),
+            path(root + tableName + "/"),
+            tableName(tableName),
+            lastCheckpoints(openset::globals::running->testCheckpoints)
+        {
+            clear();
+            openset::IO::Directory::mkdir(path);
+            openset::globals::running->path = path;
+            openset::globals::running->testCheckpoints = true;
+        }
+
+        ~ScratchPath_s()
+        {
+            openset::globals::running->path = root;
+            openset::globals::running->testCheckpoints = lastCheckpoints;
+            clear();
+        }
+
+        // empty and remove the directories the engine writes to (deepest first)
+        void clear() const
+        {
+            for (const auto& dir : {
+                    path + "checkpoint/" + tableName + "/",
+                    path + "checkpoint/",
+                    path + "cold/" + tableName + "/",
+                    path + "cold/",
+                    path + "wal/",
+                    path })
+            {
+                openset::IO::Directory files;
+                auto mask = dir + "*";
+
+                if (files.Open(mask))
+                {
+                    std::string fileName;
+                    auto more = files.FirstFile(fileName);
+
+                    while (more)
+                    {
+                        openset::IO::File::FileDelete(dir + fileName);
+                        more = files.NextFile(fileName);
+                    }
+                }
+
+                remove(dir.substr(0, dir.length() - 1).c_str());
+            }
+        }
+    };
+
+    const auto makeTable = [](const std::string& tableName)
+    {
+        auto table = openset::globals::database->newTable(tableName, false);
+
+        auto columns = table->getProperties();
+        columns->setProperty(2000, "page", PropertyTypes_e::textProp, false);
+        columns->setProperty(4001, "prop_txt", PropertyTypes_e::textProp, false, true);
+
+        return table;
+    };
+
+    const auto makeEvent = [](const std::string& id, const int64_t stamp, const std::string& page)
+    {
+        return "{\"id\":\"" + id + "\",\"stamp\":" + to_string(stamp) + ",\"event\":\"page_view\",\"page\":\"" + page + "\"}";
+    };
+
+    // insert an event (and optionally set a customer prop) as the insert loop would
+    const auto insertEvent = [](TablePartitioned* parts, const std::string& id, const std::string& json, const std::string& prop)
+    {
+        Customer person;
+        person.mapTable(parts->table, parts->partition);
+
+        auto personRaw = parts->people.getCustomerByID(id);
+        if (!personRaw)
+            personRaw = parts->people.createCustomer(id);
+
+        person.mount(personRaw);
+        person.prepare();
+
+        cjson event(json, cjson::Mode_e::string);
+        person.insert(&event);
+
+        if (prop.length())
+        {
+            auto props = person.getGrid()->getProps(true);
+            props["prop_txt"] = prop;
+            person.getGrid()->setProps(props);
+        }
+
+        person.commit();
+    };
+
+    // every customer in a partition as JSON, in linear id order
+    const auto capture = [](TablePartitioned* parts)
+    {
+        std::vector<std::string> result;
+
+        Customer person;
+        person.mapTable(parts->table, parts->partition);
+
+        for (auto linId = 0; linId < parts->people.customerCount(); ++linId)
+        {
+            const auto personRaw = parts->people.getCustomerByLIN(linId);
+
+            if (!personRaw)
+            {
+                result.emplace_back("none");
+                continue;
+            }
+
+            person.mount(personRaw);
+            person.prepare();
+
+            auto json = person.getGrid()->toJSON();
+            result.push_back(cjson::stringify(&json));
+        }
+
+        return result;
+    };
+
+    const auto population = [](TablePartitioned* parts, const std::string& page)
+    {
+        const auto attr = parts->attributes.get(2000, page);
+        return attr ? attr->getBits()->population(parts->people.customerCount()) : -1;
+    };
+
+    // a second copy of partition zero, built the way a restart builds it
+    const auto reopen = [](Table* table)
+    {
+        return new TablePartitioned(table, 0, table->getAttributeBlob(), table->getProperties());
+    };
+
+    return {
+        {
+            "checkpoint: base and delta round trip",
+            [=]
+            {
+                ScratchPath_s scratch("__testcheckpoint001__");
+                ASSERT(Checkpoint::isEnabled());
+
+                auto table = makeTable(scratch.tableName);
+                auto parts = table->getPartitionObjects(0, true);
+
+                for (auto i = 0; i < 30; ++i)
+                {
+                    const auto id = "user" + to_string(i);
+                    for (auto e = 0; e < 3; ++e)
+                        insertEvent(parts, id, makeEvent(id, 1458820830000LL + e * 1000 + i, "p" + to_string((i + e) % 7)), "");
+                }
+
+                parts->attributes.clearDirty();
+
+                ASSERT(Checkpoint::savePartition(parts, 3, 100));
+                ASSERT(openset::IO::File::FileExists(Checkpoint::getPartitionFile(scratch.tableName, 0)));
+
+                // after a base only what changes goes to the delta
+                parts->people.trackChanges = true;
+                parts->attributes.trackChanges = true;
+
+                insertEvent(parts, "user3", makeEvent("user3", 1558820830000LL, "p3"), "changed");
+                insertEvent(parts, "user30", makeEvent("user30", 1558820830000LL, "p3"), "new");
+                parts->people.drop(MakeHash("user6"));
+                parts->attributes.clearDirty();
+
+                const auto generation = parts->checkpoint->generation;
+
+                ASSERT(Checkpoint::saveDelta(parts, 4, 200));
+                ASSERT(openset::IO::File::FileExists(Checkpoint::getDeltaFile(scratch.tableName, 0, generation)));
+
+                const auto expected = capture(parts);
+                const auto expectedPop = population(parts, "p3");
+
+                {
+                    const auto restored = reopen(table.get());
+
+                    ASSERT(restored->people.customerCount() == parts->people.customerCount());
+                    ASSERT(restored->people.getCustomerByID("user6") == nullptr);
+                    ASSERT(restored->people.getCustomerByID("user30") != nullptr);
+                    ASSERT(capture(restored) == expected);
+                    ASSERT(population(restored, "p3") == expectedPop);
+
+                    // the newest batch decides where the write ahead log resumes
+                    ASSERT(restored->checkpoint->segment == 4);
+                    ASSERT(restored->checkpoint->walOffset == 200);
+
+                    delete restored;
+                }
+
+                // compacting the base and deltas into a new base changes nothing
+                insertEvent(parts, "user12", makeEvent("user12", 1558820831000LL, "p3"), "compact");
+                parts->attributes.clearDirty();
+
+                parts->checkpoint->deltaBytes = 1LL << 40;
+                ASSERT(Checkpoint::save(parts, 5, 300));
+
+                for (auto wait = 0; parts->checkpoint->compacting && wait < 1000; ++wait)
+                    ThreadSleep(10);
+                ASSERT(!parts->checkpoint->compacting);
+
+                const auto compacted = capture(parts);
+
+                {
+                    const auto restored = reopen(table.get());
+
+                    ASSERT(capture(restored) == compacted);
+                    ASSERT(population(restored, "p3") == population(parts, "p3"));
+                    ASSERT(restored->checkpoint->walOffset == 300);
+
+                    delete restored;
+                }
+
+                // table.json went out with the partition checkpoint, it is
+                // written again only once the table changes
+                const auto tableFile = Checkpoint::getTablePath(scratch.tableName) + "table.json";
+                ASSERT(openset::IO::File::FileExists(tableFile));
+
+                openset::IO::File::FileDelete(tableFile);
+                Checkpoint::saveTable(table.get());
+                ASSERT(!openset::IO::File::FileExists(tableFile));
+
+                table->getProperties()->setProperty(2001, "referral", PropertyTypes_e::textProp, false);
+                Checkpoint::saveTable(table.get());
+                ASSERT(openset::IO::File::FileExists(tableFile));
+
+                Checkpoint::dropTable(scratch.tableName);
+            }
+        },
+        {
+            "checkpoint: write ahead log drops a torn tail",
+            [=]
+            {
+                ScratchPath_s scratch("__testcheckpoint002__");
+
+                std::vector<std::string> events;
+                std::vector<int64_t> offsets;
+                int64_t segment = 0;
+
+                {
+                    WriteAheadLog wal;
+                    wal.open(scratch.path, 0, 1LL << 20);
+
+                    for (auto i = 0; i < 3; ++i)
+                    {
+                        events.push_back(makeEvent("user" + to_string(i), 1458820830000LL + i, "p" + to_string(i)));
+
+                        int64_t offset;
+                        segment = wal.append(
+                            1000 + i, 77, 0, events.back().c_str(), static_cast<int32_t>(events.back().length()), offset);
+                        offsets.push_back(offset);
+                    }
+
+                    wal.commit();
+                }
+
+                char segmentName[32];
+                snprintf(segmentName, sizeof(segmentName), "wal_%012lld.log", static_cast<long long>(segment));
+                const auto fileName = scratch.path + "wal/" + segmentName;
+
+                const auto goodBytes = openset::IO::File::FileSize(fileName);
+                ASSERT(goodBytes > 0);
+
+                // a crash part way through a write leaves a record header
+                // and some of its text on the end of the segment
+                {
+                    std::vector<char> head(40);
+
+                    const auto file = fopen(fileName.c_str(), "r+b");
+                    ASSERT(file != nullptr);
+                    ASSERT(fread(head.data(), 1, head.size(), file) == head.size());
+                    fseek(file, 0, SEEK_END);
+                    fwrite(head.data(), 1, head.size(), file);
+                    fclose(file);
+                }
+
+                ASSERT(openset::IO::File::FileSize(fileName) == goodBytes + 40);
+
+                std::vector<std::string> replayed;
+                std::vector<int64_t> replayedOffsets;
+
+                {
+                    WriteAheadLog wal;
+                    wal.open(scratch.path, 0, 1LL << 20);
+
+                    const auto count = wal.replay(
+                        [&](const int64_t replaySegment, const int64_t offset, const int64_t stamp, const int64_t tableHash, const int32_t partition, const char* json, const int32_t length)
+                        {
+                            if (replaySegment == segment && tableHash == 77 && partition == 0)
+                            {
+                                replayed.emplace_back(json, length);
+                                replayedOffsets.push_back(offset);
+                            }
+                        });
+
+                    ASSERT(count == 3);
+                }
+
+                ASSERT(replayed == events);
+                ASSERT(replayedOffsets == offsets);
+
+                // the torn record is cut off so it is not read again
+                ASSERT(openset::IO::File::FileSize(fileName) == goodBytes);
+            }
+        },
+        {
+            "checkpoint: replay resumes past the checkpoint's walOffset",
+            [=]
+            {
+                ScratchPath_s scratch("__testcheckpoint003__");
+
+                auto table = makeTable(scratch.tableName);
+                auto parts = table->getPartitionObjects(0, true);
+
+                // six inserts reach the log before a crash
+                std::vector<std::string> events;
+                std::vector<int64_t> offsets;
+                int64_t segment = 0;
+
+                {
+                    WriteAheadLog wal;
+                    wal.open(scratch.path, 0, 1LL << 20);
+
+                    for (auto i = 0; i < 6; ++i)
+                    {
+                        events.push_back(makeEvent("user" + to_string(i), 1458820830000LL + i, "p" + to_string(i)));
+
+                        int64_t offset;
+                        segment = wal.append(
+                            Now(),
+                            table->getTableHash(),
+                            0,
+                            events.back().c_str(),
+                            static_cast<int32_t>(events.back().length()),
+                            offset);
+                        offsets.push_back(offset);
+                    }
+
+                    wal.commit();
+                }
+
+                // the first four made it into the partition and its checkpoint
+                for (auto i = 0; i < 4; ++i)
+                    insertEvent(parts, "user" + to_string(i), events[i], "");
+
+                parts->attributes.clearDirty();
+
+                ASSERT(Checkpoint::savePartition(parts, segment, offsets[3]));
+
+                auto& sideLog = SideLog::getSideLog();
+                sideLog.openWriteAheadLog(scratch.path, 0, 1LL << 20);
+
+                const auto restored = reopen(table.get());
+
+                // only the inserts the checkpoint does not hold are read again
+                int64_t readPosition;
+                const auto pending = sideLog.read(table.get(), 0, 100, readPosition);
+
+                std::vector<std::string> pendingEvents;
+                for (const auto json : pending)
+                    pendingEvents.emplace_back(json);
+
+                sideLog.resetReadHead(table.get(), 0);
+                sideLog.closeWriteAheadLog();
+
+                ASSERT(restored->checkpoint->segment == segment);
+                ASSERT(restored->checkpoint->walOffset == offsets[3]);
+                ASSERT(restored->people.getCustomerByID("user3") != nullptr);
+                ASSERT(restored->people.getCustomerByID("user4") == nullptr);
+
+                ASSERT(pendingEvents.size() == 2);
+                ASSERT(pendingEvents[0] == events[4]);
+                ASSERT(pendingEvents[1] == events[5]);
+
+                delete restored;
+
+                Checkpoint::dropTable(scratch.tableName);
+            }
+        },
+        {
+            "checkpoint: a transferred log replays each event once",
+            [=]
+            {
+                ScratchPath_s scratch("__testcheckpoint005__");
+
+                auto table = makeTable(scratch.tableName);
+                const auto tableHash = table->getTableHash();
+
+                auto& sideLog = SideLog::getSideLog();
+                sideLog.openWriteAheadLog(scratch.path, 0, 1LL << 20);
+
+                // three inserts on this node, then two arrive in a transferred log
+                std::vector<std::string> events;
+                for (auto i = 0; i < 5; ++i)
+                    events.push_back(makeEvent("user" + to_string(i), 1458820830000LL + i, "p" + to_string(i)));
+
+                sideLog.lock();
+
+                for (auto i = 0; i < 3; ++i)
+                {
+                    const auto json = static_cast<char*>(PoolMem::getPool().getPtr(events[i].length() + 1));
+                    strcpy(json, events[i].c_str());
+                    sideLog.add(table.get(), 0, json);
+                }
+
+                ASSERT(sideLog.unlock());
+
+                {
+                    HeapStack mem;
+                    *recast<int64_t*>(mem.newPtr(sizeof(int64_t))) = 2;
+
+                    for (auto i = 3; i < 5; ++i)
+                        SideLogCursor_s(tableHash, 0, &events[i][0], 0, 0).serialize(&mem);
+
+                    const auto block = mem.flatten();
+                    sideLog.deserialize(block);
+                    PoolMem::getPool().freePtr(block);
+                }
+
+                sideLog.closeWriteAheadLog();
+
+                // the segment holding the first copies of the local inserts is gone
+                ASSERT(!openset::IO::File::FileExists(scratch.path + "wal/wal_000000000001.log"));
+
+                std::vector<std::string> replayed;
+
+                {
+                    WriteAheadLog wal;
+                    wal.open(scratch.path, 0, 1LL << 20);
+
+                    wal.replay(
+                        [&](const int64_t, const int64_t, const int64_t, const int64_t replayHash, const int32_t, const char* json, const int32_t length)
+                        {
+                            if (replayHash == tableHash)
+                                replayed.emplace_back(json, length);
+                        });
+                }
+
+                // transferred entries lead, the ones already here follow, each once
+                ASSERT(replayed.size() == 5);
+                ASSERT(replayed[0] == events[3]);
+                ASSERT(replayed[1] == events[4]);
+                ASSERT(replayed[2] == events[0]);
+                ASSERT(replayed[3] == events[1]);
+                ASSERT(replayed[4] == events[2]);
+            }
+        },
+        {
+            "checkpoint: cold customers read back unchanged",
+            [=]
+            {
+                ScratchPath_s scratch("__testcheckpoint004__");
+
+                auto table = makeTable(scratch.tableName);
+                auto parts = table->getPartitionObjects(0, true);
+
+                for (auto i = 0; i < 40; ++i)
+                {
+                    const auto id = "user" + to_string(i);
+                    for (auto e = 0; e < 4; ++e)
+                        insertEvent(parts, id, makeEvent(id, 1458820830000LL + e * 1000 + i, "p" + to_string((i + e) % 5)), i % 3 ? "" : "prop" + to_string(i));
+                }
+
+                parts->attributes.clearDirty();
+
+                const auto expected = capture(parts);
+
+                // page out every other customer, keeping a copy of the stored bytes
+                std::vector<int32_t> linIds;
+                std::vector<std::string> stored;
+
+                for (auto linId = 0; linId < parts->people.customerCount(); linId += 2)
+                {
+                    const auto personRaw = parts->people.getCustomerByLIN(linId);
+                    linIds.push_back(linId);
+                    stored.emplace_back(recast<const char*>(personRaw), personRaw->size());
+                }
+
+                ASSERT(parts->people.evict(linIds) == static_cast<int64_t>(linIds.size()));
+                ASSERT(parts->people.cold.getColdCount() == static_cast<int64_t>(linIds.size()));
+                ASSERT(parts->people.cold.getChunkCount() > 0);
+
+                for (size_t i = 0; i < linIds.size(); ++i)
+                {
+                    const auto personRaw = parts->people.getCustomerByLIN(linIds[i]);
+                    ASSERT(personRaw != nullptr);
+                    ASSERT(personRaw->size() == static_cast<int64_t>(stored[i].length()));
+                    ASSERT(memcmp(personRaw, stored[i].data(), stored[i].length()) == 0);
+                }
+
+                ASSERT(capture(parts) == expected);
+            }
+        },
+    };
+}
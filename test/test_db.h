@@ -15,6 +15,12 @@
 
 #include <unordered_set>
 #include "../src/queryindexing.h"
+#include "../src/decodecache.h"
+#include "../src/bitkernels.h"
+#include "../src/slicedindex.h"
+#include "../src/indexcache.h"
+#include "../src/plancache.h"
+#include "lz4.h"
 
 // Our tests
 inline Tests test_db()
@@ -214,13 +220,910 @@ inline Tests test_db()
 
                 const auto attr = parts->attributes.get(4000, "huge");
                 ASSERT(attr != nullptr);
-                const auto bits = attr->getBits();
+                const auto bits = parts->attributes.getBits(attr);
                 ASSERT(bits != nullptr);
                 const auto pop = bits->population(parts->people.customerCount());
                 ASSERT(pop == 1);
 
             }
         },
+        {
+            "db: read customer stored in row format",
+            [=]()
+            {
+                // customers written before the columnar format are rows of
+                // {int16 property, int64 value} ending with a -1 marker
+                auto table = openset::globals::database->newTable("__testrows__", false);
+                table->getProperties()->setProperty(2000, "page", PropertyTypes_e::textProp, false);
+                auto parts = table->getPartitionObjects(0, true);
+
+                std::vector<char> rowBlob;
+                const auto pushCast = [&](const int16_t property, const int64_t value)
+                {
+                    rowBlob.insert(rowBlob.end(), recast<const char*>(&property), recast<const char*>(&property) + sizeof(int16_t));
+                    rowBlob.insert(rowBlob.end(), recast<const char*>(&value), recast<const char*>(&value) + sizeof(int64_t));
+                };
+                const auto pushEnd = [&]()
+                {
+                    const int16_t marker = -1;
+                    rowBlob.insert(rowBlob.end(), recast<const char*>(&marker), recast<const char*>(&marker) + sizeof(int16_t));
+                };
+
+                pushCast(PROP_STAMP, 1458820830000);
+                pushCast(PROP_EVENT, 77);
+                pushEnd();
+                pushCast(PROP_STAMP, 1458820840000);
+                pushCast(PROP_EVENT, 77);
+                pushEnd();
+
+                const auto blank = parts->people.createCustomer("rows@test.com");
+                const auto maxBytes = LZ4_compressBound(static_cast<int>(rowBlob.size()));
+                std::vector<char> compressed(maxBytes);
+                const auto comp = LZ4_compress_default(rowBlob.data(), compressed.data(), static_cast<int>(rowBlob.size()), maxBytes);
+
+                const auto personRaw = recast<PersonData_s*>(PoolMem::getPool().getPtr(PERSON_DATA_SIZE + blank->idBytes + comp));
+                memcpy(personRaw, blank, PERSON_DATA_SIZE + blank->idBytes);
+                personRaw->bytes = static_cast<int32_t>(rowBlob.size());
+                personRaw->comp = comp;
+                memcpy(personRaw->getComp(), compressed.data(), comp);
+                parts->people.replaceCustomerRecord(personRaw);
+
+                Customer person;
+                person.mapTable(table.get(), 0);
+                person.mount(personRaw);
+                person.prepare();
+
+                auto grid = person.getGrid();
+                auto rows = grid->getRows();
+                ASSERT(rows->size() == 2);
+                ASSERT(rows->at(0)->cols[grid->getGridProperty(PROP_STAMP)] == 1458820830000);
+                ASSERT(rows->at(1)->cols[grid->getGridProperty(PROP_EVENT)] == 77);
+
+                // an insert re-encodes the customer as columns
+                cjson insertJSON(R"({"id": "rows@test.com", "stamp": 1458820850, "event": "purchase", "page": "cart"})", cjson::Mode_e::string);
+                person.insert(&insertJSON);
+                const auto columnRaw = person.commit();
+                ASSERT(columnRaw->bytes != static_cast<int32_t>(rowBlob.size()));
+
+                person.mount(columnRaw);
+                person.prepare();
+
+                rows = grid->getRows();
+                ASSERT(rows->size() == 3);
+                ASSERT(rows->at(0)->cols[grid->getGridProperty(PROP_STAMP)] == 1458820830000);
+                ASSERT(rows->at(1)->cols[grid->getGridProperty(PROP_STAMP)] == 1458820840000);
+                ASSERT(rows->at(1)->cols[grid->getGridProperty(PROP_EVENT)] == 77);
+                ASSERT(rows->at(2)->cols[grid->getGridProperty(PROP_STAMP)] == 1458820850000);
+
+                // a grid mapped to a few properties only decodes those columns
+                std::vector<std::string> columnNames { "stamp", "event" };
+                Customer narrow;
+                narrow.mapTable(table.get(), 0, columnNames);
+                narrow.mount(columnRaw);
+                narrow.prepare();
+
+                const auto narrowGrid = narrow.getGrid();
+                rows = narrowGrid->getRows();
+                ASSERT(rows->size() == 3);
+                ASSERT(narrowGrid->getGridProperty(2000) == -1);
+                ASSERT(rows->at(1)->cols[narrowGrid->getGridProperty(PROP_EVENT)] == 77);
+                ASSERT(rows->at(2)->cols[narrowGrid->getGridProperty(PROP_STAMP)] == 1458820850000);
+            }
+        },
+        {
+            "db: append events to customer tail",
+            [=]()
+            {
+                auto table = openset::globals::database->getTable("__testrows__");
+                auto parts = table->getPartitionObjects(0, true);
+
+                Customer person;
+                person.mapTable(table.get(), 0);
+                person.mount(parts->people.getCustomerByID("rows@test.com"));
+
+                ASSERT(person.getGrid()->getTailBytes() == 0);
+
+                // newer than the last event, these go on the tail
+                cjson newer(R"([
+                    {"id": "rows@test.com", "stamp": 1458820860, "event": "purchase", "page": "cart"},
+                    {"id": "rows@test.com", "stamp": 1458820870, "event": "purchase", "page": "thanks"}
+                ])", cjson::Mode_e::string);
+
+                std::vector<cjson> events;
+                for (auto node : newer.getNodes())
+                    events.emplace_back(cjson::stringify(node), cjson::Mode_e::string);
+
+                ASSERT(person.append(events));
+                ASSERT(person.getGrid()->getTailBytes() > 0);
+
+                person.mount(parts->people.getCustomerByID("rows@test.com"));
+                person.prepare();
+
+                auto grid = person.getGrid();
+                ASSERT(grid->getRows()->size() == 5);
+                ASSERT(grid->getRows()->at(4)->cols[grid->getGridProperty(PROP_STAMP)] == 1458820870000);
+
+                // older than the last event, the customer has to be re-encoded
+                std::vector<cjson> older;
+                older.emplace_back(R"({"id": "rows@test.com", "stamp": 1458820835, "event": "purchase", "page": "cart"})", cjson::Mode_e::string);
+
+                person.mount(parts->people.getCustomerByID("rows@test.com"));
+                ASSERT(!person.append(older));
+
+                // folding writes the tail back into the columns
+                person.prepare();
+                person.fold();
+
+                ASSERT(grid->getTailBytes() == 0);
+
+                person.mount(parts->people.getCustomerByID("rows@test.com"));
+                person.prepare();
+
+                ASSERT(grid->getRows()->size() == 5);
+                ASSERT(grid->getRows()->at(3)->cols[grid->getGridProperty(PROP_STAMP)] == 1458820860000);
+                ASSERT(grid->getRows()->at(4)->cols[grid->getGridProperty(PROP_STAMP)] == 1458820870000);
+            }
+        },
+        {
+            "db: compress customer with a trained dictionary",
+            [=]()
+            {
+                auto table = openset::globals::database->getTable("__testrows__");
+                auto parts = table->getPartitionObjects(0, true);
+
+                // offer enough samples to train the dictionary
+                const std::string sample = "purchase cart thanks purchase cart thanks";
+
+                for (auto i = 0; i < 4096; ++i)
+                    table->customerDictionary.sample(sample.c_str(), static_cast<int32_t>(sample.length()));
+
+                ASSERT(table->customerDictionary.getActiveId() != 0);
+
+                Customer person;
+                person.mapTable(table.get(), 0);
+                person.mount(parts->people.getCustomerByID("rows@test.com"));
+                person.prepare();
+                person.fold();
+
+                // the directory names the dictionary (and carries a zone map)
+                ASSERT(*person.getGrid()->getMeta()->getComp() == (2 | 4));
+                ASSERT(person.getGrid()->getMeta()->getDictionaryId() == table->customerDictionary.getActiveId());
+
+                person.mount(parts->people.getCustomerByID("rows@test.com"));
+                person.prepare();
+
+                auto grid = person.getGrid();
+                ASSERT(grid->getRows()->size() == 5);
+                ASSERT(grid->getRows()->at(4)->cols[grid->getGridProperty(PROP_STAMP)] == 1458820870000);
+
+                ASSERT(table->customerDictionary.getCompBytes() > 0);
+            }
+        },
+        {
+            "db: dictionaries are dropped with the last record using them",
+            [=]()
+            {
+                const std::string content = "checkout checkout checkout checkout";
+
+                const auto id = Dictionaries::add(content.c_str(), static_cast<int32_t>(content.length()))->id;
+
+                Dictionaries::retain(id);
+                Dictionaries::retain(id);
+
+                // in use, rotating it out keeps it
+                Dictionaries::retire(id);
+                Dictionaries::release(id);
+                ASSERT(Dictionaries::get(id));
+
+                Dictionaries::release(id);
+                ASSERT(!Dictionaries::get(id));
+
+                // never used, rotating it out drops it
+                Dictionaries::add(content.c_str(), static_cast<int32_t>(content.length()));
+                Dictionaries::retire(id);
+                ASSERT(!Dictionaries::get(id));
+            }
+        },
+        {
+            "db: a dictionary whose id collides is refused",
+            [=]()
+            {
+                // ids are 31 bits of the content hash, a few tens of thousands
+                // of contents are enough to find two that share one
+                const auto idOf = [](const std::string& content)
+                {
+                    auto id = static_cast<int32_t>(MakeHash(content.c_str(), content.length()) & 0x7fffffff);
+                    return id ? id : 1;
+                };
+
+                std::unordered_map<int32_t, std::string> seen;
+                std::string first;
+                std::string second;
+
+                for (auto i = 0; first.empty(); ++i)
+                {
+                    auto content = "dictionary " + to_string(i);
+
+                    if (const auto iter = seen.find(idOf(content)); iter != seen.end())
+                    {
+                        first = iter->second;
+                        second = content;
+                    }
+                    else
+                        seen.emplace(idOf(content), std::move(content));
+                }
+
+                const auto dictionary = Dictionaries::add(first.c_str(), static_cast<int32_t>(first.length()));
+                ASSERT(dictionary && dictionary->id == idOf(second));
+
+                ASSERT(!Dictionaries::add(second.c_str(), static_cast<int32_t>(second.length())));
+                ASSERT(Dictionaries::add(first.c_str(), static_cast<int32_t>(first.length())) == dictionary);
+
+                Dictionaries::retire(dictionary->id);
+                ASSERT(!Dictionaries::get(dictionary->id));
+            }
+        },
+        {
+            "db: index bits stored as containers",
+            [=]()
+            {
+                IndexBits bits;
+
+                // sparse chunk (array), a run across the next two chunks, and
+                // a scattered chunk (bitmap)
+                for (auto i = 0; i < 60000; i += 1000)
+                    bits.bitSet(i);
+                for (auto i = 100000; i < 150000; ++i)
+                    bits.bitSet(i);
+                for (auto i = 200000; i < 262144; i += 3)
+                    bits.bitSet(i);
+
+                int64_t compBytes, linId;
+                int32_t offset, length;
+
+                const auto compData = bits.store(compBytes, linId, offset, length);
+
+                ASSERT(offset == -1 && length == 4);
+                ASSERT(compBytes < bits.getSizeBytes() / 2);
+
+                IndexBits mounted;
+                mounted.mount(compData, bits.ints, offset, length, static_cast<int32_t>(compBytes), -1);
+
+                // ORed straight from the containers into bits that are already set
+                IndexBits ored;
+                ored.bitSet(5);
+                ored.bitSet(200001); // in the bitmap chunk, kept by the OR
+                ored.opOrStored(compData, bits.ints, offset, length, static_cast<int32_t>(compBytes), -1);
+                PoolMem::getPool().freePtr(compData);
+
+                ASSERT(mounted.ints == bits.ints);
+                ASSERT(mounted.population(mounted.ints * 64) == bits.population(bits.ints * 64));
+
+                ASSERT(ored.ints == bits.ints);
+                ASSERT(ored.population(ored.ints * 64) == bits.population(bits.ints * 64) + 2);
+                ASSERT(ored.bitState(5) && ored.bitState(200001));
+
+                for (auto i = 0; i < bits.ints; ++i)
+                {
+                    ASSERT(mounted.bits[i] == bits.bits[i]);
+                    ASSERT(ored.bits[i] == (bits.bits[i] | (i ? 0 : 1ULL << 5) | (i == 200001 / 64 ? 1ULL << (200001 & 63) : 0)));
+                }
+            }
+        },
+        {
+            "db: bit kernels agree at every level",
+            [=]()
+            {
+                using Level_e = openset::db::BitKernels::Level_e;
+
+                IndexBits left, right;
+
+                // odd lengths leave words for the scalar tails
+                for (auto i = 0; i < 4000; i += 7)
+                    left.bitSet(i);
+                for (auto i = 0; i < 5301; i += 3)
+                    right.bitSet(i);
+
+                const auto stopBit = 5301;
+                const auto supported = openset::db::BitKernels::getSupported();
+
+                std::vector<std::vector<uint64_t>> results;
+                std::vector<int64_t> populations;
+
+                for (auto level = 0; level <= static_cast<int>(supported); ++level)
+                {
+                    openset::db::BitKernels::setLevel(static_cast<Level_e>(level));
+
+                    IndexBits work;
+                    work.opCopyAnd(left, right);
+                    results.emplace_back(work.bits, work.bits + work.ints);
+                    populations.push_back(work.population(stopBit));
+
+                    work.opCopyAndNot(left, right);
+                    results.emplace_back(work.bits, work.bits + work.ints);
+
+                    work.opCopy(left);
+                    work.opOr(right);
+                    work.opNot();
+                    results.emplace_back(work.bits, work.bits + work.ints);
+                    populations.push_back(work.population(stopBit));
+
+                    populations.push_back(left.andPopulation(right, stopBit));
+                }
+
+                openset::db::BitKernels::setLevel(supported);
+
+                // every level matches the scalar results
+                for (auto i = 3; i < static_cast<int>(results.size()); ++i)
+                    ASSERT(results[i] == results[i % 3]);
+                for (auto i = 3; i < static_cast<int>(populations.size()); ++i)
+                    ASSERT(populations[i] == populations[i % 3]);
+
+                // multiples of 21 below 4000
+                ASSERT(populations[0] == 191);
+                ASSERT(populations[2] == populations[0]);
+            }
+        },
+        {
+            "db: compare kernels agree at every level",
+            [=]()
+            {
+                using BitKernels = openset::db::BitKernels;
+                using Compare_e = BitKernels::Compare_e;
+
+                // an odd count leaves values for the scalar tails, NONE for missing values
+                const auto count = 901;
+                std::vector<int64_t> values;
+                for (auto i = 0; i < count; ++i)
+                    values.push_back(i % 13 == 0 ? NONE : (i * 7919) % 2000 - 1000);
+
+                const auto words = (count + 63) / 64;
+                const auto supported = BitKernels::getSupported();
+
+                std::vector<std::vector<uint64_t>> results;
+                std::vector<int32_t> selected(count);
+                std::vector<int32_t> selectedCounts;
+
+                for (auto level = 0; level <= static_cast<int>(supported); ++level)
+                {
+                    BitKernels::setLevel(static_cast<BitKernels::Level_e>(level));
+
+                    for (auto op = 0; op <= static_cast<int>(Compare_e::gte); ++op)
+                    {
+                        std::vector<uint64_t> bits(words);
+
+                        BitKernels::compare(bits.data(), values.data(), 17, static_cast<Compare_e>(op), count);
+                        results.push_back(bits);
+                        selectedCounts.push_back(BitKernels::select(bits.data(), count, 0, selected.data()));
+
+                        BitKernels::compareScaled(bits.data(), values.data(), 100.0, -2.5, static_cast<Compare_e>(op), count);
+                        results.push_back(bits);
+                        selectedCounts.push_back(BitKernels::select(bits.data(), count, 0, selected.data()));
+                    }
+                }
+
+                BitKernels::setLevel(supported);
+
+                // every level matches the scalar results
+                for (auto i = 12; i < static_cast<int>(results.size()); ++i)
+                {
+                    ASSERT(results[i] == results[i % 12]);
+                    ASSERT(selectedCounts[i] == selectedCounts[i % 12]);
+                }
+
+                // the scalar results match the values, unused bits are clear
+                for (auto i = 0; i < count; ++i)
+                {
+                    const auto bit = [&](const int result) { return (results[result][i / 64] >> (i % 64)) & 1; };
+                    const auto scaled = values[i] == NONE ? static_cast<double>(NONE) : values[i] / 100.0;
+
+                    ASSERT(bit(0) == (values[i] == 17));
+                    ASSERT(bit(2) == (values[i] != 17));
+                    ASSERT(bit(4) == (values[i] < 17));
+                    ASSERT(bit(9) == (scaled > -2.5));
+                    ASSERT(bit(11) == (scaled >= -2.5));
+                }
+
+                ASSERT((results[2][words - 1] >> (count % 64)) == 0);
+
+                // select writes ascending rows from the offset
+                std::vector<uint64_t> bits(words);
+                BitKernels::compare(bits.data(), values.data(), NONE, Compare_e::eq, count);
+                const auto found = BitKernels::select(bits.data(), count, 1000, selected.data());
+
+                ASSERT(found == (count + 12) / 13);
+                for (auto i = 0; i < found; ++i)
+                    ASSERT(selected[i] == 1000 + i * 13);
+            }
+        },
+        {
+            "db: batched linId iteration matches linearIter",
+            [=]()
+            {
+                IndexBits bits;
+
+                // runs, gaps of whole words and bits either side of the stop bit
+                for (auto i = 0; i < 300; ++i)
+                    bits.bitSet(i);
+                for (auto i = 1000; i < 5000; i += 13)
+                    bits.bitSet(i);
+                bits.bitSet(5063);
+                bits.bitSet(5064);
+
+                const auto stopBit = 5064;
+
+                std::vector<int64_t> expected;
+                int64_t linId = -1;
+
+                while (bits.linearIter(linId, stopBit))
+                    expected.push_back(linId);
+
+                std::vector<int64_t> batched;
+                openset::db::LinearBatch batch;
+
+                while (batch.next(&bits, stopBit, linId))
+                {
+                    // peek sees the following ids in the same batch
+                    if (const auto ahead = batch.peek(1); ahead != -1)
+                        ASSERT(ahead > linId);
+                    batched.push_back(linId);
+                }
+
+                ASSERT(expected.size() == static_cast<size_t>(bits.population(stopBit)));
+                ASSERT(batched == expected);
+                ASSERT(expected.back() == 5063);
+
+                batch.reset();
+                ASSERT(batch.next(&bits, stopBit, linId) && linId == 0);
+            }
+        },
+        {
+            "db: property value ranges from the ordered value index",
+            [=]()
+            {
+                auto table = openset::globals::database->getTable("__testrows__");
+                auto parts = table->getPartitionObjects(0, true);
+                auto& attributes = parts->attributes;
+
+                // a property number the table doesn't use
+                const auto propIndex = MAX_PROPERTIES - 1;
+
+                for (const auto value : { 50, 10, 40, 20, 30 })
+                    attributes.getMake(propIndex, value);
+
+                using listMode_e = Attributes::listMode_e;
+
+                ASSERT(attributes.getPropertyValues(propIndex, listMode_e::GT, 20).size() == 3);
+                ASSERT(attributes.getPropertyValues(propIndex, listMode_e::GTE, 20).size() == 4);
+                ASSERT(attributes.getPropertyValues(propIndex, listMode_e::LT, 20).size() == 1);
+                ASSERT(attributes.getPropertyValues(propIndex, listMode_e::LTE, 20).size() == 2);
+                ASSERT(attributes.getPropertyValues(propIndex, listMode_e::PRESENT, 0).size() == 5);
+
+                attributes.drop(propIndex, 30);
+                attributes.getMake(propIndex, 5);
+
+                ASSERT(attributes.getPropertyValues(propIndex, listMode_e::GTE, 30).size() == 2);
+
+                // listed in value order, without the dropped value
+                std::vector<int64_t> values;
+                for (const auto& item : attributes.getPropertyValues(propIndex))
+                    values.push_back(item.first);
+
+                ASSERT((values == std::vector<int64_t>{ 5, 10, 20, 40, 50 }));
+                ASSERT(attributes.getPropertyValues(propIndex).front().second == attributes.get(propIndex, 5));
+
+                for (const auto value : values)
+                    attributes.drop(propIndex, value);
+
+                ASSERT(attributes.getPropertyValues(propIndex).empty());
+            }
+        },
+        {
+            "db: index changes collect in a delta until compacted",
+            [=]()
+            {
+                auto table = openset::globals::database->getTable("__testrows__");
+                auto parts = table->getPartitionObjects(0, true);
+                auto& attributes = parts->attributes;
+
+                // a property number the table doesn't use
+                const auto propIndex = MAX_PROPERTIES - 1;
+
+                const auto attr = attributes.getMake(propIndex, 7);
+
+                for (const auto linId : { 9, 3, 5 })
+                    attributes.setDirty(linId, propIndex, 7);
+                attributes.clearDirty();
+
+                attributes.setDirty(5, propIndex, 7, false);
+                attributes.setDirty(70, propIndex, 7);
+                attributes.clearDirty();
+
+                // the index itself wasn't rewritten, reads merge the delta
+                ASSERT(attributes.get(propIndex, 7) == attr);
+                ASSERT(attributes.deltas.count(attr));
+
+                auto bits = attributes.getBits(attr);
+                ASSERT(bits->population(bits->ints * 64) == 3);
+                ASSERT(bits->bitState(3) && bits->bitState(9) && bits->bitState(70) && !bits->bitState(5));
+                delete bits;
+
+                // compacting writes the delta into a new index
+                attributes.compact();
+
+                const auto compacted = attributes.get(propIndex, 7);
+                ASSERT(compacted != attr);
+                ASSERT(!attributes.deltas.count(compacted));
+
+                bits = compacted->getBits();
+                ASSERT(bits->population(bits->ints * 64) == 3);
+                ASSERT(bits->bitState(3) && bits->bitState(9) && bits->bitState(70));
+                delete bits;
+
+                // a delta past the limit is written straight away
+                for (auto linId = 0; linId <= static_cast<int>(Attributes::DELTA_LIMIT); ++linId)
+                    attributes.setDirty(linId * 2, propIndex, 7);
+                attributes.clearDirty();
+
+                const auto rewritten = attributes.get(propIndex, 7);
+                ASSERT(rewritten != compacted);
+                ASSERT(!attributes.deltas.count(rewritten));
+
+                bits = rewritten->getBits();
+                ASSERT(bits->population(bits->ints * 64) == static_cast<int64_t>(Attributes::DELTA_LIMIT) + 3);
+                delete bits;
+
+                // an index emptied through its delta is dropped when compacted
+                bits = attributes.getBits(rewritten);
+                int64_t linId = -1;
+                while (bits->linearIter(linId, bits->ints * 64))
+                    attributes.setDirty(static_cast<int32_t>(linId), propIndex, 7, false);
+                delete bits;
+
+                attributes.compact();
+
+                ASSERT(attributes.get(propIndex, 7) == nullptr);
+                ASSERT(attributes.getPropertyValues(propIndex).empty());
+            }
+        },
+        {
+            "db: decoded index bits are cached until the index changes",
+            [=]()
+            {
+                auto table = openset::globals::database->getTable("__testrows__");
+                auto parts = table->getPartitionObjects(0, true);
+                auto& attributes = parts->attributes;
+
+                const auto propIndex = MAX_PROPERTIES - 1;
+
+                attributes.getMake(propIndex, 11);
+                for (const auto linId : { 2, 4, 8 })
+                    attributes.setDirty(linId, propIndex, 11);
+                attributes.compact();
+
+                const auto attr = attributes.get(propIndex, 11);
+
+                const auto hits = IndexCache::getHits();
+
+                // the first read decodes, the second is a copy from the cache
+                auto bits = attributes.getBits(attr);
+                delete bits;
+
+                bits = attributes.getBits(attr);
+                ASSERT(IndexCache::getHits() > hits);
+                ASSERT(bits->population(bits->ints * 64) == 3);
+                delete bits;
+
+                // a change to the index drops the cached bits
+                attributes.setDirty(16, propIndex, 11);
+                attributes.clearDirty();
+
+                bits = attributes.getBits(attr);
+                ASSERT(bits->population(bits->ints * 64) == 4 && bits->bitState(16));
+                delete bits;
+
+                // compacting rewrites the index, its old bits aren't served again
+                attributes.compact();
+
+                const auto rewritten = attributes.get(propIndex, 11);
+                bits = attributes.getBits(rewritten);
+                ASSERT(bits->population(bits->ints * 64) == 4);
+                delete bits;
+
+                ASSERT(attributes.cache.getPartitionBytes() > 0);
+
+                attributes.drop(propIndex, 11);
+                PoolMem::getPool().freePtr(rewritten);
+            }
+        },
+        {
+            "db: stamp ranges OR dense day buckets",
+            [=]()
+            {
+                auto table = openset::globals::database->getTable("__testrows__");
+                auto parts = table->getPartitionObjects(0, true);
+                auto& attributes = parts->attributes;
+
+                // three days in one week (so no week bucket covers them), each
+                // a scattered chunk 0 that is stored as a bitmap
+                const int64_t firstDay = 40000;
+                IndexBits expected;
+
+                for (auto day = firstDay; day < firstDay + 3; ++day)
+                {
+                    attributes.getMake(PROP_DAY, day);
+                    for (auto linId = static_cast<int32_t>(day - firstDay); linId < 65536; linId += 5)
+                    {
+                        attributes.setDirty(linId, PROP_DAY, day);
+                        expected.bitSet(linId);
+                    }
+                }
+                attributes.clearDirty();
+                attributes.compact();
+
+                openset::query::Macro_s queryMacros;
+                queryMacros.indexes.emplace_back(
+                    "_",
+                    openset::query::HintOpList {
+                        openset::query::HintOp_s(
+                            openset::query::HintOp_e::STAMP_RANGE,
+                            firstDay * DAY_MS,
+                            (firstDay + 3) * DAY_MS - 1)
+                    });
+
+                openset::query::Indexing indexing;
+                indexing.mount(table.get(), queryMacros, 0, 65536);
+
+                bool countable;
+                const auto index = indexing.getIndex("_", countable);
+
+                // every day's customers, not just the last bitmap ORed in
+                ASSERT(index->population(65536) == expected.population(65536));
+                ASSERT(index->bitState(0) && index->bitState(1) && index->bitState(2) && !index->bitState(3));
+
+                for (auto day = firstDay; day < firstDay + 3; ++day)
+                    attributes.drop(PROP_DAY, day);
+            }
+        },
+        {
+            "db: bit-sliced index ranges",
+            [=]()
+            {
+                SlicedIndex sliced;
+                std::vector<int64_t> values(300, NONE);
+
+                // negatives, small, large, and some customers without a value
+                uint64_t seed = 0x9E3779B97F4A7C15ULL;
+                for (auto linId = 0; linId < static_cast<int>(values.size()); ++linId)
+                {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 7;
+                    seed ^= seed << 17;
+
+                    if (linId % 7 == 0)
+                        continue;
+
+                    switch (linId % 4)
+                    {
+                    case 0:
+                        values[linId] = static_cast<int64_t>(seed % 100) - 50;
+                        break;
+                    case 1:
+                        values[linId] = static_cast<int64_t>(seed % 10);
+                        break;
+                    case 2:
+                        values[linId] = static_cast<int64_t>(seed >> 2) - (1LL << 61);
+                        break;
+                    default:
+                        values[linId] = 25;
+                    }
+
+                    sliced.set(linId, values[linId]);
+                }
+
+                // clearing with the wrong value leaves the customer alone
+                sliced.clear(1, values[1] + 1);
+                int64_t value;
+                ASSERT(sliced.get(1, value) && value == values[1]);
+
+                sliced.clear(2, values[2]);
+                values[2] = NONE;
+                ASSERT(!sliced.get(2, value));
+
+                using Range_e = SlicedIndex::Range_e;
+
+                for (const int64_t pivot : { -51LL, -50LL, -1LL, 0LL, 5LL, 25LL, 49LL, 1LL << 40, -(1LL << 40) })
+                {
+                    for (const auto mode : { Range_e::gt, Range_e::gte, Range_e::lt, Range_e::lte })
+                    {
+                        IndexBits result;
+                        sliced.range(mode, pivot, result);
+
+                        for (auto linId = 0; linId < static_cast<int>(values.size()); ++linId)
+                        {
+                            const auto v = values[linId];
+                            auto expected = false;
+
+                            if (v != NONE)
+                            {
+                                switch (mode)
+                                {
+                                case Range_e::gt: expected = v > pivot; break;
+                                case Range_e::gte: expected = v >= pivot; break;
+                                case Range_e::lt: expected = v < pivot; break;
+                                case Range_e::lte: expected = v <= pivot; break;
+                                }
+                            }
+
+                            ASSERT(result.bitState(linId) == expected);
+                        }
+                    }
+                }
+            }
+        },
+        {
+            "db: sliced double property ranges from a query",
+            [=]()
+            {
+                auto table = openset::globals::database->newTable("__testsliced__", false);
+
+                auto columns = table->getProperties();
+                columns->setProperty(2000, "page", PropertyTypes_e::textProp, false);
+                columns->setProperty(4000, "prop_price", PropertyTypes_e::doubleProp, false, true, false, true);
+                ASSERT(columns->getProperty("prop_price")->isSliced);
+
+                auto parts = table->getPartitionObjects(0, true); // partition zero for test
+
+                // prices either side of the 2.5 queried below, and one on it
+                const std::vector<double> prices = { 1.25, 2.5, 2.75, 10.0, 0.5, 3.0 };
+
+                for (auto i = 0; i < static_cast<int>(prices.size()); ++i)
+                {
+                    const auto id = "user" + to_string(i) + "@test.com";
+
+                    Customer person;
+                    person.mapTable(table.get(), 0);
+                    person.mount(parts->people.createCustomer(id));
+                    person.prepare();
+
+                    cjson event(
+                        "{\"id\":\"" + id + "\",\"stamp\":1458820830,\"event\":\"page_view\",\"page\":\"home\"}",
+                        cjson::Mode_e::string);
+                    person.insert(&event);
+
+                    auto props = person.getGrid()->getProps(true);
+                    props["prop_price"] = prices[i];
+                    person.getGrid()->setProps(props);
+
+                    person.commit();
+                }
+
+                parts->attributes.clearDirty();
+                ASSERT(parts->attributes.getSliced(4000) != nullptr);
+
+                const auto maxLinearId = parts->people.customerCount();
+
+                const std::vector<std::pair<std::string, int64_t>> expected = {
+                    { ">", 3 }, { ">=", 4 }, { "<", 2 }, { "<=", 3 }
+                };
+
+                for (const auto& test : expected)
+                {
+                    auto testScript =
+                    R"osl(
+
+                        select
+                            count id
+                        end
+
+                        each_row where prop_price {op} 2.5
+                            << page
+                        end
+
+                    )osl"s;
+
+                    testScript.replace(testScript.find("{op}"), 4, test.first);
+
+                    openset::query::Macro_s queryMacros;
+                    openset::query::QueryParser p;
+                    p.compileQuery(testScript, table->getProperties(), queryMacros, nullptr);
+                    ASSERT(p.error.inError() == false);
+
+                    openset::query::Indexing indexing;
+                    indexing.mount(table.get(), queryMacros, 0, maxLinearId);
+
+                    bool countable;
+                    const auto index = indexing.getIndex("_", countable);
+                    ASSERT(index->population(maxLinearId) == test.second);
+
+                    // the plan estimates from the same scaled values
+                    ASSERT(indexing.plans.size() == 1);
+                    const auto& plan = indexing.plans[0];
+                    ASSERT(plan.nodes[plan.root].estimate == test.second);
+                }
+            }
+        },
+        {
+            "db: grid columns match rows",
+            [=]()
+            {
+                auto table = openset::globals::database->getTable("__testrows__");
+                auto parts = table->getPartitionObjects(0, true);
+
+                Customer person;
+                person.mapTable(table.get(), 0);
+                person.mount(parts->people.getCustomerByID("rows@test.com"));
+                person.prepare();
+
+                const auto grid = person.getGrid();
+                const auto rows = grid->getRows();
+                const auto columns = grid->getColumns();
+                const auto propertyCount = grid->getPropertyMap()->propertyCount;
+
+                ASSERT(columns->rowCount == static_cast<int64_t>(rows->size()));
+
+                for (auto c = 0; c < propertyCount; ++c)
+                {
+                    for (auto r = 0; r < columns->rowCount; ++r)
+                        ASSERT(columns->column(c)[r] == rows->at(r)->cols[c]);
+
+                    // one past the last row reads as empty
+                    ASSERT(columns->column(c)[columns->rowCount] == NONE);
+                }
+
+                ASSERT(columns->stamps[4] == 1458820870000);
+
+                // changed rows rebuild the columns
+                person.mount(parts->people.getCustomerByID("rows@test.com"));
+                ASSERT(grid->getColumns()->rowCount == 0);
+            }
+        },
+        {
+            "db: prepare from the decode cache",
+            [=]()
+            {
+                auto table = openset::globals::database->getTable("__testrows__");
+                auto parts = table->getPartitionObjects(0, true);
+
+                Customer person;
+                person.mapTable(table.get(), 0);
+                person.mount(parts->people.getCustomerByID("rows@test.com"));
+                person.prepare();
+
+                // a grid mapping fewer properties is served from the rows cached above
+                vector<string> columnNames { "stamp", "event" };
+                Customer narrow;
+                narrow.mapTable(table.get(), 0, columnNames);
+
+                auto hits = DecodeCache::getHits();
+
+                narrow.mount(parts->people.getCustomerByID("rows@test.com"));
+                narrow.prepare();
+
+                ASSERT(DecodeCache::getHits() == hits + 1);
+
+                const auto narrowGrid = narrow.getGrid();
+                ASSERT(narrowGrid->getRows()->size() == 5);
+                ASSERT(narrowGrid->getRows()->at(4)->cols[narrowGrid->getGridProperty(PROP_STAMP)] == 1458820870000);
+
+                // a commit replaces the cached rows with the new version
+                cjson event(R"({"id": "rows@test.com", "stamp": 1458820880, "event": "purchase", "page": "cart"})", cjson::Mode_e::string);
+
+                person.mount(parts->people.getCustomerByID("rows@test.com"));
+                person.prepare();
+                person.insert(&event);
+                person.commit();
+
+                hits = DecodeCache::getHits();
+
+                narrow.mount(parts->people.getCustomerByID("rows@test.com"));
+                narrow.prepare();
+
+                ASSERT(DecodeCache::getHits() == hits + 1);
+                ASSERT(narrowGrid->getRows()->size() == 6);
+                ASSERT(narrowGrid->getRows()->at(5)->cols[narrowGrid->getGridProperty(PROP_STAMP)] == 1458820880000);
+            }
+        },
         {
             "db: iterate a Set column in row",
             []
@@ -330,7 +1233,7 @@ inline Tests test_db()
 
                 auto attr = interpreter->interpreter->attrs->get(4000, "hello");
                 ASSERT(attr != nullptr);
-                auto bits = attr->getBits();
+                auto bits = interpreter->interpreter->attrs->getBits(attr);
                 ASSERT(bits != nullptr);
                 auto pop = bits->population(parts->people.customerCount());
                 ASSERT(pop == 1);
@@ -418,6 +1321,148 @@ inline Tests test_db()
                 delete interpreter;
             }
         },
+        {
+            "db: fused tally matches the marshalled tally",
+            []
+            {
+                // `<< page` fuses to TALLYCOL, the literal in `<< 'all', page` keeps the MARSHAL
+                const auto fusedScript =
+                R"osl(
+                    select
+                        count id
+                    end
+
+                    each_row where event == "page_view"
+                        << page
+                    end
+                )osl"s;
+
+                const auto marshalScript =
+                R"osl(
+                    select
+                        count id
+                    end
+
+                    each_row where event == "page_view"
+                        << 'all', page
+                    end
+                )osl"s;
+
+                openset::query::Macro_s fusedMacros;
+                const auto fused = TestScriptRunner("__test001__", fusedScript, fusedMacros, true);
+
+                openset::query::Macro_s marshalMacros;
+                const auto marshalled = TestScriptRunner("__test001__", marshalScript, marshalMacros, true);
+
+                const auto hasOp = [](const openset::query::Macro_s& macros, const openset::query::OpCode_e op)
+                {
+                    for (const auto& inst : macros.code)
+                        if (inst.op == op)
+                            return true;
+                    return false;
+                };
+
+                ASSERT(hasOp(fusedMacros, openset::query::OpCode_e::TALLYCOL));
+                ASSERT(hasOp(fusedMacros, openset::query::OpCode_e::CALL_EACH_EQ));
+                ASSERT(!hasOp(marshalMacros, openset::query::OpCode_e::TALLYCOL));
+
+                auto fusedJson = ResultToJson(fused);
+                auto marshalJson = ResultToJson(marshalled);
+
+                const auto fusedPages = fusedJson.xPath("/_");
+                ASSERT(fusedPages != nullptr);
+
+                const auto allNodes = marshalJson.xPath("/_");
+                ASSERT(allNodes != nullptr && allNodes->getNodes().size() == 1);
+
+                const auto marshalPages = allNodes->getNodes()[0]->xPath("/_");
+                ASSERT(marshalPages != nullptr);
+
+                ASSERT(cjson::stringify(fusedPages) == cjson::stringify(marshalPages));
+                ASSERT(fusedPages->getNodes().size() == 3); // blog, home page, about
+
+                delete fused;
+                delete marshalled;
+            }
+        },
+        {
+            "db: compiled scripts are cached by script, params and schema",
+            []
+            {
+                const auto table = openset::globals::database->getTable("__test001__");
+                auto& cache = table->planCache;
+                const auto properties = table->getProperties();
+
+                const auto script = "each_row where event == \"page_view\"\n    << page\nend\n"s;
+
+                openset::query::ParamVars params;
+                params["limit"] = 10;
+                params["name"] = "home"s;
+
+                // the same parameters in a different order make the same key
+                openset::query::ParamVars reordered;
+                reordered["name"] = "home"s;
+                reordered["limit"] = 10;
+
+                const auto key = openset::query::PlanCache::makeKey(script, &params, properties->version);
+                ASSERT(key == openset::query::PlanCache::makeKey(script, &reordered, properties->version));
+
+                // a different value, type, script or schema doesn't
+                reordered["limit"] = 11;
+                ASSERT(key != openset::query::PlanCache::makeKey(script, &reordered, properties->version));
+                reordered["limit"] = "10"s;
+                ASSERT(key != openset::query::PlanCache::makeKey(script, &reordered, properties->version));
+                ASSERT(key != openset::query::PlanCache::makeKey(script + " ", &params, properties->version));
+                ASSERT(key != openset::query::PlanCache::makeKey(script, &params, properties->version + 1));
+
+                cache.clear();
+
+                openset::query::Macro_s compiled;
+                openset::query::QueryParser parser;
+                parser.compileQuery(script, properties, compiled, &params);
+                ASSERT(!parser.error.inError());
+
+                const auto hits = openset::query::PlanCache::getHits();
+                const auto misses = openset::query::PlanCache::getMisses();
+                const auto saved = openset::query::PlanCache::getSavedMicros();
+
+                openset::query::Macro_s restored;
+                ASSERT(!cache.restore(key, restored));
+
+                cache.store(key, compiled, 250);
+                ASSERT(cache.restore(key, restored));
+                ASSERT(restored.code.size() == compiled.code.size());
+                ASSERT(restored.rawScript == compiled.rawScript);
+
+                ASSERT(openset::query::PlanCache::getHits() == hits + 1);
+                ASSERT(openset::query::PlanCache::getMisses() == misses + 1);
+                ASSERT(openset::query::PlanCache::getSavedMicros() == saved + 250);
+
+                // a property change bumps the schema version, old keys no longer match
+                const auto version = properties->version.load();
+                const auto page = properties->getProperty("page");
+                properties->setProperty(page->idx, std::string(page->name), page->type, page->isSet, page->isCustomerProperty, false, page->isSliced);
+                ASSERT(properties->version > version);
+
+                // the least recently used entries go past Config::planCacheSize
+                const auto planCacheSize = openset::globals::running->planCacheSize;
+                openset::globals::running->planCacheSize = 2;
+
+                cache.store("a", compiled, 1);
+                cache.store("b", compiled, 1);
+                ASSERT(cache.restore("a", restored));
+                cache.store("c", compiled, 1);
+
+                ASSERT(cache.getEntries() == 2);
+                ASSERT(cache.restore("a", restored));
+                ASSERT(!cache.restore("b", restored));
+
+                cache.clear();
+                ASSERT(cache.getEntries() == 0);
+
+                openset::globals::running->planCacheSize = planCacheSize;
+            }
+        },
         {
             "db: index compiler basic",
             []
@@ -803,6 +1848,174 @@ inline Tests test_db()
                 delete interpreter;
             }
         },
+        {
+            "db: index plan runs the rarest AND operand first",
+            []
+            {
+                const auto testScript =
+                R"osl(
+
+                    select
+                        count id
+                    end
+
+                    each_row where page.is(!= "blog") && prop_set contains 'orange'
+                        << page
+                    end
+
+                )osl"s;
+
+                openset::query::Macro_s queryMacros;
+                const auto interpreter = TestScriptRunner("__test001__", testScript, queryMacros, true);
+
+                const auto database = openset::globals::database;
+                const auto table    = database->getTable("__test001__");
+                const auto parts = table->getPartitionObjects(0, true); // partition zero for test
+
+                const auto maxLinearId = parts->people.customerCount();
+
+                openset::query::Indexing indexing;
+                indexing.mount(table.get(), queryMacros, 0, maxLinearId);
+
+                bool countable;
+                const auto index = indexing.getIndex("_", countable);
+                ASSERT(index->population(maxLinearId) == 0);
+
+                ASSERT(indexing.plans.size() == 1);
+
+                const auto& plan = indexing.plans[0];
+                const auto& root = plan.nodes[plan.root];
+
+                ASSERT(root.op == openset::query::HintOp_e::BIT_AND);
+                ASSERT(root.children.size() == 2);
+
+                // 'orange' has no index, it runs first and decides the result
+                const auto& first = plan.nodes[root.children[0]];
+                const auto& second = plan.nodes[root.children[1]];
+
+                ASSERT(first.columnName == "prop_set");
+                ASSERT(first.estimate == 0 && first.population == 0);
+                ASSERT(second.columnName == "page");
+                ASSERT(second.population == -1);
+
+                const auto text = indexing.explain();
+                ASSERT(text.find("AND") != std::string::npos);
+                ASSERT(text.find("skipped") != std::string::npos);
+
+                delete interpreter;
+            }
+        },
+
+        {
+            "db: index narrowed to customers with events in a literal range",
+            []
+            {
+                const auto database = openset::globals::database;
+                const auto table    = database->getTable("__test001__");
+                const auto parts = table->getPartitionObjects(0, true); // partition zero for test
+
+                // user1's events are all on 2016-03-24
+                const auto day = stampToDay(1458820830000LL);
+
+                ASSERT(parts->attributes.get(PROP_DAY, day) != nullptr);
+                ASSERT(parts->attributes.get(PROP_WEEK, dayToWeek(day)) != nullptr);
+
+                // stamps before 1970 round down to their own day and week
+                ASSERT(stampToDay(0) == 0 && stampToDay(DAY_MS - 1) == 0);
+                ASSERT(stampToDay(-1) == -1 && stampToDay(-DAY_MS) == -1 && stampToDay(-DAY_MS - 1) == -2);
+                ASSERT(dayToWeek(6) == 0 && dayToWeek(-1) == -1 && dayToWeek(-7) == -1 && dayToWeek(-8) == -2);
+
+                // a whole month is answered from week buckets where they fit
+                auto buckets = parts->attributes.getTimeBuckets(
+                    Epoch::ISO8601ToEpoch("2016-03-01T00:00:00+00:00"),
+                    Epoch::ISO8601ToEpoch("2016-03-31T23:59:59+00:00"));
+                ASSERT(buckets.size() == 1 && buckets[0] == parts->attributes.get(PROP_WEEK, dayToWeek(day)));
+
+                buckets = parts->attributes.getTimeBuckets(
+                    Epoch::ISO8601ToEpoch("2016-03-24T00:00:00+00:00"),
+                    Epoch::ISO8601ToEpoch("2016-03-24T23:59:59+00:00"));
+                ASSERT(buckets.size() == 1 && buckets[0] == parts->attributes.get(PROP_DAY, day));
+
+                const auto maxLinearId = parts->people.customerCount();
+
+                const auto populationFor = [&](const std::string& range) -> int64_t
+                {
+                    const auto testScript =
+                        "select\n"
+                        "    count id\n"
+                        "end\n"
+                        "each_row.range(" + range + ") where page == 'blog'\n"
+                        "    << page\n"
+                        "end\n";
+
+                    openset::query::Macro_s queryMacros;
+                    const auto interpreter = TestScriptRunner("__test001__", testScript, queryMacros, true);
+
+                    ASSERT(queryMacros.index.size() == 5);
+                    ASSERT(queryMacros.index[3].op == openset::query::HintOp_e::STAMP_RANGE);
+                    ASSERT(queryMacros.index[4].op == openset::query::HintOp_e::BIT_AND);
+                    ASSERT(!queryMacros.indexIsCountable);
+
+                    openset::query::Indexing indexing;
+                    indexing.mount(table.get(), queryMacros, 0, maxLinearId);
+
+                    bool countable;
+                    const auto population = indexing.getIndex("_", countable)->population(maxLinearId);
+
+                    delete interpreter;
+                    return population;
+                };
+
+                ASSERT(populationFor("'2016-03-24T12:00:00+00:00', '2016-03-24T13:00:00+00:00'") == 1);
+                ASSERT(populationFor("'2017-01-01T00:00:00+00:00', '2017-01-31T00:00:00+00:00'") == 0);
+
+                // until the cleaner has indexed the buckets of loaded customers, ranges don't narrow
+                parts->bucketsComplete = false;
+                ASSERT(populationFor("'2017-01-01T00:00:00+00:00', '2017-01-31T00:00:00+00:00'") == 1);
+                parts->bucketsComplete = true;
+            }
+        },
+
+        {
+            "db: zone map of a customer's events",
+            []
+            {
+                const auto database = openset::globals::database;
+                const auto table    = database->getTable("__test001__");
+                const auto parts = table->getPartitionObjects(0, true); // partition zero for test
+
+                const auto personData = parts->people.getCustomerByID("user1@test.com"s);
+                ASSERT(personData != nullptr);
+
+                ZoneMap_s zone;
+                ASSERT(personData->getZone(zone));
+                ASSERT(zone.firstStamp == 1458820830000LL);
+                ASSERT(zone.lastStamp == 1458820900000LL);
+                ASSERT(zone.rowCount == 4);
+                ASSERT(zone.mayHaveEvent(MakeHash("page_view")));
+
+                ASSERT(zone.mayMatch(1458820800000LL, 1458820840000LL, {}));
+                ASSERT(!zone.mayMatch(1458820900001LL, LLONG_MAX, {}));
+                ASSERT(zone.mayMatch(LLONG_MIN, LLONG_MAX, { MakeHash("page_view") }));
+
+                // a script that needs an event says which
+                const auto testScript =
+                    "select\n"
+                    "    count id\n"
+                    "end\n"
+                    "each_row where event == 'purchase'\n"
+                    "    << event\n"
+                    "end\n";
+
+                openset::query::Macro_s queryMacros;
+                const auto interpreter = TestScriptRunner("__test001__", testScript, queryMacros, true);
+
+                ASSERT(queryMacros.zoneEvents.size() == 1);
+                ASSERT(queryMacros.zoneEvents[0] == MakeHash("purchase"));
+
+                delete interpreter;
+            }
+        },
 
         {
             "db: index compiler basic with prop (not equal and not equal)",
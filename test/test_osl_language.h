@@ -286,6 +286,332 @@ inline Tests test_osl_language()
             }
         },
 
+        {
+            "test OSL typed logic lambdas",
+            []
+            {
+                const auto testScript =
+                R"osl(
+
+                    oranges = 0
+                    each_row where fruit == "orange"
+                        oranges = oranges + 1
+                    end
+
+                    pricey = 0
+                    each_row where price > 5 && fruit != "pear"
+                        pricey = pricey + 1
+                    end
+
+                    cheap = 0
+                    each_row where price < 5.55 || fruit.ever(== "donkey")
+                        cheap = cheap + 1
+                    end
+
+                    missing = 0
+                    each_row where fruit == nil
+                        missing = missing + 1
+                    end
+
+                    # text can't be ordered by hash, this one runs in the interpreter
+                    late = 0
+                    each_row where fruit > "orange"
+                        late = late + 1
+                    end
+
+                    debug(oranges == 2)
+                    debug(pricey == 3)
+                    debug(cheap == 1)
+                    debug(missing == 0)
+                    debug(late == 1)
+
+                )osl"s;
+
+                openset::query::Macro_s queryMacros;
+                const auto interpreter = TestScriptRunner("__test003__", testScript, queryMacros, true);
+
+                auto& debug = interpreter->debugLog();
+                ASSERT(debug.size() == 5);
+                ASSERTDEBUGLOG(debug);
+
+                // every `where` but the text ordering is typed
+                std::vector<int64_t> loopLambdas;
+                for (const auto& inst : queryMacros.code)
+                    if (inst.op == openset::query::OpCode_e::CALL_EACH ||
+                        inst.op == openset::query::OpCode_e::CALL_EACH_EQ)
+                        loopLambdas.push_back(inst.extra);
+
+                ASSERT(loopLambdas.size() == 5);
+                ASSERT(!queryMacros.typedLambdas.empty());
+
+                for (auto i = 0; i < 4; ++i)
+                    ASSERT(queryMacros.typedLambdas[loopLambdas[i]] != -1);
+                ASSERT(queryMacros.typedLambdas[loopLambdas[4]] == -1);
+
+                delete interpreter;
+            }
+        },
+
+        {
+            "test OSL superinstructions",
+            []
+            {
+                const auto testScript =
+                R"osl(
+
+                    oranges = 0
+                    each_row where fruit == "orange"
+                        oranges = oranges + 1
+                    end
+
+                    # text ordering isn't typed, so `fruit == "pear"` runs as PSHCOLEQ
+                    matched = 0
+                    each_row where price > 0
+                        if fruit == "pear" || fruit > "pear"
+                            matched = matched + 1
+                        end
+                    end
+
+                    debug(oranges == 2)
+                    debug(matched == 1)
+
+                )osl"s;
+
+                openset::query::Macro_s queryMacros;
+                const auto interpreter = TestScriptRunner("__test003__", testScript, queryMacros, true);
+
+                auto& debug = interpreter->debugLog();
+                ASSERT(debug.size() == 2);
+                ASSERTDEBUGLOG(debug);
+
+                auto eachEq = 0;
+                auto colEq  = 0;
+                for (const auto& inst : queryMacros.code)
+                {
+                    if (inst.op == openset::query::OpCode_e::CALL_EACH_EQ)
+                        ++eachEq;
+                    if (inst.op == openset::query::OpCode_e::PSHCOLEQ)
+                        ++colEq;
+                }
+
+                ASSERT(eachEq == 1);
+                ASSERT(colEq != 0);
+
+                delete interpreter;
+            }
+        },
+
+        {
+            "test OSL prepared queries bind parameters",
+            []
+            {
+                const auto testScript =
+                R"osl(
+
+                    matched = 0
+                    each_row where fruit == wanted
+                        matched = matched + 1
+                    end
+
+                    if flagged
+                        matched = matched + 100
+                    end
+
+                    debug(matched)
+
+                )osl"s;
+
+                const auto table = openset::globals::database->getTable("__test003__");
+                const auto parts = table->getPartitionObjects(0, true);
+
+                openset::query::ParamVars defaults;
+                defaults["wanted"] = "orange"s;
+                defaults["flagged"] = false; // a bool_ slot
+
+                // the same script and parameters make the same handle
+                const auto handle = table->setPreparedQuery(testScript, defaults);
+                ASSERT(handle == table->setPreparedQuery(testScript, defaults));
+
+                PreparedQuery_s prepared;
+                ASSERT(!table->getPreparedQuery("0123456789abcdef", prepared));
+                ASSERT(table->getPreparedQuery(handle, prepared));
+                ASSERT(prepared.script == testScript);
+
+                // a parameter slot doesn't need assigning in the script
+                openset::query::QueryParser noParams;
+                openset::query::Macro_s unbound;
+                noParams.compileQuery(testScript, table->getProperties(), unbound, nullptr);
+                ASSERT(noParams.error.inError());
+
+                const auto run = [&](const openset::query::ParamVars& bind) -> int64_t
+                {
+                    openset::query::QueryParser p;
+                    openset::query::Macro_s queryMacros;
+                    p.compileQuery(prepared.script, table->getProperties(), queryMacros, &prepared.params);
+                    ASSERT(!p.error.inError());
+
+                    openset::query::QueryParser::bindParams(queryMacros, bind);
+
+                    TestEngineContainer_s engine(queryMacros);
+
+                    auto mappedColumns = engine.interpreter->getReferencedColumns();
+
+                    Customer person;
+                    person.mapTable(table.get(), 0, mappedColumns);
+                    person.mount(parts->people.createCustomer("user1@test.com"));
+                    person.prepare();
+
+                    engine.interpreter->mount(&person);
+                    engine.interpreter->exec();
+
+                    ASSERT(engine.debugLog().size() == 1);
+                    return engine.debugLog()[0].getInt64();
+                };
+
+                ASSERT(run({}) == 2);
+                ASSERT(run({ { "wanted", "pear"s } }) == 1);
+                ASSERT(run({ { "wanted", "donkey"s } }) == 0);
+                ASSERT(run({ { "wanted", "pear"s }, { "flagged", true } }) == 101);
+
+                // prepared queries travel with the table definition
+                cjson doc;
+                table->serializeTable(&doc);
+
+                auto copy = openset::globals::database->newTable("__testprepared__", false);
+                copy->deserializeTable(&doc);
+
+                PreparedQuery_s copied;
+                ASSERT(copy->getPreparedQuery(handle, copied));
+                ASSERT(copied.script == testScript);
+                ASSERT(copied.params["wanted"] == "orange"s);
+
+                // dropped handles are gone, and leave the table definition
+                ASSERT(copy->dropPreparedQuery(handle));
+                ASSERT(!copy->dropPreparedQuery(handle));
+                ASSERT(!copy->getPreparedQuery(handle, copied));
+
+                cjson dropped;
+                copy->serializeTable(&dropped);
+                ASSERT(!dropped.xPath("/prepared") || dropped.xPath("/prepared")->getNodes().empty());
+            }
+        },
+
+        {
+            "test OSL each_row selects rows in batches",
+            []
+            {
+                // a customer with enough events to select rows a batch at a time
+                auto table   = openset::globals::database->newTable("__testselect__", false);
+                auto columns = table->getProperties();
+
+                int col = 1000;
+                columns->setProperty(++col, "fruit", PropertyTypes_e::textProp, false, false);
+                columns->setProperty(++col, "price", PropertyTypes_e::doubleProp, false, false);
+                columns->setProperty(++col, "qty", PropertyTypes_e::intProp, false, false);
+                columns->setProperty(++col, "flag", PropertyTypes_e::boolProp, false, false);
+
+                auto parts = table->getPartitionObjects(0, true);
+
+                Customer person;
+                person.mapTable(table.get(), 0);
+                person.mount(parts->people.createCustomer("user1@test.com"));
+
+                const std::string fruits[] = { "apple", "orange", "pear" };
+
+                for (auto i = 0; i < 1500; ++i)
+                {
+                    const auto json =
+                        "{\"id\": \"user1@test.com\", \"stamp\": " + to_string(1458820830 + i) +
+                        ", \"event\": \"buy\", \"fruit\": \"" + fruits[i % 3] +
+                        "\", \"price\": " + to_string((i % 100) / 4.0) +
+                        ", \"qty\": " + to_string(i % 7) +
+                        ", \"flag\": " + (i % 2 ? "false" : "true") + "}";
+
+                    cjson event(json, cjson::Mode_e::string);
+                    person.insert(&event);
+                }
+
+                person.commit();
+
+                // `|| fruit > "zzz"` (text ordering isn't typed) runs the same logic a row at a time
+                const auto testScript =
+                R"osl(
+
+                    oranges = 0
+                    each_row where fruit == "orange"
+                        oranges = oranges + 1
+                    end
+
+                    pricey = 0
+                    each_row where price > 20 && qty != 3
+                        pricey = pricey + 1
+                    end
+
+                    pricey_rows = 0
+                    each_row where (price > 20 && qty != 3) || fruit > "zzz"
+                        pricey_rows = pricey_rows + 1
+                    end
+
+                    flagged = 0
+                    each_row where flag == true || price <= 1.5
+                        flagged = flagged + 1
+                    end
+
+                    flagged_rows = 0
+                    each_row where flag == true || price <= 1.5 || fruit > "zzz"
+                        flagged_rows = flagged_rows + 1
+                    end
+
+                    last = 0
+                    each_row.reverse().limit(5) where qty == 6 && fruit != "pear" && flag != false
+                        last = last + price
+                    end
+
+                    last_rows = 0
+                    each_row.reverse().limit(5) where (qty == 6 && fruit != "pear" && flag != false) || fruit > "zzz"
+                        last_rows = last_rows + price
+                    end
+
+                    near = 0
+                    near_rows = 0
+                    each_row.limit(1) where qty == 5 && price > 10
+                        match_stamp = stamp
+                        each_row.continue().next().within(300_seconds, match_stamp) where qty == 2
+                            near = near + 1
+                        end
+                        each_row.continue().next().within(300_seconds, match_stamp) where qty == 2 || fruit > "zzz"
+                            near_rows = near_rows + 1
+                        end
+                    end
+
+                    debug(oranges == 500)
+                    debug(pricey > 0 && pricey == pricey_rows)
+                    debug(flagged > 750 && flagged == flagged_rows)
+                    debug(last > 0 && last == last_rows)
+                    debug(near > 0 && near == near_rows)
+
+                )osl"s;
+
+                openset::query::Macro_s queryMacros;
+                const auto interpreter = TestScriptRunner("__testselect__", testScript, queryMacros, true);
+
+                auto& debug = interpreter->debugLog();
+                ASSERT(debug.size() == 5);
+                ASSERTDEBUGLOG(debug);
+
+                // all but the `fruit > "zzz"` loops select in batches
+                auto selectable = 0;
+                for (const auto& inst : queryMacros.code)
+                    if ((inst.op == openset::query::OpCode_e::CALL_EACH || inst.op == openset::query::OpCode_e::CALL_EACH_EQ) &&
+                        inst.extra != -1 && queryMacros.selectLambdas[inst.extra])
+                        ++selectable;
+
+                ASSERT(selectable == 6);
+
+                delete interpreter;
+            }
+        },
+
         {
             "test OSL break and continue",
             []
@@ -7,6 +7,7 @@
 #include "test_zorder.h"
 #include "test_sessions.h"
 #include "test_count_methods.h"
+#include "test_checkpoint.h"
 #include "../src/logger.h"
 
 bool unitTest()
@@ -26,6 +27,7 @@ bool unitTest()
     add(test_osl_language());
     add(test_zorder());
     add(test_sessions());
+    add(test_checkpoint());
     //add(test_count_methods());
 
     return runTests(allTests).size() == 0; // true if zero